@@ -9,196 +9,345 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <string.h>
-#include <ctype.h>
+#include <limits.h>
 #include "map.h"
 #include "message.h"
 #include "hashtable.h"
 #include "file.h"
+#include "memory.h"
+#include "nmap.h"
+#include "tilemap.h"
+
+/**************** Terrain tables ****************/
+/* the class of every character; any left out is terrain_INVALID (0) */
+static const unsigned char TerrainClass[256] = {
+	[' '] = terrain_ROCK, ['.'] = terrain_FLOOR, ['-'] = terrain_WALL,
+	['|'] = terrain_WALL, ['+'] = terrain_CORNER, ['#'] = terrain_PASSAGE,
+};
+/* what each class allows */
+static const bool Walkable[terrain_NCLASSES] = {
+	[terrain_FLOOR] = true, [terrain_PASSAGE] = true,
+};
+static const bool Obstructs[terrain_NCLASSES] = {
+	[terrain_INVALID] = true, [terrain_ROCK] = true, [terrain_WALL] = true,
+	[terrain_CORNER] = true, [terrain_PASSAGE] = true,
+};
+
+/**************** Private Types ****************/
+/* what can be seen from one spot: '1' or '0' for each position of the box
+ * from lo to hi (which holds the spot), in vis; row by row from origin,
+ * stride positions to a row, or if whole, indexed like the map string
+ * (origin (-1, 0), stride width; see map_calcPosition). On a tiled map,
+ * terrain holds the classes of the box's cells, laid out like vis, with a
+ * frame of two positions of wall around the box (see readBox)
+ */
+typedef struct sight {
+	char *vis;
+	size_t room;            // bytes allocated for vis, kept from one look to the next
+	unsigned char *terrain; // NULL on a flat map, whose own terrain is walked
+	size_t terrainRoom;
+	position_t lo, hi;
+	position_t origin;
+	mcoord_t stride;
+	bool whole;             // vis is as big as the map, and indexed like its string
+} sight_t;
 
 /**************** Private Functions ****************/
-static map_t *map_copy(map_t *map);
-static bool isObstruct(char c);
+static map_t *map_copy(map_t *map, arena_t *arena);
+static mcoord_t terrainIndex(map_t *map, position_t *pos);
+static terrain_t terrainAt(map_t *map, position_t *pos);
+static terrain_t cellTerrain(map_t *map, mcoord_t col, mcoord_t row);
 static bool canPlayerMoveTo(map_t *map, position_t *pos);
-static void replaceBlocked(map_t *map, map_t *outMap, player_t *player);
-static void map_calcVisPath(map_t *map, char *vis, position_t *pos1, position_t *pos2);
-static char *initVisStr(int width, int height);
-static void intersectVis(char *vis1, char *vis2);
-static void applyVis(map_t *map, char *vis);
-
-/**************** Iterator Functions ****************/
-void addPlayerITR(void *arg, const char *key, void *item);
-void placeGold(void *arg, const char *key, void *item);
-void isOnGoldITR(void *arg, const char *key, void *item);
-
-position_t *map_intToPos(map_t *map, int i);
+static void map_calcVisPath(map_t *map, sight_t *s, position_t *pos1, position_t *pos2);
+static bool lightWindow(map_t *map, position_t *pos, position_t *lo, position_t *hi);
+static void traceWithin(map_t *map, sight_t *s, position_t *pos, position_t *first, position_t *last);
+static bool look(map_t *map, position_t *pos, sight_t *s, arena_t *arena);
+static bool lookWithin(map_t *map, position_t *pos, position_t *lo, position_t *hi, mcoord_t ring,
+                       sight_t *s, arena_t *arena);
+static bool readBox(map_t *map, sight_t *s, arena_t *arena);
+static void *reserve(void *scratch, size_t *room, size_t bytes, arena_t *arena);
+static void sightFree(sight_t *s, arena_t *arena);
+static position_t eyeOf(map_t *map, position_t *pos);
+static void tileBox(map_t *map, position_t *tLo, position_t *tHi, position_t *lo, position_t *hi);
+static bool widen(map_t *map, sight_t *s, position_t *pos, position_t *tLo, position_t *tHi);
+static bool edgeOpen(sight_t *s, position_t *pos, mcoord_t x0, mcoord_t x1, mcoord_t y0, mcoord_t y1);
+static mcoord_t sightIndex(sight_t *s, position_t *pos);
+static bool sees(map_t *map, sight_t *s, position_t *pos);
+static void sightMerge(map_t *map, sight_t *s, seen_t *seen);
+static mcoord_t scrollAxis(mcoord_t start, mcoord_t at, mcoord_t size, mcoord_t limit);
+static void viewCell(map_t *map, viewport_t *view, sight_t *s, position_t *pos, char *out, char c);
+static void lookFrom(map_t *map, player_t *player, sight_t *s, arena_t *arena);
+static void collectGold(hashtable_t *goldData, player_t *player);
+static void *mapAlloc(arena_t *arena, memtag_t tag, size_t bytes);
+static map_t *loadFile(const char *path, bool tiled);
+static map_t *parseGrid(const char *text, size_t len, const char *name, bool tiled);
+static map_t *parseTiles(const char *text, size_t len, mcoord_t width, mcoord_t height,
+                         mcoord_t numFloor);
+static map_t *useCompiled(filedata_t *file, const char *name);
+static void mapFree(arena_t *arena, void *p);
+
+position_t *map_intToPos(map_t *map, mcoord_t i);
 
 /**************** map_new ****************/
 map_t *map_new(FILE *fp)
 {
-	map_t *map = malloc(sizeof(map_t));
-	if (map == NULL){
+	if (fp == NULL) {
 		return NULL;
 	}
-
     // read map *.txt file into buffer
 	char *buffer = freadfilep(fp);
-
-	int width = 0;
-	int height = 0; 
-	int offset = 0;
-
-	if (buffer){
-		// discarding the new lines and compressing the string while also calculating the w&h
-		int i;
-		for (i = 0; i < strlen(buffer); i++){
-
-			if(buffer[i] == '\n'){
-				height += 1;
-				offset += 1;
-			} else {
-				// this shifts the line over if for every new line we have taken out
-				buffer[i - offset] = buffer[i];
-				width += 1;
-			}
-		}
-		buffer[i - offset] = '\0';
+	if (buffer == NULL) {
+		fprintf(stderr, "map: empty map file\n");
+		return NULL;
 	}
+	map_t *map = parseGrid(buffer, strlen(buffer), "map", false);
+	free(buffer);
+	return map;
+}
 
-	map->width = width / height;
-	map->height = height;
 
-    // copy buffer into mapstring
-	char *mapStr = (char*) malloc( (strlen(buffer) * sizeof(char)) + 5); 
-	strcpy(mapStr, buffer);
+/**************** map_load ****************/
+map_t *map_load(const char *path)
+{
+	return loadFile(path, false);
+}
 
-	map->mapStr = mapStr;
-	free(buffer);
 
+/**************** map_loadTiled ****************/
+map_t *map_loadTiled(const char *path)
+{
+	return loadFile(path, true);
+}
+
+
+/********** helper: loadFile **********/
+/* map_load, keeping the map in tiles whatever its size if tiled */
+map_t *loadFile(const char *path, bool tiled)
+{
+	filedata_t file;
+	if (path == NULL || !fmapfile(path, &file)) {
+		fprintf(stderr, "map: cannot read %s\n", path == NULL ? "(null)" : path);
+		return NULL;
+	}
+	if (nmap_recognize(file.data, file.len)) {
+		if (tiled) {
+			fprintf(stderr, "%s: a compiled map cannot be kept in tiles\n", path);
+			funmapfile(&file);
+			return NULL;
+		}
+		return useCompiled(&file, path);
+	}
+	map_t *map = parseGrid(file.data, file.len, path, tiled);
+	funmapfile(&file);
 	return map;
 }
 
 
 /**************** map_buildPlayerMap ****************/
-map_t *map_buildPlayerMap(map_t *map, player_t *player, hashtable_t *goldData, hashtable_t *players)
+map_t *map_buildPlayerMap(map_t *map, player_t *player, hashtable_t *goldData, hashtable_t *players, arena_t *arena)
 {
-	map_t *outMap = map_copy(map);
+	// what the player can see now; gold and players out of their sight are left off
+	sight_t sight = {0};
+	if (player != NULL && !look(map, player->pos, &sight, arena)) {
+		return NULL;
+	}
+	map_t *outMap = map_copy(map, arena);
+	if (outMap == NULL) {
+		sightFree(&sight, arena);
+		return NULL;
+	}
 
-	// Adding all the gold to the map
+	void *item;
+	// Adding all the uncollected gold to the map
 	if (goldData != NULL){
-		hashtable_iterate(goldData, outMap, placeGold);
+		for (hashtable_cursor_t c = hashtable_cursor(goldData); hashtable_next(goldData, &c, NULL, &item); ) {
+			gold_t *g = item;
+			if (!g->isCollected && (player == NULL || sees(map, &sight, g->pos))) {
+				outMap->mapStr[map_calcPosition(outMap, g->pos)] = '*';
+			}
+		}
 	}
 
 	if (players != NULL){
-		// Adding the players to the map
-		hashtable_iterate(players, outMap, addPlayerITR);
+		// Adding the active players to the map
+		for (hashtable_cursor_t c = hashtable_cursor(players); hashtable_next(players, &c, NULL, &item); ) {
+			player_t *p = item;
+			if (p->isActive && (player == NULL || sees(map, &sight, p->pos))) {
+				outMap->mapStr[map_calcPosition(outMap, p->pos)] = p->letter;
+			}
+		}
 	}
 
 	// Replace this player's letter with '@'
 	if (player != NULL) {
-		int plyIndx = map_calcPosition(outMap, player->pos);
+		mcoord_t plyIndx = map_calcPosition(outMap, player->pos);
 		outMap->mapStr[plyIndx] = '@';
 		
-		replaceBlocked(map, outMap, player);
-		applyVis(outMap, player->visibility);
+		// and remember what is seen now
+		sightMerge(map, &sight, player->seen);
+		seen_hide(player->seen, outMap->mapStr, 0, map->width * map->height);
 	}
+	sightFree(&sight, arena);
 
-	outMap->mapStr = map_buildOutput(outMap);
+	char *output = map_buildOutput(outMap, arena);
+	if (output == NULL) {
+		mapFree(arena, outMap->mapStr);
+		mapFree(arena, outMap);
+		return NULL;
+	}
+	outMap->mapStr = output;
 
 	return outMap;
 }
 
-/********** helper: applyVis **********/
-void applyVis(map_t *map, char *vis)
+/**************** map_buildPlayerView ****************/
+map_t *map_buildPlayerView(map_t *map, player_t *player, hashtable_t *goldData, hashtable_t *players, arena_t *arena)
 {
-    if (strlen(map->mapStr) != strlen(vis)) {
-        // defensive programming
-        printf("mapStrLen:%ld , visLen:%ld\n", strlen(map->mapStr), strlen(vis));
-        printf("map width: %d, height: %d\n", map->width, map->height);
-        return;
-    }
+	if (map == NULL || player == NULL) {
+		return NULL;
+	}
+	viewport_t *view = &player->view;
+	if (view->rows <= 0 || view->cols <= 0) {
+		return map_buildPlayerMap(map, player, goldData, players, arena);
+	}
+	map_scrollView(map, view, player->pos);
+	mcoord_t width = map->width;
+	int rows = view->rows, cols = view->cols;
+
+	map_t *outMap = mapAlloc(arena, mem_RENDER, sizeof(map_t));
+	char *out = mapAlloc(arena, mem_RENDER, rows * (cols + 1) + 1);
+	if (outMap == NULL || out == NULL) {
+		if (outMap != NULL) {
+			mapFree(arena, outMap);
+		}
+		if (out != NULL) {
+			mapFree(arena, out);
+		}
+		return NULL;
+	}
 
-    int finalPos = map->height * map->width;
-    int i = 0;
+	// the positions of the window's cells (a column left of each; see
+	// map_calcPosition), narrowed to the light if the map is dark; the
+	// visibility scratch is just as big
+	position_t lo = {view->left - 1, view->top};
+	position_t hi = {view->left + cols - 2, view->top + rows - 1};
+	position_t litLo, litHi;
+	if (lightWindow(map, player->pos, &litLo, &litHi)) {
+		lo.x = litLo.x > lo.x ? litLo.x : lo.x;
+		lo.y = litLo.y > lo.y ? litLo.y : lo.y;
+		hi.x = litHi.x < hi.x ? litHi.x : hi.x;
+		hi.y = litHi.y < hi.y ? litHi.y : hi.y;
+	}
+	sight_t sight = {0};
+	if (!lookWithin(map, player->pos, &lo, &hi, 0, &sight, arena)) {
+		mapFree(arena, outMap);
+		mapFree(arena, out);
+		return NULL;
+	}
 
-    // loop through the map, converting non-visble characters to empty spaces
-    for (i = 0; i < finalPos; i++) {
-        if (vis[i] == '0') {
-            map->mapStr[i] = ' ';
-        }
-    }
+	// merge what is seen now into what has been seen, then render the window
+	sightMerge(map, &sight, player->seen);
+	char *o = out;
+	for (int r = 0; r < rows; r++) {
+		mcoord_t first = (view->top + r) * width + view->left;
+		map_readCells(map, first, cols, o);
+		seen_hide(player->seen, o, first, cols);
+		o += cols;
+		*o++ = '\n';
+	}
+	*o = '\0';
+
+	// then the gold and players in sight, and this player as '@'
+	void *item;
+	for (hashtable_cursor_t c = hashtable_cursor(goldData); hashtable_next(goldData, &c, NULL, &item); ) {
+		gold_t *g = item;
+		if (!g->isCollected) {
+			viewCell(map, view, &sight, g->pos, out, '*');
+		}
+	}
+	for (hashtable_cursor_t c = hashtable_cursor(players); hashtable_next(players, &c, NULL, &item); ) {
+		player_t *p = item;
+		if (p->isActive && p != player) {
+			viewCell(map, view, &sight, p->pos, out, p->letter);
+		}
+	}
+	viewCell(map, view, &sight, player->pos, out, '@');
+	sightFree(&sight, arena);
+
+	outMap->mapStr = out;
+	outMap->width = cols;
+	outMap->height = rows;
+	outMap->terrain = NULL;
+	outMap->tiles = NULL;
+	outMap->floor = NULL;
+	outMap->numFloor = 0;
+	outMap->compiled = NULL;
+	outMap->lightRadius = 0;
+	return outMap;
 }
 
-/********** helper: replaceBlocked **********/
-void replaceBlocked(map_t *map, map_t *outMap, player_t *player)
-{
-	char *visHere = initVisStr(map->width, map->height);
-	map_calculateVisibility(map, visHere, player->pos);
-
-    if (visHere != NULL) {
-        for (int i = 0; i < strlen(visHere); i++) {
-			// for any gold or players that should not be currently visible,
-            //  convert them to their default symbol in the map
-            if (visHere[i] == '0' && (isalpha(outMap->mapStr[i]) || outMap->mapStr[i] == '*')) {
-                    outMap->mapStr[i] = map->mapStr[i]; 
-            }
-			// Or-ing the vis strings
-			if(player->visibility[i] == '1' || visHere[i] == '1'){
-				player->visibility[i] = '1';
-			}
-        }
-    }
-	free(visHere);
-}
 
-/********** helper: initVisStr **********/
-char *initVisStr(int width, int height)
-{	
-	char *vis = calloc((width * height) + 1, sizeof(char));
-	for (int i = 0; i < (width * height); i++) {
-		strcat(vis, "0");
+/**************** map_scrollView ****************/
+void map_scrollView(map_t *map, viewport_t *view, position_t *pos)
+{
+	// no bigger than the map
+	if (view->rows > map->height) {
+		view->rows = map->height;
+	}
+	if (view->cols > map->width) {
+		view->cols = map->width;
 	}
-	return vis;
-}
 
-/********** helper: intersectVis **********/
-void intersectVis(char *vis1, char *vis2)
-{
-    for (int i = 0; i < strlen(vis1); i++) {
-        // Or-ing the vis strings
-        if(vis1[i] == '1' || vis2[i] == '1'){
-            vis1[i] = '1';
-        }
-    }
+	mcoord_t i = map_calcPosition(map, pos);
+	mcoord_t row = i / map->width, col = i % map->width;
+	if (view->top < 0 || view->left < 0) {
+		view->top = row - view->rows / 2;
+		view->left = col - view->cols / 2;
+	}
+	view->top = scrollAxis(view->top, row, view->rows, map->height);
+	view->left = scrollAxis(view->left, col, view->cols, map->width);
 }
 
 
-/**************** iterator: placeGold ****************/
-void placeGold(void *arg, const char *key, void *item)
+/********** helper: scrollAxis **********/
+/* where a window of size cells, starting at start, should start along one
+ * axis (of limit cells) to keep a quarter of it on either side of at
+ */
+mcoord_t scrollAxis(mcoord_t start, mcoord_t at, mcoord_t size, mcoord_t limit)
 {
-	map_t *outMap = arg;
-	gold_t *g = item;
-	if (!g->isCollected) {
-		int gIndx = map_calcPosition(outMap, g->pos);
-		outMap->mapStr[gIndx] = '*';
+	mcoord_t margin = size / 4;
+	if (at < start + margin) {
+		start = at - margin;
+	} else if (at > start + size - 1 - margin) {
+		start = at - (size - 1 - margin);
+	}
+	if (start > limit - size) {
+		start = limit - size;
 	}
+	return start < 0 ? 0 : start;
 }
 
 
-/**************** iterator: addPlayerITR ****************/
-void addPlayerITR(void *arg, const char *key, void *item)
+/********** helper: viewCell **********/
+/* writes c into the rendered window out, where pos falls, if pos is in the
+ * window and was seen by the trace into s
+ */
+void viewCell(map_t *map, viewport_t *view, sight_t *s, position_t *pos, char *out, char c)
 {
-	map_t *map = arg;
-	player_t *player = item;
-	if (player->isActive) {
-		int plyIndx = map_calcPosition(map, player->pos);
-		map->mapStr[plyIndx] = player->letter;
+	mcoord_t i = map_calcPosition(map, pos);
+	mcoord_t row = i / map->width, col = i % map->width;
+	if (row >= view->top && row < view->top + view->rows && col >= view->left
+	    && col < view->left + view->cols && sees(map, s, pos)) {
+		out[(row - view->top) * (view->cols + 1) + col - view->left] = c;
 	}
-}	
+}
 
 
 /**************** map_calcPosition ****************/
-int map_calcPosition(map_t *map, position_t *pos)
+mcoord_t map_calcPosition(map_t *map, position_t *pos)
 {
 	// checking that pos is not out of bounds
 	if (pos->x > map->width || pos->y > map->height || pos->x < -1 || pos->y < -1){
@@ -208,39 +357,69 @@ int map_calcPosition(map_t *map, position_t *pos)
 }
 
 
+/**************** map_readCells ****************/
+void map_readCells(map_t *map, mcoord_t first, mcoord_t n, char *out)
+{
+	mcoord_t cells = map->width * map->height;
+	mcoord_t inMap = first >= cells ? 0 : cells - first < n ? cells - first : n;
+	if (map->tiles == NULL) {
+		memcpy(out, map->mapStr + first, inMap);
+	} else {
+		// a row's run at a time
+		for (mcoord_t done = 0; done < inMap; ) {
+			mcoord_t x = (first + done) % map->width, y = (first + done) / map->width;
+			mcoord_t run = map->width - x < inMap - done ? map->width - x : inMap - done;
+			tilemap_getRow(map->tiles, x, y, run, out + done);
+			done += run;
+		}
+	}
+	memset(out + inMap, ' ', n - inMap);
+}
+
+
 /**************** map_intToPos ****************/
-position_t *map_intToPos(map_t *map, int i)
+position_t *map_intToPos(map_t *map, mcoord_t i)
 {
-	position_t *pos = malloc(sizeof(position_t));
+	position_t *pos = count_mallocTag(sizeof(position_t), mem_ENTITIES);
+	if (pos != NULL) {
+		map_cellToPos(map, i, pos);
+	}
+	return pos;
+}
+
 
+/**************** map_cellToPos ****************/
+void map_cellToPos(map_t *map, mcoord_t i, position_t *pos)
+{
 	i--;
 
-	int width = map->width;
+	mcoord_t width = map->width;
 
 	pos->x = i%width;
 	pos->y = i/width;
-
-	return pos;
 }
 
 
 /**************** buildMap ****************/
 /* returned string must be freed by the caller */
-char *map_buildOutput(map_t *map)
+char *map_buildOutput(map_t *map, arena_t *arena)
 {
 	if (map == NULL){
 		return NULL;
 	}
 	// Getting len of built up map
-	int newLen = strlen(map->mapStr) + map->height;
+	size_t newLen = strlen(map->mapStr) + map->height;
 
 	// creating new map str in mem
-	char *newMapStr = (char*) malloc( (newLen * sizeof(char)) + 5 ); 
+	char *newMapStr = mapAlloc(arena, mem_RENDER, (newLen * sizeof(char)) + 5);
+	if (newMapStr == NULL) {
+		return NULL;
+	}
 	strcpy(newMapStr, map->mapStr);
 
 	// Adding in new line characters 
-	int offset = map->height;
-	for(int i = strlen(map->mapStr); i >= 0; i--){
+	mcoord_t offset = map->height;
+	for(mcoord_t i = strlen(map->mapStr); i >= 0; i--){
 
 		newMapStr[i + offset] = newMapStr[i];
 		if (i % map->width == 0 && i != 0){
@@ -248,24 +427,39 @@ char *map_buildOutput(map_t *map)
 			offset -= 1;
 		}
 	}
-    free(map->mapStr);
+    mapFree(arena, map->mapStr);
     return newMapStr;
 }
 
 
 /**************** map_copy ****************/
-map_t *map_copy(map_t *map)
+map_t *map_copy(map_t *map, arena_t *arena)
 {
 	// Creating new mem for map
-	map_t *newMap = malloc(sizeof(map_t));
+	map_t *newMap = mapAlloc(arena, mem_RENDER, sizeof(map_t));
+	if (newMap == NULL) {
+		return NULL;
+	}
 
 	// Copying the h and w
 	newMap->width = map->width;
 	newMap->height = map->height;
-
-	// allocating new mem and copying into newMap
-	char *newMapStr = calloc((map->width * map->height) + 1, sizeof(char));
-	strcpy(newMapStr, map->mapStr);
+	newMap->floor = NULL;
+	newMap->numFloor = 0;
+	newMap->terrain = NULL;
+	newMap->tiles = NULL;
+	newMap->compiled = NULL;
+	newMap->lightRadius = 0;
+
+	// allocating new mem and copying into newMap (from the tiles, if it is kept in them)
+	mcoord_t cells = map->width * map->height;
+	char *newMapStr = mapAlloc(arena, mem_RENDER, cells + 1);
+	if (newMapStr == NULL) {
+		mapFree(arena, newMap);
+		return NULL;
+	}
+	map_readCells(map, 0, cells, newMapStr);
+	newMapStr[cells] = '\0';
 	newMap->mapStr = newMapStr;
 
 	return newMap;
@@ -275,34 +469,366 @@ map_t *map_copy(map_t *map)
 /**************** map_calculateVisibility ****************/
 void map_calculateVisibility(map_t *map, char *vis, position_t *pos)
 {
+	// a tiled map is looked at a box at a time, into scratch; then what
+	// was seen is marked in vis
+	if (map->tiles != NULL) {
+		sight_t sight = {0};
+		if (look(map, pos, &sight, NULL)) {
+			position_t at;
+			for (at.y = sight.lo.y; at.y <= sight.hi.y; at.y++) {
+				for (at.x = sight.lo.x; at.x <= sight.hi.x; at.x++) {
+					if (sight.vis[sightIndex(&sight, &at)] == '1') {
+						vis[map_calcPosition(map, &at)] = '1';
+					}
+				}
+			}
+		}
+		sightFree(&sight, NULL);
+		return;
+	}
 
-	position_t *newPos = malloc(sizeof(position_t));
+	// a flat map is traced straight into vis
+	sight_t sight = {.vis = vis, .origin = {-1, 0}, .stride = map->width, .whole = true};
 
-	for (newPos->x = 0; newPos->x < map->width;  newPos->x++){
-		for (newPos->y = 0; newPos->y < map->height; newPos->y++){
+	// in the dark, look only as far as the light reaches
+	if (lightWindow(map, pos, &sight.lo, &sight.hi)) {
+		traceWithin(map, &sight, pos, &sight.lo, &sight.hi);
+		return;
+	}
+
+	// a compiled map may have the answer already
+	if (map->compiled != NULL && nmap_visibility(map->compiled, map_calcPosition(map, pos), vis)) {
+		return;
+	}
 
-			// Calculating the visibility from player pos and updating visibility string
-			map_calcVisPath(map, vis, pos, newPos);
+	sight.lo.x = sight.lo.y = 0;
+	sight.hi.x = map->width - 1;
+	sight.hi.y = map->height - 1;
+	traceWithin(map, &sight, pos, &sight.lo, &sight.hi);
+}
+
+
+/********** helper: look **********/
+/* works out what can be seen from pos into s, as map_calculateVisibility
+ * does, in scratch from the arena; s starts zeroed, keeps its scratch for
+ * the next look, and is done with by sightFree.
+ * Returns false on malloc error
+ */
+bool look(map_t *map, position_t *pos, sight_t *s, arena_t *arena)
+{
+	position_t litLo, litHi;
+	if (map->tiles == NULL) {
+		if (lightWindow(map, pos, &litLo, &litHi)) {
+			return lookWithin(map, pos, &litLo, &litHi, 0, s, arena);
+		}
+
+		// a flat map, with no light, is looked at whole
+		size_t bytes = map->width * map->height + 1;
+		if ((s->vis = reserve(s->vis, &s->room, bytes, arena)) == NULL) {
+			return false;
 		}
+		memset(s->vis, '0', bytes - 1);
+		s->vis[bytes - 1] = '\0';
+		s->whole = true;
+		s->origin = (position_t) {-1, 0};
+		s->stride = map->width;
+		s->lo = (position_t) {0, 0};
+		s->hi = (position_t) {map->width - 1, map->height - 1};
+		map_calculateVisibility(map, s->vis, pos);
+		return true;
 	}
 
-	free(newPos);
+	// a tiled map, from the tile pos is in outward, until no line of
+	// sight comes near the edge of the box (or it reaches the light's).
+	// Lines are traced on out to a tile's width beyond the box, as a
+	// line along a wall sees more of it the further it is aimed
+	position_t eye = eyeOf(map, pos);
+	bool lit = lightWindow(map, &eye, &litLo, &litHi);
+	position_t cell = {eye.x + 1, eye.y};
+	cell.x = cell.x < 0 ? 0 : cell.x < map->width ? cell.x : map->width - 1;
+	cell.y = cell.y < 0 ? 0 : cell.y < map->height ? cell.y : map->height - 1;
+	position_t tLo = {cell.x >> tile_Shift, cell.y >> tile_Shift}, tHi = tLo;
+	for (bool traced = false; ; traced = true) {
+		position_t lo, hi;
+		tileBox(map, &tLo, &tHi, &lo, &hi);
+		if (lit) {
+			lo.x = litLo.x > lo.x ? litLo.x : lo.x;
+			lo.y = litLo.y > lo.y ? litLo.y : lo.y;
+			hi.x = litHi.x < hi.x ? litHi.x : hi.x;
+			hi.y = litHi.y < hi.y ? litHi.y : hi.y;
+		}
+		if (traced && lo.x >= s->lo.x && lo.y >= s->lo.y && hi.x <= s->hi.x && hi.y <= s->hi.y) {
+			return true;		// no wider than the last
+		}
+		if (!lookWithin(map, &eye, &lo, &hi, tile_Size, s, arena)) {
+			return false;
+		}
+		if (!widen(map, s, &eye, &tLo, &tHi)) {
+			return true;
+		}
+	}
 }
 
 
-/**************** map_calcVisPath ****************/
-void map_calcVisPath(map_t *map, char *vis, position_t *pos1, position_t *pos2)
+/********** helper: lookWithin **********/
+/* works out into s what can be seen from pos of the positions from lo to
+ * hi (widened to hold pos), in scratch just as big (see look), tracing
+ * lines to every position up to ring beyond them; returns false on malloc
+ * error
+ */
+bool lookWithin(map_t *map, position_t *pos, position_t *lo, position_t *hi, mcoord_t ring,
+                sight_t *s, arena_t *arena)
+{
+	position_t eye = eyeOf(map, pos);
+	s->lo = *lo;
+	s->hi = *hi;
+	s->lo.x = eye.x < s->lo.x ? eye.x : s->lo.x;
+	s->lo.y = eye.y < s->lo.y ? eye.y : s->lo.y;
+	s->hi.x = eye.x > s->hi.x ? eye.x : s->hi.x;
+	s->hi.y = eye.y > s->hi.y ? eye.y : s->hi.y;
+	s->whole = false;
+	if (map->tiles != NULL) {
+		if (!readBox(map, s, arena)) {
+			return false;
+		}
+	} else {
+		s->origin = s->lo;
+		s->stride = s->hi.x - s->lo.x + 1;
+		size_t bytes = s->stride * (s->hi.y - s->lo.y + 1);
+		if ((s->vis = reserve(s->vis, &s->room, bytes, arena)) == NULL) {
+			return false;
+		}
+		memset(s->vis, '0', bytes);
+	}
+
+	position_t first = {s->lo.x - ring, s->lo.y - ring};
+	position_t last = {s->hi.x + ring, s->hi.y + ring};
+	first.x = first.x > 0 ? first.x : 0;
+	first.y = first.y > 0 ? first.y : 0;
+	last.x = last.x < map->width - 1 ? last.x : map->width - 1;
+	last.y = last.y < map->height - 1 ? last.y : map->height - 1;
+	traceWithin(map, s, &eye, &first, &last);
+	return true;
+}
+
+
+/********** helper: readBox **********/
+/* lays out in s the classes of a tiled map's cells for the positions of
+ * s's box, with a frame of two positions around it that is all wall: a
+ * line of sight that leaves the box stops in the frame, within the
+ * scratch, however far it was aimed. Clears s's vis, laid out the same;
+ * returns false on malloc error
+ */
+bool readBox(map_t *map, sight_t *s, arena_t *arena)
+{
+	mcoord_t width = s->hi.x - s->lo.x + 1;
+	s->origin = (position_t) {s->lo.x - 2, s->lo.y - 2};
+	s->stride = width + 4;
+	size_t bytes = s->stride * (s->hi.y - s->lo.y + 5);
+	if ((s->vis = reserve(s->vis, &s->room, bytes, arena)) == NULL
+	    || (s->terrain = reserve(s->terrain, &s->terrainRoom, bytes, arena)) == NULL) {
+		return false;
+	}
+	memset(s->vis, '0', bytes);
+	memset(s->terrain, terrain_WALL, bytes);
+
+	// position x is the cell in column x + 1 (see map_calcPosition)
+	position_t at = s->lo;
+	for (at.y = s->lo.y; at.y <= s->hi.y; at.y++) {
+		unsigned char *row = s->terrain + sightIndex(s, &at);
+		tilemap_getRow(map->tiles, s->lo.x + 1, at.y, width, (char *) row);
+		for (mcoord_t i = 0; i < width; i++) {
+			row[i] = TerrainClass[row[i]];
+		}
+	}
+	return true;
+}
+
+
+/********** helper: reserve **********/
+/* scratch at least bytes long, room bytes of which are allocated already:
+ * scratch itself if big enough, else a new one in its place (room
+ * updated). Returns NULL on malloc error
+ */
+void *reserve(void *scratch, size_t *room, size_t bytes, arena_t *arena)
+{
+	if (*room < bytes) {
+		mapFree(arena, scratch);
+		scratch = mapAlloc(arena, mem_VISIBILITY, bytes);
+		*room = scratch != NULL ? bytes : 0;
+	}
+	return scratch;
+}
+
+
+/********** helper: sightFree **********/
+/* frees the scratch s was looked into */
+void sightFree(sight_t *s, arena_t *arena)
 {
+	mapFree(arena, s->vis);
+	mapFree(arena, s->terrain);
+}
 
-    int dx = abs(pos1->x - pos2->x);
-    int dy = abs(pos1->y - pos2->y);
 
-	position_t *newPos = malloc(sizeof(position_t));
-	newPos->x = pos1->x;
-	newPos->y = pos1->y;
+/********** helper: eyeOf **********/
+/* where a tiled map is looked from, for pos: the position at the end of a
+ * row is the cell that starts the next (see terrainIndex), and is looked
+ * from as the position before it
+ */
+position_t eyeOf(map_t *map, position_t *pos)
+{
+	position_t eye = *pos;
+	if (map->tiles != NULL && eye.x == map->width - 1 && eye.y < map->height - 1) {
+		eye.x = -1;
+		eye.y++;
+	}
+	return eye;
+}
 
-    int i = 1 + dx + dy;
-    int error = dx - dy;
+
+/********** helper: tileBox **********/
+/* the positions (see map_calcPosition) of the cells of the tiles from tLo
+ * to tHi, leaving out position -1 and taking in width - 1 at the map's
+ * edges, as map_calculateVisibility does on a flat map
+ */
+void tileBox(map_t *map, position_t *tLo, position_t *tHi, position_t *lo, position_t *hi)
+{
+	lo->x = tLo->x == 0 ? 0 : (tLo->x << tile_Shift) - 1;
+	lo->y = tLo->y << tile_Shift;
+	hi->x = tHi->x == map->tiles->tilesAcross - 1 ? map->width - 1 : (tHi->x << tile_Shift) + tile_Size - 2;
+	hi->y = (tHi->y << tile_Shift) + tile_Size - 1;
+	hi->y = hi->y < map->height - 1 ? hi->y : map->height - 1;
+}
+
+
+/********** helper: widen **********/
+/* after a look into s on a tiled map, moves each side of the box of tiles
+ * from tLo to tHi out by a tile, where the map goes on, if within two
+ * positions of that edge of s's box there is one seen that does not stop
+ * sight, or pos itself: a line through it may go on out of the box (a
+ * line stops within two of the first thing that stops sight).
+ * Returns whether any side moved
+ */
+bool widen(map_t *map, sight_t *s, position_t *pos, position_t *tLo, position_t *tHi)
+{
+	bool wider = false;
+	if (tLo->x > 0 && edgeOpen(s, pos, s->lo.x, s->lo.x + 1, s->lo.y, s->hi.y)) {
+		tLo->x--;
+		wider = true;
+	}
+	if (tHi->x < map->tiles->tilesAcross - 1 && edgeOpen(s, pos, s->hi.x - 1, s->hi.x, s->lo.y, s->hi.y)) {
+		tHi->x++;
+		wider = true;
+	}
+	if (tLo->y > 0 && edgeOpen(s, pos, s->lo.x, s->hi.x, s->lo.y, s->lo.y + 1)) {
+		tLo->y--;
+		wider = true;
+	}
+	if (tHi->y < map->tiles->tilesDown - 1 && edgeOpen(s, pos, s->lo.x, s->hi.x, s->hi.y - 1, s->hi.y)) {
+		tHi->y++;
+		wider = true;
+	}
+	return wider;
+}
+
+
+/********** helper: edgeOpen **********/
+/* whether any position from (x0, y0) to (x1, y1), within s's box (on a
+ * tiled map), was seen and does not stop sight, or is pos
+ */
+bool edgeOpen(sight_t *s, position_t *pos, mcoord_t x0, mcoord_t x1, mcoord_t y0, mcoord_t y1)
+{
+	position_t at;
+	for (at.y = y0 < s->lo.y ? s->lo.y : y0; at.y <= y1 && at.y <= s->hi.y; at.y++) {
+		for (at.x = x0 < s->lo.x ? s->lo.x : x0; at.x <= x1 && at.x <= s->hi.x; at.x++) {
+			mcoord_t i = sightIndex(s, &at);
+			if (s->vis[i] == '1' && (!Obstructs[s->terrain[i]] || (at.x == pos->x && at.y == pos->y))) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+
+/********** helper: sightIndex **********/
+/* the index in s's vis of pos */
+mcoord_t sightIndex(sight_t *s, position_t *pos)
+{
+	return (pos->y - s->origin.y) * s->stride + pos->x - s->origin.x;
+}
+
+
+/********** helper: sees **********/
+/* whether pos was seen in the look into s */
+bool sees(map_t *map, sight_t *s, position_t *pos)
+{
+	if (s->whole) {
+		mcoord_t i = map_calcPosition(map, pos);
+		return i >= 0 && s->vis[i] == '1';
+	}
+	return pos->x >= s->lo.x && pos->x <= s->hi.x && pos->y >= s->lo.y && pos->y <= s->hi.y
+		&& s->vis[sightIndex(s, pos)] == '1';
+}
+
+
+/********** helper: sightMerge **********/
+/* adds what was seen in the look into s to seen, a row of its box at a time
+ * (each a run of cells; see map_calcPosition)
+ */
+void sightMerge(map_t *map, sight_t *s, seen_t *seen)
+{
+	if (s->whole) {
+		seen_merge(seen, s->vis, 0, map->width * map->height);
+		return;
+	}
+	position_t at = s->lo;
+	for (at.y = s->lo.y; at.y <= s->hi.y; at.y++) {
+		seen_merge(seen, s->vis + sightIndex(s, &at), map_calcPosition(map, &at), s->hi.x - s->lo.x + 1);
+	}
+}
+
+
+/********** helper: traceWithin **********/
+/* traces a line of sight from pos to every position from first to last
+ * (that is within the light radius, if the map has one), marking in s what
+ * can be seen; pos must be in s's box. A line aimed beyond the box needs
+ * the frame of a tiled map's scratch to stop it (see readBox); one aimed
+ * within it stays in it
+ */
+void traceWithin(map_t *map, sight_t *s, position_t *pos, position_t *first, position_t *last)
+{
+	mcoord_t r = map->lightRadius, r2 = r * r;
+	position_t lo = *first, hi = *last, newPos;
+	if (r > 0) {
+		lo.x = pos->x - r > lo.x ? pos->x - r : lo.x;
+		lo.y = pos->y - r > lo.y ? pos->y - r : lo.y;
+		hi.x = pos->x + r < hi.x ? pos->x + r : hi.x;
+		hi.y = pos->y + r < hi.y ? pos->y + r : hi.y;
+	}
+
+	for (newPos.y = lo.y; newPos.y <= hi.y; newPos.y++) {
+		mcoord_t dy = newPos.y - pos->y;
+		for (newPos.x = lo.x < 0 ? 0 : lo.x; newPos.x <= hi.x; newPos.x++) {
+			mcoord_t dx = newPos.x - pos->x;
+			if (r2 == 0 || dx * dx + dy * dy <= r2) {
+				// Calculating the visibility from player pos and updating visibility string
+				map_calcVisPath(map, s, pos, &newPos);
+			}
+		}
+	}
+}
+
+
+/**************** map_calcVisPath ****************/
+void map_calcVisPath(map_t *map, sight_t *s, position_t *pos1, position_t *pos2)
+{
+
+    mcoord_t dx = llabs(pos1->x - pos2->x);
+    mcoord_t dy = llabs(pos1->y - pos2->y);
+
+    mcoord_t i = 1 + dx + dy;
+    mcoord_t error = dx - dy;
 
 	int x_dir, y_dir;
 	
@@ -313,6 +839,21 @@ void map_calcVisPath(map_t *map, char *vis, position_t *pos1, position_t *pos2)
 	if (pos2->y > pos1->y){ y_dir = 1; } 
 	else { y_dir = -1; }
 
+	// walk the line by index in the visibility scratch, and in the terrain:
+	// a flat map's own (its border stops any line before it leaves the
+	// map), or the tiled map's box, laid out like the scratch
+	char *vis = s->vis;
+	mcoord_t indx = sightIndex(s, pos1);
+	mcoord_t x_step = x_dir, y_step = y_dir * s->stride;
+	const unsigned char *terrain = s->terrain;
+	mcoord_t tIndx = indx, y_tStep = y_step;
+	if (terrain == NULL) {
+		terrain = map->terrain;
+		tIndx = terrainIndex(map, pos1);
+		y_tStep = y_dir * (map->width + 2);
+	}
+	bool fromPassage = terrain[tIndx] == terrain_PASSAGE;
+
 	dx *= 2;
     dy *= 2;
 	bool breakNext = false; 
@@ -320,14 +861,11 @@ void map_calcVisPath(map_t *map, char *vis, position_t *pos1, position_t *pos2)
     {
         // check for visibility along this line and special
         //  cases (corners and passages)
-		int indx = map_calcPosition(map,newPos);
+		terrain_t t = terrain[tIndx];
 		if (!breakNext){
 			vis[indx] = '1';
 		} 
-		else if (map->mapStr[indx] == '+'){
-			vis[indx] = '1';
-			break;
-		} else if (map->mapStr[indx] == '#' && map->mapStr[map_calcPosition(map,pos1)] == '#'){
+		else if (t == terrain_CORNER || (t == terrain_PASSAGE && fromPassage)){
 			vis[indx] = '1';
 			break;
 		}
@@ -335,37 +873,28 @@ void map_calcVisPath(map_t *map, char *vis, position_t *pos1, position_t *pos2)
 			break;
 		}
 		
-		if(isObstruct(map->mapStr[indx])){
+		if (Obstructs[t]){
 			breakNext = true;
 		} 
 		
         if (error > 0){
-            newPos->x += x_dir;
+            indx += x_step;
+            tIndx += x_dir;
             error -= dy;
         }
         else{
-            newPos->y += y_dir;
+            indx += y_step;
+            tIndx += y_tStep;
             error += dx;
         }
 
 		i -= 1;
     }
-	free(newPos);
-}
-
-
-/**************** isObstruct ****************/
-bool isObstruct(char c)
-{
-	if (c == '+' || c == '-' || c == '|' || c == '#' || c == ' '){
-		return true;
-	}
-	return false;
 }
 
 
 /**************** map_movePlayer ****************/
-void map_movePlayer(map_t *map, player_t *player, position_t *nextPos, hashtable_t *goldData)
+void map_movePlayer(map_t *map, player_t *player, position_t *nextPos, hashtable_t *goldData, arena_t *arena)
 {
 	// NULL check
 	if (map == NULL || player == NULL || nextPos == NULL){
@@ -373,11 +902,13 @@ void map_movePlayer(map_t *map, player_t *player, position_t *nextPos, hashtable
 	}
 
 	// newPos is the pos that we update throughout the loop
-	position_t *newPos = malloc(sizeof(position_t));
-	if (newPos == NULL){ return; }
+	position_t here = *player->pos;
+	position_t *newPos = &here;
 
-	newPos->x = player->pos->x;
-	newPos->y = player->pos->y;
+	// the visibility from each spot along the way, its scratch reused at
+	// every step; a player with no record of what they have seen just moves
+	bool looking = player->seen != NULL;
+	sight_t sight = {0};
 
 	int x_direction;
 	int y_direction;
@@ -394,7 +925,7 @@ void map_movePlayer(map_t *map, player_t *player, position_t *nextPos, hashtable
 	if (nextPos->x - newPos->x != 0 && nextPos->y - newPos->y != 0) {
 
 		// If movement isn't exactally diagonal return original position
-		if ( abs(nextPos->x - newPos->x) != abs(nextPos->y - newPos->y) ){
+		if ( llabs(nextPos->x - newPos->x) != llabs(nextPos->y - newPos->y) ){
 			return;
 		}
 
@@ -413,12 +944,9 @@ void map_movePlayer(map_t *map, player_t *player, position_t *nextPos, hashtable
 			// Checks if during this move they pick up gold
 			player->pos->x = newPos->x;
 			player->pos->y = newPos->y;
-			hashtable_iterate(goldData, player, isOnGoldITR);
+			collectGold(goldData, player);
 
-			char *visHere = initVisStr(map->width, map->height);
-            map_calculateVisibility(map,visHere, player->pos);
-            intersectVis(player->visibility, visHere);
-            free(visHere);
+			if (looking){ lookFrom(map, player, &sight, arena); }
 		}
 	} 
 
@@ -438,12 +966,9 @@ void map_movePlayer(map_t *map, player_t *player, position_t *nextPos, hashtable
 			// Checks if during this move they pick up gold
 			player->pos->x = newPos->x;
 			player->pos->y = newPos->y;
-			hashtable_iterate(goldData, player, isOnGoldITR);
+			collectGold(goldData, player);
 
-			char *visHere = initVisStr(map->width, map->height);
-            map_calculateVisibility(map,visHere, player->pos);
-            intersectVis(player->visibility, visHere);
-            free(visHere);
+			if (looking){ lookFrom(map, player, &sight, arena); }
 
 		}
 	} 
@@ -464,12 +989,9 @@ void map_movePlayer(map_t *map, player_t *player, position_t *nextPos, hashtable
 			// Checks if during this move they pick up gold
 			player->pos->x = newPos->x;
 			player->pos->y = newPos->y;
-			hashtable_iterate(goldData, player, isOnGoldITR);
+			collectGold(goldData, player);
 
-			char *visHere = initVisStr(map->width, map->height);
-            map_calculateVisibility(map,visHere, player->pos);
-            intersectVis(player->visibility, visHere);
-            free(visHere);
+			if (looking){ lookFrom(map, player, &sight, arena); }
 
 		}
 	}
@@ -484,50 +1006,402 @@ void map_movePlayer(map_t *map, player_t *player, position_t *nextPos, hashtable
 	nextPos->x = player->pos->x;
 	nextPos->y = player->pos->y;
 
-	free(newPos);
+	sightFree(&sight, arena);
 	return;
 }
 
 
+/**************** map_lookAlong ****************/
+void map_lookAlong(map_t *map, player_t *player, position_t *from, position_t *to, arena_t *arena)
+{
+	if (map == NULL || player == NULL || player->seen == NULL || from == NULL || to == NULL) {
+		return;
+	}
+	// walk a stand-in for the player, so that anyone looking at where
+	// the player is sees them stay put
+	position_t at = *from;
+	player_t walker = *player;
+	walker.pos = &at;
+	sight_t sight = {0};
+	int dx = (to->x > at.x) - (to->x < at.x);
+	int dy = (to->y > at.y) - (to->y < at.y);
+	do {
+		if (at.x != to->x) {
+			at.x += dx;
+		}
+		if (at.y != to->y) {
+			at.y += dy;
+		}
+		lookFrom(map, &walker, &sight, arena);
+	} while (at.x != to->x || at.y != to->y);
+	sightFree(&sight, arena);
+}
+
+
+/********** helper: lookFrom **********/
+/* adds what the player can see from where they stand to what they have
+ * seen, using s as scratch (see look); with a light radius, or on a tiled
+ * map, only the box around them is cleared and merged. A spot with no
+ * scratch to look from is not looked from
+ */
+void lookFrom(map_t *map, player_t *player, sight_t *s, arena_t *arena)
+{
+	if (look(map, player->pos, s, arena)) {
+		sightMerge(map, s, player->seen);
+	}
+}
+
+
+/********** helper: lightWindow **********/
+/* the square of positions within the map's light radius of pos, clipped
+ * to the positions map_calculateVisibility looks at (and to pos itself,
+ * which may be a column further left); every line of sight from pos to a
+ * position in it stays in it. Returns false if the map has no light radius
+ */
+bool lightWindow(map_t *map, position_t *pos, position_t *lo, position_t *hi)
+{
+	mcoord_t r = map->lightRadius;
+	if (r <= 0) {
+		return false;
+	}
+	mcoord_t left = pos->x < 0 ? pos->x : 0;
+	lo->x = pos->x - r > left ? pos->x - r : left;
+	lo->y = pos->y - r > 0 ? pos->y - r : 0;
+	hi->x = pos->x + r < map->width - 1 ? pos->x + r : map->width - 1;
+	hi->y = pos->y + r < map->height - 1 ? pos->y + r : map->height - 1;
+	return true;
+}
+
+
 /**************** canPlayerMoveTo ****************/
 bool canPlayerMoveTo(map_t *map, position_t *pos)
 {	
-	// Calculating the index in the string from the pos
-	int indx = map_calcPosition(map, pos);
-	char c = map->mapStr[indx];
+	// a step off the map lands on its border, which is wall
+	return Walkable[terrainAt(map, pos)];
+}
 
-	// Checking if pos is a space where you cant move to
-	if (c != ' ' && c != '-' && c != '|' && c != '+'){
-		return true;
+
+/**************** map_classify ****************/
+terrain_t map_classify(char c)
+{
+	return TerrainClass[(unsigned char) c];
+}
+
+
+/**************** map_walkable ****************/
+bool map_walkable(terrain_t t)
+{
+	return t >= 0 && t < terrain_NCLASSES && Walkable[t];
+}
+
+
+/**************** map_obstructs ****************/
+bool map_obstructs(terrain_t t)
+{
+	return t < 0 || t >= terrain_NCLASSES || Obstructs[t];
+}
+
+
+/********** helper: terrainIndex **********/
+/* the index of a position in the map's terrain, whose border makes room
+ * for positions one step off any edge; positions are a column to the left
+ * of their cells (see map_calcPosition), and map_cellToPos gives the cells
+ * of the first column as x = width - 1 on the row above
+ */
+mcoord_t terrainIndex(map_t *map, position_t *pos)
+{
+	if (pos->x == map->width - 1) {
+		return (pos->y + 2) * (map->width + 2) + 1;
 	}
+	return (pos->y + 1) * (map->width + 2) + pos->x + 2;
+}
 
-	return false;
+
+/********** helper: terrainAt **********/
+/* the class of the cell at a position (or, one step off the map, of its
+ * border), from the terrain of a flat map or the tiles of a tiled one
+ */
+terrain_t terrainAt(map_t *map, position_t *pos)
+{
+	if (map->tiles == NULL) {
+		return map->terrain[terrainIndex(map, pos)];
+	}
+	if (pos->x == map->width - 1) {
+		return cellTerrain(map, 0, pos->y + 1);
+	}
+	return cellTerrain(map, pos->x + 1, pos->y);
+}
+
+
+/********** helper: cellTerrain **********/
+/* the class of the cell at col, row of a tiled map; wall off the map */
+terrain_t cellTerrain(map_t *map, mcoord_t col, mcoord_t row)
+{
+	if (col < 0 || row < 0 || col >= map->width || row >= map->height) {
+		return terrain_WALL;
+	}
+	return TerrainClass[(unsigned char) tilemap_get(map->tiles, col, row)];
 }
 
 
-/********** iterator: isOnGoldITR **********/
-void isOnGoldITR(void *arg, const char *key, void *item)
+/********** helper: collectGold **********/
+void collectGold(hashtable_t *goldData, player_t *player)
 {
 	// sendGoldMessage now happens after in server file after player move is complete
-	player_t *player = arg;
-	gold_t *goldItem = item;
+	void *item;
+	for (hashtable_cursor_t c = hashtable_cursor(goldData); hashtable_next(goldData, &c, NULL, &item); ) {
+		gold_t *goldItem = item;
+		if(!goldItem->isCollected && player->pos->x == goldItem->pos->x && player->pos->y == goldItem->pos->y){
+			player->gold += goldItem->value;
+			goldItem->isCollected = true;
+			break;	// at most one pile per spot
+		}
+	}
+}
+
+
+
+/********** helper: parseGrid **********/
+/* builds a map from the len bytes of a map file's text (see map_new):
+ * one scan finds and checks the rows, then each is copied into the grid
+ * with a memcpy, and padded with a memset (or, past map_TiledCells or if
+ * tiled, into tiles; see parseTiles). Returns NULL, after printing why
+ * (naming the file as name), if the text is not a map
+ */
+map_t *parseGrid(const char *text, size_t len, const char *name, bool tiled)
+{
+	const char *end = text + len;
+
+	// measure the rows, checking every character and counting the floor
+	mcoord_t height = 0;
+	mcoord_t width = 0;
+	mcoord_t numFloor = 0;
+	for (const char *row = text; row < end; height++) {
+		const char *newline = memchr(row, '\n', end - row);
+		const char *rowEnd = newline != NULL ? newline : end;
+		if (rowEnd > row && rowEnd[-1] == '\r') {
+			rowEnd--;
+		}
+		for (const char *p = row; p < rowEnd; p++) {
+			numFloor += *p == '.';
+			if (TerrainClass[(unsigned char) *p] == terrain_INVALID) {
+				fprintf(stderr, "%s: line %" PRId64 ", column %ld: '%c' cannot be part of a map\n",
+				        name, height + 1, (long) (p - row) + 1, *p);
+				return NULL;
+			}
+		}
+		if (rowEnd - row > width) {
+			width = rowEnd - row;
+		}
+		row = newline != NULL ? newline + 1 : end;
+	}
+	if (width == 0) {
+		fprintf(stderr, "%s: no map in the file\n", name);
+		return NULL;
+	}
+	if (numFloor > INT_MAX) {
+		fprintf(stderr, "%s: %" PRId64 " floor cells are more than a game can use\n", name, numFloor);
+		return NULL;
+	}
+	if (tiled || width > map_TiledCells / height) {
+		map_t *map = parseTiles(text, len, width, height, numFloor);
+		if (map == NULL) {
+			fprintf(stderr, "%s: no memory for a %" PRId64 " x %" PRId64 " map\n", name, height, width);
+		}
+		return map;
+	}
+
+	map_t *map = count_mallocTag(sizeof(map_t), mem_MAP);
+	char *grid = count_mallocTag(width * height + 1, mem_MAP);
+	mcoord_t *floor = count_mallocTag((numFloor > 0 ? numFloor : 1) * sizeof(mcoord_t), mem_MAP);
+	unsigned char *terrain = count_mallocTag((width + 2) * (height + 2), mem_MAP);
+	if (map == NULL || grid == NULL || floor == NULL || terrain == NULL) {
+		if (map != NULL) {
+			count_free(map);
+		}
+		if (grid != NULL) {
+			count_free(grid);
+		}
+		if (floor != NULL) {
+			count_free(floor);
+		}
+		if (terrain != NULL) {
+			count_free(terrain);
+		}
+		return NULL;
+	}
+
+	// copy the rows in, padding short ones with solid rock
+	char *cell = grid;
+	for (const char *row = text; row < end; cell += width) {
+		const char *newline = memchr(row, '\n', end - row);
+		const char *rowEnd = newline != NULL ? newline : end;
+		if (rowEnd > row && rowEnd[-1] == '\r') {
+			rowEnd--;
+		}
+		memcpy(cell, row, rowEnd - row);
+		memset(cell + (rowEnd - row), ' ', width - (rowEnd - row));
+		row = newline != NULL ? newline + 1 : end;
+	}
+	*cell = '\0';
+
+	// and list the floor, where gold and players are placed
+	mcoord_t n = 0;
+	for (mcoord_t i = 0; i < width * height; i++) {
+		if (grid[i] == '.') {
+			floor[n++] = i;
+		}
+	}
+
+	// classify every cell, inside a border of wall
+	memset(terrain, terrain_WALL, (width + 2) * (height + 2));
+	for (mcoord_t y = 0; y < height; y++) {
+		unsigned char *tRow = terrain + (y + 1) * (width + 2) + 1;
+		const char *gRow = grid + y * width;
+		for (mcoord_t x = 0; x < width; x++) {
+			tRow[x] = TerrainClass[(unsigned char) gRow[x]];
+		}
+	}
+
+	map->width = width;
+	map->height = height;
+	map->mapStr = grid;
+	map->floor = floor;
+	map->numFloor = numFloor;
+	map->terrain = terrain;
+	map->tiles = NULL;
+	map->compiled = NULL;
+	map->lightRadius = 0;
+	return map;
+}
+
+
+/********** helper: parseTiles **********/
+/* builds a map of width x height cells, numFloor of them floor, kept in
+ * tiles, from the text parseGrid has checked: each row goes into the tiles
+ * it crosses, and only tiles with something other than rock in them are
+ * allocated. Returns NULL on malloc error
+ */
+map_t *parseTiles(const char *text, size_t len, mcoord_t width, mcoord_t height,
+                  mcoord_t numFloor)
+{
+	const char *end = text + len;
+	map_t *map = count_mallocTag(sizeof(map_t), mem_MAP);
+	tilemap_t *tiles = tilemap_new(width, height);
+	mcoord_t *floor = count_mallocTag((numFloor > 0 ? numFloor : 1) * sizeof(mcoord_t), mem_MAP);
+	if (map == NULL || tiles == NULL || floor == NULL) {
+		if (map != NULL) {
+			count_free(map);
+		}
+		tilemap_delete(tiles);
+		if (floor != NULL) {
+			count_free(floor);
+		}
+		return NULL;
+	}
 
-	if(!goldItem->isCollected && player->pos->x == goldItem->pos->x && player->pos->y == goldItem->pos->y){
-		player->gold += goldItem->value;
-		goldItem->isCollected = true;
+	// the short rows are rock past their ends already
+	mcoord_t n = 0;
+	mcoord_t y = 0;
+	for (const char *row = text; row < end; y++) {
+		const char *newline = memchr(row, '\n', end - row);
+		const char *rowEnd = newline != NULL ? newline : end;
+		if (rowEnd > row && rowEnd[-1] == '\r') {
+			rowEnd--;
+		}
+		if (!tilemap_setRow(tiles, 0, y, rowEnd - row, row)) {
+			count_free(map);
+			tilemap_delete(tiles);
+			count_free(floor);
+			return NULL;
+		}
+		for (const char *p = row; (p = memchr(p, '.', rowEnd - p)) != NULL; p++) {
+			floor[n++] = y * width + (p - row);
+		}
+		row = newline != NULL ? newline + 1 : end;
 	}
+
+	map->width = width;
+	map->height = height;
+	map->mapStr = NULL;
+	map->floor = floor;
+	map->numFloor = numFloor;
+	map->terrain = NULL;
+	map->tiles = tiles;
+	map->compiled = NULL;
+	map->lightRadius = 0;
+	return map;
 }
 
 
+/********** helper: useCompiled **********/
+/* builds a map around a compiled map file (see map_load), taking over the
+ * file; the map's string and floor are the compiled map's own, so nothing
+ * is copied. Returns NULL, after printing why, if the file is not usable
+ */
+map_t *useCompiled(filedata_t *file, const char *name)
+{
+	nmap_t *nm = nmap_open(file, name);
+	if (nm == NULL) {
+		return NULL;
+	}
+	map_t *map = count_mallocTag(sizeof(map_t), mem_MAP);
+	if (map == NULL) {
+		nmap_close(nm);
+		return NULL;
+	}
+	// the grid is read-only: only copies of the base map are ever written
+	map->mapStr = (char *) nm->grid;
+	map->width = nm->header->width;
+	map->height = nm->header->height;
+	map->floor = nm->floor;
+	map->numFloor = nm->header->numFloor;
+	map->terrain = (unsigned char *) nm->terrain;
+	map->tiles = NULL;
+	map->compiled = nm;
+	map->lightRadius = 0;
+	return map;
+}
+
+
+/********** helper: mapAlloc **********/
+/* allocates from the arena, or from the heap (counted under tag) if there is none */
+void *mapAlloc(arena_t *arena, memtag_t tag, size_t bytes)
+{
+	return arena != NULL ? arena_alloc(arena, bytes) : count_mallocTag(bytes, tag);
+}
+
+
+/********** helper: mapFree **********/
+/* frees what mapAlloc allocated; the arena frees its own, all at once */
+void mapFree(arena_t *arena, void *p)
+{
+	if (arena == NULL) {
+		count_free(p);
+	}
+}
+
 
 /**************** map_delete ****************/
 void map_delete(map_t *map)
 {	
 	// Deletes map str and map if not null
 	if (map != NULL) {
-		if (map->mapStr != NULL) {
-			free(map->mapStr);
+		if (map->compiled != NULL) {
+			// the string and floor are in the compiled map's file
+			nmap_close(map->compiled);
+		} else {
+			if (map->mapStr != NULL) {
+				count_free(map->mapStr);
+			}
+			if (map->floor != NULL) {
+				count_free((mcoord_t *) map->floor);
+			}
+			if (map->terrain != NULL) {
+				count_free(map->terrain);
+			}
+			tilemap_delete(map->tiles);
 		}
-		free(map);
+		count_free(map);
 	}
 }
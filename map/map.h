@@ -4,6 +4,12 @@
  * A map is a single-line string representing
  *  a playable game map that is created from a map file.
  *
+ * A map of more than map_TiledCells cells is kept in tiles instead (see
+ *  tilemap.h), allocated only where it is not solid rock, and what can be
+ *  seen from a spot is worked out within the tiles around it; the
+ *  functions below work the same on either.  Coordinates and cell numbers
+ *  are 64 bits (mcoord_t), so no map is too big to number.
+ *
  * Nuggets: Bash Boys
  */
 
@@ -12,17 +18,38 @@
 #define __MAP_H
 
 
+#include <stdint.h>
 #include "hashtable.h"
 #include "message.h"
+#include "arena.h"
+#include "seen.h"
+
+
+/******************************** CONSTANTS ********************************/
+#define map_TiledCells (1 << 22)	// bigger maps are kept in tiles
 
 
 /******************************** DATA STRUCTS ********************************/
 
+/**************** mcoord ****************/
+/* a coordinate, or the number of a cell (see map_calcPosition) */
+typedef int64_t mcoord_t;
+
 /**************** position ****************/
 typedef struct position {
-	int x, y;
+	mcoord_t x, y;
 } position_t;
 
+/**************** viewport ****************/
+/* the window of the map a client is shown, in rows and columns of cells
+ * (of glyphs, for a spectator's overview; see overview.h)
+ */
+typedef struct viewport {
+	mcoord_t top, left; // the cell at the window's top left; -1 until placed
+	int rows, cols;     // its size; 0 to show the whole map
+	int scale;          // cells per glyph along each side; 1 but for spectators
+} viewport_t;
+
 /**************** player ****************/
 typedef struct player {
     addr_t addr;        // client address
@@ -30,7 +57,9 @@ typedef struct player {
     int gold;
     char letter;        // public identifier
     bool isActive;      // current in-game status
-    char *visibility;   // current field of vision
+    seen_t *seen;       // what they have seen of the map; see seen.h
+    int caps;           // protocol capabilities requested at PLAY
+    viewport_t view;    // window requested at PLAY; see map_buildPlayerView
 } player_t;
 
 /**************** gold ****************/
@@ -40,10 +69,30 @@ typedef struct gold {
 	position_t *pos;
 } gold_t;
 
+/**************** terrain ****************/
+/* the class of a cell, which is all movement and visibility look at */
+typedef enum terrain {
+	terrain_INVALID,    // not a map character; not allowed in a map file
+	terrain_ROCK,       // ' ': solid rock
+	terrain_FLOOR,      // '.': room floor
+	terrain_WALL,       // '-' or '|'; also the border around every map
+	terrain_CORNER,     // '+'
+	terrain_PASSAGE,    // '#'
+	terrain_NCLASSES    // the number of classes
+} terrain_t;
+
 /**************** map ****************/
 typedef struct map {
-	char *mapStr;       // string representation of file input
-	int width, height;
+	char *mapStr;       // string representation of file input (for rendering);
+	                    // NULL if the map is kept in tiles
+	mcoord_t width, height;
+	unsigned char *terrain;   // the class of every cell, with a border of wall,
+	                          // (width + 2) x (height + 2); NULL in copies and if tiled
+	struct tilemap *tiles;    // the cells, if the map is kept in tiles; else NULL
+	const mcoord_t *floor;    // index of every '.' cell, increasing; NULL in copies
+	int numFloor;
+	struct nmap *compiled;  // the compiled map this was loaded from, or NULL
+	int lightRadius;    // how far a player can see, in cells; 0 for no limit
 } map_t;
 
 
@@ -52,47 +101,140 @@ typedef struct map {
 /**************** map_new ****************/
 /*
 *	Initializes a new map from an open file to a map file
-*	Assumes the file is a valid map
+*	Rows end in newlines (the last need not; a carriage return before one
+*	is dropped), and rows shorter than the widest are padded with spaces
 *
-*	Mallocs new space for map struct and the map string, freed later on by map_delete
-*	Returns NULL if fp is NULL of malloc error
+*	Mallocs new space for map struct and the map string (counted as mem_MAP; see memory.h),
+*	freed later on by map_delete
+*	Returns NULL if fp is NULL, on malloc error, or if the file is not a map
+*	(it is empty, or has a character that cannot be part of a map),
+*	after printing why to stderr
 */
 map_t *map_new(FILE *fp);
 
 
+/**************** map_load ****************/
+/*
+*	Like map_new, but loads the map file at path in one go (see fmapfile)
+*	and parses it in a single pass, straight from the file's pages
+*
+*	If the file is a compiled map (see nmap.h), nothing is parsed: the map
+*	string, floor list and visibility table are used where they lie in the
+*	read-only mapping, which stays until map_delete
+*/
+map_t *map_load(const char *path);
+
+
+/**************** map_loadTiled ****************/
+/*
+*	Like map_load, but keeps the map in tiles whatever its size (map_load
+*	does so only past map_TiledCells), so that tests and benchmarks can
+*	compare the two on the same map; a compiled map is refused
+*/
+map_t *map_loadTiled(const char *path);
+
+
 /**************** map_buildPlayerMap ****************/
 /*
 *	Takes in original map and produces a copy of a map for a the provided player 
-*	Mallocs new space for newMap struct and the newMap string
+*	(the whole map, however big: a player on a tiled map should have a viewport)
+*	Mallocs new space for newMap struct and the newMap string,
+*	unless arena is not NULL: then both come from the arena, and the
+*	copy must not be passed to map_delete
 * 
 *	Returns NULL if map or player is NULL
 */
-map_t *map_buildPlayerMap(map_t *map, player_t *player, hashtable_t *goldData, hashtable_t *players);
+map_t *map_buildPlayerMap(map_t *map, player_t *player, hashtable_t *goldData, hashtable_t *players, arena_t *arena);
+
+
+/**************** map_buildPlayerView ****************/
+/*
+*	Like map_buildPlayerMap, but builds only the player's viewport: first
+*	scrolls it to keep them in view (see map_scrollView), then works out
+*	what they can see of it, merging that into their visibility, and
+*	renders it with the gold and players in sight; nothing outside the
+*	window is read or written, so the cost follows the window's size rather
+*	than the map's (lines of sight are traced only to cells in the window)
+*
+*	Returns NULL if map or player is NULL, or on malloc error; if the player
+*	has no viewport, returns map_buildPlayerMap's map
+*/
+map_t *map_buildPlayerView(map_t *map, player_t *player, hashtable_t *goldData, hashtable_t *players, arena_t *arena);
+
+
+/**************** map_scrollView ****************/
+/*
+*	Clips the viewport to the map's size and moves it, as little as it
+*	can, to keep a quarter of it (where the map allows) between pos and
+*	each edge; a viewport not yet placed is centred on pos
+*/
+void map_scrollView(map_t *map, viewport_t *view, position_t *pos);
+
+
+/**************** map_classify ****************/
+/*
+*	Returns the terrain class of map character c, from a lookup table
+*/
+terrain_t map_classify(char c);
+
+
+/**************** map_walkable / map_obstructs ****************/
+/*
+*	Returns whether a player may stand on terrain of class t, or whether it
+*	stops sight (beyond it, only a corner, or a passage seen from a passage)
+*/
+bool map_walkable(terrain_t t);
+bool map_obstructs(terrain_t t);
 
 
 /**************** map_calcPosition ****************/
 /*
 *	calculates the index in the string from position coordinates
+*	(the number of the cell, for a map kept in tiles)
 * 
-*	Returns NULL if map or pos is NULL
+*	Returns -1 if pos is off the map
+*/
+mcoord_t map_calcPosition(map_t *map, position_t *pos);
+
+
+/**************** map_readCells ****************/
+/*
+*	Copies the n cells from cell first on (as map_calcPosition numbers
+*	them, so a run may go on from one row to the next) into out, from the
+*	string or the tiles; cells past the end read as ' '
 */
-int map_calcPosition(map_t *map, position_t *pos);
+void map_readCells(map_t *map, mcoord_t first, mcoord_t n, char *out);
 
 
 /**************** buildMap ****************/
 /*
 *	Add back the new line characters for the client
 * 	Mallocs a new string for this output and must be deleted after use
+*	(and frees the map's string), unless arena is not NULL: then the
+*	string comes from the arena and the map's string is left alone
 * 
 *	Returns NULL if map is NULL
 */
-char *map_buildOutput(map_t *map);
+char *map_buildOutput(map_t *map, arena_t *arena);
 
 
 /***************** map_calculateVisibility *************/
 /*
 *   Loops through positions in map and passes each
 *    to map_calcVisPath to determine visibility from the passed position
+*    (or, for a compiled map with a visibility table, looks it up there)
+*
+*   If the map has a light radius, only positions within that distance
+*    of pos are looked at, and only cells within the square around pos
+*    that holds them are marked, whatever the size of the map
+*
+*   On a map kept in tiles, only positions in a box of tiles around pos
+*    are looked at: it starts as pos's tile, and grows a tile at a time on
+*    any side where a line of sight gets within two cells of its edge
+*    still unblocked, so the cost follows what can be seen rather than the
+*    size of the map (vis must still be as big as the map); lines are
+*    aimed up to a tile beyond the box, as on a flat map they are aimed
+*    at every position, however far
 */
 void map_calculateVisibility(map_t *map, char *vis, position_t *pos);
 
@@ -103,23 +245,53 @@ void map_calculateVisibility(map_t *map, char *vis, position_t *pos);
 * 	Function will update player_t player position if allowed
 * 	returns Nothing 
 * 
+*	Scratch space comes from the arena, if not NULL; with a light radius,
+*	or on a map kept in tiles, each step clears, computes and merges into
+*	the player's visibility only the box looked into (see
+*	map_calculateVisibility)
+*
+*	A player whose seen is NULL moves without looking; see map_lookAlong
+*
 *	Returns if map, player or nextPos is NULL
 */
-void map_movePlayer(map_t *map, player_t *player, position_t *nextPos, hashtable_t *goldData);
+void map_movePlayer(map_t *map, player_t *player, position_t *nextPos, hashtable_t *goldData, arena_t *arena);
+
+
+/**************** map_lookAlong ****************/
+/*
+*	Adds to what the player has seen what they would see from each cell
+*	of a straight run (as map_movePlayer makes) from one cell after from
+*	up to to, as map_movePlayer would have as they ran (or from to alone,
+*	if from is to); their position is left alone
+*
+*	This lets the moving and the looking be done on different threads
+*	(see the server's pipeline.h): one moves a player that does not
+*	look, and the other looks along the runs later
+*/
+void map_lookAlong(map_t *map, player_t *player, position_t *from, position_t *to, arena_t *arena);
 
 
 /**************** map_intToPos ****************/
 /*
 *   Takes a mapstring index integer and converts
 *    it to a position struct based on the passed map,
-*    returning that position
+*    returning that position, which the caller frees with count_free
+*/
+position_t *map_intToPos(map_t *map, mcoord_t i);
+
+
+/**************** map_cellToPos ****************/
+/*
+*   Like map_intToPos, but stores the position
+*    in the caller's struct instead of a new one
 */
-position_t *map_intToPos(map_t *map, int i);
+void map_cellToPos(map_t *map, mcoord_t i, position_t *pos);
 
 
 /**************** map_delete ****************/
 /*
-*	Frees the map struct and the string inside it 
+*	Frees the map struct and the string inside it (or its tiles)
+*	(or unmaps the compiled map it was loaded from)
 */
 void map_delete(map_t *map);
 
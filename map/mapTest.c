@@ -8,13 +8,22 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <inttypes.h>
 #include "map.h"
+#include "overview.h"
+#include "tilemap.h"
 #include "hashtable.h"
 
 /********** prototypes **********/
 player_t *makePlayer(map_t *map);
 void randPos(position_t *pos);
 bool checkValidMove(map_t *map, player_t *p);
+int checkLight(const char *path, int radius);
+int compareView(const char *path, int rows, int cols);
+int compareOverview(const char *path, int scale);
+int compareSeen(int width, int height);
+int compareTiled(const char *path);
+int checkWorld(const char *path, int copies, int gap);
 
 /********** main **********/
 int main(const int argc, const char *argv[])
@@ -22,7 +31,7 @@ int main(const int argc, const char *argv[])
 	FILE *fp = fopen("../maps/small.txt", "r");
 
 	map_t *map = map_new(fp);
-	printf("map width: %d, height: %d\n\n", map->width, map->height);
+	printf("map width: %" PRId64 ", height: %" PRId64 "\n\n", map->width, map->height);
 	
 	player_t *p = makePlayer(map);
 	map_t *plyrMap;
@@ -31,8 +40,8 @@ int main(const int argc, const char *argv[])
 	// Testing player movement 
 	for (int i = 0; i < 20; i++){
 		randPos(pos);
-		map_movePlayer(map, p, pos, hashtable_new(1));
-		plyrMap = map_buildPlayerMap(map,p,NULL, NULL);
+		map_movePlayer(map, p, pos, hashtable_new(1), NULL);
+		plyrMap = map_buildPlayerMap(map,p,NULL, NULL, NULL);
 
 		if (checkValidMove(map,p)){
 			printf(" -- Valid Move\n");
@@ -56,13 +65,37 @@ int main(const int argc, const char *argv[])
         if (p->pos != NULL) {
             free(p->pos);
         }
-        if (p->visibility != NULL) {
-            free(p->visibility);
-        }
+        seen_delete(p->seen);
         free(p);
     }
 
 	free(pos);
+
+	// Testing that a light radius only ever narrows what is seen
+	int strays = checkLight("../maps/main.txt", 5) + checkLight("../maps/hole.txt", 3);
+	printf("light radius visibility: %d cells out of place\n", strays);
+
+	// Testing that a viewport shows nothing the whole map would not there
+	int viewMismatches = compareView("../maps/main.txt", 10, 30) + compareView("../maps/hole.txt", 7, 20);
+	printf("viewport rendering: %d mismatches\n", viewMismatches);
+
+	// Testing that an overview kept up to date matches one made afresh
+	int overviewMismatches = compareOverview("../maps/main.txt", 1) + compareOverview("../maps/main.txt", 3)
+		+ compareOverview("../maps/hole.txt", 4);
+	printf("overview updates: %d mismatches\n", overviewMismatches);
+
+	// Testing that a sparse record of what was seen matches a flat string
+	int seenMismatches = compareSeen(79, 21) + compareSeen(150, 37);
+	printf("seen maps: %d mismatches\n", seenMismatches);
+
+	// Testing that a map kept in tiles looks and moves as a flat one, and
+	// that in a world of rock, sight from a spot does not go past its room
+	int tiledMismatches = compareTiled("../maps/main.txt") + compareTiled("../maps/hole.txt");
+	printf("tiled maps: %d mismatches\n", tiledMismatches);
+	int worldMismatches = checkWorld("../maps/main.txt", 3, 70) + checkWorld("../maps/hole.txt", 2, 100);
+	printf("tiled worlds: %d mismatches\n", worldMismatches);
+	return strays == 0 && viewMismatches == 0 && overviewMismatches == 0
+		&& seenMismatches == 0 && tiledMismatches == 0 && worldMismatches == 0 ? 0 : 1;
 }
 
 /********** makePlayer **********/
@@ -76,16 +109,12 @@ player_t *makePlayer(map_t *map)
 	// initialize player info
 	player->isActive = true;
 	player->gold = 0;
-	player->visibility = calloc(map->width * map->height + 1, sizeof(char));
+	player->seen = seen_new(map->width, map->height);
 
 	player->pos = malloc(sizeof(position_t));
 	player->pos->x = 7;
 	player->pos->y = 3;
 
-	for (int i = 0; i < map->width * map->height; i++) {
-		strcat(player->visibility, "0");
-	}
-
 	return player;
 }
 
@@ -97,7 +126,7 @@ void randPos(position_t *pos)
 {
 
 	int mv = rand() % 3;
-	printf("Moving Player from: (%d,%d) to ", pos->x, pos->y);
+	printf("Moving Player from: (%" PRId64 ",%" PRId64 ") to ", pos->x, pos->y);
 	// Vertical
 	if (mv == 0){
 		pos->y = rand() % 10;
@@ -111,7 +140,7 @@ void randPos(position_t *pos)
 		pos->x = rand() % 10;
 		pos->y = rand() % 10;
 	}
-	printf("(%d,%d)", pos->x, pos->y);
+	printf("(%" PRId64 ",%" PRId64 ")", pos->x, pos->y);
 }
 
 /********** checkValidMove **********/
@@ -126,3 +155,386 @@ bool checkValidMove(map_t *map, player_t *p)
 	}
 	return false;
 }
+
+/********** checkLight **********/
+/* load the map at path, and from every floor cell compare what can be seen
+ *  with the given light radius against what can be seen without one;
+ *  returns the number of cells seen in the light but not without it, or
+ *  farther than the radius from the player (leaving out the first and last
+ *  columns, where the map's positions wrap from one row to the next)
+ */
+int checkLight(const char *path, int radius)
+{
+	map_t *map = map_load(path);
+	if (map == NULL) {
+		printf("cannot load %s\n", path);
+		return 1;
+	}
+	int cells = map->width * map->height;
+	char *full = malloc(cells + 1);
+	char *lit = malloc(cells + 1);
+	full[cells] = lit[cells] = '\0';
+
+	int strays = 0;
+	for (int f = 0; f < map->numFloor; f++) {
+		mcoord_t i = map->floor[f];
+		position_t pos;
+		map_cellToPos(map, i, &pos);
+		memset(full, '0', cells);
+		map->lightRadius = 0;
+		map_calculateVisibility(map, full, &pos);
+		memset(lit, '0', cells);
+		map->lightRadius = radius;
+		map_calculateVisibility(map, lit, &pos);
+
+		for (int j = 0; j < cells; j++) {
+			int col = j % map->width;
+			if (lit[j] == '1' && col > 0 && col < map->width - 1
+			    && (full[j] == '0' || llabs(col - i % map->width) > radius
+			        || llabs(j / map->width - i / map->width) > radius)) {
+				strays++;
+			}
+		}
+	}
+	free(full);
+	free(lit);
+	map_delete(map);
+	return strays;
+}
+
+/********** compareView **********/
+/* load the map at path, and from every floor cell render what a player
+ *  who has seen nothing yet sees of the whole map, and of a viewport of
+ *  rows x cols; returns the number of cells where the viewport shows
+ *  something other than the same cell of the whole map (it may show less,
+ *  as it traces lines of sight only to cells in the window), or where it
+ *  does not show the player
+ */
+int compareView(const char *path, int rows, int cols)
+{
+	map_t *map = map_load(path);
+	if (map == NULL) {
+		printf("cannot load %s\n", path);
+		return 1;
+	}
+	position_t pos;
+	player_t p = {.pos = &pos, .isActive = true, .letter = 'A'};
+
+	int mismatches = 0;
+	for (int f = 0; f < map->numFloor; f++) {
+		map_cellToPos(map, map->floor[f], &pos);
+		p.seen = seen_new(map->width, map->height);
+		p.view = (viewport_t) {-1, -1, 0, 0, 1};
+		map_t *whole = map_buildPlayerMap(map, &p, NULL, NULL, NULL);
+		seen_delete(p.seen);
+
+		p.seen = seen_new(map->width, map->height);
+		p.view = (viewport_t) {-1, -1, rows, cols, 1};
+		map_t *view = map_buildPlayerView(map, &p, NULL, NULL, NULL);
+		seen_delete(p.seen);
+
+		for (int r = 0; r < view->height; r++) {
+			for (int c = 0; c < view->width; c++) {
+				char w = whole->mapStr[(p.view.top + r) * (map->width + 1) + p.view.left + c];
+				char v = view->mapStr[r * (view->width + 1) + c];
+				if ((v != ' ' && v != w) || (w == '@' && v != '@')) {
+					mismatches++;
+				}
+			}
+		}
+		map_delete(whole);
+		map_delete(view);
+	}
+	map_delete(map);
+	return mismatches;
+}
+
+/********** compareOverview **********/
+/* load the map at path, put gold and two players on it, and keep an
+ *  overview at scale up to date as one player walks over the floor, picking
+ *  up gold, and the other leaves; after each change compare it with an
+ *  overview made afresh (and at scale 1 with the spectator's map), and
+ *  return the number of times they differ
+ */
+int compareOverview(const char *path, int scale)
+{
+	map_t *map = map_load(path);
+	if (map == NULL) {
+		printf("cannot load %s\n", path);
+		return 1;
+	}
+	hashtable_t *gold = hashtable_new(4);
+	hashtable_t *players = hashtable_new(4);
+	gold_t piles[3];
+	position_t pilePos[3], playerPos[2];
+	player_t p[2];
+	char key[2] = "0";
+	for (int g = 0; g < 3; g++) {
+		map_cellToPos(map, map->floor[(g + 1) * map->numFloor / 5], &pilePos[g]);
+		piles[g] = (gold_t) {10, false, &pilePos[g]};
+		key[0] = '0' + g;
+		hashtable_insert(gold, key, &piles[g]);
+	}
+	for (int i = 0; i < 2; i++) {
+		map_cellToPos(map, map->floor[i * map->numFloor / 2], &playerPos[i]);
+		p[i] = (player_t) {.pos = &playerPos[i], .isActive = true, .letter = 'A' + i};
+		key[0] = 'a' + i;
+		hashtable_insert(players, key, &p[i]);
+	}
+
+	overview_t *ov = overview_new(map, scale, gold);
+	int mismatches = 0;
+	for (int f = 0; f < map->numFloor; f++) {
+		// A walks; where it lands on gold, it picks it up; halfway, B leaves
+		map_cellToPos(map, map->floor[f], &playerPos[0]);
+		if (p[1].isActive && playerPos[0].x == playerPos[1].x && playerPos[0].y == playerPos[1].y) {
+			continue;		// no two players share a cell
+		}
+		for (int g = 0; g < 3; g++) {
+			if (pilePos[g].x == playerPos[0].x && pilePos[g].y == playerPos[0].y) {
+				piles[g].isCollected = true;
+			}
+		}
+		if (f > map->numFloor / 2) {
+			p[1].isActive = false;
+		}
+		overview_update(ov, players);
+
+		overview_t *fresh = overview_new(map, scale, gold);
+		overview_update(fresh, players);
+		if (strcmp(ov->grid, fresh->grid) != 0) {
+			mismatches++;
+		}
+		overview_delete(fresh);
+		if (scale == 1) {
+			map_t *spec = map_buildPlayerMap(map, NULL, gold, players, NULL);
+			if (strcmp(ov->grid, spec->mapStr) != 0) {
+				mismatches++;
+			}
+			map_delete(spec);
+		}
+	}
+	overview_delete(ov);
+	hashtable_delete(gold, NULL);
+	hashtable_delete(players, NULL);
+	map_delete(map);
+	return mismatches;
+}
+
+/********** compareSeen **********/
+/* merge random patches of '1's, over random runs of cells, into both a
+ *  seen_t and a flat string for a width x height map, and return the
+ *  number of cells where they differ, by seen_get or by seen_hide
+ */
+int compareSeen(int width, int height)
+{
+	int cells = width * height;
+	seen_t *seen = seen_new(width, height);
+	char *flat = malloc(cells + 1);
+	char *vis = malloc(cells + 1);
+	char *out = malloc(cells + 1);
+	memset(flat, '0', cells);
+
+	int mismatches = 0;
+	for (int round = 0; round < 200; round++) {
+		// a patch of what can be seen now, and the run of it to merge
+		memset(vis, '0', cells);
+		int centre = rand() % cells, size = rand() % (2 * width);
+		for (int i = centre - size; i <= centre + size; i++) {
+			if (i >= 0 && i < cells && rand() % 3 != 0) {
+				vis[i] = '1';
+			}
+		}
+		int first = rand() % cells, last = first + rand() % (cells - first);
+		seen_merge(seen, vis + first, first, last - first + 1);
+		for (int i = first; i <= last; i++) {
+			if (vis[i] == '1') {
+				flat[i] = '1';
+			}
+		}
+
+		for (int i = 0; i < cells; i++) {
+			if (seen_get(seen, i) != (flat[i] == '1')) {
+				mismatches++;
+			}
+		}
+		first = rand() % cells;
+		int n = rand() % (cells - first) + 1;
+		memset(out, 'x', n);
+		seen_hide(seen, out, first, n);
+		for (int i = 0; i < n; i++) {
+			if ((out[i] == ' ') != (flat[first + i] == '0')) {
+				mismatches++;
+			}
+		}
+	}
+	seen_delete(seen);
+	free(flat);
+	free(vis);
+	free(out);
+	return mismatches;
+}
+
+/********** compareTiled **********/
+/* load the map at path both flat and in tiles, and from every floor cell
+ *  compare what can be seen, what a player who has seen nothing yet is
+ *  shown of the whole map and of a viewport, and where a run to the right
+ *  and one down end; returns the number of cells and runs that differ
+ */
+int compareTiled(const char *path)
+{
+	map_t *flat = map_load(path);
+	map_t *tiled = map_loadTiled(path);
+	if (flat == NULL || tiled == NULL || tiled->tiles == NULL) {
+		printf("cannot load %s\n", path);
+		map_delete(flat);
+		map_delete(tiled);
+		return 1;
+	}
+	mcoord_t cells = flat->width * flat->height;
+	char *flatVis = malloc(cells + 1);
+	char *tiledVis = malloc(cells + 1);
+	flatVis[cells] = tiledVis[cells] = '\0';
+	position_t pos;
+	player_t p = {.pos = &pos, .isActive = true, .letter = 'A'};
+
+	int mismatches = 0;
+	for (int f = 0; f < flat->numFloor; f++) {
+		map_cellToPos(flat, flat->floor[f], &pos);
+		memset(flatVis, '0', cells);
+		map_calculateVisibility(flat, flatVis, &pos);
+		memset(tiledVis, '0', cells);
+		map_calculateVisibility(tiled, tiledVis, &pos);
+		for (mcoord_t j = 0; j < cells; j++) {
+			mismatches += flatVis[j] != tiledVis[j];
+		}
+
+		for (int rows = 0; rows <= 7; rows += 7) {
+			map_t *rendered[2];
+			for (int m = 0; m < 2; m++) {
+				p.seen = seen_new(flat->width, flat->height);
+				p.view = (viewport_t) {-1, -1, rows, 2 * rows, 1};
+				rendered[m] = map_buildPlayerView(m == 0 ? flat : tiled, &p, NULL, NULL, NULL);
+				seen_delete(p.seen);
+			}
+			mismatches += strcmp(rendered[0]->mapStr, rendered[1]->mapStr) != 0;
+			map_delete(rendered[0]);
+			map_delete(rendered[1]);
+		}
+
+		p.seen = NULL;
+		for (int run = 0; run < 2; run++) {
+			position_t start = pos, end[2];
+			for (int m = 0; m < 2; m++) {
+				pos = start;
+				end[m] = (position_t) {pos.x + (run == 0) * 1000, pos.y + (run == 1) * 1000};
+				map_movePlayer(m == 0 ? flat : tiled, &p, &end[m], NULL, NULL);
+			}
+			mismatches += end[0].x != end[1].x || end[0].y != end[1].y;
+			pos = start;
+		}
+	}
+	free(flatVis);
+	free(tiledVis);
+	map_delete(flat);
+	map_delete(tiled);
+	return mismatches;
+}
+
+/********** checkWorld **********/
+/* write a world of copies x copies of the map at path, each with gap
+ *  cells of rock around it, and load it (in tiles); from every floor cell
+ *  of the middle copy, check that nothing outside the copy can be seen,
+ *  and that all the map itself shows from the same cell is seen (lines
+ *  aimed further in the world may see a little more along walls), leaving
+ *  out the map's first and last columns (where its positions wrap from
+ *  one row to the next); returns the number of cells wrongly seen or
+ *  missed, plus one if any tile of nothing but the rock between was
+ *  allocated
+ */
+int checkWorld(const char *path, int copies, int gap)
+{
+	static const char *WorldPath = "world.tmp";
+	map_t *map = map_load(path);
+	FILE *fp = fopen(WorldPath, "w");
+	if (map == NULL || fp == NULL) {
+		printf("cannot make a world of %s\n", path);
+		map_delete(map);
+		if (fp != NULL) {
+			fclose(fp);
+		}
+		return 1;
+	}
+	mcoord_t width = gap + copies * (map->width + gap);
+	mcoord_t height = gap + copies * (map->height + gap);
+	char *row = malloc(width + 1);
+	for (mcoord_t y = 0; y < height; y++) {
+		memset(row, ' ', width);
+		mcoord_t inCopy = (y - gap) % (map->height + gap);
+		if (y >= gap && inCopy < map->height) {
+			for (int c = 0; c < copies; c++) {
+				map_readCells(map, inCopy * map->width, map->width, row + gap + c * (map->width + gap));
+			}
+		}
+		fwrite(row, 1, width, fp);
+		fputc('\n', fp);
+	}
+	fclose(fp);
+	free(row);
+	map_t *world = map_loadTiled(WorldPath);
+	remove(WorldPath);
+	if (world == NULL) {
+		printf("cannot load the world of %s\n", path);
+		map_delete(map);
+		return 1;
+	}
+
+	// only the tiles the copies touch are allocated
+	int mismatches = 0;
+	mcoord_t touched = 0;
+	for (mcoord_t ty = 0; ty < world->tiles->tilesDown; ty++) {
+		for (mcoord_t tx = 0; tx < world->tiles->tilesAcross; tx++) {
+			bool any = false;
+			for (mcoord_t y = ty * tile_Size; y < (ty + 1) * tile_Size && y < height; y++) {
+				mcoord_t inCopy = (y - gap) % (map->height + gap);
+				for (int c = 0; c < copies && y >= gap && inCopy < map->height; c++) {
+					mcoord_t left = gap + c * (map->width + gap);
+					any = any || (left < (tx + 1) * tile_Size && left + map->width > tx * tile_Size);
+				}
+			}
+			touched += any;
+		}
+	}
+	mismatches += world->tiles->numTiles > touched;
+
+	mcoord_t cells = map->width * map->height, worldCells = width * height;
+	mcoord_t ox = gap + copies / 2 * (map->width + gap), oy = gap + copies / 2 * (map->height + gap);
+	char *vis = malloc(cells + 1);
+	char *worldVis = malloc(worldCells + 1);
+	vis[cells] = worldVis[worldCells] = '\0';
+	for (int f = 0; f < map->numFloor; f++) {
+		position_t pos, worldPos;
+		map_cellToPos(map, map->floor[f], &pos);
+		map_cellToPos(world, (map->floor[f] / map->width + oy) * width + map->floor[f] % map->width + ox,
+		              &worldPos);
+		memset(vis, '0', cells);
+		map_calculateVisibility(map, vis, &pos);
+		memset(worldVis, '0', worldCells);
+		map_calculateVisibility(world, worldVis, &worldPos);
+
+		// every cell seen in the world is in the copy, and every one the map sees is seen
+		for (mcoord_t j = 0; j < worldCells; j++) {
+			mcoord_t col = j % width - ox, r = j / width - oy;
+			if (col < 0 || col >= map->width || r < 0 || r >= map->height) {
+				mismatches += worldVis[j] == '1';
+			} else if (col > 0 && col < map->width - 1) {
+				mismatches += vis[r * map->width + col] == '1' && worldVis[j] != '1';
+			}
+		}
+	}
+	free(vis);
+	free(worldVis);
+	map_delete(map);
+	map_delete(world);
+	return mismatches;
+}
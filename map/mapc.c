@@ -0,0 +1,48 @@
+/* mapc.c -- compile a map file into a .nmap (see nmap.h)
+ *
+ * usage: ./mapc [--visibility] map.txt map.nmap
+ *
+ * The compiled map loads without parsing; with --visibility it also holds
+ * what can be seen from every spot a player may stand, so the server
+ * looks visibility up instead of tracing it.  Exits 0 on success, 1 on
+ * bad arguments, 2 if the map cannot be read, 3 if it cannot be compiled.
+ *
+ * Nuggets: Bash Boys
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include "map.h"
+#include "nmap.h"
+
+/********** main **********/
+int main(const int argc, const char *argv[])
+{
+	bool withVisibility = false;
+	int arg = 1;
+	if (arg < argc && strcmp(argv[arg], "--visibility") == 0) {
+		withVisibility = true;
+		arg++;
+	}
+	if (argc - arg != 2) {
+		fprintf(stderr, "usage: %s [--visibility] map.txt map.nmap\n", argv[0]);
+		return 1;
+	}
+	const char *in = argv[arg];
+	const char *out = argv[arg + 1];
+
+	map_t *map = map_load(in);
+	if (map == NULL) {
+		return 2;
+	}
+	bool ok = nmap_write(map, out, withVisibility);
+	if (ok) {
+		printf("%s: %" PRId64 " x %" PRId64 ", %d floor cells%s\n", out, map->height, map->width,
+		       map->numFloor, withVisibility ? ", with visibility" : "");
+	}
+	map_delete(map);
+	return ok ? 0 : 3;
+}
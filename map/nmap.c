@@ -0,0 +1,288 @@
+/*
+* nmap.c -- implementation of compiled maps
+*
+* See nmap.h for the format, and mapc.c for the tool that writes it
+*
+* Nuggets: Bash Boys
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "nmap.h"
+#include "map.h"
+#include "file.h"
+#include "jhash.h"
+#include "memory.h"
+
+_Static_assert(sizeof(mcoord_t) == sizeof(int64_t), "floor cells are stored as int64");
+
+/**************** Constants ****************/
+static const uint32_t ByteOrder = 0x01020304;
+static const uint64_t ChecksumSeed = 0;
+static const size_t MaxVisibilityBytes = 256 << 20;	// largest table mapc will build
+
+/**************** Private Functions ****************/
+static size_t align8(size_t n);
+static bool fillVisibility(map_t *map, const unsigned char *walkable,
+                           int32_t *visIndex, unsigned char *visibility, size_t rowBytes);
+
+
+/**************** nmap_recognize ****************/
+bool nmap_recognize(const char *data, size_t len)
+{
+	return data != NULL && len >= sizeof(nmap_header_t)
+		&& memcmp(data, nmap_Magic, sizeof(((nmap_header_t *) 0)->magic)) == 0;
+}
+
+
+/**************** nmap_open ****************/
+nmap_t *nmap_open(filedata_t *file, const char *name)
+{
+	const char *why = NULL;
+	const nmap_header_t *h = (const nmap_header_t *) file->data;
+
+	// check the header, then that each section is where it should be
+	if (!nmap_recognize(file->data, file->len)) {
+		why = "not a compiled map";
+	} else if (h->byteOrder != ByteOrder) {
+		why = "compiled on a machine of the other byte order";
+	} else if (h->version != nmap_Version) {
+		why = "compiled for another version of the server; run mapc again";
+	} else if (h->width == 0 || h->height == 0
+	           || (uint64_t) h->width * h->height >= INT32_MAX) {
+		why = "bad dimensions";
+	} else {
+		uint64_t cells = (uint64_t) h->width * h->height;
+		uint64_t bitmapBytes = (cells + 7) / 8;
+		uint64_t expect[nmap_NSECTIONS] = {
+			[nmap_GRID] = cells + 1,
+			[nmap_WALKABLE] = bitmapBytes,
+			[nmap_OBSTRUCTS] = bitmapBytes,
+			[nmap_FLOOR] = (uint64_t) h->numFloor * sizeof(int64_t),
+			[nmap_TERRAIN] = ((uint64_t) h->width + 2) * (h->height + 2),
+			[nmap_VISINDEX] = h->numVisRows > 0 ? cells * sizeof(int32_t) : 0,
+			[nmap_VISIBILITY] = h->numVisRows * bitmapBytes,
+		};
+		for (int s = 0; s < nmap_NSECTIONS && why == NULL; s++) {
+			if (h->section[s].bytes != expect[s]) {
+				why = "a section is the wrong size";
+			} else if (h->section[s].offset % 8 != 0
+			           || h->section[s].offset < sizeof(nmap_header_t)
+			           || h->section[s].offset > file->len
+			           || h->section[s].bytes > file->len - h->section[s].offset) {
+				why = "truncated or corrupt";
+			}
+		}
+		if (why == NULL && MemoryHash(file->data + sizeof(nmap_header_t),
+		                              file->len - sizeof(nmap_header_t), ChecksumSeed) != h->checksum) {
+			why = "checksum mismatch";
+		} else if (why == NULL && file->data[h->section[nmap_GRID].offset + cells] != '\0') {
+			why = "the grid is not terminated";
+		}
+	}
+	if (why != NULL) {
+		fprintf(stderr, "%s: %s\n", name, why);
+		funmapfile(file);
+		return NULL;
+	}
+
+	nmap_t *nm = count_mallocTag(sizeof(nmap_t), mem_MAP);
+	if (nm == NULL) {
+		funmapfile(file);
+		return NULL;
+	}
+	nm->file = *file;
+	nm->header = h;
+	nm->grid = file->data + h->section[nmap_GRID].offset;
+	nm->walkable = (const unsigned char *) file->data + h->section[nmap_WALKABLE].offset;
+	nm->obstructs = (const unsigned char *) file->data + h->section[nmap_OBSTRUCTS].offset;
+	nm->floor = (const int64_t *) (file->data + h->section[nmap_FLOOR].offset);
+	nm->terrain = (const unsigned char *) file->data + h->section[nmap_TERRAIN].offset;
+	if (h->numVisRows > 0) {
+		nm->visIndex = (const int32_t *) (file->data + h->section[nmap_VISINDEX].offset);
+		nm->visibility = (const unsigned char *) file->data + h->section[nmap_VISIBILITY].offset;
+	} else {
+		nm->visIndex = NULL;
+		nm->visibility = NULL;
+	}
+	nm->visRowBytes = ((size_t) h->width * h->height + 7) / 8;
+	return nm;
+}
+
+
+/**************** nmap_visibility ****************/
+bool nmap_visibility(const nmap_t *nm, mcoord_t i, char *vis)
+{
+	mcoord_t cells = nm->header->width * nm->header->height;
+	if (nm->visIndex == NULL || i < 0 || i >= cells || nm->visIndex[i] < 0) {
+		return false;
+	}
+
+	// spread the row's bits out into the string, a byte (8 cells) at a time
+	const unsigned char *row = nm->visibility + (size_t) nm->visIndex[i] * nm->visRowBytes;
+	for (int byte = 0; byte < nm->visRowBytes; byte++) {
+		unsigned char bits = row[byte];
+		for (int cell = byte * 8; bits != 0; bits >>= 1, cell++) {
+			if (bits & 1) {
+				vis[cell] = '1';
+			}
+		}
+	}
+	return true;
+}
+
+
+/**************** nmap_write ****************/
+bool nmap_write(map_t *map, const char *path, bool withVisibility)
+{
+	if (map->tiles != NULL) {
+		fprintf(stderr, "%s: a map this big is kept in tiles, and cannot be compiled\n", path);
+		return false;
+	}
+	size_t cells = (size_t) map->width * map->height;
+	size_t bitmapBytes = (cells + 7) / 8;
+
+	// every walkable cell gets a row of the visibility table
+	size_t numWalkable = 0;
+	for (size_t i = 0; i < cells; i++) {
+		numWalkable += map_walkable(map_classify(map->mapStr[i]));
+	}
+	size_t numVisRows = withVisibility ? numWalkable : 0;
+	if (numVisRows > 0 && numVisRows > MaxVisibilityBytes / bitmapBytes) {
+		fprintf(stderr, "%s: a visibility table for this map would take %zu MB; "
+		        "compile it without one\n", path, numVisRows * (bitmapBytes >> 10) >> 10);
+		return false;
+	}
+
+	// lay out the sections
+	nmap_header_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, nmap_Magic, sizeof(header.magic));
+	header.version = nmap_Version;
+	header.byteOrder = ByteOrder;
+	header.width = map->width;
+	header.height = map->height;
+	header.numFloor = map->numFloor;
+	header.numVisRows = numVisRows;
+	header.section[nmap_GRID].bytes = cells + 1;
+	header.section[nmap_WALKABLE].bytes = bitmapBytes;
+	header.section[nmap_OBSTRUCTS].bytes = bitmapBytes;
+	header.section[nmap_FLOOR].bytes = (size_t) map->numFloor * sizeof(int64_t);
+	header.section[nmap_TERRAIN].bytes = ((size_t) map->width + 2) * (map->height + 2);
+	header.section[nmap_VISINDEX].bytes = numVisRows > 0 ? cells * sizeof(int32_t) : 0;
+	header.section[nmap_VISIBILITY].bytes = numVisRows * bitmapBytes;
+	size_t len = align8(sizeof(header));
+	for (int s = 0; s < nmap_NSECTIONS; s++) {
+		header.section[s].offset = len;
+		len += align8(header.section[s].bytes);
+	}
+
+	// build the whole file in memory
+	char *data = count_callocTag(len, 1, mem_MAP);
+	if (data == NULL) {
+		fprintf(stderr, "%s: out of memory\n", path);
+		return false;
+	}
+	memcpy(data + header.section[nmap_GRID].offset, map->mapStr, cells + 1);
+	unsigned char *walkable = (unsigned char *) data + header.section[nmap_WALKABLE].offset;
+	unsigned char *obstructs = (unsigned char *) data + header.section[nmap_OBSTRUCTS].offset;
+	for (size_t i = 0; i < cells; i++) {
+		terrain_t t = map_classify(map->mapStr[i]);
+		walkable[i / 8] |= map_walkable(t) << (i % 8);
+		obstructs[i / 8] |= map_obstructs(t) << (i % 8);
+	}
+	memcpy(data + header.section[nmap_FLOOR].offset, map->floor, header.section[nmap_FLOOR].bytes);
+	memcpy(data + header.section[nmap_TERRAIN].offset, map->terrain, header.section[nmap_TERRAIN].bytes);
+	if (numVisRows > 0
+	    && !fillVisibility(map, walkable,
+	                       (int32_t *) (data + header.section[nmap_VISINDEX].offset),
+	                       (unsigned char *) data + header.section[nmap_VISIBILITY].offset, bitmapBytes)) {
+		// an unfilled table would tell players they see nothing
+		fprintf(stderr, "%s: out of memory for the visibility table\n", path);
+		count_free(data);
+		return false;
+	}
+	header.checksum = MemoryHash(data + sizeof(header), len - sizeof(header), ChecksumSeed);
+	memcpy(data, &header, sizeof(header));
+
+	// write it beside the old one, then swap it in
+	size_t tmpLen = strlen(path) + 5;
+	char *tmp = count_mallocTag(tmpLen, mem_OTHER);
+	bool ok = false;
+	if (tmp != NULL) {
+		snprintf(tmp, tmpLen, "%s.tmp", path);
+		FILE *fp = fopen(tmp, "wb");
+		if (fp != NULL) {
+			ok = fwrite(data, 1, len, fp) == len;
+			ok = fclose(fp) == 0 && ok;
+			ok = ok && rename(tmp, path) == 0;
+			if (!ok) {
+				remove(tmp);
+			}
+		}
+		count_free(tmp);
+	}
+	if (!ok) {
+		fprintf(stderr, "%s: cannot write the compiled map\n", path);
+	}
+	count_free(data);
+	return ok;
+}
+
+
+/**************** nmap_close ****************/
+void nmap_close(nmap_t *nm)
+{
+	if (nm != NULL) {
+		funmapfile(&nm->file);
+		count_free(nm);
+	}
+}
+
+
+/********** helper: fillVisibility **********/
+/* computes, for every walkable cell, what a player there can see, as
+ * map_calculateVisibility does, and packs it into the table's rows;
+ * returns false, with the table unfilled, if out of memory
+ */
+bool fillVisibility(map_t *map, const unsigned char *walkable,
+                    int32_t *visIndex, unsigned char *visibility, size_t rowBytes)
+{
+	int cells = map->width * map->height;
+	char *vis = count_mallocTag(cells + 1, mem_VISIBILITY);
+	if (vis == NULL) {
+		return false;
+	}
+	vis[cells] = '\0';
+
+	int32_t row = 0;
+	for (int i = 0; i < cells; i++) {
+		if ((walkable[i / 8] >> (i % 8) & 1) == 0) {
+			visIndex[i] = -1;
+			continue;
+		}
+		position_t pos;
+		map_cellToPos(map, i, &pos);
+		memset(vis, '0', cells);
+		map_calculateVisibility(map, vis, &pos);
+
+		unsigned char *bits = visibility + (size_t) row * rowBytes;
+		for (int cell = 0; cell < cells; cell++) {
+			bits[cell / 8] |= (vis[cell] == '1') << (cell % 8);
+		}
+		visIndex[i] = row++;
+	}
+	count_free(vis);
+	return true;
+}
+
+
+/********** helper: align8 **********/
+/* rounds n up to a multiple of 8 */
+size_t align8(size_t n)
+{
+	return (n + 7) & ~(size_t) 7;
+}
@@ -0,0 +1,134 @@
+/*
+ * nmap.h -- header file for compiled maps
+ *
+ * A compiled map (.nmap) is a map file run through mapc, laid out so the
+ * server can map it into memory read-only and use it where it lies:
+ * nothing is parsed or derived at startup, and every server process
+ * loading the same .nmap shares the same physical pages.
+ *
+ * The file is a header followed by sections, each 8-byte aligned:
+ *	grid		the map string, width*height cells and a null
+ *	walkable	one bit per cell, set where a player may stand ('.' or '#')
+ *	obstructs	one bit per cell, set where sight stops (see map.c)
+ *	floor		the index of every '.' cell, increasing, as int64s
+ *	terrain		the class of every cell (see map.h), with a border of wall
+ *	visindex	(optional) for each cell, its row in visibility, or -1
+ *	visibility	(optional) for each walkable cell, one bit per cell of the
+ *			map, set where a player standing there can see
+ * All integers are in the byte order of the machine that wrote the file;
+ * the header records which, as it does the format's version and a
+ * checksum of everything after the header.
+ *
+ * Nuggets: Bash Boys
+ */
+
+
+#ifndef __NMAP_H
+#define __NMAP_H
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "file.h"
+#include "map.h"
+
+
+/******************************** CONSTANTS ********************************/
+#define nmap_Magic "NUGGMAP\n"	// first 8 bytes of every .nmap
+#define nmap_Version 3		// bumped whenever the layout changes
+
+
+/******************************** DATA STRUCTS ********************************/
+
+/**************** sections ****************/
+typedef enum nmap_section {
+	nmap_GRID, nmap_WALKABLE, nmap_OBSTRUCTS, nmap_FLOOR, nmap_TERRAIN,
+	nmap_VISINDEX, nmap_VISIBILITY,
+	nmap_NSECTIONS
+} nmap_section_t;
+
+/**************** header ****************/
+/* exactly as it lies at the start of the file */
+typedef struct nmap_header {
+	char magic[8];		// nmap_Magic
+	uint32_t version;	// nmap_Version
+	uint32_t byteOrder;	// 0x01020304, as the writer stored it
+	uint32_t width, height;
+	uint32_t numFloor;	// entries in the floor section
+	uint32_t numVisRows;	// rows in the visibility section; 0 if none
+	uint64_t checksum;	// MemoryHash (see jhash.h) of the bytes after the header
+	struct {
+		uint64_t offset;	// from the start of the file
+		uint64_t bytes;		// 0 if the section is absent
+	} section[nmap_NSECTIONS];
+} nmap_header_t;
+
+/**************** nmap ****************/
+/* a compiled map in memory; every pointer is into the (read-only) file */
+typedef struct nmap {
+	filedata_t file;		// the whole file
+	const nmap_header_t *header;
+	const char *grid;
+	const unsigned char *walkable;
+	const unsigned char *obstructs;
+	const int64_t *floor;
+	const unsigned char *terrain;
+	const int32_t *visIndex;	// NULL if the file has no visibility
+	const unsigned char *visibility;
+	size_t visRowBytes;		// bytes per row of visibility
+} nmap_t;
+
+
+/******************************** FUNCTIONS ********************************/
+
+/**************** nmap_recognize ****************/
+/*
+*	Returns true if the len bytes at data start like a compiled map
+*/
+bool nmap_recognize(const char *data, size_t len);
+
+
+/**************** nmap_open ****************/
+/*
+*	Takes over a file loaded with fmapfile (see file.h) that holds a compiled
+*	map, and checks its header, the bounds of each section and its checksum
+*
+*	Returns the compiled map, to be released with nmap_close, or NULL (after
+*	printing why to stderr, naming the file as name, and releasing the file)
+*	if it is not a compiled map this version can read
+*/
+nmap_t *nmap_open(filedata_t *file, const char *name);
+
+
+/**************** nmap_visibility ****************/
+/*
+*	Marks with '1', in the visibility string vis, every cell visible from
+*	the cell at index i (as map_calcPosition gives), from the compiled table
+*
+*	Returns false, leaving vis alone, if the table has no row for that cell
+*/
+bool nmap_visibility(const nmap_t *nm, mcoord_t i, char *vis);
+
+
+/**************** nmap_write ****************/
+/*
+*	Compiles map into a .nmap at path, with the visibility table if asked;
+*	writes a temporary file and renames it into place, so servers that have
+*	the old file mapped keep their (unchanged) copy
+*
+*	Returns false, after printing why to stderr, if the map is kept in
+*	tiles (see map.h), is too big for the table asked for, there is no
+*	memory to build it, or the file cannot be written; nothing is left at
+*	path, or beside it, but the old file
+*/
+bool nmap_write(map_t *map, const char *path, bool withVisibility);
+
+
+/**************** nmap_close ****************/
+/*
+*	Unmaps the file and frees the struct
+*/
+void nmap_close(nmap_t *nm);
+
+
+#endif // __NMAP_H
@@ -0,0 +1,254 @@
+/*
+* overview.c -- implementation of spectator overviews
+*
+* See overview.h for more details
+*
+* Nuggets: Bash Boys
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "overview.h"
+#include "map.h"
+#include "hashtable.h"
+#include "memory.h"
+
+/**************** Constants ****************/
+/* what the cells of a block hold, a bit each, while summarizing terrain */
+enum { HasCorner = 0x1, HasHorizontal = 0x2, HasVertical = 0x4, HasFloor = 0x8, HasPassage = 0x10 };
+
+/**************** Private Functions ****************/
+static int blockOf(overview_t *ov, position_t *pos);
+static char terrainGlyph(unsigned char has);
+static void redraw(overview_t *ov, int block);
+
+
+/**************** overview_new ****************/
+overview_t *overview_new(map_t *map, int scale, hashtable_t *goldData)
+{
+	if (map == NULL || scale < 1) {
+		return NULL;
+	}
+	overview_t *ov = count_callocTag(1, sizeof(overview_t), mem_RENDER);
+	if (ov == NULL) {
+		return NULL;
+	}
+	ov->map = map;
+	ov->scale = scale;
+	ov->rows = (map->height + scale - 1) / scale;
+	ov->cols = (map->width + scale - 1) / scale;
+	size_t blocks = (size_t) ov->rows * ov->cols;
+
+	// note the gold, wherever it is
+	void *item;
+	for (hashtable_cursor_t c = hashtable_cursor(goldData); hashtable_next(goldData, &c, NULL, &item); ) {
+		ov->numPiles++;
+	}
+	ov->grid = count_mallocTag((size_t) ov->rows * (ov->cols + 1) + 1, mem_RENDER);
+	ov->terrain = count_callocTag(blocks, 1, mem_RENDER);
+	ov->players = count_callocTag(blocks, sizeof(uint32_t), mem_RENDER);
+	ov->gold = count_callocTag(blocks, 1, mem_RENDER);
+	ov->piles = count_mallocTag((ov->numPiles > 0 ? ov->numPiles : 1) * sizeof(gold_t *), mem_RENDER);
+	ov->pileBlock = count_mallocTag((ov->numPiles > 0 ? ov->numPiles : 1) * sizeof(int), mem_RENDER);
+	if (ov->grid == NULL || ov->terrain == NULL || ov->players == NULL || ov->gold == NULL
+	    || ov->piles == NULL || ov->pileBlock == NULL) {
+		overview_delete(ov);
+		return NULL;
+	}
+
+	// summarize the terrain in one pass over the map, a row at a time (from
+	// the string or the tiles): first what each block holds, then the glyph
+	// that stands for it
+	char *row = count_mallocTag(map->width, mem_RENDER);
+	if (row == NULL) {
+		overview_delete(ov);
+		return NULL;
+	}
+	for (mcoord_t y = 0; y < map->height; y++) {
+		map_readCells(map, y * map->width, map->width, row);
+		char *has = ov->terrain + (size_t) (y / scale) * ov->cols;
+		for (mcoord_t x = 0; x < map->width; x++) {
+			switch (row[x]) {
+				case '+': has[x / scale] |= HasCorner; break;
+				case '-': has[x / scale] |= HasHorizontal; break;
+				case '|': has[x / scale] |= HasVertical; break;
+				case '.': has[x / scale] |= HasFloor; break;
+				case '#': has[x / scale] |= HasPassage; break;
+			}
+		}
+	}
+	count_free(row);
+	for (size_t b = 0; b < blocks; b++) {
+		ov->terrain[b] = terrainGlyph(ov->terrain[b]);
+	}
+
+	// the gold goes on top
+	int p = 0;
+	for (hashtable_cursor_t c = hashtable_cursor(goldData); hashtable_next(goldData, &c, NULL, &item); p++) {
+		gold_t *g = item;
+		ov->piles[p] = g;
+		ov->pileBlock[p] = g->isCollected ? -1 : blockOf(ov, g->pos);
+		if (ov->pileBlock[p] >= 0 && ov->gold[ov->pileBlock[p]] < 255) {
+			ov->gold[ov->pileBlock[p]]++;
+		}
+	}
+	for (int l = 0; l < 26; l++) {
+		ov->playerBlock[l] = -1;
+	}
+
+	// draw every block once; from now on, only those that change
+	for (int r = 0; r < ov->rows; r++) {
+		ov->grid[r * (ov->cols + 1) + ov->cols] = '\n';
+	}
+	ov->grid[ov->rows * (ov->cols + 1)] = '\0';
+	for (size_t b = 0; b < blocks; b++) {
+		redraw(ov, b);
+	}
+	return ov;
+}
+
+
+/**************** overview_update ****************/
+void overview_update(overview_t *ov, hashtable_t *players)
+{
+	if (ov == NULL) {
+		return;
+	}
+
+	// move the players that have moved, joined or left
+	bool active[26] = {false};
+	void *item;
+	for (hashtable_cursor_t c = hashtable_cursor(players); hashtable_next(players, &c, NULL, &item); ) {
+		player_t *player = item;
+		int l = player->letter - 'A';
+		if (!player->isActive || l < 0 || l >= 26) {
+			continue;
+		}
+		active[l] = true;
+		int block = blockOf(ov, player->pos);
+		if (block != ov->playerBlock[l]) {
+			if (ov->playerBlock[l] >= 0) {
+				ov->players[ov->playerBlock[l]] &= ~(1u << l);
+				redraw(ov, ov->playerBlock[l]);
+			}
+			ov->players[block] |= 1u << l;
+			redraw(ov, block);
+			ov->playerBlock[l] = block;
+		}
+	}
+	for (int l = 0; l < 26; l++) {
+		if (!active[l] && ov->playerBlock[l] >= 0) {
+			ov->players[ov->playerBlock[l]] &= ~(1u << l);
+			redraw(ov, ov->playerBlock[l]);
+			ov->playerBlock[l] = -1;
+		}
+	}
+
+	// and take away the gold that has been collected
+	for (int p = 0; p < ov->numPiles; p++) {
+		int block = ov->pileBlock[p];
+		if (block >= 0 && ov->piles[p]->isCollected) {
+			ov->gold[block]--;
+			redraw(ov, block);
+			ov->pileBlock[p] = -1;
+		}
+	}
+}
+
+
+/**************** overview_follow ****************/
+void overview_follow(overview_t *ov, viewport_t *view, position_t *pos)
+{
+	// the grid, as a map of glyphs, and the block as a position in it
+	// (a column to the left; see map_calcPosition)
+	int block = blockOf(ov, pos);
+	map_t glyphs = {.width = ov->cols, .height = ov->rows};
+	position_t at = {block % ov->cols - 1, block / ov->cols};
+	map_scrollView(&glyphs, view, &at);
+}
+
+
+/**************** overview_window ****************/
+void overview_window(overview_t *ov, viewport_t *view, char *out)
+{
+	for (int r = 0; r < view->rows; r++) {
+		memcpy(out, ov->grid + (size_t) (view->top + r) * (ov->cols + 1) + view->left, view->cols);
+		out += view->cols;
+		*out++ = '\n';
+	}
+	*out = '\0';
+}
+
+
+/**************** overview_delete ****************/
+void overview_delete(overview_t *ov)
+{
+	if (ov != NULL) {
+		if (ov->grid != NULL) {
+			count_free(ov->grid);
+		}
+		if (ov->terrain != NULL) {
+			count_free(ov->terrain);
+		}
+		if (ov->players != NULL) {
+			count_free(ov->players);
+		}
+		if (ov->gold != NULL) {
+			count_free(ov->gold);
+		}
+		if (ov->piles != NULL) {
+			count_free(ov->piles);
+		}
+		if (ov->pileBlock != NULL) {
+			count_free(ov->pileBlock);
+		}
+		count_free(ov);
+	}
+}
+
+
+/********** helper: blockOf **********/
+/* the block holding pos */
+int blockOf(overview_t *ov, position_t *pos)
+{
+	mcoord_t i = map_calcPosition(ov->map, pos);
+	mcoord_t row = i / ov->map->width, col = i % ov->map->width;
+	return (row / ov->scale) * ov->cols + col / ov->scale;
+}
+
+
+/********** helper: terrainGlyph **********/
+/* the glyph for a block holding the kinds of cell in has: walls outrank
+ * floor, and floor passages, so rooms keep their outlines at any scale
+ */
+char terrainGlyph(unsigned char has)
+{
+	if ((has & HasCorner) || ((has & HasHorizontal) && (has & HasVertical))) {
+		return '+';
+	} else if (has & HasHorizontal) {
+		return '-';
+	} else if (has & HasVertical) {
+		return '|';
+	} else if (has & HasFloor) {
+		return '.';
+	} else if (has & HasPassage) {
+		return '#';
+	}
+	return ' ';
+}
+
+
+/********** helper: redraw **********/
+/* redraws one block: the lowest letter of its players, else gold, else terrain */
+void redraw(overview_t *ov, int block)
+{
+	char glyph = ov->terrain[block];
+	if (ov->players[block] != 0) {
+		glyph = 'A' + __builtin_ctz(ov->players[block]);
+	} else if (ov->gold[block] > 0) {
+		glyph = '*';
+	}
+	ov->grid[(block / ov->cols) * (ov->cols + 1) + block % ov->cols] = glyph;
+}
@@ -0,0 +1,94 @@
+/*
+ * overview.h -- header file for spectator overviews
+ *
+ * An overview is the whole map drawn at a scale: each of its glyphs
+ * stands for a block of scale x scale cells, and shows the lowest letter
+ * of the players in the block, else '*' if it holds gold, else what its
+ * terrain mostly is (walls outrank floor, so rooms keep their outlines).
+ * At scale 1 it is the spectator's usual view, one glyph per cell.
+ *
+ * The overview keeps its rendered grid, and for each block the players
+ * and piles of gold in it; overview_update moves only the blocks whose
+ * players or gold have changed since the last update, so a frame costs
+ * the number of entities and changes, not the size of the map. The
+ * terrain is summarized once, when the overview is made.
+ *
+ * Nuggets: Bash Boys
+ */
+
+
+#ifndef __OVERVIEW_H
+#define __OVERVIEW_H
+
+
+#include <stdint.h>
+#include "map.h"
+#include "hashtable.h"
+
+
+/******************************** DATA STRUCTS ********************************/
+
+/**************** overview ****************/
+typedef struct overview {
+	int scale;              // cells per glyph, along each side
+	int rows, cols;         // in glyphs
+	char *grid;             // rows lines of cols glyphs, each followed by a newline
+	char *terrain;          // the terrain glyph of every block
+	uint32_t *players;      // the letters of the players in each block, a bit each
+	unsigned char *gold;    // uncollected piles in each block
+	int playerBlock[26];    // the block each player is shown in, by letter; -1 if none
+	gold_t **piles;         // every pile of gold, and the block it is shown in (or -1)
+	int *pileBlock;
+	int numPiles;
+	map_t *map;
+} overview_t;
+
+
+/******************************** FUNCTIONS ********************************/
+
+/**************** overview_new ****************/
+/*
+*	Creates an overview of map at the given scale (at least 1), summarizing
+*	its terrain, and takes note of every pile of gold in goldData, which
+*	must not gain piles afterwards; the players are added by the first
+*	overview_update. Everything is counted as mem_RENDER
+*
+*	Returns NULL on malloc error
+*/
+overview_t *overview_new(map_t *map, int scale, hashtable_t *goldData);
+
+
+/**************** overview_update ****************/
+/*
+*	Brings the overview up to date with the active players in players and
+*	the gold noted by overview_new, redrawing only the blocks a player has
+*	entered or left, or where gold has been collected
+*/
+void overview_update(overview_t *ov, hashtable_t *players);
+
+
+/**************** overview_follow ****************/
+/*
+*	Clips view (in glyphs) to the grid, and scrolls it as map_scrollView
+*	does to keep the block holding pos in it, centring it the first time
+*/
+void overview_follow(overview_t *ov, viewport_t *view, position_t *pos);
+
+
+/**************** overview_window ****************/
+/*
+*	Copies the window of the grid given by view (whose top, left, rows and
+*	cols are in glyphs) into out, each row followed by a newline, then a
+*	null; out must have room for view->rows * (view->cols + 1) + 1 bytes
+*/
+void overview_window(overview_t *ov, viewport_t *view, char *out);
+
+
+/**************** overview_delete ****************/
+/*
+*	Frees the overview (but not the map or gold it was made from)
+*/
+void overview_delete(overview_t *ov);
+
+
+#endif // __OVERVIEW_H
@@ -0,0 +1,207 @@
+/*
+* seen.c -- implementation of what a player has seen of a map
+*
+* See seen.h for more details
+*
+* Nuggets: Bash Boys
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "seen.h"
+#include "memory.h"
+
+/**************** Private Functions ****************/
+static uint64_t *findChunk(const seen_t *seen, int64_t row, int64_t col);
+static uint64_t *addChunk(seen_t *seen, int64_t row, int64_t col);
+static int64_t segmentEnd(const seen_t *seen, int64_t i, int64_t last);
+
+
+/**************** seen_new ****************/
+seen_t *seen_new(int64_t width, int64_t height)
+{
+	if (width <= 0 || height <= 0) {
+		return NULL;
+	}
+	seen_t *seen = count_mallocTag(sizeof(seen_t), mem_VISIBILITY);
+	if (seen == NULL) {
+		return NULL;
+	}
+	seen->width = width;
+	seen->height = height;
+	seen->chunksAcross = (width + seen_ChunkCols - 1) / seen_ChunkCols;
+	int64_t chunksDown = (height + seen_ChunkRows - 1) / seen_ChunkRows;
+	seen->words = (seen->chunksAcross * chunksDown + 63) / 64;
+	seen->occupied = count_callocTag(seen->words, sizeof(uint64_t), mem_VISIBILITY);
+	seen->before = count_callocTag(seen->words, sizeof(int), mem_VISIBILITY);
+	seen->chunks = NULL;
+	seen->numChunks = seen->capacity = 0;
+	if (seen->occupied == NULL || seen->before == NULL) {
+		seen_delete(seen);
+		return NULL;
+	}
+	return seen;
+}
+
+
+/**************** seen_get ****************/
+bool seen_get(const seen_t *seen, int64_t i)
+{
+	if (i < 0 || i >= seen->width * seen->height) {
+		return false;
+	}
+	int64_t row = i / seen->width, col = i % seen->width;
+	const uint64_t *chunk = findChunk(seen, row, col);
+	return chunk != NULL && (chunk[row % seen_ChunkRows] >> (col % seen_ChunkCols) & 1);
+}
+
+
+/**************** seen_merge ****************/
+bool seen_merge(seen_t *seen, const char *vis, int64_t first, int64_t n)
+{
+	int64_t last = first + n - 1;
+	if (first < 0) {
+		vis -= first;
+		first = 0;
+	}
+	if (last >= seen->width * seen->height) {
+		last = seen->width * seen->height - 1;
+	}
+
+	// a run of cells at a time, within one row of one chunk
+	for (int64_t i = first; i <= last; ) {
+		int64_t end = segmentEnd(seen, i, last);
+		uint64_t bits = 0;
+		for (int64_t j = i; j <= end; j++) {
+			bits |= (uint64_t) (vis[j - first] == '1') << (j - i);
+		}
+		if (bits != 0) {
+			int64_t row = i / seen->width, col = i % seen->width;
+			uint64_t *chunk = findChunk(seen, row, col);
+			if (chunk == NULL && (chunk = addChunk(seen, row, col)) == NULL) {
+				return false;
+			}
+			chunk[row % seen_ChunkRows] |= bits << (col % seen_ChunkCols);
+		}
+		i = end + 1;
+	}
+	return true;
+}
+
+
+/**************** seen_hide ****************/
+void seen_hide(const seen_t *seen, char *out, int64_t first, int64_t n)
+{
+	int64_t last = first + n - 1;
+	for (int64_t i = first; i <= last; ) {
+		int64_t end = segmentEnd(seen, i, last);
+		int64_t row = i / seen->width, col = i % seen->width;
+		const uint64_t *chunk = i < seen->width * seen->height ? findChunk(seen, row, col) : NULL;
+		if (chunk == NULL) {
+			memset(out + (i - first), ' ', end - i + 1);
+		} else {
+			uint64_t bits = chunk[row % seen_ChunkRows] >> (col % seen_ChunkCols);
+			for (int64_t j = i; j <= end; j++, bits >>= 1) {
+				if ((bits & 1) == 0) {
+					out[j - first] = ' ';
+				}
+			}
+		}
+		i = end + 1;
+	}
+}
+
+
+/**************** seen_bytes ****************/
+size_t seen_bytes(const seen_t *seen)
+{
+	return sizeof(seen_t) + seen->words * (sizeof(uint64_t) + sizeof(int))
+		+ (size_t) seen->capacity * seen_ChunkRows * sizeof(uint64_t);
+}
+
+
+/**************** seen_delete ****************/
+void seen_delete(seen_t *seen)
+{
+	if (seen != NULL) {
+		if (seen->occupied != NULL) {
+			count_free(seen->occupied);
+		}
+		if (seen->before != NULL) {
+			count_free(seen->before);
+		}
+		if (seen->chunks != NULL) {
+			count_free(seen->chunks);
+		}
+		count_free(seen);
+	}
+}
+
+
+/********** helper: findChunk **********/
+/* the chunk holding the cell at row, col, or NULL if nothing in it has
+ * been seen; it is the one after all the allocated chunks before it
+ */
+uint64_t *findChunk(const seen_t *seen, int64_t row, int64_t col)
+{
+	int64_t k = (row / seen_ChunkRows) * seen->chunksAcross + col / seen_ChunkCols;
+	uint64_t word = seen->occupied[k / 64], bit = (uint64_t) 1 << (k % 64);
+	if ((word & bit) == 0) {
+		return NULL;
+	}
+	int slot = seen->before[k / 64] + __builtin_popcountll(word & (bit - 1));
+	return seen->chunks + (size_t) slot * seen_ChunkRows;
+}
+
+
+/********** helper: addChunk **********/
+/* allocates the (empty) chunk holding the cell at row, col, moving the
+ * chunks after it along; returns it, or NULL on malloc error
+ */
+uint64_t *addChunk(seen_t *seen, int64_t row, int64_t col)
+{
+	if (seen->numChunks == seen->capacity) {
+		int capacity = seen->capacity > 0 ? seen->capacity * 2 : 4;
+		uint64_t *chunks = count_mallocTag((size_t) capacity * seen_ChunkRows * sizeof(uint64_t),
+		                                   mem_VISIBILITY);
+		if (chunks == NULL) {
+			return NULL;
+		}
+		if (seen->chunks != NULL) {
+			memcpy(chunks, seen->chunks, (size_t) seen->numChunks * seen_ChunkRows * sizeof(uint64_t));
+			count_free(seen->chunks);
+		}
+		seen->chunks = chunks;
+		seen->capacity = capacity;
+	}
+
+	int64_t k = (row / seen_ChunkRows) * seen->chunksAcross + col / seen_ChunkCols;
+	uint64_t bit = (uint64_t) 1 << (k % 64);
+	int slot = seen->before[k / 64] + __builtin_popcountll(seen->occupied[k / 64] & (bit - 1));
+	uint64_t *chunk = seen->chunks + (size_t) slot * seen_ChunkRows;
+	memmove(chunk + seen_ChunkRows, chunk,
+	        (size_t) (seen->numChunks - slot) * seen_ChunkRows * sizeof(uint64_t));
+	memset(chunk, 0, seen_ChunkRows * sizeof(uint64_t));
+	seen->occupied[k / 64] |= bit;
+	for (int64_t w = k / 64 + 1; w < seen->words; w++) {
+		seen->before[w]++;
+	}
+	seen->numChunks++;
+	return chunk;
+}
+
+
+/********** helper: segmentEnd **********/
+/* the last cell, no further than last, in the same row and chunk as cell i */
+int64_t segmentEnd(const seen_t *seen, int64_t i, int64_t last)
+{
+	int64_t col = i % seen->width;
+	int64_t end = i + (seen_ChunkCols - 1 - col % seen_ChunkCols);
+	if (end > i + (seen->width - 1 - col)) {
+		end = i + (seen->width - 1 - col);
+	}
+	return end < last ? end : last;
+}
@@ -0,0 +1,103 @@
+/*
+ * seen.h -- header file for what a player has seen of a map
+ *
+ * A player used to remember what they had seen in a string as big as the
+ * map, a byte per cell, kept for the whole game however little of the map
+ * they explored; with many players on a big map those strings were most
+ * of the server's memory.  A seen_t keeps a bit per cell instead, in
+ * chunks of seen_ChunkRows x seen_ChunkCols cells, and allocates a chunk
+ * only when the player first sees into it.  Which chunks exist is a
+ * bitmap with a bit per chunk (and a running count per word of it, to
+ * find a chunk among those allocated), so an unexplored part of the map
+ * costs under a quarter of a byte per 512 cells.
+ *
+ * Cells are numbered as in the map string (see map_calcPosition): the
+ * cell at row r, column c is r * width + c, a 64-bit number however big
+ * the map.  Visibility is computed into strings of '0' and '1' as before,
+ * and merged in with seen_merge, a chunk row (64 cells) at a time.
+ *
+ * Nuggets: Bash Boys
+ */
+
+
+#ifndef __SEEN_H
+#define __SEEN_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/******************************** CONSTANTS ********************************/
+#define seen_ChunkRows 8			// a chunk is 8 rows of 64 cells,
+#define seen_ChunkCols 64			// a row to a 64-bit word
+
+
+/******************************** DATA STRUCTS ********************************/
+
+/**************** seen ****************/
+typedef struct seen {
+	int64_t width, height;		// of the map, in cells
+	int64_t chunksAcross;		// chunks per band of seen_ChunkRows rows
+	int64_t words;			// in occupied (and before)
+	uint64_t *occupied;		// a bit per chunk, set once it is allocated
+	int *before;			// for each word of occupied, the chunks allocated in earlier words
+	uint64_t *chunks;		// the allocated chunks, in chunk order, seen_ChunkRows words each
+	int numChunks, capacity;	// allocated, and room for
+} seen_t;
+
+
+/******************************** FUNCTIONS ********************************/
+
+/**************** seen_new ****************/
+/*
+*	Creates a record of nothing seen, for a map of width x height cells,
+*	counted as mem_VISIBILITY
+*
+*	Returns NULL on malloc error
+*/
+seen_t *seen_new(int64_t width, int64_t height);
+
+
+/**************** seen_get ****************/
+/*
+*	Returns whether cell i has been seen
+*/
+bool seen_get(const seen_t *seen, int64_t i);
+
+
+/**************** seen_merge ****************/
+/*
+*	Marks seen each of the n cells first, first + 1, ... whose character
+*	in vis (vis[0] standing for cell first) is '1'; chunks with nothing
+*	seen in them are not allocated
+*
+*	Returns false on malloc error, having merged what it could
+*/
+bool seen_merge(seen_t *seen, const char *vis, int64_t first, int64_t n);
+
+
+/**************** seen_hide ****************/
+/*
+*	Blanks (to ' ') each of the n characters of out standing for cells
+*	first, first + 1, ... that have not been seen
+*/
+void seen_hide(const seen_t *seen, char *out, int64_t first, int64_t n);
+
+
+/**************** seen_bytes ****************/
+/*
+*	Returns the bytes the record takes, chunks and bookkeeping together
+*/
+size_t seen_bytes(const seen_t *seen);
+
+
+/**************** seen_delete ****************/
+/*
+*	Frees the record
+*/
+void seen_delete(seen_t *seen);
+
+
+#endif // __SEEN_H
@@ -0,0 +1,161 @@
+/*
+* tilemap.c -- implementation of tiled maps
+*
+* See tilemap.h for more details
+*
+* Nuggets: Bash Boys
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "tilemap.h"
+#include "memory.h"
+
+/**************** Private Functions ****************/
+static tcoord_t tileIndex(const tilemap_t *tm, tcoord_t x, tcoord_t y);
+static tcoord_t runEnd(tcoord_t x, tcoord_t n);
+
+
+/**************** tilemap_new ****************/
+tilemap_t *tilemap_new(tcoord_t width, tcoord_t height)
+{
+	if (width <= 0 || height <= 0) {
+		return NULL;
+	}
+	tcoord_t across = (width + tile_Size - 1) >> tile_Shift;
+	tcoord_t down = (height + tile_Size - 1) >> tile_Shift;
+	if (across > SIZE_MAX / sizeof(tile_t *) / down) {
+		return NULL;
+	}
+
+	tilemap_t *tm = count_mallocTag(sizeof(tilemap_t), mem_MAP);
+	tile_t **tiles = count_callocTag(across * down, sizeof(tile_t *), mem_MAP);
+	if (tm == NULL || tiles == NULL) {
+		if (tm != NULL) {
+			count_free(tm);
+		}
+		if (tiles != NULL) {
+			count_free(tiles);
+		}
+		return NULL;
+	}
+	tm->width = width;
+	tm->height = height;
+	tm->tilesAcross = across;
+	tm->tilesDown = down;
+	tm->tiles = tiles;
+	tm->numTiles = 0;
+	return tm;
+}
+
+
+/**************** tilemap_get ****************/
+char tilemap_get(const tilemap_t *tm, tcoord_t x, tcoord_t y)
+{
+	tcoord_t t = tileIndex(tm, x, y);
+	if (t < 0 || tm->tiles[t] == NULL) {
+		return ' ';
+	}
+	return tm->tiles[t]->cell[(y & (tile_Size - 1)) * tile_Size + (x & (tile_Size - 1))];
+}
+
+
+/**************** tilemap_getRow ****************/
+void tilemap_getRow(const tilemap_t *tm, tcoord_t x, tcoord_t y, tcoord_t n, char *out)
+{
+	for (tcoord_t end = x + n; x < end; ) {
+		tcoord_t stop = runEnd(x, end - x);
+		tcoord_t t = tileIndex(tm, x, y);
+		if (t < 0 || tm->tiles[t] == NULL) {
+			memset(out, ' ', stop - x);
+		} else {
+			memcpy(out, tm->tiles[t]->cell + (y & (tile_Size - 1)) * tile_Size + (x & (tile_Size - 1)),
+			       stop - x);
+		}
+		out += stop - x;
+		x = stop;
+	}
+}
+
+
+/**************** tilemap_setRow ****************/
+bool tilemap_setRow(tilemap_t *tm, tcoord_t x, tcoord_t y, tcoord_t n, const char *cells)
+{
+	if (x < 0 || n < 0 || x + n > tm->width || y < 0 || y >= tm->height) {
+		return false;
+	}
+	for (tcoord_t end = x + n; x < end; ) {
+		tcoord_t stop = runEnd(x, end - x);
+		tcoord_t t = tileIndex(tm, x, y);
+		if (tm->tiles[t] == NULL) {
+			tcoord_t i = 0;
+			while (i < stop - x && cells[i] == ' ') {
+				i++;
+			}
+			if (i == stop - x) {
+				cells += stop - x;
+				x = stop;
+				continue;		// rock already
+			}
+			tm->tiles[t] = count_mallocTag(sizeof(tile_t), mem_MAP);
+			if (tm->tiles[t] == NULL) {
+				return false;
+			}
+			memset(tm->tiles[t]->cell, ' ', tile_Cells);
+			tm->numTiles++;
+		}
+		memcpy(tm->tiles[t]->cell + (y & (tile_Size - 1)) * tile_Size + (x & (tile_Size - 1)),
+		       cells, stop - x);
+		cells += stop - x;
+		x = stop;
+	}
+	return true;
+}
+
+
+/**************** tilemap_bytes ****************/
+size_t tilemap_bytes(const tilemap_t *tm)
+{
+	return sizeof(tilemap_t) + tm->tilesAcross * tm->tilesDown * sizeof(tile_t *)
+		+ tm->numTiles * sizeof(tile_t);
+}
+
+
+/**************** tilemap_delete ****************/
+void tilemap_delete(tilemap_t *tm)
+{
+	if (tm != NULL) {
+		for (tcoord_t t = 0; t < tm->tilesAcross * tm->tilesDown; t++) {
+			if (tm->tiles[t] != NULL) {
+				count_free(tm->tiles[t]);
+			}
+		}
+		count_free(tm->tiles);
+		count_free(tm);
+	}
+}
+
+
+/********** helper: tileIndex **********/
+/* the index in the table of the tile holding column x, row y, or -1 if
+ * that is outside the map
+ */
+tcoord_t tileIndex(const tilemap_t *tm, tcoord_t x, tcoord_t y)
+{
+	if (x < 0 || y < 0 || x >= tm->width || y >= tm->height) {
+		return -1;
+	}
+	return (y >> tile_Shift) * tm->tilesAcross + (x >> tile_Shift);
+}
+
+
+/********** helper: runEnd **********/
+/* the column after the last of the n from x on that is in x's tile */
+tcoord_t runEnd(tcoord_t x, tcoord_t n)
+{
+	tcoord_t next = (x | (tile_Size - 1)) + 1;
+	return next < x + n ? next : x + n;
+}
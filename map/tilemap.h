@@ -0,0 +1,100 @@
+/*
+ * tilemap.h -- header file for tiled maps
+ *
+ * The flat map (map.h) keeps every cell in one string as big as the map,
+ * which does not scale to worlds of 10,000 x 10,000 and more.  A tilemap
+ * cuts the world into tiles of tile_Size x tile_Size cells and allocates
+ * a tile only when something is put in it: a tile that is all solid rock
+ * (' ') is never allocated, so memory follows what has been built rather
+ * than the area of the world.  The map module keeps a big map in a
+ * tilemap (see map_TiledCells in map.h); this is only its storage.
+ *
+ * Coordinates are 64-bit column (x) and row (y) numbers of cells from the
+ * top left; unlike the map's positions, x is the column itself.
+ *
+ * Nuggets: Bash Boys
+ */
+
+
+#ifndef __TILEMAP_H
+#define __TILEMAP_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/******************************** CONSTANTS ********************************/
+#define tile_Shift 6				// tiles are 64 x 64 cells
+#define tile_Size (1 << tile_Shift)
+#define tile_Cells (tile_Size * tile_Size)
+
+
+/******************************** DATA STRUCTS ********************************/
+
+/**************** tcoord ****************/
+typedef int64_t tcoord_t;
+
+/**************** tile ****************/
+/* one tile of cells, row by row */
+typedef struct tile {
+	char cell[tile_Cells];
+} tile_t;
+
+/**************** tilemap ****************/
+typedef struct tilemap {
+	tcoord_t width, height;			// in cells
+	tcoord_t tilesAcross, tilesDown;	// in tiles
+	tile_t **tiles;				// tilesAcross x tilesDown, row by row; NULL where all rock
+	long numTiles;				// how many are allocated
+} tilemap_t;
+
+
+/******************************** FUNCTIONS ********************************/
+
+/**************** tilemap_new ****************/
+/*
+*	Creates a width x height world of solid rock; allocates only the
+*	table of tiles (one pointer per tile), counted as mem_MAP
+*
+*	Returns NULL if either dimension is not positive, or on malloc error
+*/
+tilemap_t *tilemap_new(tcoord_t width, tcoord_t height);
+
+
+/**************** tilemap_get ****************/
+/*
+*	Returns the cell at column x, row y; ' ' (rock) anywhere outside the map
+*/
+char tilemap_get(const tilemap_t *tm, tcoord_t x, tcoord_t y);
+
+
+/**************** tilemap_getRow / tilemap_setRow ****************/
+/*
+*	tilemap_getRow copies the n cells of row y from column x on into out,
+*	a tile's run at a time; cells outside the map read as ' '
+*
+*	tilemap_setRow stores the n cells of cells there, allocating each tile
+*	they fall in unless their run of it is all rock; returns false if the
+*	run is not all in the map, or on malloc error
+*/
+void tilemap_getRow(const tilemap_t *tm, tcoord_t x, tcoord_t y, tcoord_t n, char *out);
+bool tilemap_setRow(tilemap_t *tm, tcoord_t x, tcoord_t y, tcoord_t n, const char *cells);
+
+
+/**************** tilemap_bytes ****************/
+/*
+*	Returns the bytes the tilemap holds: its table and the tiles allocated
+*/
+size_t tilemap_bytes(const tilemap_t *tm);
+
+
+/**************** tilemap_delete ****************/
+/*
+*	Frees the tilemap and every tile in it
+*/
+void tilemap_delete(tilemap_t *tm);
+
+
+#endif // __TILEMAP_H
@@ -0,0 +1,151 @@
+/* visbench.c -- measure what a move costs, with and without a light radius
+ *
+ * usage: ./visbench [--tiled] map.txt...
+ *   typically given every map in ../maps, and a big one or two; with
+ *   --tiled, every map is kept in tiles (see map_loadTiled), as big ones are
+ *
+ * For each map we walk a player back and forth between pairs of floor
+ * cells spread through the map, one step at a time with map_movePlayer,
+ * which computes what the player sees from each new spot and merges it
+ * into what they have seen.  We report the CPU time per move with full
+ * visibility and with each of a few light radii (see map.h): the first
+ * grows with the area of the map, the others only with the radius.
+ * Each measurement runs at least MinSeconds, and at least one move.
+ *
+ * Nuggets: Bash Boys
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include "map.h"
+
+/**************** Constants ****************/
+static const double MinSeconds = 0.2;		// time each mode at least this long
+static const int MaxPairs = 64;			// pairs of cells to walk between
+static const int Radii[] = {0, 4, 8, 16, 32};	// 0 for full visibility
+#define NumRadii (int) (sizeof(Radii) / sizeof(Radii[0]))
+
+/**************** Private Functions ****************/
+static int findPairs(map_t *map, mcoord_t *pairs);
+static double timeMoves(map_t *map, player_t *player, const mcoord_t *pairs, int numPairs);
+static double cpuNow(void);
+
+
+/********** main **********/
+int main(const int argc, const char *argv[])
+{
+	int first = 1;
+	bool tiled = first < argc && strcmp(argv[first], "--tiled") == 0;
+	if (tiled) {
+		first++;
+	}
+	if (argc - first < 1) {
+		fprintf(stderr, "usage: %s [--tiled] map.txt...\n", argv[0]);
+		return 1;
+	}
+
+	printf("%-24s %11s", "map", "size");
+	for (int r = 0; r < NumRadii; r++) {
+		char heading[16];
+		if (Radii[r] == 0) {
+			snprintf(heading, sizeof(heading), "full us");
+		} else {
+			snprintf(heading, sizeof(heading), "R=%d us", Radii[r]);
+		}
+		printf(" %10s", heading);
+	}
+	printf("\n");
+
+	for (int m = first; m < argc; m++) {
+		map_t *map = tiled ? map_loadTiled(argv[m]) : map_load(argv[m]);
+		if (map == NULL) {
+			continue;
+		}
+		mcoord_t pairs[MaxPairs];
+		int numPairs = findPairs(map, pairs);
+		if (numPairs == 0) {
+			fprintf(stderr, "%s: no two floor cells side by side\n", argv[m]);
+			map_delete(map);
+			continue;
+		}
+
+		position_t pos;
+		player_t player = {.pos = &pos, .isActive = true, .letter = 'A'};
+
+		const char *name = strrchr(argv[m], '/') ? strrchr(argv[m], '/') + 1 : argv[m];
+		char size[24];
+		snprintf(size, sizeof(size), "%" PRId64 "x%" PRId64, map->height, map->width);
+		printf("%-24.24s %11s", name, size);
+		for (int r = 0; r < NumRadii; r++) {
+			player.seen = seen_new(map->width, map->height);
+			if (player.seen == NULL) {
+				fprintf(stderr, "%s: out of memory\n", argv[m]);
+				break;
+			}
+			map->lightRadius = Radii[r];
+			printf(" %10.1f", timeMoves(map, &player, pairs, numPairs));
+			fflush(stdout);
+			seen_delete(player.seen);
+		}
+		printf("\n");
+
+		map_delete(map);
+	}
+	return 0;
+}
+
+
+/********** helper: findPairs **********/
+/* fills pairs with up to MaxPairs floor cells, spread evenly through the
+ * map's floor, each with floor just to its right; returns how many
+ */
+int findPairs(map_t *map, mcoord_t *pairs)
+{
+	int numPairs = 0;
+	int stride = map->numFloor / MaxPairs > 0 ? map->numFloor / MaxPairs : 1;
+	for (int f = 0; f + 1 < map->numFloor && numPairs < MaxPairs; f += stride) {
+		mcoord_t i = map->floor[f];
+		if (map->floor[f + 1] == i + 1 && (i + 1) % map->width != 0) {
+			pairs[numPairs++] = i;
+		}
+	}
+	return numPairs;
+}
+
+
+/********** helper: timeMoves **********/
+/* returns the CPU microseconds per move of stepping the player right from
+ * each pair's first cell and back again
+ */
+double timeMoves(map_t *map, player_t *player, const mcoord_t *pairs, int numPairs)
+{
+	long moves = 0;
+	double start = cpuNow();
+	double elapsed;
+	int p = 0;
+	do {
+		map_cellToPos(map, pairs[p], player->pos);
+		position_t next = {player->pos->x + 1, player->pos->y};
+		map_movePlayer(map, player, &next, NULL, NULL);
+		next.x -= 1;
+		map_movePlayer(map, player, &next, NULL, NULL);
+		moves += 2;
+		p = (p + 1) % numPairs;
+		elapsed = cpuNow() - start;
+	} while (elapsed < MinSeconds);
+	return elapsed * 1e6 / moves;
+}
+
+
+/********** helper: cpuNow **********/
+double cpuNow(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
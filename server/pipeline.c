@@ -0,0 +1,604 @@
+/*
+ * pipeline.c - the server's stages, each on its own thread(s)
+ *
+ * see pipeline.h for more information.
+ *
+ * Group 7 - Bash Boys
+ */
+
+#define _POSIX_C_SOURCE 200809L     // for clock_gettime, semaphores and barriers
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include "pipeline.h"
+#include "ring.h"
+#include "memory.h"
+#include "log.h"
+
+/**************** Constants ****************/
+static const int IntakeSlots = 4096;    // messages waiting for the simulation, at most
+static const int OutboxSlots = 4096;    // messages from one thread waiting for the sender, at most
+#define Fresh 4                         // in ready, with a snapshot's index: not yet taken
+
+/********* Data Structures **********/
+/* a message waiting for the simulation */
+typedef struct input {
+    addr_t from;
+    double queued;          // when the network thread copied it
+    char text[];
+} input_t;
+
+/* a message waiting for the sender, as it was sent */
+typedef enum outKind { out_TEXT, out_BYTES, out_LATEST } outKind_t;
+typedef struct output {
+    addr_t to;
+    outKind_t kind;
+    int tag;                // for out_LATEST
+    long epoch;             // see outbox_t
+    double queued;          // when the stage sent it
+    size_t len;
+    unsigned char bytes[];  // a text message keeps its null
+} output_t;
+
+/* a thread's ring to the sender; what it sends is stamped with epoch:
+ * for the simulation, the snapshots published before it was sent, and
+ * for a renderer, the snapshot it was drawn from
+ */
+typedef struct outbox {
+    pipeline_t *pipe;
+    ring_t *ring;
+    long epoch;
+    long pushed;            // messages put on the ring
+} outbox_t;
+
+/* a snapshot, numbered from 1 in the order published */
+typedef struct snap {
+    long epoch;
+    double published;
+    max_align_t data[];     // the game's snapBytes
+} snap_t;
+
+/* one render worker; worker 0 also takes each snapshot and shares out its jobs */
+typedef struct worker {
+    pipeline_t *pipe;
+    int index;
+    pthread_t thread;
+    outbox_t outbox;
+} worker_t;
+
+/* one stage's running totals, each updated by one thread (but drops,
+ * which any thread sending may count) and read by any
+ */
+typedef struct counts {
+    atomic_long items;
+    atomic_llong totalNanos;
+    atomic_llong maxNanos;
+    atomic_int maxDepth;
+    atomic_long drops;
+} counts_t;
+
+struct pipeline {
+    pipelineGame_t game;
+    ring_t *intake;             // network thread -> simulation
+    outbox_t simOutbox;         // simulation -> sender
+    worker_t *workers;          // each with an outbox -> sender
+    int numWorkers;
+    int started;                // workers whose threads are running
+    pthread_t simThread, sendThread;
+    bool simStarted, sendStarted;
+    sem_t simWake, renderWake, sendWake;
+    sem_t renderGo;             // lets the render workers start, once all have been created
+    pthread_barrier_t startJobs, jobsDone;  // the render workers, around each snapshot
+
+    // the snapshots: the simulation fills back, leaving it in ready (as
+    // back | Fresh) and taking back whichever was there; worker 0 takes
+    // ready when it is Fresh, leaving front in its place
+    snap_t *snaps[3];
+    int back, front;
+    atomic_int ready;
+    long published;             // snapshots published (simulation only)
+    atomic_long rendered;       // the last snapshot drawn, or skipped
+    int jobs;                   // of the snapshot being drawn, set by worker 0 before startJobs
+    long lastDrawn;             // worker 0 only
+
+    atomic_bool over;           // the game is over
+    atomic_bool stopSim, stopRender, stopSend;
+    bool stopWorkers;           // set by worker 0 before startJobs
+    bool stopped;               // by pipeline_stop, on the network thread
+    counts_t counts[pipe_NSTAGES];
+};
+
+/* the outbox of the simulation or render thread calling; NULL on others */
+static _Thread_local outbox_t *threadOutbox = NULL;
+
+/*********** Private Functions ************/
+static void *simMain(void *arg);
+static void *renderMain(void *arg);
+static void *sendMain(void *arg);
+static bool drainOutboxes(pipeline_t *pipe);
+static void deliver(pipeline_t *pipe, output_t *out);
+static void post(const addr_t to, outKind_t kind, int tag, const void *buf, const size_t len);
+static void record(counts_t *counts, double queued);
+static void noteDepth(counts_t *counts, int depth);
+static double now(void);
+
+/************** pipeline_new *****************/
+pipeline_t *pipeline_new(const pipelineGame_t *game, int workers)
+{
+    if (game == NULL || workers < 1) {
+        return NULL;
+    }
+    pipeline_t *pipe = count_callocTag(1, sizeof(pipeline_t), mem_OTHER);
+    if (pipe == NULL) {
+        return NULL;
+    }
+    pipe->game = *game;
+    pipe->numWorkers = workers;
+    sem_init(&pipe->simWake, 0, 0);
+    sem_init(&pipe->renderWake, 0, 0);
+    sem_init(&pipe->sendWake, 0, 0);
+    sem_init(&pipe->renderGo, 0, 0);
+    pthread_barrier_init(&pipe->startJobs, NULL, workers);
+    pthread_barrier_init(&pipe->jobsDone, NULL, workers);
+    atomic_init(&pipe->ready, 2);
+    pipe->back = 0;
+    pipe->front = 1;
+    atomic_init(&pipe->rendered, 0);
+    atomic_init(&pipe->over, false);
+    atomic_init(&pipe->stopSim, false);
+    atomic_init(&pipe->stopRender, false);
+    atomic_init(&pipe->stopSend, false);
+
+    pipe->intake = ring_new(IntakeSlots, mem_NET);
+    pipe->simOutbox = (outbox_t) {pipe, ring_new(OutboxSlots, mem_NET), 0, 0};
+    pipe->workers = count_callocTag(workers, sizeof(worker_t), mem_OTHER);
+    bool ok = pipe->intake != NULL && pipe->simOutbox.ring != NULL && pipe->workers != NULL;
+    for (int s = 0; s < 3 && ok; s++) {
+        ok = (pipe->snaps[s] = count_callocTag(1, sizeof(snap_t) + game->snapBytes, mem_OTHER)) != NULL;
+    }
+    for (int w = 0; w < workers && ok; w++) {
+        pipe->workers[w] = (worker_t) {pipe, w, pthread_self(), {pipe, ring_new(OutboxSlots, mem_NET), 0, 0}};
+        ok = pipe->workers[w].outbox.ring != NULL;
+    }
+    if (!ok) {
+        pipeline_delete(pipe);
+        return NULL;
+    }
+
+    // the sender first, then the renderers, then the simulation that feeds them
+    if (pthread_create(&pipe->sendThread, NULL, sendMain, pipe) != 0) {
+        pipeline_delete(pipe);
+        return NULL;
+    }
+    pipe->sendStarted = true;
+    for (int w = 0; w < workers; w++) {
+        if (pthread_create(&pipe->workers[w].thread, NULL, renderMain, &pipe->workers[w]) != 0) {
+            // those started leave without waiting for the rest
+            pipe->stopWorkers = true;
+            break;
+        }
+        pipe->started++;
+    }
+    for (int w = 0; w < pipe->started; w++) {
+        sem_post(&pipe->renderGo);
+    }
+    if (pipe->stopWorkers) {
+        pipeline_delete(pipe);
+        return NULL;
+    }
+    if (pthread_create(&pipe->simThread, NULL, simMain, pipe) != 0) {
+        pipeline_delete(pipe);
+        return NULL;
+    }
+    pipe->simStarted = true;
+    return pipe;
+}
+
+/************** pipeline_post *****************/
+bool pipeline_post(pipeline_t *pipe, const addr_t from, const char *message)
+{
+    if (pipe->stopped || atomic_load(&pipe->over)) {
+        return false;
+    }
+    size_t len = strlen(message);
+    input_t *in = count_mallocTag(sizeof(input_t) + len + 1, mem_NET);
+    if (in == NULL) {
+        atomic_fetch_add(&pipe->counts[pipe_INTAKE].drops, 1);
+        return false;
+    }
+    double queued = now();
+    in->from = from;
+    in->queued = queued;
+    memcpy(in->text, message, len + 1);
+    if (!ring_push(pipe->intake, in)) {
+        count_free(in);
+        atomic_fetch_add(&pipe->counts[pipe_INTAKE].drops, 1);
+        return false;
+    }
+    // (in is the simulation's now)
+    noteDepth(&pipe->counts[pipe_SIMULATE], ring_depth(pipe->intake));
+    record(&pipe->counts[pipe_INTAKE], queued);
+    sem_post(&pipe->simWake);
+    return true;
+}
+
+/************** pipeline_over *****************/
+bool pipeline_over(pipeline_t *pipe)
+{
+    return atomic_load(&pipe->over);
+}
+
+/************** pipeline_stats *****************/
+void pipeline_stats(pipeline_t *pipe, stageStats_t stats[pipe_NSTAGES])
+{
+    for (int s = 0; s < pipe_NSTAGES; s++) {
+        counts_t *c = &pipe->counts[s];
+        long items = atomic_load(&c->items);
+        stats[s].items = items;
+        stats[s].meanLatency = items > 0 ? atomic_load(&c->totalNanos) / 1e9 / items : 0;
+        stats[s].maxLatency = atomic_load(&c->maxNanos) / 1e9;
+        stats[s].depth = 0;
+        stats[s].maxDepth = atomic_load(&c->maxDepth);
+        stats[s].drops = atomic_load(&c->drops);
+    }
+    stats[pipe_SIMULATE].depth = ring_depth(pipe->intake);
+    stats[pipe_RENDER].depth = (atomic_load(&pipe->ready) & Fresh) ? 1 : 0;
+    stats[pipe_SEND].depth = ring_depth(pipe->simOutbox.ring);
+    for (int w = 0; w < pipe->numWorkers; w++) {
+        stats[pipe_SEND].depth += ring_depth(pipe->workers[w].outbox.ring);
+    }
+}
+
+/************** pipeline_printStats *****************/
+void pipeline_printStats(pipeline_t *pipe, FILE *fp)
+{
+    static const char *names[pipe_NSTAGES] = {"intake", "simulate", "render", "send"};
+    stageStats_t stats[pipe_NSTAGES];
+    pipeline_stats(pipe, stats);
+    fprintf(fp, "%-10s %10s %10s %10s %8s %8s %8s\n",
+            "stage", "handled", "mean ms", "max ms", "queued", "deepest", "dropped");
+    for (int s = 0; s < pipe_NSTAGES; s++) {
+        fprintf(fp, "%-10s %10ld %10.3f %10.3f %8d %8d %8ld\n", names[s], stats[s].items,
+                stats[s].meanLatency * 1e3, stats[s].maxLatency * 1e3,
+                stats[s].depth, stats[s].maxDepth, stats[s].drops);
+    }
+}
+
+/************** pipeline_stop *****************/
+void pipeline_stop(pipeline_t *pipe)
+{
+    if (pipe == NULL || pipe->stopped) {
+        return;
+    }
+    pipe->stopped = true;
+    // stop each stage once the one before it has stopped, so nothing is left behind
+    if (pipe->simStarted) {
+        atomic_store(&pipe->stopSim, true);
+        sem_post(&pipe->simWake);
+        pthread_join(pipe->simThread, NULL);
+    }
+    atomic_store(&pipe->stopRender, true);
+    sem_post(&pipe->renderWake);
+    for (int w = 0; w < pipe->started; w++) {
+        pthread_join(pipe->workers[w].thread, NULL);
+    }
+    if (pipe->sendStarted) {
+        atomic_store(&pipe->stopSend, true);
+        sem_post(&pipe->sendWake);
+        pthread_join(pipe->sendThread, NULL);
+    }
+}
+
+/************** pipeline_delete *****************/
+void pipeline_delete(pipeline_t *pipe)
+{
+    if (pipe == NULL) {
+        return;
+    }
+    pipeline_stop(pipe);
+
+    input_t *in;
+    while (pipe->intake != NULL && (in = ring_pop(pipe->intake)) != NULL) {
+        count_free(in);
+    }
+    ring_delete(pipe->intake);
+    ring_delete(pipe->simOutbox.ring);
+    if (pipe->workers != NULL) {
+        for (int w = 0; w < pipe->numWorkers; w++) {
+            ring_delete(pipe->workers[w].outbox.ring);
+        }
+        count_free(pipe->workers);
+    }
+    for (int s = 0; s < 3; s++) {
+        if (pipe->snaps[s] != NULL) {
+            count_free(pipe->snaps[s]);
+        }
+    }
+    pthread_barrier_destroy(&pipe->startJobs);
+    pthread_barrier_destroy(&pipe->jobsDone);
+    sem_destroy(&pipe->simWake);
+    sem_destroy(&pipe->renderWake);
+    sem_destroy(&pipe->sendWake);
+    sem_destroy(&pipe->renderGo);
+    count_free(pipe);
+}
+
+/************** pipeline_send *****************/
+void pipeline_send(const addr_t to, const char *message)
+{
+    post(to, out_TEXT, 0, message, strlen(message) + 1);
+}
+
+/************** pipeline_sendBytes *****************/
+void pipeline_sendBytes(const addr_t to, const void *buf, const size_t len)
+{
+    post(to, out_BYTES, 0, buf, len);
+}
+
+/************** pipeline_sendLatest *****************/
+void pipeline_sendLatest(const addr_t to, const void *buf, const size_t len, const int tag)
+{
+    post(to, out_LATEST, tag, buf, len);
+}
+
+/************** simMain *****************/
+/* the simulation: applies each batch of messages waiting for it, then
+ * publishes a snapshot if any frames are due
+ */
+static void *simMain(void *arg)
+{
+    pipeline_t *pipe = arg;
+    outbox_t *box = &pipe->simOutbox;
+    threadOutbox = box;
+    while (true) {
+        sem_wait(&pipe->simWake);
+        long pushed = box->pushed;
+        input_t *in;
+        while ((in = ring_pop(pipe->intake)) != NULL) {
+            if (!atomic_load(&pipe->over) && pipe->game.simulate(pipe->game.arg, in->from, in->text)) {
+                // no frames after the game-over screen
+                atomic_store(&pipe->over, true);
+            }
+            record(&pipe->counts[pipe_SIMULATE], in->queued);
+            count_free(in);
+        }
+
+        snap_t *snap = pipe->snaps[pipe->back];
+        if (!atomic_load(&pipe->over) && pipe->game.capture(pipe->game.arg, snap->data)) {
+            snap->epoch = ++pipe->published;
+            snap->published = now();
+            // what it sends from now on goes after this snapshot's frames
+            box->epoch = pipe->published;
+            pipe->back = atomic_exchange(&pipe->ready, pipe->back | Fresh) & ~Fresh;
+            noteDepth(&pipe->counts[pipe_RENDER], 1);
+            sem_post(&pipe->renderWake);
+        }
+        if (box->pushed != pushed) {
+            sem_post(&pipe->sendWake);
+        }
+        if (atomic_load(&pipe->stopSim) && ring_depth(pipe->intake) == 0) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/************** renderMain *****************/
+/* a render worker: draws its share (job % workers == its index) of the
+ * frames of each snapshot. Worker 0 waits for the snapshots, prepares
+ * each, and lets the others go; after all have finished, it tells the
+ * sender the snapshot is drawn
+ */
+static void *renderMain(void *arg)
+{
+    worker_t *worker = arg;
+    pipeline_t *pipe = worker->pipe;
+    threadOutbox = &worker->outbox;
+    sem_wait(&pipe->renderGo);
+    if (pipe->stopWorkers) {
+        return NULL;
+    }
+    while (true) {
+        if (worker->index == 0) {
+            // once told to stop, draw what is left without waiting
+            if (!atomic_load(&pipe->stopRender)) {
+                sem_wait(&pipe->renderWake);
+            }
+            if (!(atomic_load(&pipe->ready) & Fresh)) {
+                if (!atomic_load(&pipe->stopRender)) {
+                    continue;
+                }
+                pipe->stopWorkers = true;
+            } else {
+                pipe->front = atomic_exchange(&pipe->ready, pipe->front) & ~Fresh;
+                snap_t *snap = pipe->snaps[pipe->front];
+                atomic_fetch_add(&pipe->counts[pipe_RENDER].drops, snap->epoch - pipe->lastDrawn - 1);
+                pipe->lastDrawn = snap->epoch;
+                pipe->jobs = pipe->game.prepare(pipe->game.arg, snap->data);
+                for (int w = 0; w < pipe->numWorkers; w++) {
+                    pipe->workers[w].outbox.epoch = snap->epoch;
+                }
+            }
+        }
+        pthread_barrier_wait(&pipe->startJobs);
+        if (pipe->stopWorkers) {
+            break;
+        }
+        for (int j = worker->index; j < pipe->jobs; j += pipe->numWorkers) {
+            pipe->game.render(pipe->game.arg, j, worker->index);
+        }
+        pthread_barrier_wait(&pipe->jobsDone);
+
+        if (worker->index == 0) {
+            snap_t *snap = pipe->snaps[pipe->front];
+            record(&pipe->counts[pipe_RENDER], snap->published);
+            atomic_store(&pipe->rendered, snap->epoch);
+            sem_post(&pipe->sendWake);
+        }
+    }
+    return NULL;
+}
+
+/************** sendMain *****************/
+/* the sender: sends what the other stages have sent, as it comes, until
+ * told to stop with nothing left
+ */
+static void *sendMain(void *arg)
+{
+    pipeline_t *pipe = arg;
+    while (true) {
+        int depth = ring_depth(pipe->simOutbox.ring);
+        for (int w = 0; w < pipe->numWorkers; w++) {
+            depth += ring_depth(pipe->workers[w].outbox.ring);
+        }
+        noteDepth(&pipe->counts[pipe_SEND], depth);
+        if (!drainOutboxes(pipe)) {
+            if (atomic_load(&pipe->stopSend) && depth == 0) {
+                break;
+            }
+            sem_wait(&pipe->sendWake);
+        }
+    }
+    return NULL;
+}
+
+/************** drainOutboxes *****************/
+/* sends all it can of what is waiting, in the order one thread would
+ * have sent it: frames of snapshot e go after messages the simulation
+ * sent before publishing e, and before those it sent after; returns
+ * false if there was nothing it could send
+ */
+static bool drainOutboxes(pipeline_t *pipe)
+{
+    ring_t *sim = pipe->simOutbox.ring;
+    // (read before looking at the rings: every frame of these is on them or sent)
+    long rendered = atomic_load(&pipe->rendered);
+    bool sent = false;
+
+    // frames, so long as the simulation sent nothing before their snapshot
+    for (int w = 0; w < pipe->numWorkers; w++) {
+        ring_t *ring = pipe->workers[w].outbox.ring;
+        output_t *out;
+        while ((out = ring_peek(ring)) != NULL) {
+            output_t *first = ring_peek(sim);
+            if (first != NULL && first->epoch < out->epoch) {
+                break;
+            }
+            deliver(pipe, ring_pop(ring));
+            sent = true;
+        }
+    }
+
+    // the simulation's messages, once all frames drawn before them have gone
+    output_t *out;
+    while ((out = ring_peek(sim)) != NULL && out->epoch <= rendered) {
+        bool framesFirst = false;
+        for (int w = 0; w < pipe->numWorkers && !framesFirst; w++) {
+            output_t *frame = ring_peek(pipe->workers[w].outbox.ring);
+            framesFirst = frame != NULL && frame->epoch <= out->epoch;
+        }
+        if (framesFirst) {
+            break;
+        }
+        deliver(pipe, ring_pop(sim));
+        sent = true;
+    }
+    return sent;
+}
+
+/************** deliver *****************/
+/* sends a message for real, and frees it */
+static void deliver(pipeline_t *pipe, output_t *out)
+{
+    switch (out->kind) {
+        case out_TEXT:
+            message_send(out->to, (const char *) out->bytes);
+            break;
+        case out_BYTES:
+            message_sendBytes(out->to, out->bytes, out->len);
+            break;
+        case out_LATEST:
+            message_sendLatest(out->to, out->bytes, out->len, out->tag);
+            break;
+    }
+    record(&pipe->counts[pipe_SEND], out->queued);
+    count_free(out);
+}
+
+/************** post *****************/
+/* sends a message, or, from a stage's thread, copies it onto the stage's
+ * outbox for the sender
+ */
+static void post(const addr_t to, outKind_t kind, int tag, const void *buf, const size_t len)
+{
+    outbox_t *box = threadOutbox;
+    if (box == NULL) {
+        switch (kind) {
+            case out_TEXT:
+                message_send(to, buf);
+                break;
+            case out_BYTES:
+                message_sendBytes(to, buf, len);
+                break;
+            case out_LATEST:
+                message_sendLatest(to, buf, len, tag);
+                break;
+        }
+        return;
+    }
+
+    output_t *out = count_mallocTag(sizeof(output_t) + len, mem_NET);
+    if (out == NULL) {
+        log_e("out of memory");
+        atomic_fetch_add(&box->pipe->counts[pipe_SEND].drops, 1);
+        return;
+    }
+    out->to = to;
+    out->kind = kind;
+    out->tag = tag;
+    out->epoch = box->epoch;
+    out->queued = now();
+    out->len = len;
+    memcpy(out->bytes, buf, len);
+    if (!ring_push(box->ring, out)) {
+        count_free(out);
+        atomic_fetch_add(&box->pipe->counts[pipe_SEND].drops, 1);
+        return;
+    }
+    box->pushed++;
+}
+
+/************** record *****************/
+/* counts an item a stage has finished, queued for it at queued */
+static void record(counts_t *counts, double queued)
+{
+    long long nanos = (long long) ((now() - queued) * 1e9);
+    atomic_fetch_add_explicit(&counts->items, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&counts->totalNanos, nanos, memory_order_relaxed);
+    if (nanos > atomic_load_explicit(&counts->maxNanos, memory_order_relaxed)) {
+        atomic_store_explicit(&counts->maxNanos, nanos, memory_order_relaxed);
+    }
+}
+
+/************** noteDepth *****************/
+/* notes how much work was waiting for a stage */
+static void noteDepth(counts_t *counts, int depth)
+{
+    if (depth > atomic_load_explicit(&counts->maxDepth, memory_order_relaxed)) {
+        atomic_store_explicit(&counts->maxDepth, depth, memory_order_relaxed);
+    }
+}
+
+/************** now *****************/
+/* returns the time in seconds on a clock that only goes forward */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
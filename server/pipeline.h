@@ -0,0 +1,127 @@
+/*
+ * pipeline.h - header file for the pipeline module
+ *
+ * A server started with --pipeline splits the work of its one game into
+ * stages, each on its own thread(s), passing work from one to the next
+ * through lock-free rings (see ring.h):
+ *
+ *   intake    the network thread (message_loop) copies each message
+ *             into the simulation's ring, and goes back to the socket;
+ *   simulate  one thread applies the messages waiting, in order, to the
+ *             game, and then captures what frames are to be drawn from
+ *             into a snapshot;
+ *   render    R threads (--pipeline=R) draw the frames of the newest snapshot,
+ *             each the same share of the clients every time;
+ *   send      one thread hands everything the other stages send to the
+ *             socket, in batches.
+ *
+ * The simulation never waits for the stages after it: it leaves each
+ * snapshot in a triple buffer, where the renderers pick up the newest
+ * when they are ready, skipping any that a newer one has replaced (only
+ * the newest view matters, as with message_sendLatest); and the messages
+ * it sends (OK, GOLD, QUIT, ...) go into its own ring for the sender.
+ * The sender puts each stage's messages back in the order one thread
+ * would have sent them: a message the simulation sent after publishing
+ * a snapshot goes out after that snapshot's frames, and before those of
+ * later snapshots.
+ *
+ * Each stage counts the work it does, how long work waited for it (from
+ * when the stage before queued it to when this stage finished it), and
+ * how deep its queue has grown; see pipeline_stats.
+ *
+ * Group 7 - Bash Boys
+ */
+
+#ifndef __PIPELINE_H
+#define __PIPELINE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "message.h"
+
+/********* Data Structures **********/
+/* what the game does at each stage; arg is passed to each */
+typedef struct pipelineGame {
+    void *arg;
+    size_t snapBytes;   // the size of a snapshot
+    // simulate: applies one message to the game, returning true if the game is over
+    bool (*simulate)(void *arg, const addr_t from, const char *message);
+    // simulate: after a batch of messages, copies into snap what the frames now
+    // due are drawn from, returning false (leaving snap alone) if none are due
+    bool (*capture)(void *arg, void *snap);
+    // render, on one thread: gets ready to draw the frames of snap, returning how
+    // many jobs there are; job j always goes to worker j % workers
+    int (*prepare)(void *arg, const void *snap);
+    // render, on each worker: draws and sends the frame(s) of one job
+    void (*render)(void *arg, int job, int worker);
+} pipelineGame_t;
+
+typedef struct pipeline pipeline_t;     // opaque
+
+typedef enum pipelineStage {
+    pipe_INTAKE, pipe_SIMULATE, pipe_RENDER, pipe_SEND, pipe_NSTAGES
+} pipelineStage_t;
+
+/* what one stage has done */
+typedef struct stageStats {
+    long items;         // intake and simulate: messages; render: snapshots drawn; send: messages sent
+    double meanLatency; // seconds from being queued for the stage to being done with
+    double maxLatency;
+    int depth;          // work waiting for the stage now
+    int maxDepth;       // ... and the most there has been
+    long drops;         // intake and send: dropped from a full ring; render: snapshots skipped
+} stageStats_t;
+
+/*********** Functions ************/
+
+/************** pipeline_new *******************/
+/* starts the simulation, sender and workers render threads for game;
+ * returns NULL if a thread cannot be started, or on malloc error.
+ * The caller must have called message_init on the select backend, and
+ * run message_loop with a timeout, since the sender sends while the
+ * loop waits
+ */
+pipeline_t *pipeline_new(const pipelineGame_t *game, int workers);
+
+/************** pipeline_post *******************/
+/* copies message into the simulation's ring; call only from the network
+ * thread.  Returns false, dropping it, if the ring is full, the game is
+ * over, or on malloc error
+ */
+bool pipeline_post(pipeline_t *pipe, const addr_t from, const char *message);
+
+/************** pipeline_over *******************/
+/* returns true once the simulation has found the game over */
+bool pipeline_over(pipeline_t *pipe);
+
+/************** pipeline_stats *******************/
+/* fills stats, one per stage (indexed by pipelineStage_t) */
+void pipeline_stats(pipeline_t *pipe, stageStats_t stats[pipe_NSTAGES]);
+
+/************** pipeline_printStats *******************/
+/* prints a table of the stages' stats to fp */
+void pipeline_printStats(pipeline_t *pipe, FILE *fp);
+
+/************** pipeline_stop *******************/
+/* lets the simulation finish the messages waiting for it, the renderers
+ * draw the last snapshot, and the sender send everything; then stops
+ * the threads.  Messages posted after this are never handled
+ */
+void pipeline_stop(pipeline_t *pipe);
+
+/************** pipeline_delete *******************/
+/* stops the pipeline (see pipeline_stop), if not yet stopped, and frees it */
+void pipeline_delete(pipeline_t *pipe);
+
+/************** pipeline_send *******************/
+/* message_send, message_sendBytes and message_sendLatest, for code that
+ * runs both in a pipeline and not: on a simulation or render thread, the
+ * message is copied for the sender to send; on any other, it is sent
+ * at once
+ */
+void pipeline_send(const addr_t to, const char *message);
+void pipeline_sendBytes(const addr_t to, const void *buf, const size_t len);
+void pipeline_sendLatest(const addr_t to, const void *buf, const size_t len, const int tag);
+
+#endif // __PIPELINE_H
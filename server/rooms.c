@@ -0,0 +1,330 @@
+/*
+ * rooms.c - hosting several games in one server process
+ *
+ * see rooms.h for more information.
+ *
+ * Group 7 - Bash Boys
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "rooms.h"
+#include "memory.h"
+
+/********* Data Structures **********/
+/* one worker thread and its deque of rooms to run: a ring holding count
+ * rooms, the oldest at top; the owner pushes and pops at the other end
+ * (the bottom), and thieves take from the top
+ */
+typedef struct worker {
+    pool_t *pool;
+    int index;
+    pthread_t thread;
+    pthread_mutex_t lock;   // guards the deque
+    room_t **deque;         // room of numRooms: a room is on one deque at most
+    int top, count;
+    atomic_long runs, messages, steals;
+} worker_t;
+
+struct pool {
+    int numWorkers, numRooms;
+    worker_t *workers;
+    int started;            // workers whose threads are running
+    roomHandler_t handler;
+    pthread_mutex_t idleLock;   // guards pending and stopping; workers with nothing to do wait on wake
+    pthread_cond_t wake;
+    int pending;            // rooms on the deques
+    int maxPending;
+    bool stopping;
+    atomic_int roomsOver;
+};
+
+/*********** Private Functions ************/
+static void *workerMain(void *arg);
+static void schedule(pool_t *pool, worker_t *worker, room_t *room, bool last);
+static room_t *takeRoom(worker_t *worker);
+static void runRoom(worker_t *worker, room_t *room);
+
+/************** room_new *****************/
+room_t *room_new(int id, serverInfo_t *info)
+{
+    room_t *room = count_callocTag(1, sizeof(room_t), mem_OTHER);
+    if (room == NULL) {
+        return NULL;
+    }
+    room->id = id;
+    room->info = info;
+    pthread_mutex_init(&room->gameLock, NULL);
+    pthread_mutex_init(&room->inboxLock, NULL);
+    room->head = room->tail = NULL;
+    room->queued = false;
+    atomic_init(&room->over, false);
+    atomic_init(&room->seats, 0);
+    return room;
+}
+
+/************** room_delete *****************/
+void room_delete(room_t *room)
+{
+    if (room != NULL) {
+        while (room->head != NULL) {
+            inmsg_t *msg = room->head;
+            room->head = msg->next;
+            count_free(msg);
+        }
+        pthread_mutex_destroy(&room->gameLock);
+        pthread_mutex_destroy(&room->inboxLock);
+        count_free(room);
+    }
+}
+
+/************** pool_new *****************/
+pool_t *pool_new(int numWorkers, int numRooms, roomHandler_t handler)
+{
+    if (numWorkers < 1 || numRooms < 1 || handler == NULL) {
+        return NULL;
+    }
+    pool_t *pool = count_callocTag(1, sizeof(pool_t), mem_OTHER);
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->numWorkers = numWorkers;
+    pool->numRooms = numRooms;
+    pool->handler = handler;
+    pthread_mutex_init(&pool->idleLock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    atomic_init(&pool->roomsOver, 0);
+    pool->workers = count_callocTag(numWorkers, sizeof(worker_t), mem_OTHER);
+    if (pool->workers == NULL) {
+        pool_delete(pool);
+        return NULL;
+    }
+    for (int w = 0; w < numWorkers; w++) {
+        worker_t *worker = &pool->workers[w];
+        worker->pool = pool;
+        worker->index = w;
+        pthread_mutex_init(&worker->lock, NULL);
+        worker->deque = count_callocTag(numRooms, sizeof(room_t *), mem_OTHER);
+        if (worker->deque == NULL) {
+            pool_delete(pool);
+            return NULL;
+        }
+    }
+    for (int w = 0; w < numWorkers; w++) {
+        if (pthread_create(&pool->workers[w].thread, NULL, workerMain, &pool->workers[w]) != 0) {
+            pool_delete(pool);
+            return NULL;
+        }
+        pool->started++;
+    }
+    return pool;
+}
+
+/************** pool_post *****************/
+bool pool_post(pool_t *pool, room_t *room, const addr_t from, const char *message)
+{
+    if (atomic_load(&room->over)) {
+        return false;
+    }
+    size_t len = strlen(message);
+    inmsg_t *msg = count_mallocTag(sizeof(inmsg_t) + len + 1, mem_NET);
+    if (msg == NULL) {
+        return false;
+    }
+    msg->next = NULL;
+    msg->from = from;
+    memcpy(msg->text, message, len + 1);
+
+    pthread_mutex_lock(&room->inboxLock);
+    if (room->head == NULL) {
+        room->head = msg;
+    } else {
+        room->tail->next = msg;
+    }
+    room->tail = msg;
+    bool idle = !room->queued;
+    room->queued = true;
+    pthread_mutex_unlock(&room->inboxLock);
+
+    // a room already waiting or running will get to this message
+    if (idle) {
+        schedule(pool, &pool->workers[room->id % pool->numWorkers], room, false);
+    }
+    return true;
+}
+
+/************** pool_roomsOver *****************/
+int pool_roomsOver(pool_t *pool)
+{
+    return atomic_load(&pool->roomsOver);
+}
+
+/************** pool_stats *****************/
+poolStats_t pool_stats(pool_t *pool)
+{
+    poolStats_t stats = {0, 0, 0, 0};
+    for (int w = 0; w < pool->numWorkers; w++) {
+        stats.runs += atomic_load(&pool->workers[w].runs);
+        stats.messages += atomic_load(&pool->workers[w].messages);
+        stats.steals += atomic_load(&pool->workers[w].steals);
+    }
+    pthread_mutex_lock(&pool->idleLock);
+    stats.maxPending = pool->maxPending;
+    pthread_mutex_unlock(&pool->idleLock);
+    return stats;
+}
+
+/************** pool_delete *****************/
+void pool_delete(pool_t *pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pool->idleLock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->idleLock);
+    for (int w = 0; w < pool->started; w++) {
+        pthread_join(pool->workers[w].thread, NULL);
+    }
+    if (pool->workers != NULL) {
+        for (int w = 0; w < pool->numWorkers; w++) {
+            if (pool->workers[w].deque != NULL) {
+                count_free(pool->workers[w].deque);
+            }
+            pthread_mutex_destroy(&pool->workers[w].lock);
+        }
+        count_free(pool->workers);
+    }
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->idleLock);
+    count_free(pool);
+}
+
+/************** workerMain *****************/
+/* runs rooms, its own or stolen, until the pool stops; sleeps while
+ * there are none to run
+ */
+static void *workerMain(void *arg)
+{
+    worker_t *worker = arg;
+    pool_t *pool = worker->pool;
+    while (true) {
+        pthread_mutex_lock(&pool->idleLock);
+        while (pool->pending == 0 && !pool->stopping) {
+            pthread_cond_wait(&pool->wake, &pool->idleLock);
+        }
+        bool stopping = pool->stopping;
+        pthread_mutex_unlock(&pool->idleLock);
+        if (stopping) {
+            break;
+        }
+
+        room_t *room = takeRoom(worker);
+        if (room != NULL) {
+            pthread_mutex_lock(&pool->idleLock);
+            pool->pending--;
+            pthread_mutex_unlock(&pool->idleLock);
+            runRoom(worker, room);
+        }
+    }
+    return NULL;
+}
+
+/************** schedule *****************/
+/* puts room on worker's deque: at the bottom, to be run next, or (if
+ * last) at the top, behind every room already waiting; then wakes a
+ * worker to run it
+ */
+static void schedule(pool_t *pool, worker_t *worker, room_t *room, bool last)
+{
+    int size = pool->numRooms;
+    pthread_mutex_lock(&worker->lock);
+    if (last) {
+        worker->top = (worker->top + size - 1) % size;
+        worker->deque[worker->top] = room;
+    } else {
+        worker->deque[(worker->top + worker->count) % size] = room;
+    }
+    worker->count++;
+    pthread_mutex_unlock(&worker->lock);
+
+    pthread_mutex_lock(&pool->idleLock);
+    pool->pending++;
+    if (pool->pending > pool->maxPending) {
+        pool->maxPending = pool->pending;
+    }
+    pthread_cond_signal(&pool->wake);
+    pthread_mutex_unlock(&pool->idleLock);
+}
+
+/************** takeRoom *****************/
+/* returns the newest room on the worker's own deque or, if it is empty,
+ * the oldest on the first other deque that is not; NULL if all are empty
+ */
+static room_t *takeRoom(worker_t *worker)
+{
+    pool_t *pool = worker->pool;
+    int size = pool->numRooms;
+    room_t *room = NULL;
+
+    pthread_mutex_lock(&worker->lock);
+    if (worker->count > 0) {
+        worker->count--;
+        room = worker->deque[(worker->top + worker->count) % size];
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    for (int k = 1; k < pool->numWorkers && room == NULL; k++) {
+        worker_t *victim = &pool->workers[(worker->index + k) % pool->numWorkers];
+        pthread_mutex_lock(&victim->lock);
+        if (victim->count > 0) {
+            room = victim->deque[victim->top];
+            victim->top = (victim->top + 1) % size;
+            victim->count--;
+            atomic_fetch_add(&worker->steals, 1);
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+    return room;
+}
+
+/************** runRoom *****************/
+/* handles the messages waiting for a room when the worker took it; if
+ * more have come in since, the room goes back on the worker's deque,
+ * behind the rooms already waiting there, so a busy room cannot keep
+ * the others from being run
+ */
+static void runRoom(worker_t *worker, room_t *room)
+{
+    pool_t *pool = worker->pool;
+
+    pthread_mutex_lock(&room->inboxLock);
+    inmsg_t *msg = room->head;
+    room->head = room->tail = NULL;
+    pthread_mutex_unlock(&room->inboxLock);
+
+    pthread_mutex_lock(&room->gameLock);
+    while (msg != NULL) {
+        inmsg_t *next = msg->next;
+        if (!atomic_load(&room->over) && pool->handler(room->info, msg->from, msg->text)) {
+            atomic_store(&room->over, true);
+            atomic_fetch_add(&pool->roomsOver, 1);
+        }
+        count_free(msg);
+        atomic_fetch_add(&worker->messages, 1);
+        msg = next;
+    }
+    pthread_mutex_unlock(&room->gameLock);
+    atomic_fetch_add(&worker->runs, 1);
+
+    pthread_mutex_lock(&room->inboxLock);
+    bool more = room->head != NULL;
+    if (!more) {
+        room->queued = false;
+    }
+    pthread_mutex_unlock(&room->inboxLock);
+    if (more) {
+        schedule(pool, worker, room, true);
+    }
+}
@@ -0,0 +1,100 @@
+/*
+ * rooms.h - header file for the rooms module
+ *
+ * A server started with --rooms=N hosts N independent games ("rooms") in
+ * one process.  Each room has its own serverInfo_t (players, gold, slabs,
+ * scratch arena and random state); all of them share the one map, which
+ * nothing changes once it is loaded.
+ *
+ * The network thread (message_loop) never touches a game.  It routes
+ * each message to a room and posts it to the room's inbox; a pool of
+ * worker threads runs the rooms that have messages waiting.  Each worker
+ * keeps a deque of rooms to run: a room goes onto the deque of its home
+ * worker when a message arrives for it, the worker takes its own rooms
+ * newest first, and a worker with none steals the oldest from another's
+ * deque.  A room is on at most one deque, and run by at most one worker,
+ * at a time, so its messages are handled one after another, in the order
+ * they arrived, exactly as a one-game server would handle them.
+ *
+ * Group 7 - Bash Boys
+ */
+
+#ifndef __ROOMS_H
+#define __ROOMS_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "serverUtils.h"
+
+/********* Data Structures **********/
+/* a message waiting for a room */
+typedef struct inmsg {
+    struct inmsg *next;
+    addr_t from;
+    char text[];
+} inmsg_t;
+
+typedef struct room {
+    int id;                 // the room's number, from 0
+    serverInfo_t *info;     // its game; touched only while a worker runs the room
+    pthread_mutex_t gameLock;   // held while the game is run (or read, as by "stats")
+    pthread_mutex_t inboxLock;  // guards the inbox and queued
+    inmsg_t *head, *tail;   // messages waiting, oldest first
+    bool queued;            // on a worker's deque, or being run
+    atomic_bool over;       // the game has ended; messages for it are dropped
+    atomic_int seats;       // PLAYs routed here (by the network thread), less those the game turned away
+} room_t;
+
+/* handles one message for a room's game, returning true if the game is over */
+typedef bool (*roomHandler_t)(void *info, const addr_t from, const char *message);
+
+typedef struct pool pool_t;     // opaque
+
+/* what the workers have done, all together */
+typedef struct poolStats {
+    long runs;          // times a worker took a room and ran its waiting messages
+    long messages;      // messages handled
+    long steals;        // rooms a worker took from another's deque
+    int maxPending;     // most rooms waiting to be run at once
+} poolStats_t;
+
+/*********** Functions ************/
+
+/************** room_new *******************/
+/* returns a room numbered id for the game info, with an empty inbox,
+ * or NULL on malloc error
+ */
+room_t *room_new(int id, serverInfo_t *info);
+
+/************** room_delete *******************/
+/* frees the room and any messages still waiting for it, but not its game */
+void room_delete(room_t *room);
+
+/************** pool_new *******************/
+/* starts numWorkers threads to run up to numRooms rooms, handling each
+ * message with handler; returns NULL if a thread cannot be started
+ */
+pool_t *pool_new(int numWorkers, int numRooms, roomHandler_t handler);
+
+/************** pool_post *******************/
+/* copies message onto the room's inbox and, if the room is not already
+ * waiting or running, puts it on its home worker's deque; returns false
+ * (dropping the message) if the room's game is over or on malloc error
+ */
+bool pool_post(pool_t *pool, room_t *room, const addr_t from, const char *message);
+
+/************** pool_roomsOver *******************/
+/* returns how many rooms' games have ended */
+int pool_roomsOver(pool_t *pool);
+
+/************** pool_stats *******************/
+poolStats_t pool_stats(pool_t *pool);
+
+/************** pool_delete *******************/
+/* lets the workers finish the rooms they are running, stops them, and
+ * frees the pool; rooms still waiting are not run
+ */
+void pool_delete(pool_t *pool);
+
+#endif // __ROOMS_H
@@ -4,9 +4,11 @@
  * Dartmouth CS50, Winter 2021
  */
 
+#define _POSIX_C_SOURCE 200809L     // for sysconf
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <inttypes.h>
 #include <ctype.h>
 #include <string.h>
 #include <unistd.h>
@@ -17,154 +19,787 @@
 #include "hashtable.h"
 #include "set.h"
 #include "counters.h"
+#include "slab.h"
+#include "arena.h"
+#include "memory.h"
+#include "format.h"
 #include "serverUtils.h"
-
-/********* Data Structures **********/
-typedef struct countersMap {
-    counters_t *ctrs;
-    map_t *map;
-} ctrsmap_t;
-
-typedef struct twoctrs {
-    counters_t *ctrs1;
-    counters_t *ctrs2;
-} twoctrs_t;
-
-typedef struct playerBundle {
-    position_t *pos1;
-    position_t *pos2;
+#include "rooms.h"
+#include "pipeline.h"
+#include "ring.h"
+
+/**************** Constants ****************/
+static const int MaxPlayers = 26;       // maximum number of players in a game
+#define RouteKeyBytes 24                // a client address as a routes key; see routeKey
+static const int RunSlots = 4096;       // runs waiting for the renderers, at most; see frames_t
+
+/**************** Data Structures ****************/
+/* a game, with the counts its serverInfo points to */
+typedef struct game {
+    serverInfo_t info;      // first, so a serverInfo_t * is the game's
+    int numPlayers;
+    int goldCt;
+    rng_t goldSeeded;       // the gold stream before the gold was placed; see server
+} game_t;
+
+/* where a client's messages go, with --rooms */
+typedef struct route {
+    room_t *room;
+} route_t;
+
+/* where a player went (or, if from is to, was put) since the last
+ * snapshot, for the renderers to look along (see map_lookAlong),
+ * numbered in the order made
+ */
+typedef struct run {
+    long seq;
+    char letter;
+    position_t from, to;
+} run_t;
+
+/* what a snapshot records of a player */
+typedef struct snapPlayer {
     addr_t addr;
-} pb_t;
-
-typedef struct twoints {
-    int *x;
-    int *y;
-} twoints_t;
-
-struct findPlayer {
-	addr_t addr;
-	player_t *result;
-};
-
-typedef struct goldBundle {
-    player_t *player;
-    int *goldCt;
-} gb_t;
+    int caps;
+    char letter;
+    bool isActive;
+    position_t pos;
+    viewport_t view;        // the window they asked for at PLAY
+} snapPlayer_t;
+
+/* what the frames due are drawn from, with --pipeline: copied from the
+ * game by the simulation, for the renderers; see captureFrames
+ */
+typedef struct snapshot {
+    int due;                // Frames* bits
+    int numPlayers;
+    snapPlayer_t players[26];   // by letter
+    long runsEnd;           // the runs made before it
+    addr_t specAddr;
+    int specCaps;
+    viewport_t specView;
+    int specEpoch;
+    char specFollow;
+    char lastMoved;
+    bool collected[];       // for each pile, in the order of frames_t's piles
+} snapshot_t;
+
+/* the game as the renderers see it, with --pipeline: a copy with players,
+ * gold and spectator of its own, brought up to date from each snapshot,
+ * so frames are drawn from it while the game itself moves on.  Only the
+ * copy's players remember what they have seen; the game's move without
+ * looking, and pass their runs to the renderers through a ring
+ */
+typedef struct frames {
+    serverInfo_t *game;         // the game; read only by the simulation
+    serverInfo_t *mirror;       // the copy; written only by prepareFrames
+    serverInfo_t *workers;      // the copy as each render worker uses it, with its own arena
+    int numWorkers;
+    gold_t **piles;             // the game's gold piles ...
+    gold_t **mirrorPiles;       // ... and their copies, in the same order
+    int numPiles;
+    player_t *players[26];      // the copy's players, by letter
+    int specEpoch;              // of the copy's spectator
+    const snapshot_t *snap;     // being drawn
+    ring_t *runs;               // simulation -> renderers
+    long nextRun;               // simulation only
+    long runsDropped;           // ... from a full ring
+    run_t **drawing;            // the runs of the snapshot being drawn
+    int numDrawing, maxDrawing;
+} frames_t;
+
+/* the games this server hosts, and (with --rooms) how messages reach them */
+typedef struct host {
+    serverInfo_t **games;   // numRooms of them; just one without --rooms
+    room_t **rooms;         // a room for each game; NULL with one game, run inline
+    int numRooms;
+    pool_t *pool;           // the workers running the rooms
+    hashtable_t *routes;    // the route of each client address; see routeKey
+    int numWorkers;
+    pipeline_t *pipeline;   // with --pipeline, the stages playing the one game
+    frames_t *frames;       // ... and what they draw from
+} host_t;
 
 /**************** Functions ****************/
-int server(char *argv[], int seed);
+int server(serverOptions_t *opts);
 void splitline(char *message, char *words[]);
 player_t *player_new(addr_t from, char letter, serverInfo_t *info);
-counters_t *getDotsPos(char *map);
-bool validateParameters(int argc, char *argv[], int *seed);
+bool validateParameters(int argc, char *argv[], serverOptions_t *opts);
 bool checkFile(char *fname, char *openParam);
-hashtable_t *generateGold(map_t *map, int seed, int *goldCt, counters_t *dotsPos);
-position_t *getRandomPos(map_t *map, counters_t *dotsPos, hashtable_t *goldInfo, hashtable_t *playerInfo);
-gold_t *gold_new();
+hashtable_t *generateGold(map_t *map, rng_t *rng, int *goldCt, slab_t *goldSlab, slab_t *posSlab);
+position_t *getRandomPos(map_t *map, hashtable_t *goldInfo, hashtable_t *playerInfo, slab_t *posSlab, rng_t *rng);
+static int floorRank(map_t *map, mcoord_t cell);
+gold_t *gold_new(slab_t *goldSlab);
 
 
 /**************** Server Communication Functions ****************/
-void sendInitialInfo(const addr_t from, serverInfo_t *info, char letter);
+void sendInitialInfo(const addr_t from, serverInfo_t *info, char letter, int caps, const viewport_t *view);
 void sendSpectatorView(serverInfo_t *info);
+static void setSpectatorView(serverInfo_t *info, int caps, viewport_t *view);
+static player_t *findFollowed(serverInfo_t *info);
+static serverInfo_t *game_new(map_t *map, int seed, const char *rngStates, int room);
+static void logGold(serverInfo_t *info);
+static game_t *game_alloc(map_t *map, int room);
+static void game_delete(serverInfo_t *info);
+static bool startRooms(host_t *host, int workers);
+static bool startPipeline(host_t *host, int workers);
+static frames_t *frames_new(serverInfo_t *game, int workers);
+static void frames_delete(frames_t *frames);
+static void noteRun(serverInfo_t *info, player_t *player, position_t *from, position_t *to);
+static player_t *mirrorPlayer(frames_t *frames, const snapPlayer_t *sp);
+static bool simulateFrames(void *arg, const addr_t from, const char *message);
+static bool captureFrames(void *arg, void *snap);
+static int prepareFrames(void *arg, const void *snap);
+static void renderFrames(void *arg, int job, int worker);
+static bool handleTimeout(void *arg);
 static bool handleInput(void *arg);
+static void reportSeen(host_t *host, FILE *fp);
 static bool handleMessage(void *arg, const addr_t from, const char *message);
+static room_t *routeMessage(host_t *host, const addr_t from, const char *message);
+static void routeKey(const addr_t addr, char *key);
+static bool handleGameMessage(void *arg, const addr_t from, const char *message);
+static bool handleClientMessage(serverInfo_t *info, const addr_t from, const char *message);
 void sendMaps(serverInfo_t *info);
 void sendQuit(serverInfo_t *info);
-void sendGoldMessage(addr_t from, int collected, int purse, int remain);
-
-
-/**************** Iterators ****************/
-void findPlayerITR(void *arg, const char *key, void *item);
-void buildGameOverString(void *arg, const char *key, void *item);
-void mapSend(void *arg, const char* key, void *item);
-void quitFunc(void *arg, const char *key, void *item);
-void searchActivePlayers(void *arg, const char *key, void *item);
-void checkPlayerCollision(void *arg, const char *key, void *item);
-void sendOthersGold(void *arg, const char *key, void *item);
-void goldFill(void *arg, const char *key, void *item);
-void playerFill(void *arg, const char *key, void *item);
-void recountGold(void *arg, const char *key, void *item);
-void findPos(void *arg, int key, int count);
-void onlyDots(void *arg, int key, int count);
-void keyCount(void *arg, int key, int count);
+void sendGoldMessage(addr_t from, int caps, int collected, int purse, int remain);
+void sendPlayerMap(serverInfo_t *info, player_t *player);
+void sendOthersGold(hashtable_t *playerInfo, player_t *alreadySent, int goldCt);
+
+
+/**************** Traversals ****************/
+player_t *findPlayer(hashtable_t *playerInfo, addr_t addr);
+bool anyActivePlayers(hashtable_t *playerInfo);
+player_t *checkPlayerCollision(hashtable_t *playerInfo, position_t *originalPos, position_t *newPos, addr_t addr);
+int recountGold(hashtable_t *goldData);
+void markFilled(counters_t *filled, map_t *map, hashtable_t *goldInfo, hashtable_t *playerInfo);
 void playerDelete(void *item);
-void goldDelete(void *item);
+void playerFree(serverInfo_t *info, player_t *player);
 
 /************** main *****************/
 /* validates parameters and makes the call to the server
  */
 int main(int argc, char *argv[])
 {
-    int seed = -1;
-    if (!validateParameters(argc, argv, &seed)) {
+    serverOptions_t opts = {NULL, -1, message_SELECT, 0, log_VERBOSE, false, 0, 1, 0, 0, NULL};
+    if (!validateParameters(argc, argv, &opts)) {
         return 1;
     }
 
-	return server(argv, seed);
+	return server(&opts);
 }
 
 /************** server *****************/
 /* initializes all necessary data structures
  * and starts listening for messages from clients
  */
-int server(char *argv[], int seed)
+int server(serverOptions_t *opts)
 {
-    // initialize variables to be stored as the server information
-    //static const int MaxNameLength = 50;   // max number of chars in playerName
-    static const int maxPlayers = 26;      // maximum number of players
-  
-    int goldCt = 0;
-    int numPlayers = 0;
-    hashtable_t *playerInfo = hashtable_new(maxPlayers);
-    addr_t specAddr = message_noAddr();
-
-    // read the map file to create the map
-    FILE *fp;
-    int len = strlen(argv[1]);
-    char *mapfile = calloc(len + 1, sizeof(char));
-    strcpy(mapfile, argv[1]);
-    fp = fopen(mapfile, "r");
-    map_t *map = map_new(fp);
-    fclose(fp);
-    free(mapfile);
-
+    static const int AsyncLogRecords = 4096;  // records in the ring for --log=async
+    static const float WakeTimeout = 0.1;     // how often, in seconds, the network thread wakes on its own, with --rooms or --pipeline
 
+    // load the map file (in one go) to create the map, which every game shares
+    map_t *map = map_load(opts->mapfile);
     if (map == NULL) {
-        fprintf(stderr, "unable to load map");
+        fprintf(stderr, "unable to load map\n");
         return 2;
     }
-    // create the counters which holds the integer positions of '.' in the map
-    counters_t *dotsPos = getDotsPos(map->mapStr);
-    // generate the gold randomly (or based on the seed) and store in a hashtable
-    hashtable_t *goldData = generateGold(map, seed, &goldCt, dotsPos);
+    map->lightRadius = opts->lightRadius;
 
-    // construct the serverInfo object which holds all the relevant data for the server
-    serverInfo_t info = {&numPlayers, &goldCt, maxPlayers, playerInfo, goldData, dotsPos, map, specAddr};
+    // one game, or one for each room; see rooms.h
+    host_t host = {NULL, NULL, opts->rooms, NULL, NULL, 1, NULL, NULL};
+    host.games = count_callocTag(host.numRooms, sizeof(serverInfo_t *), mem_OTHER);
+    if (host.games == NULL) {
+        fprintf(stderr, "out of memory");
+        return 2;
+    }
+    for (int r = 0; r < host.numRooms; r++) {
+        // generate the gold randomly (or based on the seed), differently in each room
+        host.games[r] = game_new(map, opts->seed, opts->rngStates, r);
+        if (host.games[r] == NULL) {
+            fprintf(stderr, "out of memory");
+            return 2;
+        }
+    }
     
-    // start logging
+    // start logging, at the requested level and (if asked) from a background thread
+    log_setLevel(opts->logLevel);
+    if (opts->asyncLog && !log_startAsync(stderr, AsyncLogRecords)) {
+        fprintf(stderr, "cannot start asynchronous logging; logging synchronously\n");
+    }
     log_init(stderr);
-    // initialize messages; listen on a port
+    // record each game's random state as seeded, so the game can be replayed
+    for (int r = 0; r < host.numRooms; r++) {
+        char gold[rng_SavedBytes], spawn[rng_SavedBytes], line[2 * rng_SavedBytes + 48];
+        rng_save(&((game_t *) host.games[r])->goldSeeded, gold);
+        rng_save(&host.games[r]->spawnRng, spawn);
+        snprintf(line, sizeof(line), "room %d: gold %s, spawns %s", r, gold, spawn);
+        log_s("random state, %s", line);
+        logGold(host.games[r]);
+    }
+    // initialize messages on the requested backend; listen on a port.
+    // rooms' workers, and a pipeline's sender, send from their own threads,
+    // which only the select backend allows
+    if ((host.numRooms > 1 || opts->pipeline > 0) && opts->backend != message_SELECT) {
+        fprintf(stderr, "--rooms and --pipeline use the select backend\n");
+        opts->backend = message_SELECT;
+    }
+    message_setBackend(opts->backend);
+    message_setSendBuffer(opts->sendBuffer);
     int serverPort = message_init(stderr);
     if (serverPort == 0) {
+        log_stopAsync();
         return 3;
     }
     printf("waiting for connections on port %d\n", serverPort);
 
-    // continue looping, listening for messages until the end of the game is triggered
-    message_loop(&info, 0, NULL, handleInput, handleMessage);
+    if (opts->pipeline > 0) {
+        if (startPipeline(&host, opts->pipeline)) {
+            printf("playing in stages, with %d render workers\n", opts->pipeline);
+            // take in messages until the simulation finds the game over
+            message_loop(&host, WakeTimeout, handleTimeout, handleInput, handleMessage);
+            // and let the later stages finish
+            pipeline_stop(host.pipeline);
+        } else {
+            log_e("cannot start the pipeline");
+        }
+    } else if (host.numRooms == 1) {
+        // continue looping, listening for messages until the end of the game is triggered
+        message_loop(&host, 0, NULL, handleInput, handleMessage);
+    } else if (startRooms(&host, opts->workers)) {
+        printf("hosting %d games on %d workers\n", host.numRooms, host.numWorkers);
+        // route messages to the rooms until every game has ended
+        message_loop(&host, WakeTimeout, handleTimeout, handleInput, handleMessage);
+        // let the workers finish what they are doing
+        poolStats_t pool = pool_stats(host.pool);
+        pool_delete(host.pool);
+        log_d("room runs: %d", (int) pool.runs);
+        log_d("messages handled in rooms: %d", (int) pool.messages);
+        log_d("rooms stolen by idle workers: %d", (int) pool.steals);
+        log_d("most rooms waiting for a worker: %d", pool.maxPending);
+    } else {
+        log_e("cannot start the rooms' workers");
+    }
+
+    // report on oversized (fragmented) frames before shutting down
+    message_stats_t stats = message_stats();
+    log_d("fragments sent: %d", stats.fragmentsSent);
+    log_d("reassemblies dropped: %d", stats.reassembliesDropped);
+    // and on messages that had to wait for room in the socket
+    log_d("messages queued: %d", stats.messagesQueued);
+    log_d("displays superseded while queued: %d", stats.superseded);
+    log_d("messages dropped from full queues: %d", stats.queueDrops);
+    log_d("deepest send queue: %d", stats.maxQueueDepth);
+    // and on how often handling a keystroke needed the heap (only while the arena grows)
+    long keyMessages = 0, keyHeapMessages = 0, arenaChunks = 0;
+    for (int r = 0; r < host.numRooms; r++) {
+        keyMessages += host.games[r]->keyMessages;
+        keyHeapMessages += host.games[r]->keyHeapMessages;
+        arenaChunks += arena_heapAllocs(host.games[r]->arena);
+    }
+    log_d("KEY messages handled: %d", (int) keyMessages);
+    log_d("KEY messages that allocated from the heap: %d", (int) keyHeapMessages);
+    log_d("scratch arena chunks allocated: %d", (int) arenaChunks);
 
     // clean up
     message_done();
+    log_stopAsync();
+    // where memory went, with the games' structures still live
+    count_reportTags(stderr);
+    reportSeen(&host, stderr);
+    if (host.pipeline != NULL) {
+        pipeline_printStats(host.pipeline, stderr);
+        log_d("runs the renderers missed: %d", (int) host.frames->runsDropped);
+        pipeline_delete(host.pipeline);
+    }
     log_done();
+    for (int r = 0; r < host.numRooms; r++) {
+        if (host.rooms != NULL) {
+            room_delete(host.rooms[r]);
+        }
+        game_delete(host.games[r]);
+    }
+    if (host.rooms != NULL) {
+        count_free(host.rooms);
+        hashtable_delete(host.routes, count_free);
+    }
+    frames_delete(host.frames);
+    count_free(host.games);
     map_delete(map);
-    hashtable_delete(playerInfo, playerDelete);
-    hashtable_delete(goldData, goldDelete);
-    counters_delete(dotsPos);
     return 0;
 }
 
+/************** game_new *****************/
+/* sets up a game on map: its players (none yet), its gold, placed at
+ * random from the seed (or the pid, if seed is -1), and everything it
+ * allocates from; returns NULL on malloc error.  Each room draws from
+ * streams of its own (see rng.h), one for the gold and one for where
+ * players appear, so that rooms differ, and the gold is the same however
+ * the players come and go. If rngStates (from --rng) has states for the
+ * room, its streams start from those instead, to replay an earlier game
+ */
+static serverInfo_t *game_new(map_t *map, int seed, const char *rngStates, int room)
+{
+    game_t *game = game_alloc(map, room);
+    if (game == NULL) {
+        return NULL;
+    }
+    if (!restoreRng(rngStates, room, &game->info.goldRng, &game->info.spawnRng)) {
+        uint64_t from = seed == -1 ? (uint64_t) getpid() : (uint64_t) seed;
+        rng_seed(&game->info.goldRng, from, 2 * room);
+        rng_seed(&game->info.spawnRng, from, 2 * room + 1);
+    }
+    game->goldSeeded = game->info.goldRng;
+
+    // generate the gold randomly on the map's floor, and store in a hashtable
+    game->info.goldData = generateGold(map, &game->info.goldRng, &game->goldCt, game->info.goldSlab, game->info.posSlab);
+    return &game->info;
+}
+
+/************** logGold *****************/
+/* logs where a game's gold is, pile by pile, as "x,y=value"; a game
+ * restored with --rng from the random state logged beside it repeats it
+ */
+static void logGold(serverInfo_t *info)
+{
+    static const int PileBytes = 3 * format_IntBytes;   // one " x,y=value"
+    int piles = 0;
+    for (hashtable_cursor_t c = hashtable_cursor(info->goldData); hashtable_next(info->goldData, &c, NULL, NULL); ) {
+        piles++;
+    }
+    char *line = arena_alloc(info->arena, PileBytes * piles + format_IntBytes + 8);
+    if (line == NULL) {
+        return;
+    }
+    int len = snprintf(line, format_IntBytes + 8, "room %d:", info->room);
+    void *item;
+    for (hashtable_cursor_t c = hashtable_cursor(info->goldData); hashtable_next(info->goldData, &c, NULL, &item); ) {
+        gold_t *gold = item;
+        len += snprintf(line + len, PileBytes, " %" PRId64 ",%" PRId64 "=%d", gold->pos->x, gold->pos->y, gold->value);
+    }
+    log_s("gold, %s", line);
+    arena_reset(info->arena);
+}
+
+/************** game_alloc *****************/
+/* sets up a game on map with no players, no gold and no random state
+ * yet, and everything it allocates from; returns NULL on malloc error
+ */
+static game_t *game_alloc(map_t *map, int room)
+{
+    game_t *game = count_callocTag(1, sizeof(game_t), mem_ENTITIES);
+    if (game == NULL) {
+        return NULL;
+    }
+    hashtable_t *playerInfo = hashtable_new(MaxPlayers);
+    // the game's players, gold piles and their positions are allocated from these,
+    // and released all at once when the game ends
+    slab_t *playerSlab = slab_newOf(player_t, MaxPlayers, mem_ENTITIES);
+    slab_t *goldSlab = slab_newOf(gold_t, 32, mem_ENTITIES);
+    slab_t *posSlab = slab_newOf(position_t, 64, mem_ENTITIES);
+    // and everything needed only while handling one message comes from here
+    arena_t *arena = arena_new(64 * 1024, mem_RENDER);
+    if (playerInfo == NULL || playerSlab == NULL || goldSlab == NULL || posSlab == NULL || arena == NULL) {
+        // let go of whatever was made before the failure
+        hashtable_delete(playerInfo, NULL);
+        slab_delete(playerSlab);
+        slab_delete(goldSlab);
+        slab_delete(posSlab);
+        arena_delete(arena);
+        count_free(game);
+        return NULL;
+    }
+
+    // construct the serverInfo object which holds all the relevant data for the game
+    // (copied in whole, since its maxPlayers cannot be assigned)
+    serverInfo_t info = {&game->numPlayers, &game->goldCt, MaxPlayers, playerInfo, NULL, map,
+                         message_noAddr(), 0, {-1, -1, 0, 0, 1}, NULL, 0, 0,
+                         playerSlab, goldSlab, posSlab, arena, 0, 0, room};
+    memcpy(&game->info, &info, sizeof(info));
+    return game;
+}
+
+/************** game_delete *****************/
+/* frees a game made by game_new (or game_alloc), but not its map */
+static void game_delete(serverInfo_t *info)
+{
+    if (info != NULL) {
+        overview_delete(info->overview);
+        hashtable_delete(info->playerInfo, playerDelete);
+        hashtable_delete(info->goldData, NULL);
+        // release every player, gold pile and position in one go
+        slab_delete(info->playerSlab);
+        slab_delete(info->goldSlab);
+        slab_delete(info->posSlab);
+        arena_delete(info->arena);
+        count_free((game_t *) info);
+    }
+}
+
+/************** startRooms *****************/
+/* makes a room for each of the host's games, and starts workers (by
+ * default, one per processor, but no more than there are rooms) to run
+ * them; returns false on error
+ */
+static bool startRooms(host_t *host, int workers)
+{
+    host->rooms = count_callocTag(host->numRooms, sizeof(room_t *), mem_OTHER);
+    host->routes = hashtable_new(MaxPlayers * host->numRooms);
+    if (host->rooms == NULL || host->routes == NULL) {
+        return false;
+    }
+    for (int r = 0; r < host->numRooms; r++) {
+        if ((host->rooms[r] = room_new(r, host->games[r])) == NULL) {
+            return false;
+        }
+        host->games[r]->seats = &host->rooms[r]->seats;
+    }
+    if (workers <= 0) {
+        long processors = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = processors > 0 ? processors : 1;
+    }
+    if (workers > host->numRooms) {
+        workers = host->numRooms;
+    }
+    host->pool = pool_new(workers, host->numRooms, handleGameMessage);
+    host->numWorkers = workers;
+    return host->pool != NULL;
+}
+
+/************** startPipeline *****************/
+/* plays the host's one game in stages (see pipeline.h), with workers
+ * render threads drawing its frames from a copy of it; returns false on
+ * error
+ */
+static bool startPipeline(host_t *host, int workers)
+{
+    serverInfo_t *game = host->games[0];
+    host->frames = frames_new(game, workers);
+    if (host->frames == NULL) {
+        return false;
+    }
+    game->frames = host->frames;
+    pipelineGame_t stages = {host->frames, sizeof(snapshot_t) + host->frames->numPiles * sizeof(bool),
+                             simulateFrames, captureFrames, prepareFrames, renderFrames};
+    host->pipeline = pipeline_new(&stages, workers);
+    return host->pipeline != NULL;
+}
+
+/************** frames_new *****************/
+/* sets up the copy of game a pipeline's workers render threads draw
+ * from: its gold, copied pile by pile, and (on each worker) an arena of
+ * its own; the players come later, from the snapshots.  Returns NULL on
+ * malloc error
+ */
+static frames_t *frames_new(serverInfo_t *game, int workers)
+{
+    frames_t *frames = count_callocTag(1, sizeof(frames_t), mem_OTHER);
+    if (frames == NULL) {
+        return NULL;
+    }
+    frames->game = game;
+    frames->numWorkers = workers;
+    game_t *mirror = game_alloc(game->map, game->room);
+    if (mirror == NULL) {
+        frames_delete(frames);
+        return NULL;
+    }
+    frames->mirror = &mirror->info;
+    frames->mirror->goldData = hashtable_new(32);
+    frames->runs = ring_new(RunSlots, mem_OTHER);
+    frames->workers = count_callocTag(workers, sizeof(serverInfo_t), mem_OTHER);
+    if (frames->mirror->goldData == NULL || frames->runs == NULL || frames->workers == NULL) {
+        frames_delete(frames);
+        return NULL;
+    }
+    for (int w = 0; w < workers; w++) {
+        memcpy(&frames->workers[w], frames->mirror, sizeof(serverInfo_t));
+        frames->workers[w].arena = w == 0 ? frames->mirror->arena : arena_new(64 * 1024, mem_RENDER);
+        if (frames->workers[w].arena == NULL) {
+            frames_delete(frames);
+            return NULL;
+        }
+    }
+
+    // the piles, in the order the cursor finds them, under the same keys
+    const char *key;
+    void *item;
+    for (hashtable_cursor_t c = hashtable_cursor(game->goldData); hashtable_next(game->goldData, &c, NULL, &item); ) {
+        frames->numPiles++;
+    }
+    frames->piles = count_callocTag(frames->numPiles + 1, sizeof(gold_t *), mem_OTHER);
+    frames->mirrorPiles = count_callocTag(frames->numPiles + 1, sizeof(gold_t *), mem_OTHER);
+    if (frames->piles == NULL || frames->mirrorPiles == NULL) {
+        frames_delete(frames);
+        return NULL;
+    }
+    int p = 0;
+    for (hashtable_cursor_t c = hashtable_cursor(game->goldData); hashtable_next(game->goldData, &c, &key, &item); p++) {
+        gold_t *gold = item;
+        gold_t *copy = slab_alloc(frames->mirror->goldSlab);
+        position_t *pos = slab_alloc(frames->mirror->posSlab);
+        if (copy == NULL || pos == NULL || !hashtable_insert(frames->mirror->goldData, key, copy)) {
+            frames_delete(frames);
+            return NULL;
+        }
+        *copy = *gold;
+        *pos = *gold->pos;
+        copy->pos = pos;
+        frames->piles[p] = gold;
+        frames->mirrorPiles[p] = copy;
+    }
+    return frames;
+}
+
+/************** frames_delete *****************/
+/* frees what frames_new made, once the pipeline drawing from it is gone;
+ * we ignore NULL frames
+ */
+static void frames_delete(frames_t *frames)
+{
+    if (frames == NULL) {
+        return;
+    }
+    run_t *run;
+    while (frames->runs != NULL && (run = ring_pop(frames->runs)) != NULL) {
+        count_free(run);
+    }
+    ring_delete(frames->runs);
+    for (int r = 0; r < frames->numDrawing; r++) {
+        count_free(frames->drawing[r]);
+    }
+    if (frames->drawing != NULL) {
+        count_free(frames->drawing);
+    }
+    if (frames->workers != NULL) {
+        for (int w = 1; w < frames->numWorkers; w++) {
+            arena_delete(frames->workers[w].arena);
+        }
+        count_free(frames->workers);
+    }
+    if (frames->piles != NULL) {
+        count_free(frames->piles);
+    }
+    if (frames->mirrorPiles != NULL) {
+        count_free(frames->mirrorPiles);
+    }
+    game_delete(frames->mirror);
+    count_free(frames);
+}
+
+/************** noteRun *****************/
+/* in a pipeline, passes a player's run from from to to (or, if from is
+ * to, where they were put) to the renderers, to look along for the
+ * player's copy; does nothing otherwise
+ */
+static void noteRun(serverInfo_t *info, player_t *player, position_t *from, position_t *to)
+{
+    frames_t *frames = info->frames;
+    if (frames == NULL) {
+        return;
+    }
+    run_t *run = count_mallocTag(sizeof(run_t), mem_OTHER);
+    if (run == NULL) {
+        log_e("out of memory");
+        frames->runsDropped++;
+        return;
+    }
+    *run = (run_t) {frames->nextRun, player->letter, *from, *to};
+    // with the renderers that far behind, the player forgets the way
+    if (!ring_push(frames->runs, run)) {
+        count_free(run);
+        frames->runsDropped++;
+        return;
+    }
+    frames->nextRun++;
+}
+
+/************** simulateFrames *****************/
+/* the pipeline's simulate: handles a message for the game frames draws */
+static bool simulateFrames(void *arg, const addr_t from, const char *message)
+{
+    frames_t *frames = arg;
+    return handleGameMessage(frames->game, from, message);
+}
+
+/************** captureFrames *****************/
+/* the pipeline's capture, on the simulation: copies into snap (a
+ * snapshot_t) where the players and gold are, and who is watching, if
+ * any frames have fallen due since the last; see pipeline.h
+ */
+static bool captureFrames(void *arg, void *snap)
+{
+    frames_t *frames = arg;
+    serverInfo_t *info = frames->game;
+    snapshot_t *s = snap;
+    if (info->framesDue == 0) {
+        return false;
+    }
+    s->due = info->framesDue;
+    info->framesDue = 0;
+
+    s->numPlayers = *info->numPlayers;
+    void *item;
+    for (hashtable_cursor_t c = hashtable_cursor(info->playerInfo); hashtable_next(info->playerInfo, &c, NULL, &item); ) {
+        player_t *player = item;
+        s->players[player->letter - 'A'] = (snapPlayer_t) {player->addr, player->caps, player->letter,
+                                                           player->isActive, *player->pos, player->view};
+    }
+    s->runsEnd = frames->nextRun;
+    s->specAddr = info->specAddr;
+    s->specCaps = info->specCaps;
+    s->specView = info->specView;
+    s->specEpoch = info->specEpoch;
+    s->specFollow = info->specFollow;
+    s->lastMoved = info->lastMoved;
+    for (int p = 0; p < frames->numPiles; p++) {
+        s->collected[p] = frames->piles[p]->isCollected;
+    }
+    return true;
+}
+
+/************** prepareFrames *****************/
+/* the pipeline's prepare, on render worker 0: brings the copy of the
+ * game up to date from snap, and takes the runs made before it; a job
+ * for each player, then one for the spectator
+ */
+static int prepareFrames(void *arg, const void *snap)
+{
+    frames_t *frames = arg;
+    const snapshot_t *s = snap;
+    serverInfo_t *mirror = frames->mirror;
+    frames->snap = s;
+    // where the spectator's worker last moved their window
+    mirror->specView = frames->workers[MaxPlayers % frames->numWorkers].specView;
+
+    for (int l = 0; l < s->numPlayers; l++) {
+        const snapPlayer_t *sp = &s->players[l];
+        player_t *player = frames->players[l] != NULL ? frames->players[l] : mirrorPlayer(frames, sp);
+        if (player != NULL) {
+            player->addr = sp->addr;
+            player->caps = sp->caps;
+            player->isActive = sp->isActive;
+            *player->pos = sp->pos;
+        }
+    }
+    for (int p = 0; p < frames->numPiles; p++) {
+        frames->mirrorPiles[p]->isCollected = s->collected[p];
+    }
+    mirror->specAddr = s->specAddr;
+    mirror->specCaps = s->specCaps;
+    mirror->lastMoved = s->lastMoved;
+    if (s->specEpoch != frames->specEpoch) {
+        viewport_t view = s->specView;
+        setSpectatorView(mirror, s->specCaps, &view);
+        frames->specEpoch = s->specEpoch;
+    }
+    mirror->specFollow = s->specFollow;
+
+    // the runs this snapshot has moved past
+    for (int r = 0; r < frames->numDrawing; r++) {
+        count_free(frames->drawing[r]);
+    }
+    frames->numDrawing = 0;
+    run_t *run;
+    while ((run = ring_peek(frames->runs)) != NULL && run->seq < s->runsEnd) {
+        if (frames->numDrawing == frames->maxDrawing) {
+            int max = frames->maxDrawing > 0 ? 2 * frames->maxDrawing : 64;
+            run_t **drawing = count_mallocTag(max * sizeof(run_t *), mem_OTHER);
+            if (drawing == NULL) {
+                log_e("out of memory");
+                break;
+            }
+            if (frames->drawing != NULL) {
+                memcpy(drawing, frames->drawing, frames->numDrawing * sizeof(run_t *));
+                count_free(frames->drawing);
+            }
+            frames->drawing = drawing;
+            frames->maxDrawing = max;
+        }
+        frames->drawing[frames->numDrawing++] = ring_pop(frames->runs);
+    }
+
+    for (int w = 0; w < frames->numWorkers; w++) {
+        arena_t *arena = frames->workers[w].arena;
+        memcpy(&frames->workers[w], mirror, sizeof(serverInfo_t));
+        frames->workers[w].arena = arena;
+    }
+    return MaxPlayers + 1;
+}
+
+/************** mirrorPlayer *****************/
+/* adds to the copy of the game a player the snapshot has and it has
+ * not; returns NULL on malloc error
+ */
+static player_t *mirrorPlayer(frames_t *frames, const snapPlayer_t *sp)
+{
+    serverInfo_t *mirror = frames->mirror;
+    player_t *player = slab_alloc(mirror->playerSlab);
+    position_t *pos = slab_alloc(mirror->posSlab);
+    seen_t *seen = seen_new(mirror->map->width, mirror->map->height);
+    char key[2] = {sp->letter, '\0'};
+    if (player == NULL || pos == NULL || seen == NULL) {
+        log_e("out of memory");
+        seen_delete(seen);
+        return NULL;
+    }
+    *player = (player_t) {sp->addr, pos, 0, sp->letter, sp->isActive, seen, sp->caps, sp->view};
+    *pos = sp->pos;
+    if (!hashtable_insert(mirror->playerInfo, key, player)) {
+        seen_delete(seen);
+        return NULL;
+    }
+    (*mirror->numPlayers)++;
+    frames->players[sp->letter - 'A'] = player;
+    return player;
+}
+
+/************** renderFrames *****************/
+/* the pipeline's render, on a worker: job l < 26 draws the frame of the
+ * player with letter 'A' + l, after looking along their runs; job 26
+ * draws the spectator's
+ */
+static void renderFrames(void *arg, int job, int worker)
+{
+    frames_t *frames = arg;
+    const snapshot_t *s = frames->snap;
+    serverInfo_t *info = &frames->workers[worker];
+    if (job < MaxPlayers) {
+        player_t *player = frames->players[job];
+        if (player == NULL) {
+            return;
+        }
+        for (int r = 0; r < frames->numDrawing; r++) {
+            run_t *run = frames->drawing[r];
+            if (run->letter == player->letter) {
+                map_lookAlong(info->map, player, &run->from, &run->to, info->arena);
+            }
+        }
+        if (s->due & FramesPlayers) {
+            sendPlayerMap(info, player);
+        }
+    } else if ((s->due & FramesSpectator) && message_isAddr(info->specAddr)) {
+        sendSpectatorView(info);
+    }
+    arena_reset(info->arena);
+}
+
+/************** handleTimeout *****************/
+/* ends the rooms' (or the pipeline's) message loop once every game has
+ * ended (which workers, or the simulation, notice, not the network thread)
+ */
+static bool handleTimeout(void *arg)
+{
+    host_t *host = arg;
+    if (host->pipeline != NULL) {
+        return pipeline_over(host->pipeline);
+    }
+    return pool_roomsOver(host->pool) == host->numRooms;
+}
+
 /************** handleInput *****************/
-/* allows for a manual closing of the server
+/* allows for a manual closing of the server (at end of input),
+ * and prints memory use by tag, and per player for what they have seen,
+ * when the operator types "stats"
  */
 static bool handleInput(void *arg)
 {
@@ -172,30 +807,67 @@ static bool handleInput(void *arg)
     if ((line = freadlinep(stdin)) == NULL) {
         return true;
     }
+    // "stats" prints where the server's memory is going (or, in a
+    // pipeline, whose renderers may be using the players' records of what
+    // they have seen, how its stages are keeping up)
+    if (strcmp(line, "stats") == 0) {
+        host_t *host = arg;
+        count_reportTags(stdout);
+        if (host->pipeline != NULL) {
+            pipeline_printStats(host->pipeline, stdout);
+        } else {
+            reportSeen(host, stdout);
+        }
+    }
+    free(line);
     return false;
 }
 
+/************** reportSeen *****************/
+/* prints what the players' records of what they have seen take, on
+ * average, beside the byte per cell a flat string would
+ */
+static void reportSeen(host_t *host, FILE *fp)
+{
+    size_t bytes = 0;
+    int numPlayers = 0;
+    for (int r = 0; r < host->numRooms; r++) {
+        // in a pipeline, only the renderers' copy of the game remembers
+        serverInfo_t *info = host->frames != NULL ? host->frames->mirror : host->games[r];
+        // a room's game may be running on a worker
+        if (host->rooms != NULL) {
+            pthread_mutex_lock(&host->rooms[r]->gameLock);
+        }
+        void *item;
+        for (hashtable_cursor_t c = hashtable_cursor(info->playerInfo); hashtable_next(info->playerInfo, &c, NULL, &item); ) {
+            player_t *player = item;
+            if (player->seen != NULL) {
+                bytes += seen_bytes(player->seen);
+                numPlayers++;
+            }
+        }
+        if (host->rooms != NULL) {
+            pthread_mutex_unlock(&host->rooms[r]->gameLock);
+        }
+    }
+    fprintf(fp, "seen maps: %d players, %zu bytes per player (%" PRId64 " as a flat string)\n",
+            numPlayers, numPlayers > 0 ? bytes / numPlayers : 0,
+            host->games[0]->map->width * host->games[0]->map->height + 1);
+}
+
 /************** generateGold *****************/
 /* generates random positions and values for the gold in the game
  * Returns a hashtable containing the generated gold structs
  */
-hashtable_t *generateGold(map_t *map, int seed, int *goldCt, counters_t *dotsPos)
+hashtable_t *generateGold(map_t *map, rng_t *rng, int *goldCt, slab_t *goldSlab, slab_t *posSlab)
 {
     static const int GoldTotal = 250;      // amount of gold in the game
     static const int GoldMinNumPiles = 10; // minimum number of gold piles
     int GoldMaxNumPiles = 30; // maximum number of gold piles
 
-    // randomize either based on the seed or the pid
-    if (seed == -1) {
-        srand(getpid());
-    } else {
-        srand(seed);
-    }
-
     // if there are less dots than the max possible piles, 
     // allow for a maximum number of piles equal to the number of dots minus one, allowing one space for a player. 
-    int numDots = 0;
-    counters_iterate(dotsPos, &numDots, keyCount);
+    int numDots = map->numFloor;
     if (numDots <= GoldMaxNumPiles) {
         GoldMaxNumPiles = numDots-1;
     }
@@ -206,12 +878,12 @@ hashtable_t *generateGold(map_t *map, int seed, int *goldCt, counters_t *dotsPos
     hashtable_t *goldInfo = hashtable_new(GoldMinNumPiles);     // initialize the goldInfo hashtable to store gold data
     
     while (goldToPlace != 0) {      // loop until all gold placed
-        gold_t *gold = gold_new();  // create the new pile of gold to be placed
+        gold_t *gold = gold_new(goldSlab);  // create the new pile of gold to be placed
 
         // generate gold for a pile to ensure min num piles, and a pile has at least 1 gold
-        int value = (rand() % GoldTotal/GoldMinNumPiles) + 1; 
+        int value = rng_below(rng, GoldTotal / GoldMinNumPiles) + 1;
         // generate a random position for the gold (must be an unoccupied '.' character)
-        position_t *pos = getRandomPos(map, dotsPos, goldInfo, NULL);
+        position_t *pos = getRandomPos(map, goldInfo, NULL, posSlab, rng);
 
         // if the random value is less than the remaining gold OR we have reached the max number of piles...
         if (goldToPlace-value < 0 || numPiles+1 == GoldMaxNumPiles) {
@@ -225,14 +897,12 @@ hashtable_t *generateGold(map_t *map, int seed, int *goldCt, counters_t *dotsPos
         gold->pos = pos;
 
         // convert the pile number into a string
-        int npLen = snprintf(NULL, 0, "%d", numPiles);
-        char *numPileStr = malloc(npLen + 1);
-        snprintf(numPileStr, npLen + 1, "%d", numPiles);
+        char numPileStr[format_IntBytes];
+        format_decimal(numPileStr, numPiles);
 
         // insert the gold into the hashtable
         hashtable_insert(goldInfo, numPileStr, gold);
 
-        free(numPileStr);
         numPiles++;     // increment the number of piles
 
     }
@@ -240,28 +910,168 @@ hashtable_t *generateGold(map_t *map, int seed, int *goldCt, counters_t *dotsPos
 }
 
 /************** handleMessage *****************/
-/* function to listen for messages from users
- * handles adding/deleting players/spectators
- * manages player moves
+/* function to listen for messages from users: with one game, handles
+ * each in turn; with --rooms, posts it to the room of the client that
+ * sent it, for a worker to handle
  */
 static bool handleMessage(void *arg, const addr_t from, const char *message)
+{
+	host_t *host = arg;
+	if (host == NULL) {     // defensive programming
+		log_v("handleMessage called with arg=NULL");
+		return true;
+	}
+	if (host->pipeline != NULL) {
+		if (!pipeline_post(host->pipeline, from, message)) {
+			log_v("dropping a message the simulation has no room for");
+		}
+		return pipeline_over(host->pipeline);
+	}
+	if (host->pool == NULL) {
+		return handleGameMessage(host->games[0], from, message);
+	}
+
+	room_t *room = routeMessage(host, from, message);
+	if (room != NULL && !pool_post(host->pool, room, from, message)) {
+		log_v("dropping a message for a game that has ended");
+	}
+	return pool_roomsOver(host->pool) == host->numRooms;
+}
+
+/************** routeMessage *****************/
+/* returns the room for a message: the one its sender joined or, for a
+ * PLAY or SPECTATE from a client in no room (or one whose game is over),
+ * the room it names with /ROOM=k if that is still open, else the first
+ * open room with a seat left (for a player) or at all (for a spectator).
+ * A PLAY holds a seat in its room until the game has handled it, and keeps
+ * it only if the game adds the player (see handleGameMessage).
+ * Returns NULL, having told the client if need be, if there is none
+ */
+static room_t *routeMessage(host_t *host, const addr_t from, const char *message)
+{
+	char key[RouteKeyBytes];
+	routeKey(from, key);
+	route_t *route = hashtable_find(host->routes, key);
+	bool play = strncmp(message, "PLAY", 4) == 0;
+	bool spectate = strncmp(message, "SPECTATE", 8) == 0;
+	if (!play && !spectate) {
+		if (route == NULL) {
+			log_v("ignoring a message from an address in no room");
+			return NULL;
+		}
+		return route->room;
+	}
+	if (route != NULL && !atomic_load(&route->room->over)) {
+		if (play) {
+			atomic_fetch_add(&route->room->seats, 1);
+		}
+		return route->room;
+	}
+
+	room_t *room = NULL;
+	int asked = requestedRoom(message);
+	if (asked >= 0 && asked < host->numRooms && !atomic_load(&host->rooms[asked]->over)) {
+		room = host->rooms[asked];
+	}
+	for (int r = 0; r < host->numRooms && room == NULL; r++) {
+		if (!atomic_load(&host->rooms[r]->over)
+		    && (spectate || atomic_load(&host->rooms[r]->seats) < MaxPlayers)) {
+			room = host->rooms[r];
+		}
+	}
+	if (room == NULL) {
+		char verb[16];
+		snprintf(verb, sizeof(verb), "%s", message);
+		verb[strcspn(verb, " ")] = '\0';
+		sendQuitMessage(from, parseCapabilities(verb, NULL), "no game has room for you, sorry!");
+		return NULL;
+	}
+	if (play) {
+		atomic_fetch_add(&room->seats, 1);
+	}
+
+	if (route == NULL) {
+		route = count_mallocTag(sizeof(route_t), mem_NET);
+		if (route == NULL || !hashtable_insert(host->routes, key, route)) {
+			log_e("out of memory");
+			if (route != NULL) {
+				count_free(route);
+			}
+			return NULL;
+		}
+	}
+	route->room = room;
+	log_d("routing a client to room %d", room->id);
+	return room;
+}
+
+/************** routeKey *****************/
+/* writes a client's address into key (RouteKeyBytes), as "address:port" in hex */
+static void routeKey(const addr_t addr, char *key)
+{
+	snprintf(key, RouteKeyBytes, "%08x:%04x", (unsigned int) ntohl(addr.sin_addr.s_addr),
+	         (unsigned int) ntohs(addr.sin_port));
+}
+
+/************** handleGameMessage *****************/
+/* handles one message for a game with handleClientMessage, then takes
+ * back everything it allocated in the game's arena. For KEY messages we
+ * count any that needed the heap (through memory.h, which the
+ * arena and the support containers use), which should happen
+ * only while the arena grows to fit the largest message; only this
+ * thread's allocations are counted, as with --rooms other workers are
+ * running other rooms meanwhile. With --rooms, a PLAY that did not add
+ * a player gives back the seat routeMessage held for it
+ */
+static bool handleGameMessage(void *arg, const addr_t from, const char *message)
 {
 	serverInfo_t *info = (serverInfo_t *)arg;
 	if (info == NULL) {     // defensive programming
-		log_v("handleMessage called with arg=NULL");
+		log_v("handleGameMessage called with arg=NULL");
 		return true;
 	}
+
+	int allocs = count_threadAllocs();
+	int joined = *info->numPlayers;
+	bool done = handleClientMessage(info, from, message);
+	if (info->seats != NULL && strncmp(message, "PLAY", 4) == 0 && *info->numPlayers == joined) {
+		atomic_fetch_sub(info->seats, 1);
+	}
+	if (strncmp(message, "KEY ", 4) == 0) {
+		info->keyMessages++;
+		if (count_threadAllocs() != allocs) {
+			info->keyHeapMessages++;
+		}
+	}
+	arena_reset(info->arena);
+	return done;
+}
+
+/************** handleClientMessage *****************/
+/* handles one message from a user:
+ * adds/deletes players/spectators
+ * manages player moves
+ */
+static bool handleClientMessage(serverInfo_t *info, const addr_t from, const char *message)
+{
 	hashtable_t *playerInfo = info->playerInfo;
 	int *numPlayers = info->numPlayers;
 	const int maxPlayers = info->maxPlayers;
 
-    // create memory to pass the message to the splitline function
-	char *line = calloc(strlen(message) + 1, sizeof(char));
+    // copy the message (into the arena) to pass to the splitline function
+	char *line = arena_alloc(info->arena, strlen(message) + 1);
+	if (line == NULL) {     // out of memory
+		log_e("out of memory");
+		return false;
+	}
 	strcpy(line, message);
 
     // split the message into an array of two words (a message from the client is always 1-2 words)
 	char *words[2];
 	splitline(line, words);
+    // a PLAY or SPECTATE verb may carry capabilities, as in "PLAY/BIN"
+    viewport_t view;
+    int caps = parseCapabilities(words[0], &view);
 
 
     // call the appropriate function relevant to the first word provided by the client
@@ -269,7 +1079,7 @@ static bool handleMessage(void *arg, const addr_t from, const char *message)
 	if (strcmp(words[0], "PLAY") == 0) {
         // validate the number of players
 		if (*numPlayers == maxPlayers) {
-			message_send(from, "QUIT Game is full: no more players can join");
+			sendQuitMessage(from, caps, "Game is full: no more players can join");
 		} else {
 			// check for blank player name
             bool allSpaces = true;
@@ -279,7 +1089,7 @@ static bool handleMessage(void *arg, const addr_t from, const char *message)
                 }
             }
             if (allSpaces) {
-                message_send(from, "QUIT name cannot be only spaces!");
+                sendQuitMessage(from, caps, "name cannot be only spaces!");
             }
             
             // truncate names that are too long
@@ -292,15 +1102,26 @@ static bool handleMessage(void *arg, const addr_t from, const char *message)
             // create a new player
 			char letter = 'A' + *numPlayers;                // set the letter based on the number of players, starting at 'A'
 			player_t *newPlayer = player_new(from, letter, info);
-            if (newPlayer == NULL || newPlayer->pos == NULL) {
+            if (newPlayer == NULL || newPlayer->pos == NULL || (newPlayer->seen == NULL && info->frames == NULL)) {
                 log_d("too many players (%d already created)", *numPlayers);
-                message_send(from, "QUIT no available spaces in the game, sorry!");
+                sendQuitMessage(from, caps, "no available spaces in the game, sorry!");
+                playerFree(info, newPlayer);
             } else {
-                if (hashtable_insert(playerInfo, words[1], newPlayer)) { // check for duplicate player name
+                newPlayer->caps = caps;
+                if (caps & CAP_VIEW) {
+                    // place the window around the player, no bigger than the map
+                    newPlayer->view = view;
+                    map_scrollView(info->map, &newPlayer->view, newPlayer->pos);
+                }
+                if (!hashtable_insert(playerInfo, words[1], newPlayer)) { // check for duplicate player name
+                    playerFree(info, newPlayer);
+                } else {
                     (*numPlayers)++;
+                    info->lastMoved = letter;
+                    noteRun(info, newPlayer, newPlayer->pos, newPlayer->pos);
                     // send the necessary initial info to the new player
                     log_c("sending info to new player: %c", letter);
-				    sendInitialInfo(from, info, letter);
+				    sendInitialInfo(from, info, letter, caps, (caps & CAP_VIEW) ? &newPlayer->view : NULL);
                     // send the map with the added new player to all clients
                     log_v("sending displays to all users");
 				    sendMaps(info);
@@ -310,17 +1131,12 @@ static bool handleMessage(void *arg, const addr_t from, const char *message)
     // key press from player or spectator
 	} else if (strcmp(words[0], "KEY") == 0) {
 
-        // Finding player from address
-	    struct findPlayer *f = malloc(sizeof(struct findPlayer));
-	    f->addr = from;
-	    hashtable_iterate(info->playerInfo, f, findPlayerITR);
-	    // Player that sent command
-	    player_t *fromPlayer = f->result;
-	    free(f);
+        // Finding player from address: the player that sent the command
+	    player_t *fromPlayer = findPlayer(info->playerInfo, from);
 
         int prevGold = 0;
         // Keeping track of prev gold to find the amount of gold collected on a move
-        if (!message_eqAddr(from, info->specAddr)){
+        if (fromPlayer != NULL){
             prevGold = fromPlayer->gold;
         }
         
@@ -332,62 +1148,64 @@ static bool handleMessage(void *arg, const addr_t from, const char *message)
                 log_v("removing spectator...");
                 info->specAddr = message_noAddr();
                 // send a quit message to the spectator
-                message_send(from, "QUIT Thanks for watching!");
-            } else { 
+                sendQuitMessage(from, info->specCaps, "Thanks for watching!");
+            } else if (fromPlayer != NULL) { 
                 // the player is no longer active; they should not be displayed on the map
                 fromPlayer->isActive = false;
                 // send a quit message to the player
-                message_send(from, "QUIT Thanks for playing!");
+                sendQuitMessage(from, fromPlayer->caps, "Thanks for playing!");
 
-                bool activePlayers = false;
-                hashtable_iterate(info->playerInfo, &activePlayers, searchActivePlayers);
-                if (!activePlayers && !message_isAddr(info->specAddr)) {
-                    free(line);
+                if (!anyActivePlayers(info->playerInfo) && !message_isAddr(info->specAddr)) {
                     return true;
                 } else {
                     // send the updated maps to all clients
-                    log_v("sending displays to all users...");
+                    logv_v("sending displays to all users...");
                     sendMaps(info);
                 }
             }
+        } else if (message_eqAddr(from, info->specAddr)) {
+            // a spectator's lower-case letter picks the player its window follows
+            if (islower(words[1][0])) {
+                info->specFollow = toupper(words[1][0]);
+                sendSpectatorView(info);
+            }
+        } else if (fromPlayer == NULL) {
+            log_v("ignoring a key from an address that is not playing");
         } else {
             // track the current position of the player before they move
-            position_t *prePos = malloc(sizeof(position_t));
-            prePos->x = fromPlayer->pos->x;
-            prePos->y = fromPlayer->pos->y;
-            if (prePos == NULL) {   // out of memory
-                free(line);
-                return true;
-            }
+            position_t before = *fromPlayer->pos;
+            position_t *prePos = &before;
 
             if (validateAction(words[1], fromPlayer, info)) {   // validate the input action of the player
                 hashtable_t *goldData = info->goldData;
+                info->lastMoved = fromPlayer->letter;
                 
+                // the renderers look along the way, in a pipeline
+                noteRun(info, fromPlayer, &before, fromPlayer->pos);
                 // check if the player has collided with another player
-                pb_t pb = {prePos, fromPlayer->pos, from};
-                hashtable_iterate(info->playerInfo, &pb, checkPlayerCollision);
+                player_t *aside = checkPlayerCollision(info->playerInfo, prePos, fromPlayer->pos, from);
+                if (aside != NULL) {
+                    noteRun(info, aside, aside->pos, aside->pos);
+                }
 
-                // Recount gold availability         
-                *info->goldCt = 0;       
-                hashtable_iterate(goldData, info, recountGold);
+                // Recount gold availability
+                *info->goldCt = recountGold(goldData);
                
                 int justReceived = fromPlayer->gold - prevGold;
 
                 if (justReceived > 0) {
-                  gb_t goldBundle = {fromPlayer, info->goldCt};
-
                   // log the gold collection
-                  log_d("gold collected: %d", justReceived);
-                  log_d("gold now in purse: %d", fromPlayer->gold);
-                  log_d("gold left in the game: %d", *info->goldCt);
-                  log_v("sending gold messages...");
+                  logv_d("gold collected: %d", justReceived);
+                  logv_d("gold now in purse: %d", fromPlayer->gold);
+                  logv_d("gold left in the game: %d", *info->goldCt);
+                  logv_v("sending gold messages...");
                   // send the gold message to the player
-                  sendGoldMessage(from, justReceived, fromPlayer->gold, *info->goldCt);
+                  sendGoldMessage(from, fromPlayer->caps, justReceived, fromPlayer->gold, *info->goldCt);
                   // send updated gold messages to other existing players...
-                  hashtable_iterate(info->playerInfo, &goldBundle, sendOthersGold);
+                  sendOthersGold(info->playerInfo, fromPlayer, *info->goldCt);
                   // send the gold message to the spectator (if there is one)
                   if (message_isAddr(info->specAddr)) {
-                      sendGoldMessage(info->specAddr, 0, 0, *info->goldCt);
+                      sendGoldMessage(info->specAddr, info->specCaps, 0, 0, *info->goldCt);
                   }
                 }
 
@@ -395,16 +1213,13 @@ static bool handleMessage(void *arg, const addr_t from, const char *message)
                 if(*info->goldCt == 0) {
                     log_v("sending game over screen to all users");
                     sendQuit(info);
-                    free(line);
-                    free(prePos);
                     return true;
                 } else {
                     // otherwise, send the updated maps as usual
-                    log_v("sending displays to all users");
+                    logv_v("sending displays to all users");
                     sendMaps(info);
                 }
             }
-            free(prePos);
 		}
     // new spectator
 	} else if (strcmp(words[0], "SPECTATE") == 0) {
@@ -412,162 +1227,113 @@ static bool handleMessage(void *arg, const addr_t from, const char *message)
 
         // check for an existing spectator
 		if (message_isAddr(specAddr)) {
-			message_send(specAddr, "QUIT You have been replaced by a new spectator.");
+			sendQuitMessage(specAddr, info->specCaps, "You have been replaced by a new spectator.");
 		}
 
         log_v("replacing spectator...");
         // update the spectator information
 		info->specAddr = from;
+		info->specCaps = caps;
+		info->specEpoch++;
+        setSpectatorView(info, caps, &view);
         // send the new spectator the initial info they need
         
         log_v("sending spectator info and display...");
-		sendInitialInfo(from, info, 's');
+		sendInitialInfo(from, info, 's', caps, info->overview != NULL ? &info->specView : NULL);
         // send the spectator the map
 		sendSpectatorView(info);
 	}
 
-	free(line);
 	return false;
 }
 
 /************** sendInitialInfo *****************/
 /* sends the initial information necessary for gameplay
- * to either a new player or a new spectator
+ * to either a new player or a new spectator, and the size
+ * of the window a player asked for (if view is not NULL)
  */
-void sendInitialInfo(const addr_t from, serverInfo_t *info, char letter)
+void sendInitialInfo(const addr_t from, serverInfo_t *info, char letter, int caps, const viewport_t *view)
 {
-    if (letter != 's') {    // indicates whether the client is a spectator or a player
-    // send the "OK L" message to the player
-        log_v("sending OK message");
-        char *letterMessage = malloc(5);
-        if (letterMessage != NULL) {
-            strcpy(letterMessage, "OK ");
-            
-            // add the player's corresponding letter
-            letterMessage[3] = letter;
-            letterMessage[4] = '\0';
-
-            // send the message
-            message_send(from, letterMessage);
-            free(letterMessage);
-        } else {
-            log_e("out of memory");
+    if (caps & CAP_BIN) {
+        // the binary protocol sends the same three messages as frames
+        unsigned char frame[3 * wire_HeaderBytes + 32];
+        if (letter != 's') {
+            pipeline_sendBytes(from, frame, wire_encodeOk(frame, sizeof(frame), letter));
         }
+        size_t len = wire_encodeGrid(frame, sizeof(frame), info->map->height, info->map->width);
+        pipeline_sendBytes(from, frame, len);
+        if (view != NULL) {
+            len = wire_encodeView(frame, sizeof(frame), view->rows, view->cols);
+            pipeline_sendBytes(from, frame, len);
+        }
+        sendGoldMessage(from, caps, 0, 0, *info->goldCt);
+        return;
     }
 
-    int NR = info->map->height;     // map height
-    int NC = info->map->width;      // map width
-
-    // get the length of the integers (if they were a string)
-    int NRlen = snprintf(NULL, 0, "%d", NR); 
-    int NClen = snprintf(NULL, 0, "%d", NC);
+    // room for "GRID NR NC", the longest of these messages
+    char message[5 + 2 * format_IntBytes];
 
-    // create a string for each integer
-    char *NRstr = malloc(NRlen + 1);
-    if (NRstr == NULL) { // out of memory
-        log_e("out of memory");
-        return;
-    }
-    char *NCstr = malloc(NClen + 1);
-    if (NCstr == NULL) { // out of memory
-        log_e("out of memory");
-        free(NRstr);
-        return;
+    if (letter != 's') {    // indicates whether the client is a spectator or a player
+        // send the "OK L" message to the player
+        log_v("sending OK message");
+        format_ok(message, sizeof(message), letter);
+        pipeline_send(from, message);
     }
-    // write the integers to their corresponding string
-    snprintf(NRstr, NRlen + 1, "%d", NR);
-    snprintf(NCstr, NClen + 1, "%d", NC);
 
     // send the "GRID NR NC" message to the client
     log_v("sending grid message");
-    char *message = malloc(NRlen + NClen + 7);
-    if (message != NULL) {
-        // build the message
-        strcpy(message, "GRID ");
-        strcat(message, NRstr);
-        strcat(message, " ");
-        strcat(message, NCstr);
-
-        // send the message
-        message_send(from, message);
-        free(message);
-    } else {
-        log_e("out of memory");
+    format_grid(message, sizeof(message), info->map->height, info->map->width);
+    pipeline_send(from, message);
+
+    // and the "VIEW NR NC" message, if the player asked for a window
+    if (view != NULL) {
+        log_v("sending view message");
+        format_view(message, sizeof(message), view->rows, view->cols);
+        pipeline_send(from, message);
     }
-    free(NRstr);
-    free(NCstr);
-    
+
     // send the initial gold message
     log_v("sending gold message");
-    sendGoldMessage(from, 0, 0, *info->goldCt);
+    sendGoldMessage(from, caps, 0, 0, *info->goldCt);
 }
 
 /************** sendGoldMessage *****************/
 /* constructs and sends the message informing the player
  * or spectator of gold collected and gold remaining in the game
  */
-void sendGoldMessage(addr_t address, int collected, int purse, int remain)
+void sendGoldMessage(addr_t address, int caps, int collected, int purse, int remain)
 {
-    // length of the integers if they were strings
-    int clen = snprintf(NULL, 0, "%d", collected);
-    int plen = snprintf(NULL, 0, "%d", purse);
-    int rlen = snprintf(NULL, 0, "%d", remain);
-    // allocate memory for the string form of the integers
-    char *cstr = malloc(clen + 1);
-    if (cstr == NULL) { // out of memory
-        log_e("out of memory");
-        return;
-    }
-    char *pstr = malloc(plen + 1);
-    if (pstr == NULL) { // out of memory
-        log_e("out of memory");
-        free(cstr);
+    if (caps & CAP_BIN) {
+        unsigned char frame[wire_HeaderBytes + 30];
+        size_t len = wire_encodeGold(frame, sizeof(frame), collected, purse, remain);
+        pipeline_sendBytes(address, frame, len);
         return;
     }
-    char *rstr = malloc(rlen + 1);
-    if (rstr == NULL) { // out of memory
-        log_e("out of memory");
-        free(cstr);
-        free(pstr);
-        return;
-    }
-    // write the integers to their corresponding string
-    snprintf(cstr, clen + 1, "%d", collected);
-    snprintf(pstr, plen + 1, "%d", purse);
-    snprintf(rstr, rlen + 1, "%d", remain);
-
-    // send the "GOLD n p r" message to the client
-    char *message = malloc(clen + plen + rlen + 8); 
-    if (message != NULL) {
-        // build the message
-        strcpy(message, "GOLD ");
-        strcat(message, cstr);
-        strcat(message, " ");
-        strcat(message, pstr);
-        strcat(message, " ");
-        strcat(message, rstr);
-
-        // send the message
-        message_send(address, message);
-        free(message);
-    } else {
-        log_e("out of memory");
-    }
-    free(cstr);
-    free(rstr);
-    free(pstr);
+
+    // build the "GOLD n p r" message on the stack and send it to the client
+    char message[5 + 3 * format_IntBytes];
+    format_gold(message, sizeof(message), collected, purse, remain);
+    pipeline_send(address, message);
 }
 
 /************** sendMaps *****************/
 /* calls the functions for sending maps
  * to players and the potential spectator
+ * (in a pipeline, marks them due, for the renderers to send)
  */
 void sendMaps(serverInfo_t *info)
 {
 	hashtable_t *playerInfo = info->playerInfo;
+	if (info->frames != NULL) {     // the renderers draw them; see captureFrames
+		info->framesDue |= FramesPlayers | FramesSpectator;
+		return;
+	}
 
     // for each player, construct their map and send it to their corresponding address
-	hashtable_iterate(playerInfo, info, mapSend);
+	void *item;
+	for (hashtable_cursor_t c = hashtable_cursor(playerInfo); hashtable_next(playerInfo, &c, NULL, &item); ) {
+		sendPlayerMap(info, item);
+	}
 
     // if there is an active spectator, send them the spectator view
 	if (message_isAddr(info->specAddr)) {
@@ -580,109 +1346,154 @@ void sendMaps(serverInfo_t *info)
  */
 void sendQuit(serverInfo_t *info)
 {   
-    // allocing result string and copying in the first line
-    char *result = (char*) malloc(sizeof(char) * 1000);
-    strcpy(result, "QUIT GAME OVER\n");
+    // building the summary on the stack, leaving room for "QUIT " in front
+    char result[QuitMessageBytes - 5];
+    format_t f;
+    format_start(&f, result, sizeof(result));
+    format_str(&f, "GAME OVER\n");
 
     hashtable_t *playerInfo = info->playerInfo;
-    // Building new string iteratively
-    hashtable_iterate(playerInfo, result, buildGameOverString);
-    hashtable_iterate(playerInfo, result, quitFunc);
+    const char *key;
+    void *item;
+    // one line per player
+    for (hashtable_cursor_t c = hashtable_cursor(playerInfo); hashtable_next(playerInfo, &c, &key, &item); ) {
+        player_t *player = item;
+        format_char(&f, player->letter);
+        format_char(&f, '\t');
+        format_int(&f, player->gold);
+        format_char(&f, '\t');
+        format_str(&f, key);
+        format_char(&f, '\n');
+    }
+    if (format_end(&f) >= sizeof(result)) {
+        log_e("game-over summary truncated");
+    }
+    // Sending every player the game over screen
+    for (hashtable_cursor_t c = hashtable_cursor(playerInfo); hashtable_next(playerInfo, &c, NULL, &item); ) {
+        player_t *player = item;
+        sendQuitMessage(player->addr, player->caps, result);
+    }
     if (message_isAddr(info->specAddr)) {
-        message_send(info->specAddr, result);
+        sendQuitMessage(info->specAddr, info->specCaps, result);
     }
-    free(result);
 }
 
-/*********** buildGameOverString ***********/
-/* builds the game over string to be sent to all clients
+/************** setSpectatorView *****************/
+/* sets up the view a new spectator asked for: with a window (VIEW) or a
+ * scale (SCALE), an overview of the map at that scale, kept from then on
+ * (reusing the last spectator's if the scale is the same), and a window
+ * of it no bigger than it (all of it, without VIEW); otherwise none
  */
-void buildGameOverString(void *arg, const char *key, void *item)
+static void setSpectatorView(serverInfo_t *info, int caps, viewport_t *view)
 {
-    char *result = arg;
-    player_t *player = item;
-    // Making this players score string
-    int bufsize = 10 + strlen(key);
-    char *plyRes = malloc(bufsize); 
-    snprintf(plyRes, bufsize, "%c\t%d\t%s\n", player->letter, player->gold, key);
-    
-    // Adding the string to the result string
-    strncat(result, plyRes, strlen(plyRes) + 1);
-    free(plyRes);
+    if (info->overview != NULL && (info->overview->scale != view->scale || !(caps & (CAP_VIEW | CAP_SCALE)))) {
+        overview_delete(info->overview);
+        info->overview = NULL;
+    }
+    info->specFollow = 0;
+    if (!(caps & (CAP_VIEW | CAP_SCALE))) {
+        return;
+    }
+    if (info->overview == NULL) {
+        info->overview = overview_new(info->map, view->scale, info->goldData);
+        if (info->overview == NULL) {
+            log_e("out of memory");
+            return;
+        }
+    }
+    info->specView = *view;
+    if (!(caps & CAP_VIEW) || info->specView.rows > info->overview->rows) {
+        info->specView.rows = info->overview->rows;
+    }
+    if (!(caps & CAP_VIEW) || info->specView.cols > info->overview->cols) {
+        info->specView.cols = info->overview->cols;
+    }
 }
 
-/************** quitFunc *****************/
-/* iterator function to send all players the game over screen
+/************** findFollowed *****************/
+/* returns the active player the spectator's window follows: the one
+ * they picked, else the one who last moved; NULL if neither is playing
  */
-void quitFunc(void *arg, const char *key, void *item)
+static player_t *findFollowed(serverInfo_t *info)
 {
-    // Sending a player a quit message
-    char *result = arg;
-    player_t *player = item;
-    message_send(player->addr, result);
+    player_t *picked = NULL, *last = NULL;
+    void *item;
+    for (hashtable_cursor_t c = hashtable_cursor(info->playerInfo); hashtable_next(info->playerInfo, &c, NULL, &item); ) {
+        player_t *player = item;
+        if (player->isActive && player->letter == info->specFollow) {
+            picked = player;
+        }
+        if (player->isActive && player->letter == info->lastMoved) {
+            last = player;
+        }
+    }
+    return picked != NULL ? picked : last;
 }
 
 /************** sendSpectatorView *****************/
-/* sends the spectator the fully visible map
+/* sends the spectator the fully visible map, or the window
+ * of the overview they asked for (see setSpectatorView)
  */
 void sendSpectatorView(serverInfo_t *info)
 {
 	addr_t specAddr = info->specAddr;
+	if (info->frames != NULL) {     // the renderers draw it; see captureFrames
+		info->framesDue |= FramesSpectator;
+		return;
+	}
+
+    if (info->overview != NULL) {
+        // bring the overview up to date, and move the window with the player it follows
+        viewport_t *view = &info->specView;
+        overview_update(info->overview, info->playerInfo);
+        player_t *followed = findFollowed(info);
+        if (followed != NULL) {
+            overview_follow(info->overview, view, followed->pos);
+        } else if (view->top < 0 || view->left < 0) {
+            view->top = view->left = 0;
+        }
+        char *grid = arena_alloc(info->arena, view->rows * (view->cols + 1) + 1);
+        if (grid == NULL) {
+            log_e("out of memory");
+            return;
+        }
+        overview_window(info->overview, view, grid);
+        map_t frame = {.mapStr = grid, .width = view->cols, .height = view->rows};
+        sendDisplay(specAddr, info->specCaps, &frame, info->arena);
+        return;
+    }
 
     // grab the default, unaltered map
     map_t *baseMap = info->map;
     // build the player map with a NULL player, indicating the spectator view
-    map_t *specMap = map_buildPlayerMap(baseMap, NULL, info->goldData, info->playerInfo);
+    map_t *specMap = map_buildPlayerMap(baseMap, NULL, info->goldData, info->playerInfo, info->arena);
     if (specMap == NULL) {  // out of memory
         return;
     }
 
-    int len = strlen(specMap->mapStr);
-	char *message = malloc(len + 9);
-    if (message != NULL) {
-        // build the message
-	    strcpy(message, "DISPLAY\n");
-	    strcat(message, specMap->mapStr);
-
-        // send the map
-        message_send(specAddr, message);
-	    free(message);
-    }
-	map_delete(specMap);
+    // send the map
+    sendDisplay(specAddr, info->specCaps, specMap, info->arena);
 }
 
-/************** mapSend *****************/
-/* iterator function called for each player
- * to construct and send them their individualized map
+/************** sendPlayerMap *****************/
+/* called for each player to construct
+ * and send them their individualized map
  */
-void mapSend(void *arg, const char* key, void *item)
+void sendPlayerMap(serverInfo_t *info, player_t *player)
 {
-    serverInfo_t *info = (serverInfo_t *)arg;
-    player_t *player = (player_t *)item;
     hashtable_t *playerInfo = info->playerInfo;
     hashtable_t *goldData = info->goldData;
     
     // grab the base, unaltered map
     map_t *baseMap = info->map;
-    // build the map specific to this player
-    map_t *playerMap = map_buildPlayerMap(baseMap, player, goldData, playerInfo); 
+    // build the map specific to this player (or just their window of it)
+    map_t *playerMap = map_buildPlayerView(baseMap, player, goldData, playerInfo, info->arena);
     if (playerMap == NULL) {    // out of memory
         return;
     }
 
-    int len = strlen(playerMap->mapStr);
-    char *message = malloc(len + 9);
-    if (message != NULL) {
-        // build the message
-        strcpy(message, "DISPLAY\n");
-        strcat(message, playerMap->mapStr);
-
-        // send the map
-        addr_t addr = player->addr;
-        message_send(addr, message);
-        free(message);
-    }
-    map_delete(playerMap);
+    // send the map
+    sendDisplay(player->addr, player->caps, playerMap, info->arena);
 }
 
 /************** splitline *****************/
@@ -711,7 +1522,7 @@ void splitline(char *message, char *words[])
  */
 player_t *player_new(addr_t from, char letter, serverInfo_t *info)
 {
-    player_t *player = malloc(sizeof(player_t));
+    player_t *player = slab_alloc(info->playerSlab);
     if (player == NULL) { // out of memory
         log_e("out of memory");
         return NULL;
@@ -721,15 +1532,13 @@ player_t *player_new(addr_t from, char letter, serverInfo_t *info)
     player->letter = letter;
     player->isActive = true;
     player->gold = 0;
-    player->visibility = calloc(info->map->width * info->map->height + 1, sizeof(char));
-
-    // Building out init vis string
-    for (int i = 0; i < info->map->width * info->map->height; i++) {
-		strcat(player->visibility, "0");
-	}
+    player->caps = 0;
+    player->view = (viewport_t) {-1, -1, 0, 0, 1};
+    // nothing seen yet; see seen.h (in a pipeline, the renderers keep this)
+    player->seen = info->frames == NULL ? seen_new(info->map->width, info->map->height) : NULL;
 
     // get a random unoccupied position in the map (where a '.' character is)
-    player->pos = getRandomPos(info->map, info->dotsPos, info->goldData, info->playerInfo);
+    player->pos = getRandomPos(info->map, info->goldData, info->playerInfo, info->posSlab, &info->spawnRng);
 
     return player;
 }
@@ -737,7 +1546,7 @@ player_t *player_new(addr_t from, char letter, serverInfo_t *info)
 /************** getRandomPos *****************/
 /* Returns a random, unoccupied position in the map
  */ 
-position_t *getRandomPos(map_t *map, counters_t *dotsPos, hashtable_t *goldInfo, hashtable_t *playerInfo)
+position_t *getRandomPos(map_t *map, hashtable_t *goldInfo, hashtable_t *playerInfo, slab_t *posSlab, rng_t *rng)
 {
     counters_t *filledPos = counters_new();     // counters to store locations of occupied '.' spaces in the map
     if (filledPos == NULL) { // out of memory
@@ -745,261 +1554,195 @@ position_t *getRandomPos(map_t *map, counters_t *dotsPos, hashtable_t *goldInfo,
          return NULL;
     }
 
-    // bundle to be based to the hashtable_iterate functions, adding occupied spaces to filledPos
-    ctrsmap_t bundle = {filledPos, map};
-
-    // iterate over gold, adding all occupied gold positions to filledPos
-    hashtable_iterate(goldInfo, &bundle, goldFill);
-    if (playerInfo != NULL) {
-        // iterate over players, adding all occupied player positions to filledPos
-        hashtable_iterate(playerInfo, &bundle, playerFill);
-    }
+    // add all occupied gold (and player) positions to filledPos
+    markFilled(filledPos, map, goldInfo, playerInfo);
 
-    counters_t *validPositions = counters_new();    // counters to store unoccupied '.' positions
-    if (validPositions == NULL) { // out of memory
-        log_e("out of memory");
-        counters_delete(filledPos);
-        return NULL;
+    // count the '.' positions that are not occupied (by gold or a player)
+    int numValidPos = map->numFloor;
+    int rank;
+    for (counters_cursor_t c = counters_cursor(filledPos); counters_next(filledPos, &c, &rank, NULL); ) {
+        numValidPos--;
     }
-    
-    // for all '.' positions, check if that position is occupied (by gold or a player). If not, add it to validPositions
-    twoctrs_t ctrs = {filledPos, validPositions};
-    counters_iterate(dotsPos, &ctrs, onlyDots);
-
-    // count the number of valid positions
-    int numValidPos = 0;
-    counters_iterate(validPositions, &numValidPos, keyCount);
 
     // there must be at least one valid position to return
-    if (numValidPos != 0) {
-        // select a random node in the counters
-        int val = rand() % numValidPos;
-        int finalPos = 0;
-
-        // iterate through the counters until that node is reached; return its position
-        twoints_t t = {&val, &finalPos};
-        counters_iterate(validPositions, &t, findPos);
-
+    position_t *result = NULL;
+    if (numValidPos > 0) {
+        // select a random valid position: the val'th free '.' is the val'th '.',
+        // moved on one for each occupied '.' at or before it (visited in increasing order)
+        int val = rng_below(rng, numValidPos);
+        for (counters_cursor_t c = counters_cursor(filledPos); counters_next(filledPos, &c, &rank, NULL); ) {
+            if (rank <= val) {
+                val++;
+            }
+        }
         // convert the integer value of the position to an actual (x, y) position in the map
-        position_t *result = map_intToPos(map, finalPos);
-
-        counters_delete(filledPos);
-        counters_delete(validPositions);
-        return result;
-    } else {
-        counters_delete(filledPos);
-        counters_delete(validPositions);
-        return NULL;
+        result = slab_alloc(posSlab);
+        if (result != NULL) {
+            map_cellToPos(map, map->floor[val], result);
+        }
     }
+    counters_delete(filledPos);
+    return result;
 }
 
-/************** findPos *****************/
-/* iterator function to store the key of the randomized
- * counter in a counters module
+/************** floorRank *****************/
+/* returns where cell is in the map's (increasing) list of '.' positions,
+ * found by binary search, or -1 if it is not a '.'
  */
-void findPos(void *arg, int key, int count)
+static int floorRank(map_t *map, mcoord_t cell)
 {
-    twoints_t *t = arg;
-    int *val = t->x;
-    int *finalPos = t->y;
-
-    // if we have not stored position information yet..
-    if (*val != -1) {
-        // if we are at our desired position...
-        if (*val == *finalPos) {
-            // store the integer value of the position in the map
-            *finalPos = key;
-            *val = -1;  // stop searching
+    int lo = 0, hi = map->numFloor;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (map->floor[mid] < cell) {
+            lo = mid + 1;
         } else {
-            // otherwise, increment the current position
-            (*finalPos)++;
+            hi = mid;
         }
     }
+    return lo < map->numFloor && map->floor[lo] == cell ? lo : -1;
 }
 
-/************** goldFill *****************/
-/* adds all gold positions to the counters
- * keeping track of all occupied positions in the map
+/************** markFilled *****************/
+/* adds where the spots of all gold piles, and of all active players (if
+ * playerInfo is not NULL), are in the map's list of '.' positions (see
+ * floorRank) to the filled counters; a map's cells may outnumber an int,
+ * its '.' positions do not
  */
-void goldFill(void *arg, const char *key, void *item)
+void markFilled(counters_t *filled, map_t *map, hashtable_t *goldInfo, hashtable_t *playerInfo)
 {
-    ctrsmap_t *bundle = arg;
-    counters_t *filled = bundle->ctrs;
-    map_t *map = bundle->map;
-    gold_t *gold = item;
-    position_t *pos = gold->pos;
-
-    // calculate the integer position of the gold within the map
-    int val = map_calcPosition(map, pos);
-
-    // add this integer position to the filled counters
-    counters_add(filled, val);
-}
-
-/************** playerFill *****************/
-/* adds player positions as occupied positions
- * to the occupied positions counters
- */
-void playerFill(void *arg, const char *key, void *item)
-{
-    ctrsmap_t *bundle = arg;
-    counters_t *filled = bundle->ctrs;
-    map_t *map = bundle->map;
-    player_t *player = item;
-    position_t *pos = player->pos;
-
-    // only consider a space occupied if the player is active
-    if (player->isActive) {
-
-        // get the integer position of their (x,y) position in the map
-        int val = map_calcPosition(map, pos);
-
-        // store the integer positon in the filled counters
-        counters_add(filled, val);
+    void *item;
+    for (hashtable_cursor_t c = hashtable_cursor(goldInfo); hashtable_next(goldInfo, &c, NULL, &item); ) {
+        gold_t *gold = item;
+        int rank = floorRank(map, map_calcPosition(map, gold->pos));
+        if (rank >= 0) {
+            counters_add(filled, rank);
+        }
     }
-}
-
-/************** searchActivePlayers *****************/
-/* function to check if there are any active players still
- * in the game
- */
-void searchActivePlayers(void *arg, const char *key, void *item)
-{
-    player_t *player = item;
-    bool *active = arg;
-
-    // if there is at least one active player, do not end the game
-    if (player->isActive) {
-        *active = true;
+    if (playerInfo != NULL) {
+        for (hashtable_cursor_t c = hashtable_cursor(playerInfo); hashtable_next(playerInfo, &c, NULL, &item); ) {
+            player_t *player = item;
+            // only consider a space occupied if the player is active
+            int rank = floorRank(map, map_calcPosition(map, player->pos));
+            if (player->isActive && rank >= 0) {
+                counters_add(filled, rank);
+            }
+        }
     }
 }
 
-/************** onlyDots *****************/
-/* builds a counters which holds all unoccupied '.'
- * positions in the map
+/************** anyActivePlayers *****************/
+/* returns true if there are any active players still
+ * in the game
  */
-void onlyDots(void *arg, int key, int count)
+bool anyActivePlayers(hashtable_t *playerInfo)
 {
-    twoctrs_t *ctrs = arg;
-    counters_t *filled = ctrs->ctrs1;
-    counters_t *validPos = ctrs->ctrs2;
-
-    // if the integer position is not in the filled counters, it is unoccupied
-    if (counters_get(filled, key) == 0) {
-        // thus, add it to the counters of valid positions
-        counters_add(validPos, key);
+    void *item;
+    for (hashtable_cursor_t c = hashtable_cursor(playerInfo); hashtable_next(playerInfo, &c, NULL, &item); ) {
+        player_t *player = item;
+        // if there is at least one active player, do not end the game
+        if (player->isActive) {
+            return true;
+        }
     }
+    return false;
 }
 
 /************** playerDelete *****************/
-/* function to delete a player struct
+/* function to delete what a player struct holds outside the game's slabs;
+ * the struct and its position are released with the slabs
  */
 void playerDelete(void *item)
 {
     player_t *player = item;
     if (player != NULL) {
-        if (player->pos != NULL) {
-            free(player->pos);
-        }
-        if (player->visibility != NULL) {
-            free(player->visibility);
-        }
-        free(player);
-    }
-}
-
-/************** goldDelete *****************/
-/* function to delete a gold struct
- */
-void goldDelete(void *item)
-{
-    gold_t *gold = item;
-    if (gold != NULL) {
-        if (gold->pos != NULL) {
-            free(gold->pos);
-        }
-        free(gold);
+        seen_delete(player->seen);
     }
 }
 
-/************** keyCount *****************/
-/* simple function to count the number of keys in a `counters` module
+/************** playerFree *****************/
+/* returns a player that never joined the game (and its position, if any)
+ * to the game's slabs for reuse
  */
-void keyCount(void *arg, int key, int count)
+void playerFree(serverInfo_t *info, player_t *player)
 {
-    int *nkeys = arg;
-    if (nkeys != NULL && key >= 0 && count >=0) {
-        (*nkeys)++;
+    if (player != NULL) {
+        playerDelete(player);
+        slab_free(info->posSlab, player->pos);
+        slab_free(info->playerSlab, player);
     }
 }
 
 /************** checkPlayerCollision *****************/
-/* checks if two players have collided, and swaps their
- * locations appropriately if so
+/* checks if the player who moved from originalPos to newPos has collided
+ * with another player, and swaps their locations appropriately if so;
+ * returns the player moved aside, or NULL if none
  */
-void checkPlayerCollision(void *arg, const char *key, void *item)
+player_t *checkPlayerCollision(hashtable_t *playerInfo, position_t *originalPos, position_t *newPos, addr_t addr)
 {
-    pb_t *pb = arg;
-    position_t *originalPos = pb->pos1;
-    position_t *newPos = pb->pos2;
-    addr_t addr = pb->addr;
-    player_t *player = item;
+    void *item;
+    for (hashtable_cursor_t c = hashtable_cursor(playerInfo); hashtable_next(playerInfo, &c, NULL, &item); ) {
+        player_t *player = item;
+        if (!message_eqAddr(addr, player->addr) && player->pos->x == newPos->x && player->pos->y == newPos->y) {
+            // move the x position closer until it is 1 space away from the player
+            while (llabs(originalPos->x - newPos->x) > 1) {
+                originalPos->x += originalPos->x < newPos->x ? 1 : -1;
+            }
 
-    if (!message_eqAddr(addr, player->addr) && player->pos->x == newPos->x && player->pos->y == newPos->y) {
-        // move the x position closer until it is 1 space away from the player
-        while (abs(originalPos->x - newPos->x) > 1) {
-            originalPos->x -= 1;
-        }
+            // move the y position closer until it is 1 space away from the player
+            while (llabs(originalPos->y - newPos->y) > 1) {
+                originalPos->y += originalPos->y < newPos->y ? 1 : -1;
+            }
 
-        // move the y position closer until it is 1 space away from the player
-        while (abs(originalPos->y - newPos->y) > 1) {
-            originalPos->y -= 1;
+            // swaps the player that's been collided with to their proper spot;
+            // no two players share a spot, so there is no one else to check
+            player->pos->x = originalPos->x;
+            player->pos->y = originalPos->y;
+            return player;
         }
-
-        // swaps the player that's been collided with to their proper spot
-        player->pos->x = originalPos->x;
-        player->pos->y = originalPos->y;
     }
+    return NULL;
 }
 
 /************** recountGold *****************/
-/* An iterator to recount the gold that is left, called after a player moves
- * *info->goldCt must be set to 0 before the iterator is called
+/* recounts the gold that is left, called after a player moves
  */
-void recountGold(void *arg, const char *key, void *item)
+int recountGold(hashtable_t *goldData)
 {
-    serverInfo_t *info = arg;
-    gold_t *goldItem = item;
-
-    // for any uncollected gold, add its value to the total gold left in the game
-    if (!goldItem->isCollected){
-       *info->goldCt += goldItem->value;
+    int goldCt = 0;
+    void *item;
+    for (hashtable_cursor_t c = hashtable_cursor(goldData); hashtable_next(goldData, &c, NULL, &item); ) {
+        gold_t *goldItem = item;
+        // for any uncollected gold, add its value to the total gold left in the game
+        if (!goldItem->isCollected) {
+            goldCt += goldItem->value;
+        }
     }
+    return goldCt;
 }
 
 /************** sendOthersGold *****************/
 /* sends updated gold counters to all players in the game
  * after a player has collected gold
  */
-void sendOthersGold(void *arg, const char *key, void *item)
+void sendOthersGold(hashtable_t *playerInfo, player_t *alreadySent, int goldCt)
 {
-    gb_t *goldBundle = arg;
-    int *goldCt = goldBundle->goldCt;
-    player_t *alreadySent = goldBundle->player;
-    player_t *player = item;
-
-    // send the updated gold count to all other players
-    if (!message_eqAddr(alreadySent->addr, player->addr) && player->isActive) {
-        sendGoldMessage(player->addr, 0, player->gold, *goldCt);
+    void *item;
+    for (hashtable_cursor_t c = hashtable_cursor(playerInfo); hashtable_next(playerInfo, &c, NULL, &item); ) {
+        player_t *player = item;
+        // send the updated gold count to all other players
+        if (!message_eqAddr(alreadySent->addr, player->addr) && player->isActive) {
+            sendGoldMessage(player->addr, player->caps, 0, player->gold, goldCt);
+        }
     }
 }
 
 /************** gold_new *****************/
 /* allocates a new gold struct
  */
-gold_t *gold_new()
+gold_t *gold_new(slab_t *goldSlab)
 {
-    gold_t *gold = malloc(sizeof(gold_t));
+    gold_t *gold = slab_alloc(goldSlab);
     if (gold == NULL) { // out of memory
         return NULL;
     }
@@ -1011,52 +1754,55 @@ gold_t *gold_new()
     return gold;
 }
 
-/************** getDotsPos *****************/
-/* builds the counters to hold the position
- * of all '.' spaces in the map
- */
-counters_t *getDotsPos(char *map)
-{
-	counters_t *dotsPos = counters_new();   // counters to return
-    if (dotsPos == NULL) {  // out of memory
-        log_e("out of memory");
-        return NULL;
-    }
-	int pos;
-	int len = strlen(map);
-
-    // iterate through the entire map, adding positions holding a '.'
-	for (pos = 0; pos < len; pos++) {
-		if (map[pos] == '.') {
-			counters_add(dotsPos, pos);
-		}
-	}
-	return dotsPos;
-}
-
 /************** validateParameters *****************/
 /* checks and validates command-line arguments
  * Returns True if all parameters are valid
  */
-bool validateParameters(int argc, char *argv[], int *seed)
+bool validateParameters(int argc, char *argv[], serverOptions_t *opts)
 {
+	static const char *usage = "usage: ./server [--net=select|uring] [--sndbuf=bytes] [--loglevel=error|info|verbose] [--log=sync|async] [--light=radius] [--rooms=N [--workers=N] | --pipeline=renderers] [--rng=gold,spawns[/gold,spawns...]] map.txt [seed]\n";
+
+	// separate "--name=value" options from the positional arguments
+	char *args[2];
+	int nargs = 0;
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--", 2) == 0) {
+			if (!parseOption(argv[i], opts)) {
+				fprintf(stderr, "invalid option '%s'\n", argv[i]);
+				fprintf(stderr, "%s", usage);
+				return false;
+			}
+		} else if (nargs < 2) {
+			args[nargs++] = argv[i];
+		} else {
+			nargs++;
+		}
+	}
+
 	// validate number of arguments
-	if (argc < 2 || argc > 3) {
-		fprintf(stderr, "usage: ./server map.txt [seed]\n");
+	if (nargs < 1 || nargs > 2) {
+		fprintf(stderr, "%s", usage);
+		return false;
+	}
+	// a pipeline plays one game
+	if (opts->pipeline > 0 && opts->rooms > 1) {
+		fprintf(stderr, "--pipeline plays a single game; it cannot be used with --rooms\n");
+		fprintf(stderr, "%s", usage);
 		return false;
 	}
 	
 	// validate the map file (ensure it is readable)
-	if (!checkFile(argv[1], "r")) {
-		fprintf(stderr, "map file '%s' is not a readable file\n", argv[1]);
+	if (!checkFile(args[0], "r")) {
+		fprintf(stderr, "map file '%s' is not a readable file\n", args[0]);
 		return false;
 	}
+	opts->mapfile = args[0];
 
 	// validate seed, if provided
-	if (argc == 3) {
+	if (nargs == 2) {
 		char val;
-		if ((sscanf(argv[2], "%d%c", seed, &val)) != 1) {      // ensures optional seed parameter is solely an integer
-			fprintf(stderr, "%s is not a valid integer\n", argv[3]);
+		if ((sscanf(args[1], "%d%c", &opts->seed, &val)) != 1) {      // ensures optional seed parameter is solely an integer
+			fprintf(stderr, "%s is not a valid integer\n", args[1]);
 			return false;
 		} 
 	}
@@ -1071,7 +1817,7 @@ bool checkFile(char *fname, char *openParam)
 {
 	FILE *fp;
 	int fileLen = strlen(fname);              // length of the file's name
-	char *filename = calloc(fileLen + 1, sizeof(char));    // allocate memory to hold file plus '\0'
+	char *filename = count_calloc(fileLen + 1, sizeof(char));    // allocate memory to hold file plus '\0'
 	if (filename == NULL) { // error allocating memory
 		return false;
 	}
@@ -1079,23 +1825,25 @@ bool checkFile(char *fname, char *openParam)
 	// try to open the file based on the openParam; on success clean-up and return true
 	if ((fp = fopen(filename, openParam))) {
 		fclose(fp);
-		free(filename);
+		count_free(filename);
 		return true;
 	}
 	// return false if the file could not be opened
-	free(filename);
+	count_free(filename);
 	return false;
 }
 
-/************** findPlayerITR *****************/
-/* iterator function to find a specific player
+/************** findPlayer *****************/
+/* returns the player with the given address, or NULL if there is none
  */
-void findPlayerITR(void *arg, const char *key, void *item)
+player_t *findPlayer(hashtable_t *playerInfo, addr_t addr)
 {
-	struct findPlayer *fp = arg;
-	player_t *p = item;
-
-	if (message_eqAddr(p->addr, fp->addr)){
-		fp->result = p;
+	void *item;
+	for (hashtable_cursor_t c = hashtable_cursor(playerInfo); hashtable_next(playerInfo, &c, NULL, &item); ) {
+		player_t *p = item;
+		if (message_eqAddr(p->addr, addr)) {
+			return p;
+		}
 	}
+	return NULL;
 }
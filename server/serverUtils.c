@@ -6,12 +6,256 @@
 
 #include "serverUtils.h"
 
+// tag for DISPLAY messages: a newer one replaces one still queued
+static const int DisplayTag = 1;
+
+bool parseOption(const char *arg, serverOptions_t *opts)
+{
+    const char *value = strchr(arg, '=');
+    if (value == NULL) {
+        return false;
+    }
+    value++;
+
+    if (strncmp(arg, "--net=", 6) == 0) {
+        // network backend for the message module
+        if (strcmp(value, "select") == 0) {
+            opts->backend = message_SELECT;
+        } else if (strcmp(value, "uring") == 0) {
+            opts->backend = message_URING;
+        } else {
+            return false;
+        }
+        return true;
+    } else if (strncmp(arg, "--sndbuf=", 9) == 0) {
+        // socket send buffer size, in bytes
+        char extra;
+        if (sscanf(value, "%d%c", &opts->sendBuffer, &extra) != 1 || opts->sendBuffer <= 0) {
+            return false;
+        }
+        return true;
+    } else if (strncmp(arg, "--loglevel=", 11) == 0) {
+        // how much to log; see log.h
+        if (strcmp(value, "error") == 0) {
+            opts->logLevel = log_ERROR;
+        } else if (strcmp(value, "info") == 0) {
+            opts->logLevel = log_INFO;
+        } else if (strcmp(value, "verbose") == 0) {
+            opts->logLevel = log_VERBOSE;
+        } else {
+            return false;
+        }
+        return true;
+    } else if (strncmp(arg, "--log=", 6) == 0) {
+        // write the log synchronously, or from a background thread
+        if (strcmp(value, "sync") == 0) {
+            opts->asyncLog = false;
+        } else if (strcmp(value, "async") == 0) {
+            opts->asyncLog = true;
+        } else {
+            return false;
+        }
+        return true;
+    } else if (strncmp(arg, "--light=", 8) == 0) {
+        // players see only this far, so a move costs the same on any size of map
+        char extra;
+        if (sscanf(value, "%d%c", &opts->lightRadius, &extra) != 1 || opts->lightRadius <= 0) {
+            return false;
+        }
+        return true;
+    } else if (strncmp(arg, "--rooms=", 8) == 0) {
+        // games hosted at once, each run by whichever worker is free
+        char extra;
+        if (sscanf(value, "%d%c", &opts->rooms, &extra) != 1 || opts->rooms <= 0) {
+            return false;
+        }
+        return true;
+    } else if (strncmp(arg, "--pipeline=", 11) == 0) {
+        // play the game in stages, with this many threads drawing frames
+        char extra;
+        if (sscanf(value, "%d%c", &opts->pipeline, &extra) != 1 || opts->pipeline <= 0) {
+            return false;
+        }
+        return true;
+    } else if (strncmp(arg, "--rng=", 6) == 0) {
+        // start the rooms' generators where an earlier run's were, to replay it
+        size_t pairs = (strlen(value) + 1) / (2 * rng_SavedBytes);
+        if (pairs == 0 || (strlen(value) + 1) % (2 * rng_SavedBytes) != 0) {
+            return false;
+        }
+        rng_t gold, spawns;
+        for (int room = 0; room < pairs; room++) {
+            if (!restoreRng(value, room, &gold, &spawns)) {
+                return false;
+            }
+        }
+        opts->rngStates = value;
+        return true;
+    } else if (strncmp(arg, "--workers=", 10) == 0) {
+        // threads running the rooms
+        char extra;
+        if (sscanf(value, "%d%c", &opts->workers, &extra) != 1 || opts->workers <= 0) {
+            return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+bool restoreRng(const char *states, int room, rng_t *gold, rng_t *spawns)
+{
+    // each pair is two saved states, a comma between, and a '/' (or the null) after
+    static const int PairBytes = 2 * rng_SavedBytes;
+    if (states == NULL || room < 0 || strlen(states) + 1 < (size_t) (room + 1) * PairBytes) {
+        return false;
+    }
+    const char *pair = states + (size_t) room * PairBytes;
+    if (pair[rng_SavedBytes - 1] != ',' || (pair[PairBytes - 1] != '/' && pair[PairBytes - 1] != '\0')) {
+        return false;
+    }
+    char goldState[rng_SavedBytes], spawnState[rng_SavedBytes];
+    memcpy(goldState, pair, rng_SavedBytes - 1);
+    goldState[rng_SavedBytes - 1] = '\0';
+    memcpy(spawnState, pair + rng_SavedBytes, rng_SavedBytes - 1);
+    spawnState[rng_SavedBytes - 1] = '\0';
+
+    rng_t g, s;
+    if (!rng_restore(&g, goldState) || !rng_restore(&s, spawnState)) {
+        return false;
+    }
+    *gold = g;
+    *spawns = s;
+    return true;
+}
+
+int parseCapabilities(char *verb, viewport_t *view)
+{
+    int caps = 0;
+    if (view != NULL) {
+        view->top = view->left = -1;
+        view->rows = view->cols = 0;
+        view->scale = 1;
+    }
+    char *suffix = strchr(verb, '/');
+    if (suffix != NULL) {
+        *suffix = '\0';    // leave the bare verb
+        char *cap = suffix + 1;
+        while (cap != NULL) {
+            char *next = strchr(cap, '/');
+            if (next != NULL) {
+                *next++ = '\0';
+            }
+            if (strcmp(cap, "BIN") == 0) {
+                caps |= CAP_BIN;
+            } else if (strcmp(cap, "Z") == 0) {
+                caps |= CAP_ZIP | CAP_BIN;
+            } else if (strncmp(cap, "VIEW=", 5) == 0) {
+                int rows, cols;
+                char extra;
+                if (sscanf(cap + 5, "%dx%d%c", &rows, &cols, &extra) == 2 && rows > 0 && cols > 0) {
+                    caps |= CAP_VIEW;
+                    if (view != NULL) {
+                        view->rows = rows;
+                        view->cols = cols;
+                    }
+                } else {
+                    log_s("ignoring malformed capability %s", cap);
+                }
+            } else if (strncmp(cap, "SCALE=", 6) == 0) {
+                int scale;
+                char extra;
+                if (sscanf(cap + 6, "%d%c", &scale, &extra) == 1 && scale > 0) {
+                    caps |= CAP_SCALE;
+                    if (view != NULL) {
+                        view->scale = scale;
+                    }
+                } else {
+                    log_s("ignoring malformed capability %s", cap);
+                }
+            } else if (strncmp(cap, "ROOM=", 5) == 0) {
+                // the network thread has already routed the client; see requestedRoom
+            } else {
+                log_s("ignoring unknown capability %s", cap);
+            }
+            cap = next;
+        }
+    }
+    return caps;
+}
+
+int requestedRoom(const char *message)
+{
+    // look only in the verb, not the player's name
+    size_t verbLength = strcspn(message, " ");
+    for (const char *cap = strchr(message, '/'); cap != NULL && cap < message + verbLength; cap = strchr(cap + 1, '/')) {
+        int room;
+        if (strncmp(cap, "/ROOM=", 6) == 0 && sscanf(cap + 6, "%d", &room) == 1 && room >= 0) {
+            return room;
+        }
+    }
+    return -1;
+}
+
+void sendQuitMessage(const addr_t to, int caps, const char *explanation)
+{
+    if (caps & CAP_BIN) {
+        unsigned char frame[QuitMessageBytes];
+        size_t len = wire_encodeQuit(frame, sizeof(frame), explanation);
+        if (len > sizeof(frame)) {
+            log_d("QUIT message too long (%d bytes)", (int) len);
+            return;
+        }
+        pipeline_sendBytes(to, frame, len);
+    } else {
+        char message[QuitMessageBytes];
+        size_t len = format_quit(message, sizeof(message), explanation);
+        if (len >= sizeof(message)) {
+            log_d("QUIT message too long (%d bytes)", (int) len);
+            return;
+        }
+        pipeline_send(to, message);
+    }
+}
+
+void sendDisplay(const addr_t to, int caps, map_t *map, arena_t *arena)
+{
+    if (caps & CAP_ZIP) {
+        // compress straight into a buffer big enough for any grid
+        size_t cap = wire_zDisplayBound(map->height, map->width);
+        unsigned char *frame = arena_alloc(arena, cap);
+        if (frame == NULL) {
+            log_e("out of memory");
+            return;
+        }
+        size_t len = wire_encodeZDisplay(frame, cap, map->mapStr, map->height, map->width);
+        pipeline_sendLatest(to, frame, len, DisplayTag);
+    } else if (caps & CAP_BIN) {
+        size_t len = wire_encodeDisplay(NULL, 0, map->mapStr, map->height, map->width);
+        unsigned char *frame = arena_alloc(arena, len);
+        if (frame == NULL) {
+            log_e("out of memory");
+            return;
+        }
+        wire_encodeDisplay(frame, len, map->mapStr, map->height, map->width);
+        pipeline_sendLatest(to, frame, len, DisplayTag);
+    } else {
+        int len = strlen(map->mapStr);
+        char *message = arena_alloc(arena, len + 9);
+        if (message == NULL) {
+            log_e("out of memory");
+            return;
+        }
+        memcpy(message, "DISPLAY\n", 8);
+        memcpy(message + 8, map->mapStr, len + 1);
+        pipeline_sendLatest(to, message, len + 8, DisplayTag);
+    }
+}
+
 bool validateAction(char *keyPress, player_t *player, serverInfo_t *info)
 {
 
-	position_t *nextPos = malloc(sizeof(position_t));
-	nextPos->x = player->pos->x;
-	nextPos->y = player->pos->y;
+	position_t next = *player->pos;
+	position_t *nextPos = &next;
 
 	switch (keyPress[0]){
 		case 'h': // Left
@@ -74,16 +318,14 @@ bool validateAction(char *keyPress, player_t *player, serverInfo_t *info)
 			break;
 	}
 
-    int x = player->pos->x;
-    int y = player->pos->y;
+    mcoord_t x = player->pos->x;
+    mcoord_t y = player->pos->y;
 	// Check the move player 
-	map_movePlayer(info->map, player, nextPos, info->goldData);
+	map_movePlayer(info->map, player, nextPos, info->goldData, info->arena);
 
     if (x == nextPos->x && y == nextPos-> y) {
-        free(nextPos);
         return false;
     }
 
-    free(nextPos);
 	return true;
 }
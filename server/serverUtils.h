@@ -15,27 +15,128 @@
 #include <stdbool.h>
 #include <ctype.h>
 #include <string.h>
+#include <stdatomic.h>
 #include "map.h"
+#include "overview.h"
 #include "message.h"
 #include "log.h"
 #include "hashtable.h"
 #include "set.h"
 #include "counters.h"
+#include "slab.h"
+#include "arena.h"
+#include "wire.h"
+#include "format.h"
+#include "rng.h"
+#include "pipeline.h"
+
+/********* Constants **********/
+// room for any QUIT message we send in either protocol, including the
+// game-over summary of 26 players with 50-character names
+#define QuitMessageBytes 2048
 
 /********* Data Structures **********/
+/* the frames due in a game played in stages; see serverInfo_t's frames */
+enum { FramesPlayers = 0x1, FramesSpectator = 0x2 };
+
+struct frames;      // what a pipeline's renderers draw from; see server.c
+
+/* protocol capabilities a client requests by suffixing its PLAY or
+ * SPECTATE verb, as in "PLAY/BIN name"; see parseCapabilities
+ */
+typedef enum capability {
+    CAP_BIN = 0x1,      // binary frames (see wire.h) instead of text
+    CAP_ZIP = 0x2,      // compressed DISPLAY frames; implies CAP_BIN
+    CAP_VIEW = 0x4,     // a window of the map, as in "PLAY/VIEW=24x80 name"
+    CAP_SCALE = 0x8,    // a spectator's overview, a glyph per k x k cells ("SPECTATE/SCALE=k")
+} capability_t;
+
+typedef struct serverOptions {
+    char *mapfile;              // path of the map file to load
+    int seed;                   // random seed; -1 to seed from the pid
+    message_backend_t backend;  // network backend (--net=select|uring)
+    int sendBuffer;             // socket send buffer bytes (--sndbuf=N); 0 for default
+    int logLevel;               // most detailed level logged (--loglevel=error|info|verbose)
+    bool asyncLog;              // log from a background thread (--log=async)
+    int lightRadius;            // how far players see, in cells (--light=R); 0 for no limit
+    int rooms;                  // games hosted at once, on the one map (--rooms=N); see rooms.h
+    int workers;                // threads running them (--workers=N); 0 for one per processor
+    int pipeline;               // render threads for a game played in stages (--pipeline=R); 0 for none
+    const char *rngStates;      // random states to restore, as logged (--rng=gold,spawns[/gold,spawns...]); NULL to seed
+} serverOptions_t;
+
 typedef struct serverInfo {
     int *numPlayers;
     int *goldCt;
     const int maxPlayers;
     hashtable_t *playerInfo;
     hashtable_t *goldData;
-    counters_t *dotsPos;
     map_t *map;
     addr_t specAddr;
+    int specCaps;       // capabilities requested by the spectator
+    viewport_t specView;    // the spectator's window and scale, if they asked for one
+    overview_t *overview;   // the map at the spectator's scale, kept up to date; NULL if not needed
+    char specFollow;    // the player the spectator's window follows; 0 for whoever moved last
+    char lastMoved;     // the letter of the player who last moved or joined
+    slab_t *playerSlab; // this game's player_t structs
+    slab_t *goldSlab;   // this game's gold_t structs
+    slab_t *posSlab;    // the position_t of every player and gold pile
+    arena_t *arena;     // scratch space for handling one message; see handleMessage
+    long keyMessages;   // KEY messages handled
+    long keyHeapMessages;   // ... of which allocated from the heap; see handleGameMessage
+    int room;           // this game's room, from 0; see rooms.h
+    rng_t goldRng;      // this game's random streams: where the gold goes, and how much each pile holds ...
+    rng_t spawnRng;     // ... and where players appear; see game_new
+    struct frames *frames;  // in a pipeline, what frames are drawn from later, not as they fall due; else NULL
+    int framesDue;      // ... and those now due: Frames* bits
+    int specEpoch;      // counts spectators, so a pipeline's renderers notice a new one
+    atomic_int *seats;  // with --rooms, the room's seats taken (see routeMessage); else NULL
 } serverInfo_t;
 
 /*********** Functions ************/
 
+/************** parseOption *******************/
+/* parses one "--name=value" command-line option into opts,
+ * returning false if the option is unknown or its value is invalid
+ */
+bool parseOption(const char *arg, serverOptions_t *opts);
+
+/************** restoreRng *******************/
+/* sets a room's gold and spawn generators to the states given for it in
+ * states, the value of --rng: a "gold,spawns" pair, as the server logs
+ * them, for each room from room 0, separated by '/'; returns false,
+ * leaving them alone, if states has no valid pair for the room
+ */
+bool restoreRng(const char *states, int room, rng_t *gold, rng_t *spawns);
+
+/************** parseCapabilities *******************/
+/* strips any "/CAP" suffixes from a client's verb, leaving the bare verb,
+ * and returns the capabilities they name; unknown ones are ignored.
+ * The size asked for with VIEW=rowsxcols, and the scale with SCALE=k, go
+ * in view (if not NULL), not yet placed on the map; its rows stay 0 if
+ * no size is asked for, and its scale 1 if no scale is
+ */
+int parseCapabilities(char *verb, viewport_t *view);
+
+/************** requestedRoom *******************/
+/* returns the room a PLAY or SPECTATE message asks for with a "/ROOM=k"
+ * suffix on its verb, as in "PLAY/ROOM=2 name", or -1 if none
+ */
+int requestedRoom(const char *message);
+
+/************** sendQuitMessage *******************/
+/* sends "QUIT explanation" to a client in the form it asked for (from a
+ * pipeline stage, through the sender; see pipeline_send);
+ * the message is built on the stack, so it must fit in QuitMessageBytes
+ */
+void sendQuitMessage(const addr_t to, int caps, const char *explanation);
+
+/************** sendDisplay *******************/
+/* sends a built map (see map_buildPlayerMap) as a DISPLAY message
+ * in the form the client asked for, building it in the arena
+ */
+void sendDisplay(const addr_t to, int caps, map_t *map, arena_t *arena);
+
 /************** validateAction *******************/
 /* validates the action of a player, returning true if that player
  * has moved as a result of their key press
@@ -0,0 +1,180 @@
+/*
+ * arena.c - bump allocation for short-lived objects
+ *
+ * see arena.h for description
+ *
+ * Chunks are kept in a list, newest first; only the newest is bumped.
+ * An allocation too big for a fresh chunk of the usual size gets a chunk
+ * of its own size.
+ *
+ * Nuggets: Bash Boys
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "arena.h"
+#include "memory.h"
+
+/**************** local types ****************/
+typedef struct chunk {
+  struct chunk *prev;           // the chunk taken before this one
+  size_t size;                  // bytes of room after the header
+  max_align_t align;            // room starts here, aligned for any type
+} chunk_t;
+
+/**************** global types ****************/
+typedef struct arena {
+  chunk_t *chunks;              // the chunk being bumped; never NULL
+  size_t used;                  // bytes of it handed out
+  size_t chunkBytes;            // room in each new chunk
+  long heapAllocs;              // chunks ever taken from count_malloc
+  memtag_t tag;                 // what its memory is counted as
+} arena_t;
+
+/**************** local functions ****************/
+static chunk_t *newChunk(arena_t *arena, chunk_t *prev, size_t size);
+static size_t roundUp(size_t bytes);
+
+/**************** arena_new ****************/
+/* see arena.h for description */
+arena_t *
+arena_new(const size_t chunkBytes, memtag_t tag)
+{
+  if (chunkBytes == 0) {
+    return NULL;
+  }
+  arena_t *arena = count_mallocTag(sizeof(arena_t), tag);
+  if (arena == NULL) {
+    return NULL;
+  }
+  arena->tag = tag;
+  arena->chunkBytes = roundUp(chunkBytes);
+  arena->used = 0;
+  arena->heapAllocs = 0;
+  arena->chunks = newChunk(arena, NULL, arena->chunkBytes);
+  if (arena->chunks == NULL) {
+    count_free(arena);
+    return NULL;
+  }
+  return arena;
+}
+
+/**************** arena_alloc ****************/
+/* see arena.h for description */
+void *
+arena_alloc(arena_t *arena, const size_t bytes)
+{
+  if (arena == NULL) {
+    return NULL;
+  }
+  size_t need = roundUp(bytes == 0 ? 1 : bytes);
+  if (need > arena->chunks->size - arena->used) {
+    // no room left in this chunk; start another
+    size_t size = need > arena->chunkBytes ? need : arena->chunkBytes;
+    chunk_t *chunk = newChunk(arena, arena->chunks, size);
+    if (chunk == NULL) {
+      return NULL;
+    }
+    arena->chunks = chunk;
+    arena->used = 0;
+  }
+  void *p = (char *) &arena->chunks->align + arena->used;
+  arena->used += need;
+  return p;
+}
+
+/**************** arena_calloc ****************/
+/* see arena.h for description */
+void *
+arena_calloc(arena_t *arena, const size_t nmemb, const size_t size)
+{
+  if (size != 0 && nmemb > (size_t) -1 / size) {
+    return NULL;        // overflow
+  }
+  void *p = arena_alloc(arena, nmemb * size);
+  if (p != NULL) {
+    memset(p, 0, nmemb * size);
+  }
+  return p;
+}
+
+/**************** arena_reset ****************/
+/* see arena.h for description */
+void
+arena_reset(arena_t *arena)
+{
+  if (arena == NULL) {
+    return;
+  }
+  if (arena->chunks->prev != NULL) {
+    // we outgrew one chunk; trade them all for one as big as all together,
+    // or, if there is no room for that, keep just the newest
+    size_t total = 0;
+    for (chunk_t *chunk = arena->chunks; chunk != NULL; chunk = chunk->prev) {
+      total += chunk->size;
+    }
+    chunk_t *keep = newChunk(arena, NULL, total);
+    if (keep != NULL) {
+      arena->chunkBytes = total;
+    } else {
+      keep = arena->chunks;
+      arena->chunks = keep->prev;
+      keep->prev = NULL;
+    }
+    for (chunk_t *chunk = arena->chunks; chunk != NULL; ) {
+      chunk_t *prev = chunk->prev;
+      count_free(chunk);
+      chunk = prev;
+    }
+    arena->chunks = keep;
+  }
+  arena->used = 0;
+}
+
+/**************** arena_heapAllocs ****************/
+/* see arena.h for description */
+long
+arena_heapAllocs(arena_t *arena)
+{
+  return arena == NULL ? 0 : arena->heapAllocs;
+}
+
+/**************** arena_delete ****************/
+/* see arena.h for description */
+void
+arena_delete(arena_t *arena)
+{
+  if (arena != NULL) {
+    for (chunk_t *chunk = arena->chunks; chunk != NULL; ) {
+      chunk_t *prev = chunk->prev;
+      count_free(chunk);
+      chunk = prev;
+    }
+    count_free(arena);
+  }
+}
+
+/**************** newChunk ****************/
+/* take a chunk with room for size bytes from the heap, or return NULL */
+static chunk_t *
+newChunk(arena_t *arena, chunk_t *prev, size_t size)
+{
+  chunk_t *chunk = count_mallocTag(offsetof(chunk_t, align) + size, arena->tag);
+  if (chunk != NULL) {
+    chunk->prev = prev;
+    chunk->size = size;
+    arena->heapAllocs++;
+  }
+  return chunk;
+}
+
+/**************** roundUp ****************/
+/* round bytes up to keep what follows aligned for any type */
+static size_t
+roundUp(size_t bytes)
+{
+  size_t align = _Alignof(max_align_t);
+  return (bytes + align - 1) / align * align;
+}
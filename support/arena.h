@@ -0,0 +1,67 @@
+/*
+ * arena - bump allocation for short-lived objects
+ *
+ * An arena hands out memory by bumping a pointer through a large chunk,
+ * and takes it all back at once with arena_reset; there is no way (and no
+ * need) to free one object.  The server keeps one arena and resets it
+ * after handling each message, so everything a message needs only while
+ * it is handled (copies of the map, visibility strings, outgoing frames)
+ * costs a pointer bump instead of a malloc and a free.
+ *
+ * When a chunk runs out the arena takes another from count_malloc; at the
+ * next reset it replaces all of its chunks with one big enough for the
+ * lot, so once it has seen the largest message it will handle, it never
+ * touches the heap again.  arena_heapAllocs counts the chunks taken.
+ *
+ * Nuggets: Bash Boys
+ */
+
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "memory.h"
+
+/**************** global types ****************/
+typedef struct arena arena_t;  // opaque to users of the module
+
+/**************** functions ****************/
+
+/**************** arena_new ****************/
+/* Create an empty arena whose first chunk holds chunkBytes bytes;
+ * its memory is counted under tag (see memory.h).
+ * We return NULL if out of memory or chunkBytes is 0.
+ * Caller is responsible for later calling arena_delete.
+ */
+arena_t *arena_new(const size_t chunkBytes, memtag_t tag);
+
+/**************** arena_alloc ****************/
+/* Return bytes bytes of memory from the arena, aligned for any type and
+ * valid until the next arena_reset or arena_delete; its contents are
+ * undefined.  We return NULL if arena is NULL or we are out of memory.
+ * arena_calloc is the same, but for nmemb zeroed objects of size bytes.
+ */
+void *arena_alloc(arena_t *arena, const size_t bytes);
+void *arena_calloc(arena_t *arena, const size_t nmemb, const size_t size);
+
+/**************** arena_reset ****************/
+/* Take back everything allocated from the arena, keeping its memory for
+ * reuse; if it grew past its first chunk since the last reset, its chunks
+ * are replaced by one that holds all they did.
+ * We ignore a NULL arena.
+ */
+void arena_reset(arena_t *arena);
+
+/**************** arena_heapAllocs ****************/
+/* Return the number of chunks the arena has ever taken from the heap
+ * (counting its first); 0 if arena is NULL.
+ */
+long arena_heapAllocs(arena_t *arena);
+
+/**************** arena_delete ****************/
+/* Free the arena and all its memory; we ignore a NULL arena.
+ */
+void arena_delete(arena_t *arena);
+
+#endif // __ARENA_H
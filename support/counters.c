@@ -1,50 +1,91 @@
-/* 
+/*
  * counters.c - CS50 'counters' module
  *
- * largely mirrors the structure of the provided 
+ * largely mirrors the structure of the provided
  * CS50 'bag' module, created by David Kotz
  *
  * see counters.h for more information.
  *
+ * A counterset starts out dense: an array of counts indexed by key, with
+ * a bitmap recording which keys are present (a counter may be set to 0,
+ * so the count alone cannot say).  The array doubles to fit new keys.
+ * Keys such as the cell indexes of a map are small and packed closely,
+ * so add, get and set cost one index.  If a key would make the array too
+ * big, or mostly empty, the counterset switches for good to a hash table
+ * of (key, count) pairs with linear probing.  Either way the counters are
+ * visited in increasing order of key: the dense form walks its bitmap,
+ * and the sparse form keeps a sorted list of its keys, rebuilt on the
+ * first walk after a key is added.
+ *
  * William Dinauer, Dartmouth CS50 Winter 2021
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include "counters.h"
 #include "memory.h"
 
+/**************** local constants ****************/
+static const int MinKeys = 64;            // smallest dense array or hash table
+static const int MaxDenseKeys = 1 << 22;  // never grow the dense array past this
+static const int MaxSparseness = 16;      // nor past this many slots per counter
+static const int MaxLoad = 70;            // grow the hash table past this percent full
 
 /**************** local types ****************/
-typedef struct cntnode {
-    int key;        // any given integer key
+typedef struct cntpair {
+    int key;        // the key; -1 if the slot is empty
     int count;      // the count for the given key
-    struct cntnode *next;   // the next node (key/count pair) in the list
-} cntnode_t;
-
+} cntpair_t;
 
 /**************** global types ****************/
 typedef struct counters {
-    struct cntnode *head;   // the first item in the linked list
+    int size;           // number of counters in the set
+    int capacity;       // slots in 'counts' or 'pairs'; a power of two
+    int *counts;        // dense: count for each key below capacity
+    uint64_t *present;  // dense: bit per key, set if the key is in the set
+    cntpair_t *pairs;   // sparse: hash table; NULL while dense
+    int *sortedKeys;    // sparse: every key, in order; NULL until needed
 } counters_t;
 
+typedef struct printer {
+    FILE *fp;       // where counters_print is printing
+    bool first;     // true until the first counter is printed
+} printer_t;
+
 /**************** local functions ****************/
 /* not visible outside this file */
-static cntnode_t *cntnode_new(int key);
+static int *findCount(counters_t *ctrs, const int key, const bool insert);
+static bool denseFit(counters_t *ctrs, const int key);
+static bool makeSparse(counters_t *ctrs);
+static bool growSparse(counters_t *ctrs);
+static int *placePair(cntpair_t *pairs, const int capacity, const int key);
+static uint32_t hashKey(const int key);
+static void printCounter(void *arg, const int key, const int count);
+static bool sortKeys(counters_t *ctrs);
+static int compareKeys(const void *a, const void *b);
 
 /**************** counters_new() ****************/
 /* see counters.h for description */
-counters_t *counters_new(void) 
+counters_t *counters_new(void)
 {
     // allocate memory for the data structure
-    counters_t *ctrs = count_malloc(sizeof(counters_t));
+    counters_t *ctrs = count_mallocTag(sizeof(counters_t), mem_CONTAINERS);
     if (ctrs == NULL) {
         return NULL;    //error allocating ctrs
-    } else {
-        ctrs->head = NULL;
-        return ctrs;
     }
+    ctrs->size = 0;
+    ctrs->capacity = MinKeys;
+    ctrs->counts = count_callocTag(MinKeys, sizeof(int), mem_CONTAINERS);
+    ctrs->present = count_callocTag(MinKeys / 64, sizeof(uint64_t), mem_CONTAINERS);
+    ctrs->pairs = NULL;
+    ctrs->sortedKeys = NULL;
+    if (ctrs->counts == NULL || ctrs->present == NULL) {
+        counters_delete(ctrs);
+        return NULL;    //error allocating the arrays
+    }
+    return ctrs;
 }
 
 /**************** counters_add() ****************/
@@ -52,31 +93,9 @@ counters_t *counters_new(void)
 int counters_add(counters_t *ctrs, const int key)
 {
     if (ctrs != NULL && key >= 0) {
-        if (ctrs->head == NULL) {
-            // for an empty counters, create a new node as the head
-            cntnode_t *new = cntnode_new(key);
-            if (new != NULL) {
-                ctrs->head = new;
-                return 1;
-            }
-        } else {
-            for (cntnode_t *node = ctrs->head; node != NULL; node = node->next) {
-                if (node->key == key){              
-                    //found a match; increment count
-                    return ++node->count;
-                } else {
-                    if (node->next == NULL){        
-                        //at the last node, no matches
-                        cntnode_t *new = cntnode_new(key);
-                        if (new != NULL) {
-                            //insert at the head
-                            new->next = ctrs->head;
-                            ctrs->head = new;
-                            return 1;
-                        }
-                    }
-                }
-            }
+        int *count = findCount(ctrs, key, true);
+        if (count != NULL) {
+            return ++*count;    // a new counter starts at 0
         }
     }
     return 0;
@@ -84,14 +103,12 @@ int counters_add(counters_t *ctrs, const int key)
 
 /**************** counters_get() ****************/
 /* see counters.h for description */
-int counters_get(counters_t *ctrs, const int key) 
+int counters_get(counters_t *ctrs, const int key)
 {
     if (ctrs != NULL && key >= 0) {
-        // search through all nodes, starting at the head
-        for (cntnode_t *node = ctrs->head; node != NULL; node = node->next) {
-            if (node->key == key) {     // match found
-                return node->count;     // return the count
-            }
+        int *count = findCount(ctrs, key, false);
+        if (count != NULL) {
+            return *count;
         }
     }
     return 0;
@@ -102,33 +119,10 @@ int counters_get(counters_t *ctrs, const int key)
 bool counters_set(counters_t *ctrs, const int key, const int count)
 {
     if (ctrs != NULL && key >= 0 && count>=0) {
-        if (ctrs->head == NULL) {
-            // empty counters
-            cntnode_t *new = cntnode_new(key);
-            if (new != NULL) {      // checks for error allocating memory
-                new->count = count; // insert at the head
-                ctrs->head = new;
-                return true;
-            } 
-            return false;
-        } else {
-            // traverse the entire linked list
-            for (cntnode_t *node = ctrs->head; node != NULL; node = node->next) {
-                if (node->key == key) {     // match found
-                    node->count = count;    // update count
-                    return true;            
-                }
-                if (node->next == NULL) {   // reached the end, no matches
-                    //create a new node; insert at the head
-                    cntnode_t *new = cntnode_new(key);
-                    if (new != NULL) {
-                        new->count = count; // update the count
-                        new->next = ctrs->head;
-                        ctrs->head = new;
-                        return true;
-                    }
-                }
-            }
+        int *counter = findCount(ctrs, key, true);
+        if (counter != NULL) {
+            *counter = count;
+            return true;
         }
     }
     return false;
@@ -136,19 +130,14 @@ bool counters_set(counters_t *ctrs, const int key, const int count)
 
 /**************** counters_print() ****************/
 /* see counters.h for description */
-void counters_print(counters_t *ctrs, FILE *fp) 
+void counters_print(counters_t *ctrs, FILE *fp)
 {
     if (fp != NULL) {
         if (ctrs != NULL) {
             fputc('{', fp);
-            // print in format key=count for each node
-            for (cntnode_t *node = ctrs->head; node !=NULL; node = node->next) {
-                fprintf(fp, "%d=%d", node->key, node->count);
-                if (node->next != NULL){
-                    // commas between nodes
-                    fputc(',', fp);
-                } 
-            }
+            // print in format key=count for each counter, commas between
+            printer_t printer = { fp, true };
+            counters_iterate(ctrs, &printer, printCounter);
             fputc('}', fp);
             fputc('\n', fp);
         } else {
@@ -159,16 +148,64 @@ void counters_print(counters_t *ctrs, FILE *fp)
 
 /**************** counters_iterate() ****************/
 /* see counters.h for description */
-void counters_iterate(counters_t *ctrs, void *arg, 
-                      void (*itemfunc)(void *arg, 
+void counters_iterate(counters_t *ctrs, void *arg,
+                      void (*itemfunc)(void *arg,
                                        const int key, const int count))
 {
     if (ctrs != NULL && itemfunc != NULL) {
-        // call the given function for every node in the counter
-        for (cntnode_t *node = ctrs->head; node != NULL; node = node->next) {
-            (*itemfunc)(arg, node->key, node->count);
+        int key, count;
+        for (counters_cursor_t c = counters_cursor(ctrs); counters_next(ctrs, &c, &key, &count); ) {
+            (*itemfunc)(arg, key, count);
+        }
+    }
+}
+
+/**************** counters_cursor() ****************/
+/* see counters.h for description */
+counters_cursor_t counters_cursor(counters_t *ctrs)
+{
+    counters_cursor_t cursor = { 0 };
+    return cursor;
+}
+
+/**************** counters_next() ****************/
+/* see counters.h for description */
+bool counters_next(counters_t *ctrs, counters_cursor_t *cursor, int *key, int *count)
+{
+    if (ctrs == NULL || cursor == NULL) {
+        return false;
+    }
+    int next;
+    if (ctrs->pairs == NULL) {
+        // dense: find the next bit set at or after cursor->next
+        int word = cursor->next / 64;
+        if (word >= ctrs->capacity / 64) {
+            return false;
+        }
+        uint64_t bits = ctrs->present[word] & (~(uint64_t) 0 << cursor->next % 64);
+        while (bits == 0) {
+            if (++word >= ctrs->capacity / 64) {
+                cursor->next = ctrs->capacity;
+                return false;
+            }
+            bits = ctrs->present[word];
+        }
+        next = word * 64 + __builtin_ctzll(bits);
+        cursor->next = next + 1;
+    } else {
+        // sparse: the next key in sorted order
+        if (cursor->next >= ctrs->size || !sortKeys(ctrs)) {
+            return false;
         }
+        next = ctrs->sortedKeys[cursor->next++];
+    }
+    if (key != NULL) {
+        *key = next;
+    }
+    if (count != NULL) {
+        *count = *findCount(ctrs, next, false);
     }
+    return true;
 }
 
 /**************** counters_delete() ****************/
@@ -176,29 +213,206 @@ void counters_iterate(counters_t *ctrs, void *arg,
 void counters_delete(counters_t *ctrs)
 {
     if (ctrs != NULL) {
-        for (cntnode_t *node = ctrs->head; node!=NULL; ) {
-            cntnode_t *next = node->next;   // save the next node
-            count_free(node);               // free the current node
-            node = next;                    // traverse to the next node
-        }
+        count_free(ctrs->counts);   // free whichever arrays are in use
+        count_free(ctrs->present);
+        count_free(ctrs->pairs);
+        count_free(ctrs->sortedKeys);
         count_free(ctrs); // free the overall counters data structure
     }
 }
 
-/**************** cntnode_new() ****************/
-/* allocates a counters node for insertion into 
- * the linked list */
-static cntnode_t *cntnode_new(int key)
+/**************** findCount() ****************/
+/* returns a pointer to the count for key, or NULL if it is absent;
+ * if insert is true, an absent key is added with a count of 0, and NULL
+ * means we ran out of memory
+ */
+static int *findCount(counters_t *ctrs, const int key, const bool insert)
 {
-    cntnode_t *node = count_malloc(sizeof(cntnode_t));
-    if (node == NULL) {
-        // error allocating memory for node; return error
+    if (ctrs->pairs == NULL && key >= ctrs->capacity) {
+        // beyond the dense arrays: grow them, or give them up
+        if (!insert || (!denseFit(ctrs, key) && !makeSparse(ctrs))) {
+            return NULL;
+        }
+    }
+    if (ctrs->pairs == NULL) {
+        uint64_t bit = (uint64_t) 1 << (key % 64);
+        if ((ctrs->present[key / 64] & bit) == 0) {
+            if (!insert) {
+                return NULL;
+            }
+            ctrs->present[key / 64] |= bit;
+            ctrs->counts[key] = 0;
+            ctrs->size++;
+        }
+        return &ctrs->counts[key];
+    }
+
+    // sparse: probe from the key's home slot until we find it or a hole
+    int mask = ctrs->capacity - 1;
+    for (int x = hashKey(key) & mask; ; x = (x + 1) & mask) {
+        if (ctrs->pairs[x].key == key) {
+            return &ctrs->pairs[x].count;
+        }
+        if (ctrs->pairs[x].key < 0) {
+            break;
+        }
+    }
+    if (!insert) {
+        return NULL;
+    }
+    if ((ctrs->size + 1) * 100 > ctrs->capacity * MaxLoad && !growSparse(ctrs)) {
         return NULL;
-    } else {
-        // initialize values, count set to 1
-        node->key = key;
-        node->count = 1;
-        node->next = NULL;
-        return node;
     }
+    ctrs->size++;
+    count_free(ctrs->sortedKeys);   // no longer lists every key
+    ctrs->sortedKeys = NULL;
+    return placePair(ctrs->pairs, ctrs->capacity, key);
+}
+
+/**************** denseFit() ****************/
+/* grows the dense arrays to hold key, if that keeps them small enough
+ * and at least 1/MaxSparseness full; returns false if not (or if out of
+ * memory), leaving the arrays as they were
+ */
+static bool denseFit(counters_t *ctrs, const int key)
+{
+    long capacity = ctrs->capacity;
+    while (capacity <= key) {
+        capacity *= 2;
+    }
+    if (capacity > MaxDenseKeys || capacity > (long) (ctrs->size + 1) * MaxSparseness + MinKeys) {
+        return false;
+    }
+    int *counts = count_mallocTag(capacity * sizeof(int), mem_CONTAINERS);
+    uint64_t *present = count_callocTag(capacity / 64, sizeof(uint64_t), mem_CONTAINERS);
+    if (counts == NULL || present == NULL) {
+        count_free(counts);
+        count_free(present);
+        return false;
+    }
+    memcpy(counts, ctrs->counts, ctrs->capacity * sizeof(int));
+    memcpy(present, ctrs->present, ctrs->capacity / 64 * sizeof(uint64_t));
+    count_free(ctrs->counts);
+    count_free(ctrs->present);
+    ctrs->counts = counts;
+    ctrs->present = present;
+    ctrs->capacity = capacity;
+    return true;
+}
+
+/**************** makeSparse() ****************/
+/* moves every counter from the dense arrays into a new hash table;
+ * returns false if out of memory, leaving the counterset dense
+ */
+static bool makeSparse(counters_t *ctrs)
+{
+    int capacity = MinKeys;
+    while ((ctrs->size + 1) * 100 > capacity * MaxLoad) {
+        capacity *= 2;
+    }
+    cntpair_t *pairs = count_mallocTag(capacity * sizeof(cntpair_t), mem_CONTAINERS);
+    if (pairs == NULL) {
+        return false;
+    }
+    memset(pairs, 0xff, capacity * sizeof(cntpair_t));     // every key -1
+    for (int word = 0; word < ctrs->capacity / 64; word++) {
+        for (uint64_t bits = ctrs->present[word]; bits != 0; bits &= bits - 1) {
+            int key = word * 64 + __builtin_ctzll(bits);
+            *placePair(pairs, capacity, key) = ctrs->counts[key];
+        }
+    }
+    count_free(ctrs->counts);
+    count_free(ctrs->present);
+    ctrs->counts = NULL;
+    ctrs->present = NULL;
+    ctrs->pairs = pairs;
+    ctrs->capacity = capacity;
+    return true;
+}
+
+/**************** growSparse() ****************/
+/* doubles the hash table; returns false if out of memory */
+static bool growSparse(counters_t *ctrs)
+{
+    int capacity = ctrs->capacity * 2;
+    cntpair_t *pairs = count_mallocTag(capacity * sizeof(cntpair_t), mem_CONTAINERS);
+    if (pairs == NULL) {
+        return false;
+    }
+    memset(pairs, 0xff, capacity * sizeof(cntpair_t));     // every key -1
+    for (int x = 0; x < ctrs->capacity; x++) {
+        if (ctrs->pairs[x].key >= 0) {
+            *placePair(pairs, capacity, ctrs->pairs[x].key) = ctrs->pairs[x].count;
+        }
+    }
+    count_free(ctrs->pairs);
+    ctrs->pairs = pairs;
+    ctrs->capacity = capacity;
+    return true;
+}
+
+/**************** placePair() ****************/
+/* claims the first empty slot from key's home slot on, in a table known
+ * not to hold key and to have room; returns a pointer to its count, 0
+ */
+static int *placePair(cntpair_t *pairs, const int capacity, const int key)
+{
+    int mask = capacity - 1;
+    int x = hashKey(key) & mask;
+    while (pairs[x].key >= 0) {
+        x = (x + 1) & mask;
+    }
+    pairs[x].key = key;
+    pairs[x].count = 0;
+    return &pairs[x].count;
+}
+
+/**************** hashKey() ****************/
+/* scatters a key over 32 bits (Fibonacci hashing, folding the high bits
+ * down) so that runs of nearby keys do not fill runs of nearby slots
+ */
+static uint32_t hashKey(const int key)
+{
+    uint32_t hash = (uint32_t) key * 2654435769u;
+    return hash ^ hash >> 16;
+}
+
+/**************** printCounter() ****************/
+/* prints one key=count pair for counters_print */
+static void printCounter(void *arg, const int key, const int count)
+{
+    printer_t *printer = arg;
+    fprintf(printer->fp, "%s%d=%d", printer->first ? "" : ",", key, count);
+    printer->first = false;
+}
+
+/**************** sortKeys() ****************/
+/* makes sure sortedKeys lists every key of a sparse counterset, in
+ * order; returns false if out of memory
+ */
+static bool sortKeys(counters_t *ctrs)
+{
+    if (ctrs->sortedKeys == NULL) {
+        ctrs->sortedKeys = count_mallocTag((ctrs->size + 1) * sizeof(int), mem_CONTAINERS);
+        if (ctrs->sortedKeys == NULL) {
+            return false;
+        }
+        int n = 0;
+        for (int x = 0; x < ctrs->capacity; x++) {
+            if (ctrs->pairs[x].key >= 0) {
+                ctrs->sortedKeys[n++] = ctrs->pairs[x].key;
+            }
+        }
+        qsort(ctrs->sortedKeys, n, sizeof(int), compareKeys);
+    }
+    return true;
+}
+
+/**************** compareKeys() ****************/
+/* orders keys, for qsort */
+static int compareKeys(const void *a, const void *b)
+{
+    int keyA = *(const int *) a;
+    int keyB = *(const int *) b;
+    return (keyA > keyB) - (keyA < keyB);
 }
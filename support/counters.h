@@ -7,6 +7,10 @@
  * empty. Each time `counters_add` is called on a given key, that key's
  * counter is incremented. The current counter value can be retrieved by
  * asking for the relevant key.
+ *
+ * Small, closely packed keys (such as cell indexes into a map) are kept
+ * in an array indexed by key; others in a hash table.  Either way add,
+ * get and set take constant time.
  * 
  * David Kotz, April 2016, 2017, 2019
  * Xia Zhou, July 2017
@@ -21,6 +25,11 @@
 /**************** global types ****************/
 typedef struct counters counters_t;  // opaque to users of the module
 
+/* a place in a walk over a counterset; see counters_next */
+typedef struct counters_cursor {
+    int next;       // private to the module
+} counters_cursor_t;
+
 /**************** functions ****************/
 
 /**************** FUNCTION ****************/
@@ -91,7 +100,8 @@ bool counters_set(counters_t *ctrs, const int key, const int count);
  * We print:
  *   Nothing if NULL fp. 
  *   "(null)" if NULL ctrs.
- *   otherwise, comma=separated list of key=counter pairs, all in {brackets}.
+ *   otherwise, comma=separated list of key=counter pairs, all in {brackets},
+ *   in increasing order of key.
  */
 void counters_print(counters_t *ctrs, FILE *fp);
 
@@ -106,13 +116,36 @@ void counters_print(counters_t *ctrs, FILE *fp);
  *   nothing, if ctrs==NULL or itemfunc==NULL.
  *   otherwise, call itemfunc once for each item, with (arg, key, count).
  * Note:
- *   the order in which items are handled is undefined.
+ *   items are handled in increasing order of key.
  *   the counterset is unchanged by this operation.
  */
 void counters_iterate(counters_t *ctrs, void *arg, 
                       void (*itemfunc)(void *arg, 
                                        const int key, const int count));
 
+/**************** counters_cursor / counters_next ****************/
+/* Walk over the counters one at a time, under the caller's control.
+ *
+ * counters_cursor returns a cursor at the start of the counterset.  Each
+ * call to counters_next moves the cursor to the next counter and stores
+ * its key and count in *key and *count (either may be NULL, if not
+ * wanted), returning false once every counter has been seen.  The caller
+ * may stop at any point; a cursor holds no resources.  Typical use:
+ *
+ *     int key, count;
+ *     for (counters_cursor_t c = counters_cursor(ctrs);
+ *          counters_next(ctrs, &c, &key, &count); ) {
+ *         ...
+ *     }
+ *
+ * Notes:
+ *   counters are visited in increasing order of key.
+ *   counts may be changed with counters_set or counters_add during a walk,
+ *   but the counterset must not gain keys while a cursor is in use.
+ */
+counters_cursor_t counters_cursor(counters_t *ctrs);
+bool counters_next(counters_t *ctrs, counters_cursor_t *cursor, int *key, int *count);
+
 /**************** counters_delete ****************/
 /* Delete the whole counterset.
  *
@@ -6,9 +6,15 @@
  * David Kotz - 2016, 2017, 2019
  */
 
+#define _DEFAULT_SOURCE     // for mmap, madvise, fstat
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "file.h"
 
 
@@ -75,9 +81,11 @@ freaduntil(FILE *fp, int (*stopfunc)(int c))
   for (pos = 0; (c = fgetc(fp)) != EOF && !(*stopfunc)(c); pos++) {
     // We need to save buf[pos+1] for the terminating null
     // and buf[len-1] is the last usable slot, 
-    // so if pos+1 is past that slot, we need to grow the buffer.
+    // so if pos+1 is past that slot, we need to grow the buffer
+    // (doubling it, so a long file costs a few reallocs, not one per byte).
     if (pos+1 > len-1) {
-      char *newbuf = realloc(buf, ++len);
+      len *= 2;
+      char *newbuf = realloc(buf, len);
       if (newbuf == NULL) {
         free(buf);
         return NULL;
@@ -99,6 +107,81 @@ freaduntil(FILE *fp, int (*stopfunc)(int c))
   }
 }
 
+/**************** fmapfile ****************/
+/* See file.h for documentation. */
+bool
+fmapfile(const char *path, filedata_t *file)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+
+  // map a regular file, if it is not empty (which mmap refuses)
+  if (S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      madvise(p, st.st_size, MADV_SEQUENTIAL);
+      close(fd);
+      file->data = p;
+      file->len = st.st_size;
+      file->mapped = true;
+      return true;
+    }
+  }
+
+  // otherwise read it, into a buffer sized to the file if we know its size
+  size_t cap = S_ISREG(st.st_mode) && st.st_size > 0 ? st.st_size : 4096;
+  size_t len = 0;
+  char *buf = malloc(cap);
+  while (buf != NULL) {
+    if (len == cap) {
+      char *bigger = realloc(buf, cap * 2);
+      if (bigger == NULL) {
+        break;
+      }
+      buf = bigger;
+      cap *= 2;
+    }
+    ssize_t n = read(fd, buf + len, cap - len);
+    if (n < 0) {
+      break;
+    }
+    if (n == 0) {
+      close(fd);
+      file->data = buf;
+      file->len = len;
+      file->mapped = false;
+      return true;
+    }
+    len += n;
+  }
+  free(buf);
+  close(fd);
+  return false;
+}
+
+/**************** funmapfile ****************/
+/* See file.h for documentation. */
+void
+funmapfile(filedata_t *file)
+{
+  if (file != NULL && file->data != NULL) {
+    if (file->mapped) {
+      munmap((void *) file->data, file->len);
+    } else {
+      free((void *) file->data);
+    }
+    file->data = NULL;
+    file->len = 0;
+  }
+}
+
 /* ********************************************************** */
 /* a simple unit test of the code above */
 #ifdef QUICKTEST
@@ -8,6 +8,8 @@
 #define __FILE_H
 
 #include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
 
 /**************** lines_in_file ****************/
 /* Returns the number of lines in the given file,
@@ -66,4 +68,22 @@ static inline char *readlinep(void) { return freadlinep(stdin); }
 char *freadwordp(FILE *fp);
 static inline char *readwordp(void) { return freadwordp(stdin); }
 
+/**************** fmapfile ****************/
+/* 
+ * Make the whole file at path available in memory, in one go: a regular
+ * file is mapped (read-only) with mmap, and anything else, or a file that
+ * cannot be mapped, is read with as few read() calls as its size allows.
+ * On success fills *file and returns true; the data is NOT null-terminated,
+ * and the caller must later call funmapfile(file).
+ * Returns false if the file cannot be opened or read.
+ */
+typedef struct filedata {
+  const char *data;     // the file's bytes
+  size_t len;           // how many
+  bool mapped;          // data is mapped, rather than read into a buffer
+} filedata_t;
+
+bool fmapfile(const char *path, filedata_t *file);
+void funmapfile(filedata_t *file);
+
 #endif // __FILE_H
@@ -0,0 +1,275 @@
+/*
+ * format.c - build text protocol messages without allocating
+ *
+ * see format.h for description
+ *
+ * Compile with -DUNIT_TEST for a standalone unit test; see below.
+ *
+ * Nuggets: Bash Boys
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "format.h"
+
+/**************** file-local constants ****************/
+/* The two digits of every number 0-99, so decimal conversion takes one
+ * division by 100 for each pair of digits rather than one by 10 for each.
+ */
+static const char DigitPairs[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+/**************** format_start ****************/
+/* see format.h for description */
+void
+format_start(format_t *f, char *buf, size_t cap)
+{
+  f->buf = buf;
+  f->cap = buf == NULL ? 0 : cap;
+  f->len = 0;
+}
+
+/**************** format_bytes ****************/
+/* see format.h for description */
+void
+format_bytes(format_t *f, const char *s, size_t n)
+{
+  // store what fits before the last byte, which format_end keeps for the null
+  if (f->len + 1 < f->cap) {
+    size_t room = f->cap - 1 - f->len;
+    memcpy(f->buf + f->len, s, n < room ? n : room);
+  }
+  f->len += n;
+}
+
+/**************** format_str ****************/
+/* see format.h for description */
+void
+format_str(format_t *f, const char *s)
+{
+  format_bytes(f, s, strlen(s));
+}
+
+/**************** format_char ****************/
+/* see format.h for description */
+void
+format_char(format_t *f, char c)
+{
+  if (f->len + 1 < f->cap) {
+    f->buf[f->len] = c;
+  }
+  f->len++;
+}
+
+/**************** format_int ****************/
+/* see format.h for description */
+void
+format_int(format_t *f, long n)
+{
+  if (f->len + format_IntBytes <= f->cap) {
+    // room for any number; convert in place
+    f->len += format_decimal(f->buf + f->len, n);
+  } else {
+    char digits[format_IntBytes];
+    format_bytes(f, digits, format_decimal(digits, n));
+  }
+}
+
+/**************** format_end ****************/
+/* see format.h for description */
+size_t
+format_end(format_t *f)
+{
+  if (f->cap > 0) {
+    f->buf[f->len < f->cap ? f->len : f->cap - 1] = '\0';
+  }
+  return f->len;
+}
+
+/**************** format_decimal ****************/
+/* see format.h for description */
+size_t
+format_decimal(char *buf, long n)
+{
+  // build the digits backward at the end of a scratch buffer
+  char digits[format_IntBytes];
+  char *p = digits + sizeof(digits);
+  unsigned long v = n < 0 ? 0UL - (unsigned long) n : (unsigned long) n;
+
+  while (v >= 100) {
+    const char *pair = DigitPairs + 2 * (v % 100);
+    v /= 100;
+    *--p = pair[1];
+    *--p = pair[0];
+  }
+  if (v >= 10) {
+    *--p = DigitPairs[2 * v + 1];
+    *--p = DigitPairs[2 * v];
+  } else {
+    *--p = '0' + v;
+  }
+  if (n < 0) {
+    *--p = '-';
+  }
+
+  size_t len = digits + sizeof(digits) - p;
+  memcpy(buf, p, len);
+  buf[len] = '\0';
+  return len;
+}
+
+/**************** format_ok ****************/
+/* see format.h for description */
+size_t
+format_ok(char *buf, size_t cap, char letter)
+{
+  format_t f;
+  format_start(&f, buf, cap);
+  format_bytes(&f, "OK ", 3);
+  format_char(&f, letter);
+  return format_end(&f);
+}
+
+/**************** format_grid ****************/
+/* see format.h for description */
+size_t
+format_grid(char *buf, size_t cap, int nrows, int ncols)
+{
+  format_t f;
+  format_start(&f, buf, cap);
+  format_bytes(&f, "GRID ", 5);
+  format_int(&f, nrows);
+  format_char(&f, ' ');
+  format_int(&f, ncols);
+  return format_end(&f);
+}
+
+/**************** format_view ****************/
+/* see format.h for description */
+size_t
+format_view(char *buf, size_t cap, int nrows, int ncols)
+{
+  format_t f;
+  format_start(&f, buf, cap);
+  format_bytes(&f, "VIEW ", 5);
+  format_int(&f, nrows);
+  format_char(&f, ' ');
+  format_int(&f, ncols);
+  return format_end(&f);
+}
+
+/**************** format_gold ****************/
+/* see format.h for description */
+size_t
+format_gold(char *buf, size_t cap, int n, int p, int r)
+{
+  format_t f;
+  format_start(&f, buf, cap);
+  format_bytes(&f, "GOLD ", 5);
+  format_int(&f, n);
+  format_char(&f, ' ');
+  format_int(&f, p);
+  format_char(&f, ' ');
+  format_int(&f, r);
+  return format_end(&f);
+}
+
+/**************** format_quit ****************/
+/* see format.h for description */
+size_t
+format_quit(char *buf, size_t cap, const char *explanation)
+{
+  format_t f;
+  format_start(&f, buf, cap);
+  format_bytes(&f, "QUIT ", 5);
+  format_str(&f, explanation);
+  return format_end(&f);
+}
+
+/* ************************* UNIT_TEST ****************************** */
+/*
+ * Compare each formatter with snprintf, for messages that fit and for
+ * buffers too small.  Prints one line per failed check; exits non-zero
+ * if any check fails.
+ *
+ *   ./formattest
+ */
+
+#ifdef UNIT_TEST
+#include <stdbool.h>
+#include <limits.h>
+
+static int failures = 0;
+
+static void
+check(const bool ok, const char *what)
+{
+  if (!ok) {
+    printf("FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+/* check that buf and len are what snprintf gives for the same cap */
+static void
+checkLike(const char *buf, size_t len, size_t cap, const char *want, const char *what)
+{
+  char expect[256];
+  snprintf(expect, sizeof(expect), "%.*s", cap == 0 ? 0 : (int) cap - 1, want);
+  check(len == strlen(want), what);
+  check(cap == 0 || strcmp(buf, expect) == 0, what);
+}
+
+int
+main(const int argc, char *argv[])
+{
+  const long ints[] = {0, 7, 9, 10, 42, 99, 100, 101, 999, 1000, 12345,
+                       -1, -10, -99, -100, INT_MAX, INT_MIN, LONG_MAX, LONG_MIN};
+  for (int i = 0; i < sizeof(ints) / sizeof(ints[0]); i++) {
+    char buf[format_IntBytes], want[64];
+    snprintf(want, sizeof(want), "%ld", ints[i]);
+    size_t len = format_decimal(buf, ints[i]);
+    check(len == strlen(want) && strcmp(buf, want) == 0, want);
+  }
+
+  for (size_t cap = 0; cap < 24; cap++) {
+    char buf[24];
+    checkLike(buf, format_ok(buf, cap, 'Q'), cap, "OK Q", "format_ok");
+    checkLike(buf, format_grid(buf, cap, 21, 79), cap, "GRID 21 79", "format_grid");
+    checkLike(buf, format_view(buf, cap, 24, 80), cap, "VIEW 24 80", "format_view");
+    checkLike(buf, format_gold(buf, cap, 12, -3, 250), cap, "GOLD 12 -3 250", "format_gold");
+    checkLike(buf, format_quit(buf, cap, "Thanks for playing!"), cap,
+              "QUIT Thanks for playing!", "format_quit");
+  }
+
+  // a message built in pieces, with an integer that straddles the end
+  char buf[16];
+  format_t f;
+  format_start(&f, buf, sizeof(buf));
+  format_str(&f, "GAME OVER\n");
+  format_char(&f, 'A');
+  format_char(&f, '\t');
+  format_int(&f, 123456);
+  size_t len = format_end(&f);
+  checkLike(buf, len, sizeof(buf), "GAME OVER\nA\t123456", "format_t");
+
+  format_start(&f, NULL, 0);
+  format_int(&f, -42);
+  check(format_end(&f) == 3, "measuring");
+
+  if (failures == 0) {
+    printf("all format tests passed\n");
+  }
+  return failures == 0 ? 0 : 1;
+}
+#endif // UNIT_TEST
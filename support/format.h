@@ -0,0 +1,84 @@
+/*
+ * format - build text protocol messages without allocating
+ *
+ * The text-protocol counterpart of the wire module: each function writes
+ * one server message into a buffer the caller provides (usually on its
+ * stack, or one it reuses for every message), checking the bounds as it
+ * goes and converting integers to decimal without a trip through printf.
+ *
+ * Like snprintf, every function returns the length of the whole message
+ * (not counting the terminating null); the message is complete and
+ * null-terminated only if that length is less than cap.  Otherwise buf
+ * holds as much of it as fit, still null-terminated if cap > 0.
+ *
+ * Messages too varied for the fixed formats below are built a piece at a
+ * time with a format_t:
+ *
+ *   char buf[64];
+ *   format_t f;
+ *   format_start(&f, buf, sizeof(buf));
+ *   format_str(&f, "GOLD ");
+ *   format_int(&f, n);
+ *   if (format_end(&f) < sizeof(buf)) ... send buf ...
+ *
+ * Nuggets: Bash Boys
+ */
+
+#ifndef __FORMAT_H
+#define __FORMAT_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/**************** constants ****************/
+#define format_IntBytes 21      // room for any long in decimal, with its null
+
+/**************** global types ****************/
+/* A message under construction; its fields are private to the module */
+typedef struct format {
+  char *buf;                    // where the message goes
+  size_t cap;                   // bytes of room at buf
+  size_t len;                   // length of the message so far, even past cap
+} format_t;
+
+/**************** functions ****************/
+
+/**************** format_start ****************/
+/* Start an empty message in buf, which has room for cap bytes;
+ * buf may be NULL if cap is 0, to measure a message.
+ */
+void format_start(format_t *f, char *buf, size_t cap);
+
+/**************** format_str / format_bytes / format_char / format_int ****************/
+/* Append a string, n bytes of a string, one character, or an integer in
+ * decimal to the message.  Whatever does not fit is counted, not stored.
+ */
+void format_str(format_t *f, const char *s);
+void format_bytes(format_t *f, const char *s, size_t n);
+void format_char(format_t *f, char c);
+void format_int(format_t *f, long n);
+
+/**************** format_end ****************/
+/* Null-terminate the message and return its length; it fit only if that
+ * is less than the cap given to format_start.
+ */
+size_t format_end(format_t *f);
+
+/**************** format_decimal ****************/
+/* Write n in decimal, null-terminated, into buf, which must have room for
+ * format_IntBytes bytes; return the number of digits (and sign) written.
+ */
+size_t format_decimal(char *buf, long n);
+
+/**************** format_ok, format_grid, format_view, format_gold, format_quit ****************/
+/* Write the "OK L", "GRID nrows ncols", "VIEW nrows ncols", "GOLD n p r" or
+ * "QUIT explanation" message into buf, which has room for cap bytes; see above for the
+ * return value.
+ */
+size_t format_ok(char *buf, size_t cap, char letter);
+size_t format_grid(char *buf, size_t cap, int nrows, int ncols);
+size_t format_view(char *buf, size_t cap, int nrows, int ncols);
+size_t format_gold(char *buf, size_t cap, int n, int p, int r);
+size_t format_quit(char *buf, size_t cap, const char *explanation);
+
+#endif // __FORMAT_H
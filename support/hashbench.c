@@ -0,0 +1,252 @@
+/*
+ * hashbench.c - compare the hashtable module against the chained table
+ *
+ * The hashtable module was once an array of 'set' linked lists, fixed in
+ * size at hashtable_new; that design is reproduced here, built on the set
+ * module, as the baseline.  For several table sizes we insert that many
+ * keys, look each one up, look up as many absent keys, and iterate, and
+ * report nanoseconds per operation for both tables.  Each table is
+ * created twice: with an accurate size hint, and with the server's small
+ * hint of 10 slots, which the chained table can never outgrow.
+ * Finally we time the two string hashes alone, JenkinsHash (a byte at a
+ * time) and StringHash (eight bytes at a time), over keys of several
+ * lengths, and report nanoseconds per hash and megabytes per second.
+ *
+ * usage: ./hashbench [maxItems]
+ *   default 100000
+ *
+ * Nuggets: Bash Boys
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "hashtable.h"
+#include "set.h"
+#include "jhash.h"
+
+/**************** the chained baseline ****************/
+typedef struct chained {
+    long size;
+    set_t **array;
+} chained_t;
+
+static chained_t *chained_new(const int num_slots)
+{
+    chained_t *ht = malloc(sizeof(chained_t));
+    ht->size = num_slots;
+    ht->array = malloc(num_slots * sizeof(set_t *));
+    for (int i = 0; i < num_slots; i++) {
+        ht->array[i] = set_new();
+    }
+    return ht;
+}
+
+static bool chained_insert(chained_t *ht, const char *key, void *item)
+{
+    return set_insert(ht->array[JenkinsHash(key, ht->size)], key, item);
+}
+
+static void *chained_find(chained_t *ht, const char *key)
+{
+    return set_find(ht->array[JenkinsHash(key, ht->size)], key);
+}
+
+static void chained_iterate(chained_t *ht, void *arg,
+                            void (*itemfunc)(void *arg, const char *key, void *item))
+{
+    for (long x = 0; x < ht->size; x++) {
+        set_iterate(ht->array[x], arg, itemfunc);
+    }
+}
+
+static void chained_delete(chained_t *ht)
+{
+    for (long x = 0; x < ht->size; x++) {
+        set_delete(ht->array[x], NULL);
+    }
+    free(ht->array);
+    free(ht);
+}
+
+/**************** file-local functions ****************/
+static void countItem(void *arg, const char *key, void *item);
+static double now(void);
+static void benchOpen(char **keys, char **absent, int n, int hint, double ns[4]);
+static void benchChained(char **keys, char **absent, int n, int hint, double ns[4]);
+static void benchHashes(void);
+
+/**************** main ****************/
+int main(const int argc, char *argv[])
+{
+    int maxItems = argc > 1 ? atoi(argv[1]) : 100000;
+    if (maxItems <= 0) {
+        fprintf(stderr, "usage: %s [maxItems]\n", argv[0]);
+        return 1;
+    }
+
+    // keys like player names and gold pile numbers, some past the inline limit
+    char **keys = malloc(maxItems * sizeof(char *));
+    char **absent = malloc(maxItems * sizeof(char *));
+    for (int i = 0; i < maxItems; i++) {
+        char buf[64];
+        if (i % 4 == 3) {
+            snprintf(buf, sizeof(buf), "a rather long player name number %d", i);
+        } else {
+            snprintf(buf, sizeof(buf), "player%d", i);
+        }
+        keys[i] = strdup(buf);
+        snprintf(buf, sizeof(buf), "nobody%d", i);
+        absent[i] = strdup(buf);
+    }
+
+    printf("%8s %6s %-8s %10s %10s %10s %10s\n", "items", "hint", "table",
+           "insert ns", "hit ns", "miss ns", "iter ns");
+    for (int n = 26; n <= maxItems; n = n < 1000 ? n * 6 : n * 10) {
+        int hints[2] = { n, 10 };
+        for (int h = 0; h < 2; h++) {
+            double ns[4];
+            // the chained table with 10 slots is quadratic; skip huge runs
+            if (!(h == 1 && n > 20000)) {
+                benchChained(keys, absent, n, hints[h], ns);
+                printf("%8d %6d %-8s %10.1f %10.1f %10.1f %10.1f\n", n, hints[h],
+                       "chained", ns[0], ns[1], ns[2], ns[3]);
+            }
+            benchOpen(keys, absent, n, hints[h], ns);
+            printf("%8d %6d %-8s %10.1f %10.1f %10.1f %10.1f\n", n, hints[h],
+                   "open", ns[0], ns[1], ns[2], ns[3]);
+        }
+    }
+
+    for (int i = 0; i < maxItems; i++) {
+        free(keys[i]);
+        free(absent[i]);
+    }
+    free(keys);
+    free(absent);
+
+    benchHashes();
+    return 0;
+}
+
+/**************** benchOpen ****************/
+/* times the hashtable module: ns per insert, hit, miss, and item visited */
+static void benchOpen(char **keys, char **absent, int n, int hint, double ns[4])
+{
+    long found = 0;
+    double t0 = now();
+    hashtable_t *ht = hashtable_new(hint);
+    for (int i = 0; i < n; i++) {
+        hashtable_insert(ht, keys[i], keys[i]);
+    }
+    double t1 = now();
+    for (int i = 0; i < n; i++) {
+        found += hashtable_find(ht, keys[i]) != NULL;
+    }
+    double t2 = now();
+    for (int i = 0; i < n; i++) {
+        found += hashtable_find(ht, absent[i]) != NULL;
+    }
+    double t3 = now();
+    for (int r = 0; r < 10; r++) {
+        hashtable_iterate(ht, &found, countItem);
+    }
+    double t4 = now();
+    hashtable_delete(ht, NULL);
+    if (found != n + 10L * n) {
+        fprintf(stderr, "hashtable: found %ld, expected %ld\n", found, n + 10L * n);
+    }
+    ns[0] = (t1 - t0) * 1e9 / n;
+    ns[1] = (t2 - t1) * 1e9 / n;
+    ns[2] = (t3 - t2) * 1e9 / n;
+    ns[3] = (t4 - t3) * 1e9 / (10.0 * n);
+}
+
+/**************** benchChained ****************/
+/* the same, for the chained baseline */
+static void benchChained(char **keys, char **absent, int n, int hint, double ns[4])
+{
+    long found = 0;
+    double t0 = now();
+    chained_t *ht = chained_new(hint);
+    for (int i = 0; i < n; i++) {
+        chained_insert(ht, keys[i], keys[i]);
+    }
+    double t1 = now();
+    for (int i = 0; i < n; i++) {
+        found += chained_find(ht, keys[i]) != NULL;
+    }
+    double t2 = now();
+    for (int i = 0; i < n; i++) {
+        found += chained_find(ht, absent[i]) != NULL;
+    }
+    double t3 = now();
+    for (int r = 0; r < 10; r++) {
+        chained_iterate(ht, &found, countItem);
+    }
+    double t4 = now();
+    chained_delete(ht);
+    if (found != n + 10L * n) {
+        fprintf(stderr, "chained: found %ld, expected %ld\n", found, n + 10L * n);
+    }
+    ns[0] = (t1 - t0) * 1e9 / n;
+    ns[1] = (t2 - t1) * 1e9 / n;
+    ns[2] = (t3 - t2) * 1e9 / n;
+    ns[3] = (t4 - t3) * 1e9 / (10.0 * n);
+}
+
+/**************** benchHashes ****************/
+/* times JenkinsHash and StringHash over keys from 4 to 1024 bytes */
+static void benchHashes(void)
+{
+    static const int lengths[] = { 4, 8, 16, 32, 64, 256, 1024 };
+    const int nlengths = sizeof(lengths) / sizeof(lengths[0]);
+    const long bytesPerRun = 1L << 24;      // hash this many bytes per key length
+    char key[1025];
+
+    printf("\n%6s %12s %12s %12s %12s\n", "bytes",
+           "jenkins ns", "jenkins MB/s", "string ns", "string MB/s");
+    for (int l = 0; l < nlengths; l++) {
+        int len = lengths[l];
+        for (int i = 0; i < len; i++) {
+            key[i] = 'a' + i % 26;
+        }
+        key[len] = '\0';
+        long reps = bytesPerRun / len;
+
+        // vary the key, and keep each result, so no call can be optimized away
+        volatile unsigned long sink = 0;
+        double t0 = now();
+        for (long r = 0; r < reps; r++) {
+            key[0] = 'a' + r % 26;
+            sink += JenkinsHash(key, UINT32_MAX);
+        }
+        double t1 = now();
+        for (long r = 0; r < reps; r++) {
+            key[0] = 'a' + r % 26;
+            sink += StringHash(key, sink);
+        }
+        double t2 = now();
+
+        printf("%6d %12.1f %12.0f %12.1f %12.0f\n", len,
+               (t1 - t0) * 1e9 / reps, bytesPerRun / (t1 - t0) / 1e6,
+               (t2 - t1) * 1e9 / reps, bytesPerRun / (t2 - t1) / 1e6);
+    }
+}
+
+/**************** countItem ****************/
+static void countItem(void *arg, const char *key, void *item)
+{
+    (*(long *) arg)++;
+}
+
+/**************** now ****************/
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
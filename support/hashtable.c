@@ -1,78 +1,137 @@
-/* 
+/*
  * hashtable.c - CS50 'hashtable' module
  *
  * see hashtable.h for more information.
  *
+ * Entries are kept in an array in the order they were inserted, and
+ * found through an index: an array of slots using open addressing with
+ * Robin Hood linear probing.  A slot is placed as near as possible to
+ * the slot its hash prefers, and on insert a slot that has probed
+ * further than the one occupying a place takes that place, so no slot
+ * strays far from home and a lookup can stop as soon as it has probed
+ * further than the slot it is looking at.  The index doubles when it
+ * grows past MaxLoad full.  Each slot caches its key's hash, which is
+ * compared before the key itself, and each entry keeps a short key
+ * inline, so most inserts allocate nothing.  Keys are hashed with
+ * StringHash under a seed drawn at random for each table, so the keys a
+ * client chooses cannot be made to collide; since iteration follows the
+ * entries, not the index, its order does not depend on the seed.
+ *
  * William Dinauer, Dartmouth CS50 Winter 2021
- */ 
+ */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "string.h"
-#include "set.h"
 #include "hashtable.h"
 #include "memory.h"
 #include "jhash.h"
 
+/**************** local constants ****************/
+#define ShortKeyBytes 24        // keys shorter than this are stored inline
+static const int MinSlots = 8;  // smallest array; always a power of two
+static const int MaxLoad = 80;  // grow when more than this percent full
+
+/**************** local types ****************/
+typedef struct entry {
+    void *item;             // the item stored
+    union {
+        char inlined[ShortKeyBytes];    // a short key, in place
+        char *copy;                     // a longer key, allocated
+    } key;                  // see entryKey
+} entry_t;
+
+typedef struct slot {
+    uint32_t hash;          // cached hash of the entry's key
+    uint32_t dist;          // 1 + distance from the preferred slot; 0 if empty
+    long entry;             // index of the entry
+} slot_t;
+
+/**************** global types ****************/
 typedef struct hashtable {
-    long size;
-    set_t **array;
+    slot_t *slots;          // array of 'capacity' slots
+    entry_t *entries;       // array of room for 'capacity' * MaxLoad% entries
+    long capacity;          // number of slots; a power of two
+    long count;             // number of entries in use, in insertion order
+    uint64_t seed;          // seed for hashing keys; see HashSeed
 } hashtable_t;
 
+/**************** local functions ****************/
+/* not visible outside this file */
+static uint32_t hashKey(hashtable_t *ht, const char *key);
+static const char *entryKey(const entry_t *entry);
+static long findSlot(hashtable_t *ht, const char *key, uint32_t hash);
+static void place(slot_t *slots, long capacity, slot_t slot);
+static bool grow(hashtable_t *ht);
+
 /**************** hashtable_new() ****************/
 /* see hashtable.h for description */
 hashtable_t *hashtable_new(const int num_slots) {
-    hashtable_t *ht = count_malloc(sizeof(hashtable_t));
+    if (num_slots <= 0) {
+        return NULL;
+    }
+    hashtable_t *ht = count_mallocTag(sizeof(hashtable_t), mem_CONTAINERS);
     if (ht == NULL) {
         // error allocating memory for ht
         return NULL;
-    } else {
-        ht->size = 0; // initialize the size
-        ht->array = count_calloc(num_slots, sizeof(set_t*));
-        if (ht->array == NULL) {
-            // error allocating memory for the array
-            count_free(ht);
-            return NULL;
-        } else {
-            int i;
-            for (i = 0; i < num_slots; i++) {
-                // create a set for each slot in the array
-                ht->array[i] = set_new();
-                if (ht->array[i] == NULL) {
-                    // error allocating memory for set; delete all previously created sets
-                    int x;
-                    for (x = 0; x < ht->size; x++) {
-                        count_free(ht->array[x]);
-                    }
-                    count_free(ht->array);
-                    count_free(ht);
-                    return NULL;
-                } else {
-                    ht->size++;
-                }
-            }
-            return ht;
-        }
     }
-    return NULL;
+    // num_slots is a hint at the expected number of items; start with
+    // enough room for that many without growing
+    ht->capacity = MinSlots;
+    while (ht->capacity * MaxLoad / 100 < num_slots) {
+        ht->capacity *= 2;
+    }
+    ht->count = 0;
+    ht->seed = HashSeed();
+    ht->slots = count_callocTag(ht->capacity, sizeof(slot_t), mem_CONTAINERS);
+    ht->entries = count_mallocTag(ht->capacity * MaxLoad / 100 * sizeof(entry_t),
+                                  mem_CONTAINERS);
+    if (ht->slots == NULL || ht->entries == NULL) {
+        // error allocating memory for the arrays
+        count_free(ht->slots);
+        count_free(ht->entries);
+        count_free(ht);
+        return NULL;
+    }
+    return ht;
 }
 
 /**************** hashtable_insert() ****************/
 /* see hashtable.h for description */
 bool hashtable_insert(hashtable_t *ht, const char *key, void *item)
 {
-   if (ht != NULL && key != NULL && item != NULL) {
-      // call the hash function for the key, placing into the according slot
-      long slot = JenkinsHash(key, ht->size); 
-      if (set_insert(ht->array[slot], key, item)) {
-          return true;
-      } else {
-          // insert failed; key may already be in the set
-          return false;
-      }
-   }
-   return false;
+    if (ht == NULL || key == NULL || item == NULL) {
+        return false;
+    }
+    uint32_t hash = hashKey(ht, key);
+    if (findSlot(ht, key, hash) >= 0) {
+        // no duplicates
+        return false;
+    }
+    if ((ht->count + 1) * 100 > ht->capacity * MaxLoad && !grow(ht)) {
+        return false;
+    }
+
+    // build the entry, copying the key
+    entry_t entry = { item };
+    size_t len = strlen(key);
+    if (len < ShortKeyBytes) {
+        memcpy(entry.key.inlined, key, len + 1);
+    } else {
+        entry.key.copy = count_mallocTag(len + 1, mem_CONTAINERS);
+        if (entry.key.copy == NULL) {
+            return false;
+        }
+        memcpy(entry.key.copy, key, len + 1);
+        entry.key.inlined[ShortKeyBytes - 1] = 1;     // mark it; see entryKey
+    }
+    ht->entries[ht->count] = entry;
+    slot_t slot = { hash, 1, ht->count };
+    place(ht->slots, ht->capacity, slot);
+    ht->count++;
+    return true;
 }
 
 /**************** hashtable_find() ****************/
@@ -80,29 +139,29 @@ bool hashtable_insert(hashtable_t *ht, const char *key, void *item)
 void *hashtable_find(hashtable_t *ht, const char *key)
 {
     if (ht != NULL && key != NULL) {
-        // search for the key in the slot it hashes to
-        long slot = JenkinsHash(key, ht->size);
-        return set_find(ht->array[slot], key);
+        long slot = findSlot(ht, key, hashKey(ht, key));
+        if (slot >= 0) {
+            return ht->entries[ht->slots[slot].entry].item;
+        }
     }
     return NULL;
 }
 
 /**************** hashtable_print() ****************/
 /* see hashtable.h for description */
-void hashtable_print(hashtable_t *ht, FILE *fp, 
-                     void (*itemprint)(FILE *fp, const char *key, void *item)) 
+void hashtable_print(hashtable_t *ht, FILE *fp,
+                     void (*itemprint)(FILE *fp, const char *key, void *item))
 {
     if (fp != NULL) {
         if (ht != NULL) {
-            int x;
-            // iterate over all slots/sets
-            for (x = 0; x < ht->size; x++) {
-                fprintf(fp, "slot %d: ", x);
-                if (itemprint != NULL){
-                    //print the set
-                    set_print(ht->array[x], fp, itemprint);
+            // one line per slot, each holding at most one item
+            for (long x = 0; x < ht->capacity; x++) {
+                fprintf(fp, "slot %ld: {", x);
+                if (itemprint != NULL && ht->slots[x].dist != 0) {
+                    entry_t *entry = &ht->entries[ht->slots[x].entry];
+                    (*itemprint)(fp, entryKey(entry), entry->item);
                 }
-                fputc('\n', fp);
+                fputs("}\n", fp);
             }
         } else {
             fputs("(null)", fp);
@@ -116,12 +175,41 @@ void hashtable_iterate(hashtable_t *ht, void *arg,
                        void (*itemfunc)(void *arg, const char *key, void *item))
 {
     if (ht != NULL && itemfunc != NULL) {
-        int x;
-        // iterate over all slots/sets
-        for (x = 0; x < ht->size; x++) {
-            set_iterate(ht->array[x], arg, itemfunc);
+        // one pass down the entries, in insertion order
+        for (long x = 0; x < ht->count; x++) {
+            entry_t *entry = &ht->entries[x];
+            (*itemfunc)(arg, entryKey(entry), entry->item);
+        }
+    }
+}
+
+/**************** hashtable_cursor() ****************/
+/* see hashtable.h for description */
+hashtable_cursor_t hashtable_cursor(hashtable_t *ht)
+{
+    hashtable_cursor_t cursor = { 0 };
+    return cursor;
+}
+
+/**************** hashtable_next() ****************/
+/* see hashtable.h for description */
+bool hashtable_next(hashtable_t *ht, hashtable_cursor_t *cursor,
+                    const char **key, void **item)
+{
+    if (ht != NULL && cursor != NULL) {
+        // carry on down the entries, in insertion order
+        if (cursor->next < ht->count) {
+            entry_t *entry = &ht->entries[cursor->next++];
+            if (key != NULL) {
+                *key = entryKey(entry);
+            }
+            if (item != NULL) {
+                *item = entry->item;
+            }
+            return true;
         }
     }
+    return false;
 }
 
 /**************** hashtable_delete() ****************/
@@ -129,12 +217,108 @@ void hashtable_iterate(hashtable_t *ht, void *arg,
 void hashtable_delete(hashtable_t *ht, void (*itemdelete)(void *item))
 {
     if (ht != NULL) {
-        int x;
-        // free every set
-        for (x = 0; x < ht->size; x++) {
-            set_delete(ht->array[x], itemdelete);
+        for (long x = 0; x < ht->count; x++) {
+            entry_t *entry = &ht->entries[x];
+            if (itemdelete != NULL) {
+                // caller handles deleting the item
+                (*itemdelete)(entry->item);
+            }
+            if (entryKey(entry) != entry->key.inlined) {
+                count_free(entry->key.copy);    // free a long key
+            }
         }
-        count_free(ht->array); // free the array
+        count_free(ht->entries); // free the arrays
+        count_free(ht->slots);
         count_free(ht);        // free the hashtable
     }
 }
+
+/**************** hashKey() ****************/
+/* hashes a key to 32 bits with the table's seed */
+static uint32_t hashKey(hashtable_t *ht, const char *key)
+{
+    return (uint32_t) StringHash(key, ht->seed);
+}
+
+/**************** entryKey() ****************/
+/* returns the key of an occupied entry, wherever it is stored;
+ * the last inline byte is zero for an inline key (the key is shorter
+ * than the inline bytes, which start zeroed) and 1 for an allocated one
+ * (the pointer does not reach that far)
+ */
+static const char *entryKey(const entry_t *entry)
+{
+    return entry->key.inlined[ShortKeyBytes - 1] == 0
+        ? entry->key.inlined : entry->key.copy;
+}
+
+/**************** findSlot() ****************/
+/* returns the slot holding key, or -1 if it is not in the table */
+static long findSlot(hashtable_t *ht, const char *key, uint32_t hash)
+{
+    long mask = ht->capacity - 1;
+    uint32_t dist = 1;
+    for (long x = hash & mask; ; x = (x + 1) & mask, dist++) {
+        slot_t *slot = &ht->slots[x];
+        // an empty slot, or one closer to home than we would be,
+        // means the key is absent
+        if (slot->dist < dist) {
+            return -1;
+        }
+        if (slot->hash == hash
+            && strcmp(entryKey(&ht->entries[slot->entry]), key) == 0) {
+            return x;
+        }
+    }
+}
+
+/**************** place() ****************/
+/* puts a slot, for an entry known to be absent, into an index with room for it */
+static void place(slot_t *slots, long capacity, slot_t slot)
+{
+    long mask = capacity - 1;
+    slot.dist = 1;
+    for (long x = slot.hash & mask; ; x = (x + 1) & mask, slot.dist++) {
+        slot_t *here = &slots[x];
+        if (here->dist == 0) {
+            *here = slot;
+            return;
+        }
+        if (here->dist < slot.dist) {
+            // take from the rich: this slot has probed further than the
+            // one here, so it takes the place and we carry on placing the other
+            slot_t displaced = *here;
+            *here = slot;
+            slot = displaced;
+        }
+    }
+}
+
+/**************** grow() ****************/
+/* doubles the index, re-placing every slot, and makes room for as many
+ * more entries; returns false if out of memory
+ */
+static bool grow(hashtable_t *ht)
+{
+    long capacity = ht->capacity * 2;
+    slot_t *slots = count_callocTag(capacity, sizeof(slot_t), mem_CONTAINERS);
+    entry_t *entries = count_mallocTag(capacity * MaxLoad / 100 * sizeof(entry_t),
+                                       mem_CONTAINERS);
+    if (slots == NULL || entries == NULL) {
+        count_free(slots);
+        count_free(entries);
+        return false;
+    }
+    for (long x = 0; x < ht->capacity; x++) {
+        if (ht->slots[x].dist != 0) {
+            place(slots, capacity, ht->slots[x]);
+        }
+    }
+    memcpy(entries, ht->entries, ht->count * sizeof(entry_t));
+    count_free(ht->slots);
+    count_free(ht->entries);
+    ht->slots = slots;
+    ht->entries = entries;
+    ht->capacity = capacity;
+    return true;
+}
@@ -17,6 +17,11 @@
 /**************** global types ****************/
 typedef struct hashtable hashtable_t;  // opaque to users of the module
 
+/* a place in a walk over a hashtable; see hashtable_next */
+typedef struct hashtable_cursor {
+    long next;      // private to the module
+} hashtable_cursor_t;
+
 /**************** functions ****************/
 
 /**************** hashtable_new ****************/
@@ -81,7 +86,7 @@ void hashtable_print(hashtable_t *ht, FILE *fp,
                      void (*itemprint)(FILE *fp, const char *key, void *item));
 
 /**************** hashtable_iterate ****************/
-/* Iterate over all items in the table; in undefined order.
+/* Iterate over all items in the table, in the order they were inserted.
  *
  * Caller provides:
  *   valid pointer to hashtable, 
@@ -91,13 +96,37 @@ void hashtable_print(hashtable_t *ht, FILE *fp,
  *   nothing, if ht==NULL or itemfunc==NULL.
  *   otherwise, call the itemfunc once for each item, with (arg, key, item).
  * Notes:
- *   the order in which hashtable items are handled is undefined.
+ *   items are handled in insertion order, which does not depend on the
+ *   table's hash seed, so it is the same from one run to the next.
  *   the hashtable and its contents are not changed by this function,
  *   but the itemfunc may change the contents of the item.
  */
 void hashtable_iterate(hashtable_t *ht, void *arg,
                        void (*itemfunc)(void *arg, const char *key, void *item) );
 
+/**************** hashtable_cursor / hashtable_next ****************/
+/* Walk over the table one item at a time, under the caller's control.
+ *
+ * hashtable_cursor returns a cursor at the start of the table.  Each call
+ * to hashtable_next moves the cursor to the next (key, item) pair and
+ * stores it in *key and *item (either may be NULL, if not wanted),
+ * returning false once every pair has been seen.  The caller may stop at
+ * any point; a cursor holds no resources.  Typical use:
+ *
+ *     void *item;
+ *     for (hashtable_cursor_t c = hashtable_cursor(ht);
+ *          hashtable_next(ht, &c, NULL, &item); ) {
+ *         ...
+ *     }
+ *
+ * Notes:
+ *   items are visited in insertion order, as by hashtable_iterate.
+ *   the table must not gain items while a cursor is in use.
+ */
+hashtable_cursor_t hashtable_cursor(hashtable_t *ht);
+bool hashtable_next(hashtable_t *ht, hashtable_cursor_t *cursor,
+                    const char **key, void **item);
+
 /**************** hashtable_delete ****************/
 /* Delete hashtable, calling a delete function on each item.
  *
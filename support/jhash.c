@@ -3,10 +3,19 @@
  *
  * Implementation details can be found at:
  *     http://www.burtleburtle.net/bob/hash/doobs.html
+ *
+ * StringHash follows the XXH64 specification:
+ *     https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
  * ========================================================================= 
  */
 
+#define _DEFAULT_SOURCE     // for getrandom and clock_gettime
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/random.h>
+#endif
 #include "jhash.h" 
 
 // JenkinsHash - see header file for usage
@@ -32,3 +41,128 @@ JenkinsHash(const char *str, const unsigned long mod)
 
   return (hash % mod);
 }
+
+/**************** XXH64 primes and helpers ****************/
+static const uint64_t P1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t P2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t P3 = 0x165667B19E3779F9ULL;
+static const uint64_t P4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t P5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t
+rotl(const uint64_t x, const int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+// read 8 or 4 bytes, little-endian, from any alignment
+static inline uint64_t
+read64(const unsigned char *p)
+{
+  return (uint64_t) p[0] | (uint64_t) p[1] << 8 | (uint64_t) p[2] << 16
+    | (uint64_t) p[3] << 24 | (uint64_t) p[4] << 32 | (uint64_t) p[5] << 40
+    | (uint64_t) p[6] << 48 | (uint64_t) p[7] << 56;
+}
+
+static inline uint64_t
+read32(const unsigned char *p)
+{
+  return (uint64_t) p[0] | (uint64_t) p[1] << 8 | (uint64_t) p[2] << 16
+    | (uint64_t) p[3] << 24;
+}
+
+static inline uint64_t
+round64(uint64_t acc, const uint64_t input)
+{
+  acc += input * P2;
+  acc = rotl(acc, 31);
+  return acc * P1;
+}
+
+static inline uint64_t
+merge64(uint64_t acc, const uint64_t val)
+{
+  acc ^= round64(0, val);
+  return acc * P1 + P4;
+}
+
+// StringHash - see header file for usage
+uint64_t
+StringHash(const char *str, const uint64_t seed)
+{
+  if (str == NULL) {
+    return 0;
+  }
+  return MemoryHash(str, strlen(str), seed);
+}
+
+// MemoryHash - see header file for usage
+uint64_t
+MemoryHash(const void *data, const size_t len, const uint64_t seed)
+{
+  if (data == NULL) {
+    return 0;
+  }
+  const unsigned char *p = data;
+  const unsigned char *end = p + len;
+  uint64_t h;
+
+  if (len >= 32) {
+    // four lanes, 32 bytes per stripe
+    uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+    for (; end - p >= 32; p += 32) {
+      v1 = round64(v1, read64(p));
+      v2 = round64(v2, read64(p + 8));
+      v3 = round64(v3, read64(p + 16));
+      v4 = round64(v4, read64(p + 24));
+    }
+    h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    h = merge64(h, v1);
+    h = merge64(h, v2);
+    h = merge64(h, v3);
+    h = merge64(h, v4);
+  } else {
+    h = seed + P5;
+  }
+  h += len;
+
+  // the tail: 8 bytes, then 4, then 1 at a time
+  for (; end - p >= 8; p += 8) {
+    h ^= round64(0, read64(p));
+    h = rotl(h, 27) * P1 + P4;
+  }
+  if (end - p >= 4) {
+    h ^= read32(p) * P1;
+    h = rotl(h, 23) * P2 + P3;
+    p += 4;
+  }
+  for (; p < end; p++) {
+    h ^= *p * P5;
+    h = rotl(h, 11) * P1;
+  }
+
+  // avalanche
+  h ^= h >> 33;
+  h *= P2;
+  h ^= h >> 29;
+  h *= P3;
+  h ^= h >> 32;
+  return h;
+}
+
+// HashSeed - see header file for usage
+uint64_t
+HashSeed(void)
+{
+  uint64_t seed = 0;
+#ifdef __linux__
+  if (getrandom(&seed, sizeof(seed), GRND_NONBLOCK) == sizeof(seed)) {
+    return seed;
+  }
+#endif
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  seed = (uint64_t) ts.tv_sec * P1 ^ (uint64_t) ts.tv_nsec * P2
+    ^ (uint64_t) getpid() * P3;
+  return seed;
+}
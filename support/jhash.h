@@ -3,12 +3,18 @@
  *
  * Implementation details can be found at:
  *     http://www.burtleburtle.net/bob/hash/doobs.html
+ *
+ * Also StringHash, a faster seeded hash for hash tables, after xxHash64:
+ *     https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
  * ========================================================================= 
  */
 
 #ifndef JHASH_H
 #define JHASH_H
 
+#include <stdint.h>
+#include <stddef.h>
+
 /*
  * jenkins_hash - Bob Jenkins' one_at_a_time hash function
  * @str: char buffer to hash (non-NULL)
@@ -18,4 +24,33 @@
  */
 unsigned long JenkinsHash(const char *str, const unsigned long mod);
 
+/*
+ * StringHash - seeded 64-bit hash, reading the string 8 bytes at a time
+ * @str: string to hash (non-NULL)
+ * @seed: any value; each seed gives an unrelated hash function
+ *
+ * Returns the XXH64 hash of the bytes of str (not its null).  A table
+ * that hashes keys chosen by others (player names) should use a seed
+ * from HashSeed, so that no one can choose keys that all collide.
+ */
+uint64_t StringHash(const char *str, const uint64_t seed);
+
+/*
+ * MemoryHash - StringHash of any len bytes, nulls and all
+ * @data: bytes to hash (non-NULL)
+ * @len: how many
+ * @seed: as for StringHash
+ *
+ * Returns the XXH64 hash of the bytes; a checksum, with a fixed seed.
+ */
+uint64_t MemoryHash(const void *data, const size_t len, const uint64_t seed);
+
+/*
+ * HashSeed - a random seed for StringHash
+ *
+ * Returns 64 bits from the kernel's random source, or, failing that,
+ * a mix of the time and process id.
+ */
+uint64_t HashSeed(void);
+
 #endif // JHASH_H
@@ -1,21 +1,75 @@
 /* 
  * log module - a simple way to log messages to a file
  * 
+ * In async mode, the producer claims the record at the ring's tail, fills
+ * it, and publishes it by advancing the tail; the writer thread formats
+ * records from the head and advances the head as it goes.  Each index
+ * has one writer, so neither needs a lock.
+ * 
  * David Kotz, May 2019
  */
 
+#define _DEFAULT_SOURCE     // for nanosleep
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
 #include <sys/errno.h>
 #include "log.h"
 
+/**************** file-local constants ****************/
+#define RecordText 200          // longest string kept in a record, with its null
+static const long MinIdleNanos = 50 * 1000;        // the writer's first nap
+static const long MaxIdleNanos = 10 * 1000 * 1000; // and its longest
+
+/**************** file-local types ****************/
+/* One logging call, with its arguments copied */
+typedef struct record {
+  char kind;                    // 's', 'd', 'c', 'v' or 'e': which flog_x
+  const char *format;           // s, d, c: the format string
+  int num;                      // d: the integer; c: the char; e: errno
+  char text[RecordText];        // s: the string; v, e: the message
+  char *spill;                  // s, v, e: instead, if too long for text;
+                                // allocated by the producer, freed by the writer
+} record_t;
+
+/* The ring; head and tail count records ever written out and ever
+ * claimed, so the ring is empty when they are equal and full when they
+ * differ by its size.  They sit on separate cache lines so the two
+ * threads do not contend for one.
+ */
+static struct {
+  FILE *fp;                     // the file logged asynchronously
+  record_t *records;            // the ring
+  size_t mask;                  // its size, minus 1
+  pthread_t producer;           // the only thread that claims records
+  pthread_t writer;             // the thread writing them out
+  atomic_bool running;          // async logging is on
+  atomic_bool stopping;         // the writer should finish and exit
+  atomic_long dropped;          // records dropped because the ring was full
+  _Alignas(64) atomic_size_t head;
+  _Alignas(64) atomic_size_t tail;
+} async;
+
+/**************** global variables ****************/
+int flog_level = log_VERBOSE;   // see log.h
+
+/**************** file-local functions ****************/
+static bool isAsync(FILE *fp);
+static record_t *claim(char kind, const char *format);
+static void publish(void);
+static void copyText(record_t *r, const char *str);
+static void writeRecord(FILE *fp, const record_t *r);
+static void *writer(void *arg);
+
 /**************** flog_init ****************/
 /* Initialize the logging module.
  */
 void flog_init(FILE *fp)
 {
-  flog_v(fp, "START OF LOG");
+  flog_v(fp, log_ERROR, "START OF LOG");   // at log_ERROR so it is never filtered
 }
 
 /**************** flog_s ****************/
@@ -24,9 +78,17 @@ void flog_init(FILE *fp)
  * The string `format` can reference '%s' to incorporate `str`.
  */
 void
-flog_s(FILE *fp, const char *format, const char *str)
+flog_s(FILE *fp, int level, const char *format, const char *str)
 {
-  if (fp != NULL && format != NULL && str != NULL) {
+  if (fp != NULL && format != NULL && str != NULL && level <= flog_level) {
+    if (isAsync(fp)) {
+      record_t *r = claim('s', format);
+      if (r != NULL) {
+        copyText(r, str);
+        publish();
+      }
+      return;
+    }
     fprintf(fp, format, str);
     fputc('\n', fp);
     fflush(fp);
@@ -39,9 +101,17 @@ flog_s(FILE *fp, const char *format, const char *str)
  * The string `format` can reference '%d' to incorporate `num`.
  */
 void
-flog_d(FILE *fp, const char *format, const int num)
+flog_d(FILE *fp, int level, const char *format, const int num)
 {
-  if (fp != NULL && format != NULL) {
+  if (fp != NULL && format != NULL && level <= flog_level) {
+    if (isAsync(fp)) {
+      record_t *r = claim('d', format);
+      if (r != NULL) {
+        r->num = num;
+        publish();
+      }
+      return;
+    }
     fprintf(fp, format, num);
     fputc('\n', fp);
     fflush(fp);
@@ -54,9 +124,17 @@ flog_d(FILE *fp, const char *format, const int num)
  * The string `format` can reference '%c' to incorporate `ch`.
  */
 void
-flog_c(FILE *fp, const char *format, const char ch)
+flog_c(FILE *fp, int level, const char *format, const char ch)
 {
-  if (fp != NULL && format != NULL) {
+  if (fp != NULL && format != NULL && level <= flog_level) {
+    if (isAsync(fp)) {
+      record_t *r = claim('c', format);
+      if (r != NULL) {
+        r->num = ch;
+        publish();
+      }
+      return;
+    }
     fprintf(fp, format, ch);
     fputc('\n', fp);
     fflush(fp);
@@ -68,9 +146,17 @@ flog_c(FILE *fp, const char *format, const char ch)
  * log a message to the logfile, if logging is enabled.
  */
 void
-flog_v(FILE *fp, const char *str)
+flog_v(FILE *fp, int level, const char *str)
 {
-  if (fp != NULL && str != NULL) {
+  if (fp != NULL && str != NULL && level <= flog_level) {
+    if (isAsync(fp)) {
+      record_t *r = claim('v', NULL);
+      if (r != NULL) {
+        copyText(r, str);
+        publish();
+      }
+      return;
+    }
     fputs(str, fp);
     fputc('\n', fp);
     fflush(fp);
@@ -84,9 +170,19 @@ flog_v(FILE *fp, const char *str)
  * so this is best used immediately after a system call.
  */
 void
-flog_e(FILE *fp, const char *str)
+flog_e(FILE *fp, int level, const char *str)
 {
-  if (fp != NULL && str != NULL) {
+  if (fp != NULL && str != NULL && level <= flog_level) {
+    if (isAsync(fp)) {
+      int err = errno;
+      record_t *r = claim('e', NULL);
+      if (r != NULL) {
+        r->num = err;
+        copyText(r, str);
+        publish();
+      }
+      return;
+    }
     fprintf(fp, "%s: %s\n", str, strerror(errno));
     fflush(fp);
   }
@@ -99,5 +195,184 @@ flog_e(FILE *fp, const char *str)
 void
 flog_done(FILE *fp)
 {
-  flog_v(fp, "END OF LOG");
+  flog_v(fp, log_ERROR, "END OF LOG");
+}
+
+/**************** log_setLevel ****************/
+/* see log.h for description */
+void
+log_setLevel(int level)
+{
+  flog_level = level;
+}
+
+/**************** log_startAsync ****************/
+/* see log.h for description */
+bool
+log_startAsync(FILE *fp, int records)
+{
+  if (fp == NULL || records < 1 || atomic_load(&async.running)) {
+    return false;
+  }
+  size_t size = 1;
+  while (size < records) {
+    size <<= 1;
+  }
+  async.records = malloc(size * sizeof(record_t));
+  if (async.records == NULL) {
+    return false;
+  }
+  async.fp = fp;
+  async.mask = size - 1;
+  async.producer = pthread_self();
+  atomic_store(&async.head, 0);
+  atomic_store(&async.tail, 0);
+  atomic_store(&async.stopping, false);
+  atomic_store(&async.dropped, 0);
+  if (pthread_create(&async.writer, NULL, writer, NULL) != 0) {
+    free(async.records);
+    async.records = NULL;
+    return false;
+  }
+  atomic_store(&async.running, true);
+  return true;
+}
+
+/**************** log_stopAsync ****************/
+/* see log.h for description */
+void
+log_stopAsync(void)
+{
+  if (!atomic_load(&async.running) || !pthread_equal(pthread_self(), async.producer)) {
+    return;
+  }
+  // the writer drains the ring before it exits; we add nothing meanwhile
+  atomic_store(&async.stopping, true);
+  pthread_join(async.writer, NULL);
+  atomic_store(&async.running, false);
+
+  long dropped = atomic_load(&async.dropped);
+  if (dropped > 0) {
+    fprintf(async.fp, "log: %ld records dropped\n", dropped);
+    fflush(async.fp);
+  }
+  free(async.records);
+  async.records = NULL;
+}
+
+/**************** log_dropped ****************/
+/* see log.h for description */
+long
+log_dropped(void)
+{
+  return atomic_load(&async.dropped);
+}
+
+/**************** isAsync ****************/
+/* Should this thread's call logging to fp go through the ring? */
+static bool
+isAsync(FILE *fp)
+{
+  return atomic_load_explicit(&async.running, memory_order_acquire)
+    && fp == async.fp && pthread_equal(pthread_self(), async.producer);
+}
+
+/**************** claim ****************/
+/* Return the record at the tail of the ring, with its kind and format
+ * filled in, or NULL (counting a drop) if the ring is full.
+ */
+static record_t *
+claim(char kind, const char *format)
+{
+  size_t tail = atomic_load_explicit(&async.tail, memory_order_relaxed);
+  size_t head = atomic_load_explicit(&async.head, memory_order_acquire);
+  if (tail - head > async.mask) {
+    atomic_fetch_add_explicit(&async.dropped, 1, memory_order_relaxed);
+    return NULL;
+  }
+  record_t *r = &async.records[tail & async.mask];
+  r->kind = kind;
+  r->format = format;
+  r->spill = NULL;
+  return r;
+}
+
+/**************** publish ****************/
+/* Hand the record just claimed to the writer. */
+static void
+publish(void)
+{
+  atomic_fetch_add_explicit(&async.tail, 1, memory_order_release);
+}
+
+/**************** copyText ****************/
+/* Copy str into a record: in place if it fits, else into the record's
+ * spill, whole.  Only if there is no memory for that is it cut to fit,
+ * and marked with "...".
+ */
+static void
+copyText(record_t *r, const char *str)
+{
+  size_t len = strlen(str);
+  if (len < RecordText) {
+    memcpy(r->text, str, len + 1);
+  } else if ((r->spill = malloc(len + 1)) != NULL) {
+    memcpy(r->spill, str, len + 1);
+  } else {
+    memcpy(r->text, str, RecordText - 4);
+    strcpy(r->text + RecordText - 4, "...");
+  }
+}
+
+/**************** writeRecord ****************/
+/* Format one record as the synchronous flog_x would have. */
+static void
+writeRecord(FILE *fp, const record_t *r)
+{
+  const char *text = r->spill != NULL ? r->spill : r->text;
+  switch (r->kind) {
+  case 's': fprintf(fp, r->format, text); fputc('\n', fp); break;
+  case 'd': fprintf(fp, r->format, r->num);  fputc('\n', fp); break;
+  case 'c': fprintf(fp, r->format, (char) r->num); fputc('\n', fp); break;
+  case 'v': fputs(text, fp); fputc('\n', fp); break;
+  case 'e': fprintf(fp, "%s: %s\n", text, strerror(r->num)); break;
+  }
+}
+
+/**************** writer ****************/
+/* The background thread: write out records as they are published,
+ * flushing after each batch, and napping (longer, the longer the ring
+ * stays empty) when there are none.
+ */
+static void *
+writer(void *arg)
+{
+  long nap = MinIdleNanos;
+  size_t head = atomic_load_explicit(&async.head, memory_order_relaxed);
+  while (true) {
+    size_t tail = atomic_load_explicit(&async.tail, memory_order_acquire);
+    if (head == tail) {
+      if (atomic_load(&async.stopping)) {
+        // the producer has stopped; anything published came before that
+        if (head == atomic_load(&async.tail)) {
+          break;
+        }
+        continue;
+      }
+      struct timespec ts = { 0, nap };
+      nanosleep(&ts, NULL);
+      nap = nap * 2 > MaxIdleNanos ? MaxIdleNanos : nap * 2;
+      continue;
+    }
+    while (head != tail) {
+      record_t *r = &async.records[head & async.mask];
+      writeRecord(async.fp, r);
+      free(r->spill);
+      head++;
+      atomic_store_explicit(&async.head, head, memory_order_release);
+    }
+    fflush(async.fp);
+    nap = MinIdleNanos;
+  }
+  return NULL;
 }
@@ -10,6 +10,21 @@
  * the log_x functions will be ignored and nothing will be logged.
  * 
  * The flog_x functions should not be called by the module user.
+ *
+ * Each call has a level: log_e logs at log_ERROR, the other log_x at
+ * log_INFO, and the logv_x variants (for chatter on every message or
+ * move) at log_VERBOSE.  log_setLevel filters at runtime; compiling with
+ * -DLOG_MAXLEVEL=1 (log_INFO) removes the logv_x calls entirely,
+ * arguments and all.
+ *
+ * By default every call formats, writes and flushes before it returns.
+ * After log_startAsync(fp), calls that log to fp instead copy their
+ * arguments into a fixed-size record in a ring buffer and return (a
+ * string too long for the record is copied to the heap, and logged
+ * whole); a background thread formats and writes the records.  Only the thread
+ * that called log_startAsync uses the ring (its single producer); other
+ * threads still write directly.  If the ring is full, records are
+ * dropped and counted; log_stopAsync drains the ring and reports drops.
  * 
  * See the note below about file-local global variables; if log.h is included
  * by multiple source files within a single program, *each* such file has
@@ -24,6 +39,20 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+
+/*********** levels ****************/
+#define log_ERROR   0
+#define log_INFO    1
+#define log_VERBOSE 2
+
+// the most detailed level compiled in; see above
+#ifndef LOG_MAXLEVEL
+#define LOG_MAXLEVEL log_VERBOSE
+#endif
+
+// the most detailed level logged; see log_setLevel
+extern int flog_level;
 
 /*********** file-local global variable ****************/
 /* Here is an example of a judicious use of a global variable.
@@ -49,8 +78,8 @@ static inline void log_init(FILE *fp) { logFP = fp; flog_init(logFP); }
  * Call log_done() before the program exits.
  */
 
-void flog_s(FILE *fp, const char *format, const char *str);
-static inline void log_s(const char *f, const char *s) { flog_s(logFP, f, s); }
+void flog_s(FILE *fp, int level, const char *format, const char *str);
+static inline void log_s(const char *f, const char *s) { flog_s(logFP, log_INFO, f, s); }
 /* log_s: printf a string to the log, using the given format string.
  * Expects exactly one format specifier within the string,
  * corresponding to the one argument.  A newline is added.
@@ -58,26 +87,26 @@ static inline void log_s(const char *f, const char *s) { flog_s(logFP, f, s); }
  *   char *userName = ...; LOG_S("Your name is '%s'", userName);
  */
 
-void flog_d(FILE *fp, const char *format, const int  num);
-static inline void log_d(const char *f, const int n) { flog_d(logFP, f, n); }
+void flog_d(FILE *fp, int level, const char *format, const int  num);
+static inline void log_d(const char *f, const int n) { flog_d(logFP, log_INFO, f, n); }
 /* log_c: like the above, but to print an integer. Example:
  *   int age = ...;        log_d("You are %d years old.", age);
  */
 
-void flog_c(FILE *fp, const char *format, const char ch);
-static inline void log_c(const char *f, const char c) { flog_c(logFP, f, c); }
+void flog_c(FILE *fp, int level, const char *format, const char ch);
+static inline void log_c(const char *f, const char c) { flog_c(logFP, log_INFO, f, c); }
 /* log_c: like the above, but to print a character. Example:
  *   char player = ...;    log_c("Player %c is winning.", player);
  */
 
-void flog_v(FILE *fp, const char *str);
-static inline void log_v(const char *str) { flog_v(logFP, str); }
+void flog_v(FILE *fp, int level, const char *str);
+static inline void log_v(const char *str) { flog_v(logFP, log_INFO, str); }
 /* log_v: like the above, but used when no additional argument is needed.
  * Thus v stands for 'void'.
  */
 
-void flog_e(FILE *fp, const char *str);
-static inline void log_e(const char *str) { flog_e(logFP, str); }
+void flog_e(FILE *fp, int level, const char *str);
+static inline void log_e(const char *str) { flog_e(logFP, log_ERROR, str); }
 /* log_e: print the given string to the log, with a message representing
  * an internal error.  See 'man errno' and 'man perror';
  * This function is best used immediately after a system call.
@@ -90,4 +119,46 @@ static inline void log_done(void) { flog_done(logFP); logFP = NULL; }
  * It is the caller's responsibility to close the file, if desired.
  */
 
+/*********** verbose logging ****************/
+/* logv_s, logv_d, logv_c, logv_v: like log_s, log_d, log_c and log_v, but
+ * at log_VERBOSE; the arguments are not evaluated unless the call logs.
+ */
+#if LOG_MAXLEVEL >= log_VERBOSE
+#define logv_s(f, s) (flog_level >= log_VERBOSE ? flog_s(logFP, log_VERBOSE, f, s) : (void) 0)
+#define logv_d(f, n) (flog_level >= log_VERBOSE ? flog_d(logFP, log_VERBOSE, f, n) : (void) 0)
+#define logv_c(f, c) (flog_level >= log_VERBOSE ? flog_c(logFP, log_VERBOSE, f, c) : (void) 0)
+#define logv_v(str)  (flog_level >= log_VERBOSE ? flog_v(logFP, log_VERBOSE, str) : (void) 0)
+#else
+#define logv_s(f, s) ((void) 0)
+#define logv_d(f, n) ((void) 0)
+#define logv_c(f, c) ((void) 0)
+#define logv_v(str)  ((void) 0)
+#endif
+
+/*********** levels and asynchronous logging ****************/
+
+void log_setLevel(int level);
+/* log_setLevel: log only calls at level or below (log_ERROR, log_INFO or
+ * log_VERBOSE); the default is log_VERBOSE, everything compiled in.
+ */
+
+bool log_startAsync(FILE *fp, int records);
+/* log_startAsync: log everything sent to fp through a ring of the given
+ * number of records (rounded up to a power of two) and a background
+ * thread, as described above.  Returns false, leaving logging
+ * synchronous, if out of memory, the thread cannot start, or async
+ * logging is already on.
+ */
+
+void log_stopAsync(void);
+/* log_stopAsync: write every record still in the ring, note how many were
+ * dropped, stop the thread and return to synchronous logging.
+ * Call it before log_done and before closing the file.
+ */
+
+long log_dropped(void);
+/* log_dropped: the number of records dropped because the ring was full,
+ * since async logging last started.
+ */
+
 #endif // _LOG_H_
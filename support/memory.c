@@ -1,26 +1,72 @@
-/* 
- * memory - count_malloc and related functions 
- * 
+/*
+ * memory - count_malloc and related functions
+ *
  * 1. Replacements for malloc(), calloc(), and free(),
  *    that count the number of calls to each,
  *    so you can print reports about the current balance of memory.
- * 
+ *
  * 2. Variants that 'assert' the result is non-NULL;
  *    if NULL occurs, kick out an error and die.
  *
+ * 3. Accounting by tag: each block carries a small header recording its
+ *    size and tag, so count_free can credit the right tag.
+ *
  * David Kotz, April 2016, 2017, 2019
  */
 
+#define _DEFAULT_SOURCE     // for clock_gettime
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <time.h>
 #include "memory.h"
 
+/**************** file-local types ****************/
+/* The header in front of every block we hand out; the union keeps what
+ * follows it aligned for any type.
+ */
+typedef union header {
+  struct {
+    size_t size;                // bytes the caller asked for
+    memtag_t tag;               // whose they are
+  } h;
+  max_align_t align;
+} header_t;
+
+/* Running totals for one tag; atomic, so threads may share the module */
+typedef struct tagcount {
+  atomic_long liveBytes;
+  atomic_long liveObjects;
+  atomic_long peakBytes;
+  atomic_long allocs;
+} tagcount_t;
+
 /**************** file-local global variables ****************/
 // track malloc and free across *all* calls within this program.
-static int nmalloc = 0;    // number of successful malloc calls
-static int nfree = 0;    // number of free calls
-static int nfreenull = 0;  // number of free(NULL) calls
+static atomic_int nmalloc = 0;    // number of successful malloc calls
+static atomic_int nfree = 0;    // number of free calls
+static atomic_int nfreenull = 0;  // number of free(NULL) calls
+static _Thread_local int threadMallocs = 0;  // ... of nmalloc, by this thread
+
+static tagcount_t tags[mem_NTAGS];  // totals by tag
+static const char *TagNames[mem_NTAGS] = {
+  [mem_OTHER] = "other",
+  [mem_MAP] = "map",
+  [mem_VISIBILITY] = "visibility",
+  [mem_RENDER] = "render",
+  [mem_NET] = "net",
+  [mem_ENTITIES] = "entities",
+  [mem_CONTAINERS] = "containers",
+};
+
+// allocations by tag, and the time, at the last count_reportTags
+static long reportedAllocs[mem_NTAGS];
+static double reportedTime = -1;
 
+/**************** file-local functions ****************/
+static void *account(header_t *header, const size_t size, memtag_t tag);
+static double now(void);
 
 /**************** assertp ****************/
 /* see memory.h for description */
@@ -39,9 +85,7 @@ assertp(void *p, const char *message)
 void *
 count_malloc_assert(const size_t size, const char *message)
 {
-  void *ptr = assertp(malloc(size), message);
-  nmalloc++;
-  return ptr;
+  return assertp(count_malloc(size), message);
 }
 
 
@@ -50,11 +94,18 @@ count_malloc_assert(const size_t size, const char *message)
 void *
 count_malloc(const size_t size)
 {
-  void *ptr = malloc(size);
-  if (ptr != NULL) {
-    nmalloc++;
+  return count_mallocTag(size, mem_OTHER);
+}
+
+/**************** count_mallocTag() ****************/
+/* see memory.h for description */
+void *
+count_mallocTag(const size_t size, memtag_t tag)
+{
+  if (size > (size_t) -1 - sizeof(header_t)) {
+    return NULL;
   }
-  return ptr;
+  return account(malloc(sizeof(header_t) + size), size, tag);
 }
 
 /**************** count_calloc_assert() ****************/
@@ -62,9 +113,7 @@ count_malloc(const size_t size)
 void *
 count_calloc_assert(const size_t nmemb, const size_t size, const char *message)
 {
-  void *ptr = assertp(calloc(nmemb, size), message);
-  nmalloc++;
-  return ptr;
+  return assertp(count_calloc(nmemb, size), message);
 }
 
 /**************** count_calloc() ****************/
@@ -72,20 +121,32 @@ count_calloc_assert(const size_t nmemb, const size_t size, const char *message)
 void *
 count_calloc(const size_t nmemb, const size_t size)
 {
-  void *ptr = calloc(nmemb, size);
-  if (ptr != NULL) {
-    nmalloc++;
+  return count_callocTag(nmemb, size, mem_OTHER);
+}
+
+/**************** count_callocTag() ****************/
+/* see memory.h for description */
+void *
+count_callocTag(const size_t nmemb, const size_t size, memtag_t tag)
+{
+  if (size != 0 && nmemb > ((size_t) -1 - sizeof(header_t)) / size) {
+    return NULL;        // overflow
   }
-  return ptr;
+  size_t bytes = nmemb * size;
+  return account(calloc(1, sizeof(header_t) + bytes), bytes, tag);
 }
 
 /**************** count_free() ****************/
 /* see memory.h for description */
-void 
+void
 count_free(void *ptr)
 {
   if (ptr != NULL) {
-    free(ptr);
+    header_t *header = (header_t *) ptr - 1;
+    tagcount_t *t = &tags[header->h.tag];
+    atomic_fetch_sub_explicit(&t->liveBytes, header->h.size, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&t->liveObjects, 1, memory_order_relaxed);
+    free(header);
     nfree++;
   } else {
     // it's an error to call free(NULL)!
@@ -95,13 +156,73 @@ count_free(void *ptr)
 
 /**************** count_report() ****************/
 /* see memory.h for description */
-void 
+void
 count_report(FILE *fp, const char *message)
 {
-  fprintf(fp, "%s: %d malloc, %d free, %d free(NULL), %d net\n", 
+  fprintf(fp, "%s: %d malloc, %d free, %d free(NULL), %d net\n",
           message, nmalloc, nfree, nfreenull, nmalloc - nfree - nfreenull);
 }
 
+/**************** count_tagStats() ****************/
+/* see memory.h for description */
+memstats_t
+count_tagStats(memtag_t tag)
+{
+  memstats_t stats = {0, 0, 0, 0};
+  if (tag >= 0 && tag < mem_NTAGS) {
+    stats.liveBytes = atomic_load(&tags[tag].liveBytes);
+    stats.liveObjects = atomic_load(&tags[tag].liveObjects);
+    stats.peakBytes = atomic_load(&tags[tag].peakBytes);
+    stats.allocs = atomic_load(&tags[tag].allocs);
+  }
+  return stats;
+}
+
+/**************** count_tagName() ****************/
+/* see memory.h for description */
+const char *
+count_tagName(memtag_t tag)
+{
+  return tag >= 0 && tag < mem_NTAGS ? TagNames[tag] : "?";
+}
+
+/**************** count_reportTags() ****************/
+/* see memory.h for description */
+void
+count_reportTags(FILE *fp)
+{
+  double t = now();
+  double elapsed = reportedTime < 0 ? 0 : t - reportedTime;
+
+  fprintf(fp, "%-12s %12s %10s %12s %12s %12s\n",
+          "tag", "live bytes", "objects", "peak bytes", "allocs", "allocs/s");
+  for (memtag_t tag = 0; tag < mem_NTAGS; tag++) {
+    memstats_t s = count_tagStats(tag);
+    double rate = elapsed > 0 ? (s.allocs - reportedAllocs[tag]) / elapsed : 0;
+    fprintf(fp, "%-12s %12ld %10ld %12ld %12ld %12.1f\n",
+            TagNames[tag], s.liveBytes, s.liveObjects, s.peakBytes, s.allocs, rate);
+    reportedAllocs[tag] = s.allocs;
+  }
+  fflush(fp);
+  reportedTime = t;
+}
+
+/**************** count_allocs() ****************/
+/* see memory.h for description */
+int
+count_allocs(void)
+{
+  return nmalloc;
+}
+
+/**************** count_threadAllocs() ****************/
+/* see memory.h for description */
+int
+count_threadAllocs(void)
+{
+  return threadMallocs;
+}
+
 /**************** count_net() ****************/
 /* see memory.h for description */
 int
@@ -109,3 +230,43 @@ count_net(void)
 {
   return nmalloc - nfree - nfreenull;
 }
+
+/**************** account ****************/
+/* Record a block of size bytes for tag, if malloc or calloc gave us one,
+ * and return the caller's part of it (or NULL).
+ */
+static void *
+account(header_t *header, const size_t size, memtag_t tag)
+{
+  if (header == NULL) {
+    return NULL;
+  }
+  if (tag < 0 || tag >= mem_NTAGS) {
+    tag = mem_OTHER;
+  }
+  header->h.size = size;
+  header->h.tag = tag;
+
+  tagcount_t *t = &tags[tag];
+  long live = atomic_fetch_add_explicit(&t->liveBytes, size, memory_order_relaxed) + size;
+  long peak = atomic_load_explicit(&t->peakBytes, memory_order_relaxed);
+  while (live > peak
+         && !atomic_compare_exchange_weak(&t->peakBytes, &peak, live)) {
+    // another thread raised the peak; try again against its value
+  }
+  atomic_fetch_add_explicit(&t->liveObjects, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&t->allocs, 1, memory_order_relaxed);
+  nmalloc++;
+  threadMallocs++;
+  return header + 1;
+}
+
+/**************** now ****************/
+/* the time in seconds, from an arbitrary start */
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
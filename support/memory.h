@@ -8,6 +8,13 @@
  * 2. Variants that 'assert' the result is non-NULL;
  *    if NULL occurs, kick out an error and die.
  *
+ * 3. Accounting by tag: the count_xxxTag variants say what an allocation
+ *    is for (the map, visibility strings, rendered frames, networking,
+ *    game entities, containers), and for each tag we track live bytes,
+ *    live objects, peak bytes and allocations; count_malloc and
+ *    count_calloc use mem_OTHER.  Memory from any of these functions must
+ *    be freed with count_free, and only with count_free.
+ *
  * David Kotz, April 2016, 2017, 2019
  */
 
@@ -17,6 +24,26 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+/**************** global types ****************/
+typedef enum memtag {
+  mem_OTHER,            // anything not below
+  mem_MAP,              // the base map
+  mem_VISIBILITY,       // what each player has seen, and can see
+  mem_RENDER,           // map copies and frames built to send
+  mem_NET,              // send queues, reassembly, receive buffers
+  mem_ENTITIES,         // players, gold piles and their positions
+  mem_CONTAINERS,       // hashtables, sets and counters
+  mem_NTAGS             // the number of tags
+} memtag_t;
+
+/* The totals for one tag; see count_tagStats */
+typedef struct memstats {
+  long liveBytes;       // bytes allocated and not yet freed
+  long liveObjects;     // blocks allocated and not yet freed
+  long peakBytes;       // the most liveBytes has been
+  long allocs;          // blocks ever allocated
+} memstats_t;
+
 /**************** assertp **************************/
 /* If pointer p is NULL, print error message to stderr and die,
  * otherwise, return p unchanged.  Works nicely as a pass-through:
@@ -51,6 +78,11 @@ void *count_malloc_assert(const size_t size, const char *message);
  */
 void *count_malloc(const size_t size);
 
+/**************** count_mallocTag() ****************/
+/* Like count_malloc, but counting the allocation under the given tag.
+ */
+void *count_mallocTag(const size_t size, memtag_t tag);
+
 /**************** count_calloc_assert() ****************/
 /* Just like calloc() but track the number of successful allocations
  * and, if response is NULL, print error and die.
@@ -74,6 +106,11 @@ void *count_calloc_assert(const size_t nmemb, const size_t size,
  */
 void *count_calloc(const size_t nmemb, const size_t size);
 
+/**************** count_callocTag() ****************/
+/* Like count_calloc, but counting the allocation under the given tag.
+ */
+void *count_callocTag(const size_t nmemb, const size_t size, memtag_t tag);
+
 /**************** count_free() ****************/
 /* Just like free() but track the number of calls.
  * We assume:
@@ -91,6 +128,32 @@ void count_free(void *ptr);
  */
 void count_report(FILE *fp, const char *message);
 
+/**************** count_tagStats() ****************/
+/* Return the totals so far for one tag; all zero for an unknown tag.
+ * count_tagName returns the tag's name, as count_reportTags prints it.
+ */
+memstats_t count_tagStats(memtag_t tag);
+const char *count_tagName(memtag_t tag);
+
+/**************** count_reportTags() ****************/
+/* Print a table of the totals for every tag to fp, with the rate of
+ * allocation (per second) since the previous call; 0 on the first call.
+ */
+void count_reportTags(FILE *fp);
+
+/**************** count_allocs() ****************/
+/* Return the number of successful count_malloc and count_calloc calls
+ * so far; comparing it before and after some code tells whether that
+ * code allocated any memory through this module.
+ */
+int count_allocs(void);
+
+/**************** count_threadAllocs() ****************/
+/* Like count_allocs, but counting only the calls made by the calling
+ * thread, so that what other threads allocate meanwhile does not show.
+ */
+int count_threadAllocs(void);
+
 /**************** count_net() ****************/
 /* Return the current net malloc-free counts.
  * We assume:
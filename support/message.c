@@ -6,16 +6,21 @@
  * and may be reordered, but require no connection setup or teardown.
  * 
  * See message.h for detailed interface description for each function.
- * Depends on the 'log' module and thus must be linked with log.o.
+ * Depends on the 'log' module and thus must be linked with log.o,
+ * on the 'uring' module (uring.o) for the io_uring backend, and on the
+ * 'hashtable' module (hashtable.o, jhash.o) to find its send queues.
  * 
  * Compile with -DUNIT_TEST for a standalone unit test; see below.
  *
  * David Kotz - May 2019
  */
 
+#define _DEFAULT_SOURCE     // for clock_gettime alongside the BSD socket calls
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
@@ -24,8 +29,12 @@
 #include <arpa/inet.h>
 #include <sys/select.h>
 #include <math.h>
+#include <pthread.h>
 #include "message.h"
 #include "log.h"
+#include "uring.h"
+#include "hashtable.h"
+#include "memory.h"
 
 /**************** file-local constants ****************/
 /* See message.h for other constants (shared with users of this module).
@@ -35,6 +44,26 @@
 static const int MinPort = 1024;
 static const int MaxPort = 65535;
 
+/* Messages longer than message_MaxBytes travel as fragments, each a
+ * datagram beginning with this header (multi-byte fields big-endian):
+ *   byte  0     0x00 - no text message starts with a null
+ *   byte  1     'F'
+ *   bytes 2-3   reserved, zero
+ *   bytes 4-7   message id, chosen by the sender
+ *   bytes 8-9   fragment index, 0..count-1
+ *   bytes 10-11 fragment count
+ *   bytes 12-15 total message length
+ * followed by up to FragPayload bytes of the message.  Fragments stay one
+ * byte under message_MaxBytes, since message_loop reads at most that much.
+ */
+#define FragHeaderBytes 16
+#define FragPayload (message_MaxBytes - 1 - FragHeaderBytes)
+#define MaxReassemblies 16             // partial messages held at once
+#define MaxReassembliesPerSender 2     // of those, from any one sender
+static const long MaxReassemblyBytes = 32L * 1024 * 1024;  // all fragments held; 2 * message_MaxMessageBytes
+static const double ReassemblyTimeout = 3.0;  // seconds
+#define QueueKeyBytes 14               // "aaaaaaaa:pppp" and its null
+
 /**************** file-local global variables ****************/
 /* This is an example of a judicious use of a global variable.
  * This module provides init() and done() functions that allow it
@@ -47,12 +76,96 @@ static const int MaxPort = 65535;
  * but a more flexible approach would require a much more complex interface.
  */
 static int ourSocket = 0;     // socket on which to receive messages
+static message_backend_t ourBackend = message_SELECT; // see message_setBackend
+static message_stats_t ourStats;     // see message_stats
+
+/* Fragmented messages being reassembled; a slot is free if frags==NULL.
+ * Each fragment is kept as it arrives, so a message holds only the memory
+ * its fragments have brought, not the length its header claims.
+ */
+typedef struct reassembly {
+  addr_t from;              // sender
+  uint32_t id;              // sender's message id
+  int count;                // number of fragments expected
+  int received;             // number of distinct fragments received
+  int total;                // message length
+  long held;                // bytes of fragments held
+  char **frags;             // one per fragment; NULL until it arrives
+  double started;           // when the first fragment arrived
+} reassembly_t;
+static reassembly_t partials[MaxReassemblies];
+static long partialBytes = 0;        // held by all partials together
+static uint32_t nextMessageId = 0;   // id for the next fragmented message
+
+/* Messages waiting for room in the socket, one queue per destination,
+ * oldest first.  A destination's queue is made the first time it has to
+ * wait, and kept (empty, once drained) until message_done, so there are
+ * as many as there have been destinations kept waiting; queueIndex finds
+ * one by address, and the array keeps them in order for drainQueues.
+ */
+typedef struct outmsg {
+  struct outmsg *next;
+  int tag;                  // see message_sendLatest; 0 if none
+  uint32_t id;              // message id, if sent as fragments
+  int sentFragments;        // datagrams of it already sent
+  size_t len;
+  char data[];              // the message itself
+} outmsg_t;
+typedef struct sendqueue {
+  addr_t to;                // destination
+  outmsg_t *head, *tail;
+  int depth;                // number of messages queued
+} sendqueue_t;
+static sendqueue_t **queues = NULL;  // every queue made, oldest first
+static int numQueues = 0;            // made so far
+static int maxQueues = 0;            // room in queues
+static hashtable_t *queueIndex = NULL;  // address key -> its queue
+static int nextQueue = 0;            // where drainQueues starts, for fairness
+static int ourSendBuffer = 0;        // see message_setSendBuffer
+
+/* Held while sending or draining, so that (on the select backend) any
+ * thread may send; it guards the send queues and the statistics.
+ */
+static pthread_mutex_t sendLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The outcome of trying to put a datagram on the socket. */
+typedef enum { sendDone, sendBlocked, sendFailed } sendresult_t;
 
 /**************** file-local functions ****************/
 /* stringAddr: format a string representation of an address.
  * Returns pointer to static storage and thus should not be retained.
  */
 static const char *stringAddr(const addr_t addr);
+static bool sendMessage(const addr_t to, const char *buf, const size_t len,
+                        const int tag);
+static sendresult_t transmit(const addr_t to, const char *buf,
+                             const size_t len, const uint32_t id,
+                             int *sentFragments);
+static size_t fragment(unsigned char *frag, const char *buf, const size_t len,
+                       const uint32_t id, const int index);
+static sendresult_t sendDatagram(const addr_t to, const char *buf,
+                                 const size_t len);
+static sendqueue_t *findQueue(const addr_t to);
+static sendqueue_t *makeQueue(const addr_t to);
+static void queueKey(const addr_t to, char *key);
+static bool enqueue(const addr_t to, const char *buf, const size_t len,
+                    const int tag, const uint32_t id, const int sentFragments);
+static void drainQueues(void);
+static void freeQueues(void);
+static char *reassemble(const addr_t from, const char *buf, const int nbytes);
+static void expireReassemblies(const bool all);
+static reassembly_t *oldestPartial(const addr_t from, const reassembly_t *keep);
+static void freePartial(reassembly_t *r);
+static double now(void);
+static bool deliver(void *arg, const struct sockaddr_in sender, const char *buf,
+                    int nbytes,
+                    bool (*handleMessage)(void *arg,
+                                          const addr_t from, const char *buf));
+static bool uringLoop(void *arg, const float timeout,
+                      bool (*handleTimeout)(void *arg),
+                      bool (*handleInput)  (void *arg),
+                      bool (*handleMessage)(void *arg,
+                                            const addr_t from, const char *buf));
 
 
 /***********************************************************************/
@@ -102,6 +215,27 @@ message_init(FILE *logFP)
     ourSocket = 0;
     return 0;
   }
+  // size the send buffer, if asked
+  if (ourSendBuffer > 0) {
+    int granted = 0;
+    socklen_t grantedlen = sizeof(granted);
+    if (setsockopt(ourSocket, SOL_SOCKET, SO_SNDBUF,
+                   &ourSendBuffer, sizeof(ourSendBuffer)) != 0
+        || getsockopt(ourSocket, SOL_SOCKET, SO_SNDBUF,
+                      &granted, &grantedlen) != 0) {
+      log_e("message_init: setting send buffer size");
+    } else {
+      log_d("message_init: send buffer is %d bytes", granted);
+    }
+  }
+
+  // start the io_uring backend, if requested; fall back to select()
+  if (ourBackend == message_URING && !uring_init(ourSocket, message_MaxBytes,
+                                                 logFP)) {
+    log_v("message_init: io_uring unavailable; falling back to select");
+    ourBackend = message_SELECT;
+  }
+
   // extract our port number
   int port = ntohs(self.sin_port);
   log_d("message_init: ready at port '%d'", port);
@@ -109,6 +243,48 @@ message_init(FILE *logFP)
   return port;
 }
 
+/**************** message_setBackend ****************/
+/* 
+ * Choose the backend used by message_init and message_loop.
+ * See message.h for detailed description.
+ */
+bool
+message_setBackend(const message_backend_t backend)
+{
+  if (ourSocket != 0) {
+    log_v("message_setBackend: called after message_init");
+    return false;
+  }
+  ourBackend = backend;
+  return true;
+}
+
+/**************** message_setSendBuffer ****************/
+/* 
+ * Choose the SO_SNDBUF size applied by message_init.
+ * See message.h for detailed description.
+ */
+bool
+message_setSendBuffer(const int bytes)
+{
+  if (ourSocket != 0) {
+    log_v("message_setSendBuffer: called after message_init");
+    return false;
+  }
+  ourSendBuffer = bytes;
+  return true;
+}
+
+/**************** message_getBackend ****************/
+/* 
+ * See message.h for detailed description.
+ */
+message_backend_t
+message_getBackend(void)
+{
+  return ourBackend;
+}
+
 /**************** message_noAddr ****************/
 /* 
  * Return an empty/nonexistent address.
@@ -198,14 +374,16 @@ message_setAddr(const char *hostname, const char *portString, addr_t *addr)
 /**************** stringAddr ****************/
 /*
  * Produce a string representation of the address.
- * Returns pointer to static storage and thus should not be retained.
+ * Returns pointer to (thread-local) static storage and thus should not
+ * be retained.
  */
 static const char *
 stringAddr(const addr_t addr)
 {
   // Maximum string length to hold an IP address and port, plus null.
   // e.g., 255.255.255.255:65507
-  static char addrString[22]; // constant appears in snprintf below
+  // (one per thread, since senders may be on any thread)
+  static _Thread_local char addrString[22]; // constant appears in snprintf below
 
   snprintf(addrString, 22, "%s:%05d",
 	   inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
@@ -213,6 +391,7 @@ stringAddr(const addr_t addr)
   return addrString;
 }
 
+#if LOG_MAXLEVEL >= log_VERBOSE     // used only in verbose logging
 /**************** numLines ****************/
 /*
  * Return number of lines needed to print the string:
@@ -242,6 +421,7 @@ numLines(const char *string)
     return n;
   }
 }
+#endif
 
 /**************** message_send ****************/
 /* 
@@ -251,24 +431,604 @@ numLines(const char *string)
 void
 message_send(const addr_t to, const char *message)
 {
-  if (ourSocket == 0) {
-    log_v("message_send: called before message_init");
-    return; // error in usage of this function.
-  }
   if (message == NULL) {
     log_v("message_send: called with null message");
     return; // error in usage of this function.
   }
-  if (sendto(ourSocket, message, strlen(message), 0,
-             (struct sockaddr *) &to, sizeof(to)) < 0) {
-    log_e("message_send: error sending to datagram socket");
+  pthread_mutex_lock(&sendLock);
+  if (sendMessage(to, message, strlen(message), 0)) {
+    logv_s("message_send: TO %s", stringAddr(to));
+    logv_d("message_send: %d lines:", numLines(message));
+    logv_s("%s", message);
+  }
+  pthread_mutex_unlock(&sendLock);
+}
+
+/**************** message_sendBytes ****************/
+/* 
+ * Send a binary message to the correspondent address.
+ * See message.h for detailed description.
+ */
+void
+message_sendBytes(const addr_t to, const void *buf, const size_t len)
+{
+  if (buf == NULL) {
+    log_v("message_sendBytes: called with null buffer");
+    return; // error in usage of this function.
+  }
+  pthread_mutex_lock(&sendLock);
+  if (sendMessage(to, buf, len, 0)) {
+    logv_s("message_sendBytes: TO %s", stringAddr(to));
+    logv_d("message_sendBytes: %d bytes", (int) len);
+  }
+  pthread_mutex_unlock(&sendLock);
+}
+
+/**************** message_sendLatest ****************/
+/* 
+ * Send a message that replaces any older one of its kind still queued.
+ * See message.h for detailed description.
+ */
+void
+message_sendLatest(const addr_t to, const void *buf, const size_t len,
+                   const int tag)
+{
+  if (buf == NULL || tag <= 0) {
+    log_v("message_sendLatest: called with null buffer or bad tag");
+    return; // error in usage of this function.
+  }
+  pthread_mutex_lock(&sendLock);
+  if (sendMessage(to, buf, len, tag)) {
+    logv_s("message_sendLatest: TO %s", stringAddr(to));
+    if (len > 0 && *(const char *) buf == '\0') {
+      logv_d("message_sendLatest: %d bytes", (int) len);
+    } else {
+      logv_d("message_sendLatest: %d lines:", numLines(buf));
+      logv_s("%s", buf);
+    }
+  }
+  pthread_mutex_unlock(&sendLock);
+}
+
+/**************** sendMessage ****************/
+/*
+ * Send 'len' bytes as one datagram or, if need be, as fragments.  If the
+ * socket is full, or earlier messages to 'to' are still waiting, the
+ * message (or what is left of it) joins the queue for 'to'.
+ * Shared by message_send, message_sendBytes and message_sendLatest.
+ * Returns false (having logged why) if the message was neither sent
+ * nor queued.
+ */
+static bool
+sendMessage(const addr_t to, const char *buf, const size_t len, const int tag)
+{
+  if (ourSocket == 0) {
+    log_v("message_send: called before message_init");
+    return false; // error in usage of this function.
+  }
+  if (len > message_MaxMessageBytes) {
+    log_d("message_send: message of %d bytes is too long", (int) len);
+    return false;
+  }
+
+  uint32_t id = len > message_MaxBytes ? nextMessageId++ : 0;
+  int sentFragments = 0;
+  sendqueue_t *queue = ourStats.queueDepth > 0 ? findQueue(to) : NULL;
+  if (queue == NULL || queue->head == NULL) {
+    // nothing waiting ahead of us: try the socket now
+    switch (transmit(to, buf, len, id, &sentFragments)) {
+    case sendDone:
+      return true;
+    case sendFailed:
+      log_e("message_send: error sending to datagram socket");
+      return false;
+    case sendBlocked:
+      break;
+    }
+  }
+  return enqueue(to, buf, len, tag, id, sentFragments);
+}
+
+/**************** transmit ****************/
+/*
+ * Send a message as one datagram or, if longer than message_MaxBytes, as
+ * a series of fragments with the given id (see the header layout at the
+ * top of this file), starting at fragment *sentFragments and advancing
+ * it past each fragment sent.
+ * Returns sendBlocked if the socket filled before the last fragment left.
+ */
+static sendresult_t
+transmit(const addr_t to, const char *buf, const size_t len,
+         const uint32_t id, int *sentFragments)
+{
+  if (len <= message_MaxBytes) {
+    sendresult_t result = sendDatagram(to, buf, len);
+    if (result == sendDone) {
+      *sentFragments = 1;
+    }
+    return result;
+  }
+
+  unsigned char frag[FragHeaderBytes + FragPayload];
+  int count = (len + FragPayload - 1) / FragPayload;
+  for (int index = *sentFragments; index < count; index++) {
+    size_t n = fragment(frag, buf, len, id, index);
+    sendresult_t result = sendDatagram(to, (char *) frag, n);
+    if (result != sendDone) {
+      return result;
+    }
+    ourStats.fragmentsSent++;
+    (*sentFragments)++;
+  }
+  log_d("message_send: sent as %d fragments", count);
+  return sendDone;
+}
+
+/**************** fragment ****************/
+/*
+ * Write fragment 'index' of the 'len'-byte message 'buf', with the given
+ * id, into 'frag' (FragHeaderBytes + FragPayload of room), header first.
+ * Returns the length of the datagram.
+ */
+static size_t
+fragment(unsigned char *frag, const char *buf, const size_t len,
+         const uint32_t id, const int index)
+{
+  int count = (len + FragPayload - 1) / FragPayload;
+  size_t offset = (size_t) index * FragPayload;
+  size_t n = len - offset < FragPayload ? len - offset : FragPayload;
+  memset(frag, 0, FragHeaderBytes);
+  frag[1] = 'F';
+  frag[4] = id >> 24;  frag[5] = id >> 16;  frag[6] = id >> 8;  frag[7] = id;
+  frag[8] = index >> 8;  frag[9] = index;
+  frag[10] = count >> 8;  frag[11] = count;
+  frag[12] = len >> 24;  frag[13] = len >> 16;
+  frag[14] = len >> 8;  frag[15] = len;
+  memcpy(frag + FragHeaderBytes, buf + offset, n);
+  return FragHeaderBytes + n;
+}
+
+/**************** sendDatagram ****************/
+/*
+ * Send one datagram of 'len' bytes on the current backend, without
+ * waiting for room in the socket.
+ */
+static sendresult_t
+sendDatagram(const addr_t to, const char *buf, const size_t len)
+{
+  if (ourBackend == message_URING) {
+    // queued now, submitted in a batch when message_loop next waits
+    if (uring_send(to, buf, len)) {
+      return sendDone;
+    }
+  } else if (sendto(ourSocket, buf, len, MSG_DONTWAIT,
+                    (struct sockaddr *) &to, sizeof(to)) >= 0) {
+    return sendDone;
+  }
+  if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+    return sendBlocked;
+  }
+  return sendFailed;
+}
+
+/**************** findQueue ****************/
+/*
+ * Return the send queue for 'to', or NULL if it has none.
+ */
+static sendqueue_t *
+findQueue(const addr_t to)
+{
+  if (queueIndex == NULL) {
+    return NULL;      // the common case: nothing has ever had to wait
+  }
+  char key[QueueKeyBytes];
+  queueKey(to, key);
+  return hashtable_find(queueIndex, key);
+}
+
+/**************** makeQueue ****************/
+/*
+ * Make an empty send queue for 'to', growing the table of queues as
+ * need be.  Returns NULL if out of memory.
+ */
+static sendqueue_t *
+makeQueue(const addr_t to)
+{
+  if (queueIndex == NULL && (queueIndex = hashtable_new(64)) == NULL) {
+    return NULL;
+  }
+  if (numQueues == maxQueues) {
+    int max = maxQueues > 0 ? 2 * maxQueues : 64;
+    sendqueue_t **grown = count_mallocTag(max * sizeof(sendqueue_t *), mem_NET);
+    if (grown == NULL) {
+      return NULL;
+    }
+    if (queues != NULL) {
+      memcpy(grown, queues, numQueues * sizeof(sendqueue_t *));
+      count_free(queues);
+    }
+    queues = grown;
+    maxQueues = max;
+  }
+  sendqueue_t *queue = count_mallocTag(sizeof(sendqueue_t), mem_NET);
+  char key[QueueKeyBytes];
+  queueKey(to, key);
+  if (queue == NULL || !hashtable_insert(queueIndex, key, queue)) {
+    if (queue != NULL) {
+      count_free(queue);
+    }
+    return NULL;
+  }
+  queue->to = to;
+  queue->head = queue->tail = NULL;
+  queue->depth = 0;
+  queues[numQueues++] = queue;
+  return queue;
+}
+
+/**************** queueKey ****************/
+/*
+ * Write the key by which queueIndex knows 'to' into 'key'
+ * (QueueKeyBytes of room): its address and port, in hex.
+ */
+static void
+queueKey(const addr_t to, char *key)
+{
+  snprintf(key, QueueKeyBytes, "%08x:%04x",
+           (unsigned) ntohl(to.sin_addr.s_addr), (unsigned) ntohs(to.sin_port));
+}
+
+/**************** enqueue ****************/
+/*
+ * Copy a message onto the queue for 'to' (making it, if 'to' has none),
+ * of which 'sentFragments' have already been sent, first discarding any
+ * unsent message with the same (nonzero) tag.
+ * Returns false if the queue is full, or if out of memory.
+ */
+static bool
+enqueue(const addr_t to, const char *buf, const size_t len, const int tag,
+        const uint32_t id, const int sentFragments)
+{
+  sendqueue_t *queue = findQueue(to);
+  if (queue == NULL && (queue = makeQueue(to)) == NULL) {
+    log_e("message_send: out of memory");
+    return false;
+  }
+
+  // a newer message of the same kind makes a waiting one obsolete,
+  // unless some of it has already gone out
+  if (tag != 0) {
+    outmsg_t *prev = NULL;
+    for (outmsg_t *msg = queue->head; msg != NULL; prev = msg, msg = msg->next) {
+      if (msg->tag == tag && msg->sentFragments == 0) {
+        if (prev == NULL) {
+          queue->head = msg->next;
+        } else {
+          prev->next = msg->next;
+        }
+        if (queue->tail == msg) {
+          queue->tail = prev;
+        }
+        count_free(msg);
+        queue->depth--;
+        ourStats.queueDepth--;
+        ourStats.superseded++;
+        break;      // there is never more than one
+      }
+    }
+  }
+
+  if (queue->depth >= message_MaxQueuedMessages) {
+    log_s("message_send: queue full for %s", stringAddr(to));
+    ourStats.queueDrops++;
+    return false;
+  }
+  outmsg_t *msg = count_mallocTag(sizeof(outmsg_t) + len, mem_NET);
+  if (msg == NULL) {
+    log_e("message_send: out of memory");
+    return false;
+  }
+  msg->next = NULL;
+  msg->tag = tag;
+  msg->id = id;
+  msg->sentFragments = sentFragments;
+  msg->len = len;
+  memcpy(msg->data, buf, len);
+  if (queue->head == NULL) {
+    queue->head = msg;
+  } else {
+    queue->tail->next = msg;
+  }
+  queue->tail = msg;
+  queue->depth++;
+  ourStats.queueDepth++;
+  ourStats.messagesQueued++;
+  if (queue->depth > ourStats.maxQueueDepth) {
+    ourStats.maxQueueDepth = queue->depth;
+  }
+  return true;
+}
+
+/**************** drainQueues ****************/
+/*
+ * Send queued messages, one message per destination in turn, until the
+ * queues are empty or the socket is full again.  Each call starts with
+ * the destination after the one it started with last time.
+ */
+static void
+drainQueues(void)
+{
+  if (numQueues == 0) {
+    return;
+  }
+  nextQueue = (nextQueue + 1) % numQueues;
+  bool progress = true;
+  while (ourStats.queueDepth > 0 && progress) {
+    progress = false;
+    for (int k = 0; k < numQueues; k++) {
+      sendqueue_t *queue = queues[(nextQueue + k) % numQueues];
+      outmsg_t *msg = queue->head;
+      if (msg == NULL) {
+        continue;
+      }
+      sendresult_t result = transmit(queue->to, msg->data, msg->len,
+                                     msg->id, &msg->sentFragments);
+      if (result == sendBlocked) {
+        return;
+      }
+      if (result == sendFailed) {
+        log_e("message_send: error sending queued message");
+      }
+      queue->head = msg->next;
+      if (queue->head == NULL) {
+        queue->tail = NULL;
+      }
+      count_free(msg);
+      queue->depth--;
+      ourStats.queueDepth--;
+      progress = true;
+    }
+  }
+}
+
+/**************** freeQueues ****************/
+/*
+ * Discard every queued message, and the queues.
+ */
+static void
+freeQueues(void)
+{
+  for (int i = 0; i < numQueues; i++) {
+    while (queues[i]->head != NULL) {
+      outmsg_t *msg = queues[i]->head;
+      queues[i]->head = msg->next;
+      count_free(msg);
+    }
+    count_free(queues[i]);
+  }
+  if (queues != NULL) {
+    count_free(queues);
+  }
+  hashtable_delete(queueIndex, NULL);
+  queues = NULL;
+  queueIndex = NULL;
+  numQueues = maxQueues = nextQueue = 0;
+  if (ourStats.queueDepth > 0) {
+    log_d("message_done: %d queued messages abandoned",
+          (int) ourStats.queueDepth);
+  }
+  ourStats.queueDepth = 0;
+}
+
+/**************** reassemble ****************/
+/*
+ * Record a fragment datagram from 'from'.  If it completes a message,
+ * return that message (null-terminated, caller frees); otherwise NULL.
+ * Malformed or inconsistent fragments are logged and ignored.
+ */
+static char *
+reassemble(const addr_t from, const char *buf, const int nbytes)
+{
+  const unsigned char *h = (const unsigned char *) buf;
+  uint32_t id = (uint32_t) h[4] << 24 | h[5] << 16 | h[6] << 8 | h[7];
+  int index = h[8] << 8 | h[9];
+  int count = h[10] << 8 | h[11];
+  long total = (long) h[12] << 24 | h[13] << 16 | h[14] << 8 | h[15];
+  int n = nbytes - FragHeaderBytes;
+
+  ourStats.fragmentsReceived++;
+
+  // the fragment must agree with the layout sendFragmented produces
+  long offset = (long) index * FragPayload;
+  long expect = total - offset < FragPayload ? total - offset : FragPayload;
+  if (count < 2 || index >= count || total > message_MaxMessageBytes
+      || (long) count != (total + FragPayload - 1) / FragPayload
+      || n != expect) {
+    log_d("message_loop: ignoring malformed fragment of %d bytes", nbytes);
+    return NULL;
+  }
+
+  // find the message this fragment belongs to, noting what else this
+  // sender has in progress
+  reassembly_t *r = NULL;
+  reassembly_t *unused = NULL;
+  int senderHolds = 0;
+  for (int i = 0; i < MaxReassemblies && r == NULL; i++) {
+    reassembly_t *p = &partials[i];
+    if (p->frags == NULL) {
+      unused = unused == NULL ? p : unused;
+    } else if (message_eqAddr(p->from, from)) {
+      if (p->id == id) {
+        r = p;
+      } else {
+        senderHolds++;
+      }
+    }
+  }
+
+  // or start a new one; a sender with its share of slots gives up its own
+  // oldest, otherwise a free slot is taken, or the oldest of all
+  if (r == NULL) {
+    if (senderHolds >= MaxReassembliesPerSender) {
+      r = oldestPartial(from, NULL);
+    } else {
+      r = unused != NULL ? unused : oldestPartial(message_noAddr(), NULL);
+    }
+    if (r->frags != NULL) {
+      log_v("message_loop: too many partial messages; dropping oldest");
+      freePartial(r);
+      ourStats.reassembliesDropped++;
+    }
+    r->frags = count_callocTag(count, sizeof(char *), mem_NET);
+    if (r->frags == NULL) {
+      log_v("message_loop: out of memory for reassembly");
+      ourStats.reassembliesDropped++;
+      return NULL;
+    }
+    r->from = from;
+    r->id = id;
+    r->count = count;
+    r->received = 0;
+    r->total = total;
+    r->held = 0;
+    r->started = now();
+  } else if (r->count != count || r->total != total) {
+    log_d("message_loop: fragment disagrees with message %d", id);
+    return NULL;
+  }
+  if (r->frags[index] != NULL) {
+    return NULL;            // a duplicate
+  }
+
+  // keep what all partials hold in bounds: this sender's other messages
+  // go first, then the oldest of anyone's
+  while (partialBytes + n > MaxReassemblyBytes) {
+    reassembly_t *victim = oldestPartial(from, r);
+    if (victim == NULL) {
+      victim = oldestPartial(message_noAddr(), r);
+    }
+    if (victim == NULL) {
+      victim = r;           // cannot happen while the cap exceeds a message
+    }
+    log_v("message_loop: too much held for reassembly; dropping oldest");
+    freePartial(victim);
+    ourStats.reassembliesDropped++;
+    if (victim == r) {
+      return NULL;
+    }
+  }
+
+  char *frag = count_mallocTag(n, mem_NET);
+  if (frag == NULL) {
+    log_v("message_loop: out of memory for reassembly");
+    freePartial(r);
+    ourStats.reassembliesDropped++;
+    return NULL;
+  }
+  memcpy(frag, buf + FragHeaderBytes, n);
+  r->frags[index] = frag;
+  r->held += n;
+  partialBytes += n;
+  r->received++;
+  if (r->received < r->count) {
+    return NULL;
+  }
+
+  // complete: join the fragments, hand the message over and free the slot
+  char *message = count_mallocTag(r->total + 1, mem_NET);
+  if (message == NULL) {
+    log_v("message_loop: out of memory for reassembly");
+    ourStats.reassembliesDropped++;
   } else {
-    log_s("message_send: TO %s", stringAddr(to));
-    log_d("message_send: %d lines:", numLines(message));
-    log_s("%s", message);
+    for (int i = 0; i < r->count; i++) {
+      long at = (long) i * FragPayload;
+      memcpy(message + at, r->frags[i],
+             r->total - at < FragPayload ? r->total - at : FragPayload);
+    }
+    message[r->total] = '\0';
+    ourStats.reassembled++;
+  }
+  freePartial(r);
+  return message;
+}
+
+/**************** oldestPartial ****************/
+/*
+ * Return the partial message started longest ago, other than 'keep',
+ * from 'from' (or from anyone, if 'from' is not an address); NULL if none.
+ */
+static reassembly_t *
+oldestPartial(const addr_t from, const reassembly_t *keep)
+{
+  reassembly_t *oldest = NULL;
+  for (int i = 0; i < MaxReassemblies; i++) {
+    reassembly_t *p = &partials[i];
+    if (p->frags != NULL && p != keep
+        && (!message_isAddr(from) || message_eqAddr(p->from, from))
+        && (oldest == NULL || p->started < oldest->started)) {
+      oldest = p;
+    }
+  }
+  return oldest;
+}
+
+/**************** freePartial ****************/
+/*
+ * Free a partial message's fragments, and its slot.
+ */
+static void
+freePartial(reassembly_t *r)
+{
+  for (int i = 0; i < r->count; i++) {
+    count_free(r->frags[i]);
+  }
+  count_free(r->frags);
+  partialBytes -= r->held;
+  r->frags = NULL;
+  r->held = 0;
+}
+
+/**************** expireReassemblies ****************/
+/*
+ * Drop partial messages older than ReassemblyTimeout (or all of them).
+ */
+static void
+expireReassemblies(const bool all)
+{
+  double cutoff = now() - ReassemblyTimeout;
+  for (int i = 0; i < MaxReassemblies; i++) {
+    reassembly_t *r = &partials[i];
+    if (r->frags != NULL && (all || r->started < cutoff)) {
+      log_d("message_loop: dropping incomplete message %d", r->id);
+      freePartial(r);
+      ourStats.reassembliesDropped++;
+    }
   }
 }
 
+/**************** now ****************/
+/* Return a monotonic time in seconds. */
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**************** message_stats ****************/
+/* 
+ * See message.h for detailed description.
+ */
+message_stats_t
+message_stats(void)
+{
+  pthread_mutex_lock(&sendLock);
+  message_stats_t stats = ourStats;
+  pthread_mutex_unlock(&sendLock);
+  return stats;
+}
+
 /**************** message_loop ****************/
 /* 
  * Loop forever, calling handler functions for stdin or socket,
@@ -303,23 +1063,29 @@ message_loop(void *arg, const float timeout,
     return false; // error in usage of this function.
   }
 
+  if (ourBackend == message_URING) {
+    return uringLoop(arg, timeout, handleTimeout, handleInput, handleMessage);
+  }
+
   // set up for timeouts, if desired
   struct timeval *timerp = NULL; // stays null if no timeout desired
   struct timeval timer;          // timerp = &timer if timeout desired
   struct timeval timeoutval;     // timeval equivalent of parameter 'timeout'
   if (timeout > 0.0) {
     timeoutval.tv_sec  = (int)timeout;
-    timeoutval.tv_usec = timeout - (int)timeout;
+    timeoutval.tv_usec = (timeout - (int)timeout) * 1e6;
   }
 
   // loop until error or some handler indicates time to quit looping
   while (true) {
     // for use with select()
     fd_set rfds;        // set of file descriptors we want to read
+    fd_set wfds;        // set of file descriptors we want to write
     
     // Watch stdin (fd 0) and the socket to see when either has input.
     int nfds = 0;             // number of file descriptors to monitor
     FD_ZERO(&rfds);           // default to none
+    FD_ZERO(&wfds);
     if (handleInput != NULL) {
       FD_SET(0, &rfds);       // monitor stdin
       nfds = 1;
@@ -328,6 +1094,12 @@ message_loop(void *arg, const float timeout,
       FD_SET(ourSocket, &rfds); // monitor the socket
       nfds = ourSocket+1;       // highest-numbered fd in rfds
     }
+    pthread_mutex_lock(&sendLock);
+    if (ourStats.queueDepth > 0) {
+      FD_SET(ourSocket, &wfds); // watch for room to drain the send queues
+      nfds = ourSocket+1;
+    }
+    pthread_mutex_unlock(&sendLock);
     if (timeout > 0.0) {      // is timeout desired?
       timer = timeoutval;     // set the timer to the timeout value
       timerp = &timer;        // pass that timer to select
@@ -336,8 +1108,8 @@ message_loop(void *arg, const float timeout,
     }
 
     // Wait for input on either source
-    int select_response = select(nfds, &rfds, NULL, NULL, timerp);
-    // note: 'rfds' updated
+    int select_response = select(nfds, &rfds, &wfds, NULL, timerp);
+    // note: 'rfds' and 'wfds' updated
     
     if (select_response < 0) {
       if (errno == EINTR) {
@@ -351,23 +1123,29 @@ message_loop(void *arg, const float timeout,
       }
     } else if (select_response == 0) {
       // timeout occurred
-      log_v("message_loop: select() timed out");
+      logv_v("message_loop: select() timed out");
       if (handleTimeout != NULL && (*handleTimeout)(arg)) {
         break; // handler says to exit loop 
       }
     } else if (select_response > 0) {
-      // some data is ready on either source, or both
+      // some data is ready on either source, or both, or there is room
+      // to send
 
+      if (FD_ISSET(ourSocket, &wfds)) {
+        pthread_mutex_lock(&sendLock);
+        drainQueues();
+        pthread_mutex_unlock(&sendLock);
+      }
       if (FD_ISSET(0, &rfds)) {
         // stdin has input ready
-        log_v("message_loop: input ready on stdin");
+        logv_v("message_loop: input ready on stdin");
         if (handleInput != NULL && (*handleInput)(arg)) {
           break; // handler says to exit loop 
         }
       }
       if (FD_ISSET(ourSocket, &rfds)) {
         // socket has input ready
-        log_v("message_loop: message ready on socket");
+        logv_v("message_loop: message ready on socket");
         struct sockaddr_in sender;     // sender of this message
         struct sockaddr *senderp = (struct sockaddr *) &sender;
         socklen_t senderlen = sizeof(sender);  // must pass address to length
@@ -379,20 +1157,8 @@ message_loop(void *arg, const float timeout,
           log_e("message_loop: receiving from socket");
         } else {
           buf[nbytes] = '\0';     // null terminate message string
-          // where was it from?
-          if (sender.sin_family != AF_INET) {
-            // ignore it
-            log_d("message_loop: non-Internet family %d\n", sender.sin_family);
-          } else {
-	    // record it
-	    log_s("message_loop: FROM %s", stringAddr(sender));
-	    log_d("message_loop: %d lines:", numLines(buf));
-	    log_s("%s", buf);
-
-            // handle it
-            if (handleMessage != NULL && (*handleMessage)(arg, sender, buf)) {
-              break; // handler says to exit loop 
-            }
+          if (deliver(arg, sender, buf, nbytes, handleMessage)) {
+            break; // handler says to exit loop 
           }
         }
       }
@@ -401,6 +1167,100 @@ message_loop(void *arg, const float timeout,
   return true;
 }
 
+/**************** deliver ****************/
+/*
+ * Log an inbound datagram and pass it to the handler, if it came from an
+ * Internet address.  Shared by both backends.
+ * Returns true if the handler says to exit the loop.
+ */
+static bool
+deliver(void *arg, const struct sockaddr_in sender, const char *buf,
+        int nbytes,
+        bool (*handleMessage)(void *arg, const addr_t from, const char *buf))
+{
+  // where was it from?
+  if (sender.sin_family != AF_INET) {
+    // ignore it
+    log_d("message_loop: non-Internet family %d\n", sender.sin_family);
+    return false;
+  }
+
+  // a fragment is held until the rest of its message arrives
+  expireReassemblies(false);
+  char *whole = NULL;
+  if (nbytes >= FragHeaderBytes && buf[0] == '\0' && buf[1] == 'F') {
+    logv_s("message_loop: fragment FROM %s", stringAddr(sender));
+    if ((whole = reassemble(sender, buf, nbytes)) == NULL) {
+      return false;
+    }
+    const unsigned char *h = (const unsigned char *) buf;
+    nbytes = h[12] << 24 | h[13] << 16 | h[14] << 8 | h[15];
+    buf = whole;
+  }
+
+  // record it; a binary message (see message_sendBytes) is not printable
+  logv_s("message_loop: FROM %s", stringAddr(sender));
+  if (buf[0] == '\0' && nbytes > 0) {
+    logv_d("message_loop: %d bytes (binary)", nbytes);
+  } else {
+    logv_d("message_loop: %d lines:", numLines(buf));
+    logv_s("%s", buf);
+  }
+
+  // handle it
+  bool done = handleMessage != NULL && (*handleMessage)(arg, sender, buf);
+  count_free(whole);
+  return done;
+}
+
+/**************** uringLoop ****************/
+/*
+ * The body of message_loop for the io_uring backend.  Each iteration
+ * submits every send queued by the previous handler in one system call,
+ * then takes one completion event.
+ * Returns false on error or true if any of the handlers return true.
+ */
+static bool
+uringLoop(void *arg, const float timeout,
+          bool (*handleTimeout)(void *arg),
+          bool (*handleInput)  (void *arg),
+          bool (*handleMessage)(void *arg, const addr_t from, const char *buf))
+{
+  uring_event_t ev;
+  while (true) {
+    switch (uring_next(&ev, handleInput != NULL, timeout)) {
+    case uring_TIMEOUT:
+      log_v("message_loop: io_uring wait timed out");
+      if (handleTimeout != NULL && (*handleTimeout)(arg)) {
+        return true; // handler says to exit loop
+      }
+      break;
+    case uring_INTR:
+      log_e("message_loop: io_uring_enter EINTR: interrupted by signal");
+      break;
+    case uring_INPUT:
+      log_v("message_loop: input ready on stdin");
+      if ((*handleInput)(arg)) {
+        return true; // handler says to exit loop
+      }
+      break;
+    case uring_SENT:
+      drainQueues();    // a send completed, so there is room again
+      break;
+    case uring_MESSAGE:
+      log_v("message_loop: message ready on socket");
+      if (deliver(arg, ev.from, ev.data, ev.len, handleMessage)) {
+        uring_release(&ev);
+        return true; // handler says to exit loop
+      }
+      uring_release(&ev);
+      break;
+    case uring_ERROR:
+      return false;
+    }
+  }
+}
+
 /**************** message_done ****************/
 /* 
  * Clean up the message module, prior to exit.
@@ -409,7 +1269,13 @@ message_loop(void *arg, const float timeout,
 void
 message_done(void)
 {
+  expireReassemblies(true);
   if (ourSocket != 0) {
+    drainQueues();    // whatever fits now; the rest is abandoned
+    freeQueues();
+    if (ourBackend == message_URING) {
+      uring_done();   // lets queued sends leave before the socket closes
+    }
     close(ourSocket);
     ourSocket = 0;
   }
@@ -443,6 +1309,11 @@ message_done(void)
  *   ./messagetest 2>second.log hostName portNumber
  * 
  * ^D (EOF) to exit either side.
+ *
+ * Run with the one argument --check, it instead checks the module's
+ * internals on its own, printing a line for each check that fails, and
+ * exits non-zero if any did:
+ *   ./messagetest --check 2>check.log
  */
 
 #ifdef UNIT_TEST
@@ -451,6 +1322,14 @@ static bool handleTimeout  (void *arg);
 static bool handleInput  (void *arg);
 static bool handleMessage(void *arg, const addr_t from, const char *message);
 static bool readline(char *buf, const int len);
+static int selfCheck(const int port);
+static void check(const bool ok, const char *what);
+static void checkQueues(void);
+static void checkFragments(const int port);
+static bool takeMessage(void *arg, const addr_t from, const char *message);
+static bool giveUp(void *arg);
+
+static int failures = 0;      // checks failed, in --check
 
 int
 main(const int argc, char *argv[])
@@ -468,7 +1347,9 @@ main(const int argc, char *argv[])
 
   // check arguments
   const char *program = argv[0];
-  if (argc == 1) {
+  if (argc == 2 && strcmp(argv[1], "--check") == 0) {
+    return selfCheck(ourPort);
+  } else if (argc == 1) {
     // in this case (no arguments) we don't yet know our correspondent
     printf("waiting on port %d for contact....\n", ourPort);
     other = message_noAddr(); // no correspondent yet
@@ -578,6 +1459,218 @@ handleMessage(void *arg, const addr_t from, const char *message)
   return false;
 }
 
+/**************** selfCheck ****************/
+/* Run every check (with the module initialized, as main has it) and shut
+ * the module down.  Return 0 if all passed, else 1.
+ */
+static int
+selfCheck(const int port)
+{
+  checkQueues();
+  checkFragments(port);
+
+  message_done();
+  log_done();
+  if (failures == 0) {
+    printf("all message tests passed\n");
+  }
+  return failures == 0 ? 0 : 1;
+}
+
+/**************** check ****************/
+/* Note a check that failed. */
+static void
+check(const bool ok, const char *what)
+{
+  if (!ok) {
+    printf("FAILED: %s\n", what);
+    failures++;
+  }
+}
+
+/**************** checkQueues ****************/
+/* Keep messages waiting for more destinations than the send queues were
+ * first made for, as if the socket had had no room, with a stale DISPLAY
+ * ahead of a fresh one for each; then drain them, and see that every
+ * destination gets just its fresh message.
+ */
+static void
+checkQueues(void)
+{
+  enum { Destinations = 100 };    // more than the 64 queues made at first
+  int sockets[Destinations];
+  addr_t to[Destinations];
+  int opened = 0;
+  for (int i = 0; i < Destinations; i++, opened++) {
+    struct sockaddr_in self = {.sin_family = AF_INET};
+    self.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t selflen = sizeof(self);
+    struct timeval wait = {1, 0};
+    sockets[i] = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockets[i] < 0
+        || bind(sockets[i], (struct sockaddr *) &self, sizeof(self)) != 0
+        || getsockname(sockets[i], (struct sockaddr *) &self, &selflen) != 0
+        || setsockopt(sockets[i], SOL_SOCKET, SO_RCVTIMEO, &wait, sizeof(wait)) != 0) {
+      check(false, "open a destination");
+      break;
+    }
+    to[i] = self;
+  }
+
+  pthread_mutex_lock(&sendLock);
+  message_stats_t before = ourStats;
+  bool queued = true;
+  for (int i = 0; i < opened; i++) {
+    char stale[32], fresh[32];
+    snprintf(stale, sizeof(stale), "stale %d", i);
+    snprintf(fresh, sizeof(fresh), "fresh %d", i);
+    queued = enqueue(to[i], stale, strlen(stale) + 1, 1, 0, 0) && queued;
+    queued = enqueue(to[i], fresh, strlen(fresh) + 1, 1, 0, 0) && queued;
+  }
+  check(queued, "queue messages for every destination");
+  check(ourStats.queueDrops == before.queueDrops, "drop nothing for want of a queue");
+  check(numQueues == opened, "a queue for each destination");
+  check(ourStats.queueDepth == opened, "one message waiting for each destination");
+  check(ourStats.superseded - before.superseded == opened, "a fresh message replaces a stale one");
+  drainQueues();
+  check(ourStats.queueDepth == 0, "drain every queue");
+  pthread_mutex_unlock(&sendLock);
+
+  bool delivered = true;
+  for (int i = 0; i < opened; i++) {
+    char got[32], fresh[32];
+    snprintf(fresh, sizeof(fresh), "fresh %d", i);
+    ssize_t n = recv(sockets[i], got, sizeof(got), 0);
+    delivered = delivered && n == strlen(fresh) + 1 && strcmp(got, fresh) == 0;
+  }
+  check(delivered, "every destination gets its fresh message");
+  for (int i = 0; i < opened; i++) {
+    close(sockets[i]);
+  }
+}
+
+/**************** checkFragments ****************/
+/* Send ourselves a message too long for one datagram and see it arrive
+ * whole; then hand reassemble fragments directly, to see that a message
+ * survives a fragment coming twice or out of order, that one missing a
+ * fragment is dropped once it is too old, and that fragments held for
+ * messages never finished stay within the cap.
+ */
+static void
+checkFragments(const int port)
+{
+  addr_t self;
+  char portString[16];
+  snprintf(portString, sizeof(portString), "%d", port);
+  if (!message_setAddr("localhost", portString, &self)) {
+    check(false, "form our own address");
+    return;
+  }
+
+  // the round trip, through the socket and message_loop
+  const size_t len = 3 * message_MaxBytes + 123;
+  char *text = malloc(len + 1);
+  unsigned char *frag = malloc(FragHeaderBytes + FragPayload);
+  char *longest = calloc(message_MaxMessageBytes, 1);
+  if (text == NULL || frag == NULL || longest == NULL) {
+    check(false, "allocate the messages");
+    free(text);
+    free(frag);
+    free(longest);
+    return;
+  }
+  for (size_t i = 0; i < len; i++) {
+    text[i] = 'a' + i % 26;
+  }
+  text[len] = '\0';
+  message_stats_t before = message_stats();
+  char *got = NULL;
+  message_send(self, text);
+  message_loop(&got, 2, giveUp, NULL, takeMessage);
+  check(message_stats().fragmentsSent - before.fragmentsSent == 4, "send a long message as fragments");
+  check(got != NULL && strcmp(got, text) == 0, "a long message arrives whole");
+  free(got);
+
+  // a duplicate, and a fragment late: the message waits for the last
+  uint32_t id = 1000;
+  size_t n0 = fragment(frag, text, len, id, 0);
+  bool early = reassemble(self, (char *) frag, n0) != NULL;
+  early = reassemble(self, (char *) frag, n0) != NULL || early;
+  size_t n = fragment(frag, text, len, id, 3);
+  early = reassemble(self, (char *) frag, n) != NULL || early;
+  n = fragment(frag, text, len, id, 2);
+  early = reassemble(self, (char *) frag, n) != NULL || early;
+  check(!early, "hold a message until all its fragments are in");
+  n = fragment(frag, text, len, id, 1);
+  got = reassemble(self, (char *) frag, n);
+  check(got != NULL && strcmp(got, text) == 0, "reassemble despite a duplicate and a late fragment");
+  check(partialBytes == 0, "let go of a message's fragments once it is whole");
+  if (got != NULL) {
+    count_free(got);
+  }
+
+  // a fragment that never comes: once too old, the rest are dropped
+  before = ourStats;
+  id++;
+  n = fragment(frag, text, len, id, 0);
+  reassemble(self, (char *) frag, n);
+  expireReassemblies(false);
+  check(partialBytes == n - FragHeaderBytes, "keep a partial message until it is too old");
+  for (int i = 0; i < MaxReassemblies; i++) {
+    partials[i].started -= ReassemblyTimeout + 1;   // as if it had been waiting
+  }
+  expireReassemblies(false);
+  check(ourStats.reassembliesDropped - before.reassembliesDropped == 1, "drop a partial message that is too old");
+  check(partialBytes == 0, "let go of a dropped message's fragments");
+  early = false;
+  for (int i = 1; i < 4; i++) {
+    n = fragment(frag, text, len, id, i);
+    early = reassemble(self, (char *) frag, n) != NULL || early;
+  }
+  check(!early, "no message from the fragments left after a drop");
+  expireReassemblies(true);
+
+  // many senders, each with all but the last fragment of the longest
+  // message: more than the cap, so partial messages make way
+  before = ourStats;
+  int count = (message_MaxMessageBytes + FragPayload - 1) / FragPayload;
+  bool bounded = true;
+  for (int s = 0; s < 4; s++) {
+    addr_t from = self;
+    from.sin_port = htons(port + 1 + s);
+    for (int i = 0; i < count - 1; i++) {
+      n = fragment(frag, longest, message_MaxMessageBytes, id + 1, i);
+      reassemble(from, (char *) frag, n);
+      bounded = bounded && partialBytes <= MaxReassemblyBytes;
+    }
+  }
+  check(bounded, "hold no more fragments than the cap");
+  check(ourStats.reassembliesDropped > before.reassembliesDropped, "drop partial messages at the cap");
+  expireReassemblies(true);
+  check(partialBytes == 0, "let go of every fragment at the end");
+
+  free(text);
+  free(frag);
+  free(longest);
+}
+
+/**************** takeMessage ****************/
+/* Keep a copy of the message (arg is where) and stop the loop. */
+static bool
+takeMessage(void *arg, const addr_t from, const char *message)
+{
+  *(char **) arg = strdup(message);
+  return true;
+}
+
+/**************** giveUp ****************/
+/* Nothing came in time; stop the loop. */
+static bool
+giveUp(void *arg)
+{
+  return true;
+}
+
 /* A function to read one line from stdin, into a buffer 'buf' of length 'len';
  * thus, it reads at most len-1 characters into buf.  The newline is not copied
  * into the buffer.  Any excess characters on the line are discarded.
@@ -45,11 +45,47 @@
  */
 typedef struct sockaddr_in addr_t;
 
+/* The network backends message_loop can run on.  message_SELECT is the
+ * portable default; message_URING uses Linux io_uring (multishot receive,
+ * batched sends) and falls back to message_SELECT if the kernel lacks
+ * support.
+ */
+typedef enum {
+  message_SELECT,
+  message_URING,
+} message_backend_t;
+
 /****************** constants *********************/
 // Maximum payload size for UDP messages, according to
 // https://en.wikipedia.org/wiki/User_Datagram_Protocol
 static const int message_MaxBytes = 65507;
 
+// Maximum size of a message passed to message_send.  Messages longer than
+// message_MaxBytes are split into numbered fragments, each its own datagram,
+// and reassembled by message_loop on the receiving side before the handler
+// sees them; a message whose fragments do not all arrive within a few
+// seconds is dropped.
+static const int message_MaxMessageBytes = 16 * 1024 * 1024;
+
+// Messages held for one destination while the socket cannot take more.
+// A message that would exceed this is dropped (see message_stats).
+static const int message_MaxQueuedMessages = 64;
+
+/****************** statistics *********************/
+/* Counters kept by the module since message_init; see message_stats.
+ */
+typedef struct message_stats {
+  unsigned long fragmentsSent;        // datagrams sent as message fragments
+  unsigned long fragmentsReceived;    // fragment datagrams received
+  unsigned long reassembled;          // fragmented messages delivered whole
+  unsigned long reassembliesDropped;  // partial messages abandoned
+  unsigned long messagesQueued;       // messages that waited in a send queue
+  unsigned long superseded;           // queued messages replaced by newer
+  unsigned long queueDrops;           // messages dropped; queue was full
+  unsigned long queueDepth;           // messages queued now, all destinations
+  unsigned long maxQueueDepth;        // most ever queued for one destination
+} message_stats_t;
+
 /****************** global functions *********************/
 
 /******************************************/
@@ -64,6 +100,34 @@ static const int message_MaxBytes = 65507;
  */
 int message_init(FILE *logFP);
 
+/******************************************/
+/* message_setBackend: choose the network backend.
+ * Caller provides: the desired backend.
+ * Function returns: false if called after message_init, else true.
+ * Notes:
+ *   Must be called before message_init; the default is message_SELECT.
+ *   If the chosen backend cannot be started, message_init logs the reason
+ *   and uses message_SELECT instead; see message_getBackend.
+ */
+bool message_setBackend(const message_backend_t backend);
+
+/******************************************/
+/* message_setSendBuffer: choose the socket's send buffer size.
+ * Caller provides: the desired size in bytes (SO_SNDBUF); 0 for the default.
+ * Function returns: false if called after message_init, else true.
+ * Notes:
+ *   Must be called before message_init, which logs the size the kernel
+ *   actually granted.  A larger buffer absorbs bigger bursts (a DISPLAY to
+ *   every player) before messages start waiting in the send queues.
+ */
+bool message_setSendBuffer(const int bytes);
+
+/******************************************/
+/* message_getBackend: return the backend in use (or to be used).
+ * Logs: nothing.
+ */
+message_backend_t message_getBackend(void);
+
 /******************************************/
 /* message_noAddr: return an addr_t representing "no address".
  * Logs: nothing.
@@ -105,6 +169,19 @@ bool message_eqAddr(const addr_t a, const addr_t b);
  */
 bool message_setAddr(const char *hostname, const char *portStr, addr_t *addr);
 
+/******************************************/
+/* Sending never blocks.  When the socket cannot take a datagram, the
+ * message waits in a bounded queue kept for its destination; message_loop
+ * drains the queues in turn whenever the socket is writable, so one slow
+ * destination does not hold up messages to the others.  Messages to one
+ * destination leave in the order they were sent.
+ *
+ * On the select backend, any thread may send while another runs
+ * message_loop; a message queued by another thread is drained by the
+ * loop when it next wakes, so such a server should give the loop a
+ * timeout.  On the io_uring backend, send only from the loop's thread.
+ */
+
 /******************************************/
 /* message_send: send a message.
  * Caller provides:
@@ -112,12 +189,57 @@ bool message_setAddr(const char *hostname, const char *portStr, addr_t *addr);
  *   a string containing the message.
  * Function returns: none
  * Assumptions: message_init() has already been called.
+ * Notes:
+ *   messages longer than message_MaxBytes are sent as fragments and
+ *   reassembled by the receiver's message_loop; messages longer than
+ *   message_MaxMessageBytes are not sent.
  * Logs:
  *   errors in arguments,
  *   errors in sending the message.
  */
 void message_send(const addr_t to, const char *message);
 
+/******************************************/
+/* message_sendBytes: send a binary message.
+ * Caller provides:
+ *   a valid address to which to send the message,
+ *   a buffer of 'len' bytes, which may contain nulls.
+ * Function returns: none
+ * Assumptions: message_init() has already been called.
+ * Notes:
+ *   as for message_send.  The receiver's handler sees the bytes followed
+ *   by a null, so a binary message must carry its own length (see wire.h);
+ *   it must not start with the two bytes 0x00 'F', which mark a fragment.
+ * Logs:
+ *   errors in arguments,
+ *   errors in sending the message; the length of the message.
+ */
+void message_sendBytes(const addr_t to, const void *buf, const size_t len);
+
+/******************************************/
+/* message_sendLatest: send a message that a newer one makes obsolete.
+ * Caller provides:
+ *   a valid address to which to send the message,
+ *   a buffer of 'len' bytes (text or binary, as for message_sendBytes),
+ *   a tag greater than zero naming the kind of message.
+ * Function returns: none
+ * Assumptions: message_init() has already been called.
+ * Notes:
+ *   as for message_sendBytes, except that if an earlier message to the
+ *   same address with the same tag is still waiting in the send queue,
+ *   it is discarded; only the latest of its kind is worth sending.
+ * Logs:
+ *   as for message_send (text) or message_sendBytes (binary).
+ */
+void message_sendLatest(const addr_t to, const void *buf, const size_t len,
+                        const int tag);
+
+/******************************************/
+/* message_stats: return a copy of the module's counters.
+ * Logs: nothing.
+ */
+message_stats_t message_stats(void);
+
 /******************************************/
 /* message_loop: loop, handling input and incoming messages.
  * Caller provides:
@@ -0,0 +1,226 @@
+/*
+ * messagebench.c - compare the message module's network backends
+ *
+ * For each backend we fork an echo server that runs message_loop with
+ * that backend and replies to every datagram, the way the game server
+ * answers a KEY with a DISPLAY.  The parent drives it over loopback with
+ * a small window of outstanding KEY-sized messages and records the round
+ * trip of each one.  We report the server's CPU time per packet (from
+ * wait4's rusage) and the round-trip latency percentiles.
+ *
+ * usage: ./messagebench [packets [window [replyBytes]]]
+ *   defaults: 20000 packets, window of 8, 64-byte replies
+ *
+ * Nuggets: Bash Boys
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "message.h"
+
+/**************** file-local types ****************/
+typedef struct result {
+  const char *name;        // backend name, as requested
+  message_backend_t used;  // backend actually used by the server
+  double cpuPerPacket;     // server user+system microseconds per packet
+  double p50, p99, p999;   // round-trip microseconds
+  double rate;             // packets per second
+} result_t;
+
+/**************** file-local global variables ****************/
+static int replyBytes = 64;
+static char reply[65536];   // at least message_MaxBytes
+
+/**************** file-local functions ****************/
+static bool echo(void *arg, const addr_t from, const char *message);
+static bool runBackend(message_backend_t backend, const char *name,
+                       int packets, int window, result_t *res);
+static double now(void);
+static int cmpDouble(const void *a, const void *b);
+
+/**************** main ****************/
+int
+main(const int argc, char *argv[])
+{
+  int packets = argc > 1 ? atoi(argv[1]) : 20000;
+  int window = argc > 2 ? atoi(argv[2]) : 8;
+  replyBytes = argc > 3 ? atoi(argv[3]) : 64;
+  if (packets <= 0 || window <= 0 || replyBytes <= 0
+      || replyBytes >= message_MaxBytes) {
+    fprintf(stderr, "usage: %s [packets [window [replyBytes]]]\n", argv[0]);
+    return 1;
+  }
+
+  result_t results[2];
+  bool ok = runBackend(message_SELECT, "select", packets, window, &results[0])
+    && runBackend(message_URING, "io_uring", packets, window, &results[1]);
+  if (!ok) {
+    return 2;
+  }
+
+  printf("%d packets, window %d, %d-byte replies\n",
+         packets, window, replyBytes);
+  printf("%-9s %-9s %12s %10s %10s %10s %10s\n", "backend", "used",
+         "cpu us/pkt", "p50 us", "p99 us", "p99.9 us", "pkt/s");
+  for (int i = 0; i < 2; i++) {
+    result_t *r = &results[i];
+    printf("%-9s %-9s %12.2f %10.1f %10.1f %10.1f %10.0f\n", r->name,
+           r->used == message_URING ? "io_uring" : "select",
+           r->cpuPerPacket, r->p50, r->p99, r->p999, r->rate);
+  }
+  return 0;
+}
+
+/**************** runBackend ****************/
+/* Fork an echo server on the given backend and measure it.
+ */
+static bool
+runBackend(message_backend_t backend, const char *name,
+           int packets, int window, result_t *res)
+{
+  int fds[2];
+  if (pipe(fds) != 0) {
+    perror("pipe");
+    return false;
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return false;
+  }
+  if (pid == 0) {
+    // the echo server: report port and backend, then serve until "QUIT"
+    close(fds[0]);
+    memset(reply, 'x', replyBytes);
+    reply[replyBytes] = '\0';
+    message_setBackend(backend);
+    int port = message_init(NULL);
+    int msg[2] = { port, message_getBackend() };
+    if (write(fds[1], msg, sizeof(msg)) != sizeof(msg)) {
+      _exit(1);
+    }
+    close(fds[1]);
+    bool ok = port != 0 && message_loop(NULL, 0, NULL, NULL, echo);
+    message_done();
+    _exit(ok ? 0 : 1);
+  }
+
+  close(fds[1]);
+  int msg[2];
+  if (read(fds[0], msg, sizeof(msg)) != sizeof(msg) || msg[0] == 0) {
+    fprintf(stderr, "%s: server failed to start\n", name);
+    close(fds[0]);
+    return false;
+  }
+  close(fds[0]);
+  res->name = name;
+  res->used = msg[1];
+
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  struct timeval tv = { 1, 0 };
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  addr_t server;
+  memset(&server, 0, sizeof(server));
+  server.sin_family = AF_INET;
+  server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  server.sin_port = htons(msg[0]);
+
+  double *sent = calloc(packets, sizeof(double));
+  double *rtt = calloc(packets, sizeof(double));
+  int nrtt = 0;
+  char buf[message_MaxBytes];
+  int next = 0;       // next sequence number to send
+  int outstanding = 0;
+  double start = now();
+
+  // closed loop: keep 'window' KEY messages in flight
+  while (nrtt < packets) {
+    while (outstanding < window && next < packets) {
+      char key[32];
+      int len = snprintf(key, sizeof(key), "KEY h %d", next);
+      sent[next] = now();
+      sendto(sock, key, len, 0, (struct sockaddr *) &server, sizeof(server));
+      next++;
+      outstanding++;
+    }
+    int n = recv(sock, buf, sizeof(buf) - 1, 0);
+    if (n < 0) {
+      // a lost datagram; give up on everything outstanding
+      fprintf(stderr, "%s: timed out with %d outstanding\n", name, outstanding);
+      packets = nrtt + (packets - next);
+      outstanding = 0;
+      continue;
+    }
+    buf[n] = '\0';
+    int seq;
+    if (sscanf(buf, "%d", &seq) == 1 && seq >= 0 && seq < next) {
+      rtt[nrtt++] = (now() - sent[seq]) * 1e6;
+    }
+    outstanding--;
+  }
+  double elapsed = now() - start;
+
+  sendto(sock, "QUIT", 4, 0, (struct sockaddr *) &server, sizeof(server));
+  close(sock);
+  int status;
+  struct rusage ru;
+  wait4(pid, &status, 0, &ru);
+
+  double cpu = ru.ru_utime.tv_sec * 1e6 + ru.ru_utime.tv_usec
+    + ru.ru_stime.tv_sec * 1e6 + ru.ru_stime.tv_usec;
+  qsort(rtt, nrtt, sizeof(double), cmpDouble);
+  res->cpuPerPacket = nrtt > 0 ? cpu / nrtt : 0;
+  res->p50 = nrtt > 0 ? rtt[nrtt / 2] : 0;
+  res->p99 = nrtt > 0 ? rtt[(int)(nrtt * 0.99)] : 0;
+  res->p999 = nrtt > 0 ? rtt[(int)(nrtt * 0.999)] : 0;
+  res->rate = elapsed > 0 ? nrtt / elapsed : 0;
+
+  free(sent);
+  free(rtt);
+  return true;
+}
+
+/**************** echo ****************/
+/* Reply to "KEY h <seq>" with "<seq> xxxx..."; stop on "QUIT".
+ */
+static bool
+echo(void *arg, const addr_t from, const char *message)
+{
+  if (strcmp(message, "QUIT") == 0) {
+    return true;
+  }
+  const char *seq = strrchr(message, ' ');
+  if (seq != NULL) {
+    int len = strlen(seq + 1);
+    memcpy(reply, seq + 1, len);
+    reply[len] = ' ';
+    message_send(from, reply);
+  }
+  return false;
+}
+
+/**************** now ****************/
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**************** cmpDouble ****************/
+static int
+cmpDouble(const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
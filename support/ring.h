@@ -0,0 +1,72 @@
+/*
+ * ring - a lock-free queue from one thread to another
+ *
+ * A ring holds up to a fixed number of pointers, passed in order from the
+ * one thread that pushes them (the producer) to the one that pops them
+ * (the consumer).  Neither takes a lock or makes a system call: each side
+ * owns one counter, which only it advances, and reads the other's to see
+ * how far it may go, so a push or pop is a few loads and a store.  A
+ * push to a full ring fails rather than waiting; the producer decides
+ * whether to drop the item or try again later.
+ *
+ * Threads that have nothing to do need some other way to sleep until an
+ * item arrives (the server's pipeline uses a semaphore per stage); the
+ * ring itself never blocks.
+ *
+ * Nuggets: Bash Boys
+ */
+
+#ifndef __RING_H
+#define __RING_H
+
+#include <stdbool.h>
+#include "memory.h"
+
+/**************** global types ****************/
+typedef struct ring ring_t;  // opaque to users of the module
+
+/**************** functions ****************/
+
+/**************** ring_new ****************/
+/* Create an empty ring holding up to capacity pointers (rounded up to a
+ * power of two); its memory is counted under tag (see memory.h).
+ *
+ * We return:
+ *   pointer to a new ring; NULL if error (or if capacity < 1).
+ * Caller is responsible for:
+ *   later calling ring_delete.
+ */
+ring_t *ring_new(const int capacity, memtag_t tag);
+
+/**************** ring_push ****************/
+/* Add item (which must not be NULL) at the tail of the ring; call only
+ * from the ring's producer.
+ * We return false, adding nothing, if the ring is full.
+ */
+bool ring_push(ring_t *ring, void *item);
+
+/**************** ring_peek ****************/
+/* Return the item at the head of the ring, leaving it there, or NULL if
+ * the ring is empty; call only from the ring's consumer.
+ */
+void *ring_peek(ring_t *ring);
+
+/**************** ring_pop ****************/
+/* Remove and return the item at the head of the ring, or NULL if the
+ * ring is empty; call only from the ring's consumer.
+ */
+void *ring_pop(ring_t *ring);
+
+/**************** ring_depth ****************/
+/* Return the number of items in the ring; from any thread, it may be
+ * out of date by the time it is used.
+ */
+int ring_depth(ring_t *ring);
+
+/**************** ring_delete ****************/
+/* Delete the ring, but not any items still in it.
+ * We ignore a NULL ring.
+ */
+void ring_delete(ring_t *ring);
+
+#endif // __RING_H
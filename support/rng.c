@@ -0,0 +1,204 @@
+/*
+ * rng.c - small, fast random number generators with independent streams
+ *
+ * see rng.h for description
+ *
+ * The generator is PCG32 (the "XSH RR" output of a 64-bit LCG), as in
+ * the reference pcg32_random_r, so its sequences can be checked against
+ * the reference's.  rng_below uses Lemire's multiply-and-reject method
+ * ("Fast Random Integer Generation in an Interval", 2019): it takes the
+ * high half of a 32x32-bit product, and only when the low half shows the
+ * draw fell in the few values that would make some results likelier than
+ * others does it pay for a division, and draw again.
+ *
+ * Compile with -DUNIT_TEST for a standalone unit test; see below.
+ *
+ * Nuggets: Bash Boys
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "rng.h"
+
+/**************** file-local constants ****************/
+static const uint64_t Multiplier = 6364136223846793005ULL;  // the LCG's, as in the reference
+
+/**************** rng_seed ****************/
+/* see rng.h for description */
+void
+rng_seed(rng_t *rng, uint64_t seed, uint64_t stream)
+{
+  rng->state = 0;
+  rng->inc = (stream << 1) | 1;
+  rng_next(rng);
+  rng->state += seed;
+  rng_next(rng);
+}
+
+/**************** rng_next ****************/
+/* see rng.h for description */
+uint32_t
+rng_next(rng_t *rng)
+{
+  uint64_t old = rng->state;
+  rng->state = old * Multiplier + rng->inc;
+  uint32_t shifted = (uint32_t) (((old >> 18) ^ old) >> 27);
+  uint32_t rot = (uint32_t) (old >> 59);
+  return (shifted >> rot) | (shifted << ((-rot) & 31));
+}
+
+/**************** rng_below ****************/
+/* see rng.h for description */
+uint32_t
+rng_below(rng_t *rng, uint32_t bound)
+{
+  if (bound == 0) {
+    return 0;
+  }
+  uint64_t m = (uint64_t) rng_next(rng) * bound;
+  uint32_t low = (uint32_t) m;
+  if (low < bound) {
+    // 2^32 mod bound of the low halves are one result too many
+    uint32_t threshold = -bound % bound;
+    while (low < threshold) {
+      m = (uint64_t) rng_next(rng) * bound;
+      low = (uint32_t) m;
+    }
+  }
+  return (uint32_t) (m >> 32);
+}
+
+/**************** rng_save ****************/
+/* see rng.h for description */
+void
+rng_save(const rng_t *rng, char *buf)
+{
+  snprintf(buf, rng_SavedBytes, "%016" PRIx64 ":%016" PRIx64, rng->state, rng->inc);
+}
+
+/**************** rng_restore ****************/
+/* see rng.h for description */
+bool
+rng_restore(rng_t *rng, const char *buf)
+{
+  // exactly 16 hex digits, a colon, and 16 more
+  if (buf == NULL || strlen(buf) != rng_SavedBytes - 1 || buf[16] != ':') {
+    return false;
+  }
+  for (int i = 0; i < rng_SavedBytes - 1; i++) {
+    if (i != 16 && strchr("0123456789abcdefABCDEF", buf[i]) == NULL) {
+      return false;
+    }
+  }
+  uint64_t state = strtoull(buf, NULL, 16);
+  uint64_t inc = strtoull(buf + 17, NULL, 16);
+  if ((inc & 1) == 0) {         // no stream has an even increment
+    return false;
+  }
+  rng->state = state;
+  rng->inc = inc;
+  return true;
+}
+
+/* ************************* UNIT_TEST ****************************** */
+/*
+ * Check the generator against the reference PCG32's first outputs, that
+ * streams differ, that rng_below stays in bounds and is fair, and that a
+ * restored generator carries on as the saved one would have.  Prints one
+ * line per failed check; exits non-zero if any check fails.
+ *
+ *   ./rngtest
+ */
+
+#ifdef UNIT_TEST
+
+static int failures = 0;
+
+static void
+check(const bool ok, const char *what)
+{
+  if (!ok) {
+    printf("FAILED: %s\n", what);
+    failures++;
+  }
+}
+
+int
+main(const int argc, const char *argv[])
+{
+  // pcg32-demo's first round: pcg32_srandom_r(&rng, 42u, 54u)
+  static const uint32_t Reference[] = {
+    0xa15c02b7, 0x7b47f409, 0xba1d3330, 0x83d2f293, 0xbfa4784b, 0xcbed606e,
+  };
+  rng_t rng;
+  rng_seed(&rng, 42, 54);
+  bool same = true;
+  for (int i = 0; i < sizeof(Reference) / sizeof(Reference[0]); i++) {
+    same = same && rng_next(&rng) == Reference[i];
+  }
+  check(same, "the reference sequence");
+
+  // the same seed on another stream
+  rng_t a, b;
+  rng_seed(&a, 42, 0);
+  rng_seed(&b, 42, 1);
+  int equal = 0;
+  for (int i = 0; i < 1000; i++) {
+    equal += rng_next(&a) == rng_next(&b);
+  }
+  check(equal < 2, "streams differ");
+
+  // bounds, including those just past a power of two and near 2^32
+  static const uint32_t Bounds[] = {1, 2, 3, 7, 10, 250, 1000, 65537, 0x80000001u, 0xffffffffu};
+  rng_seed(&rng, 7, 0);
+  bool inBounds = true;
+  for (int k = 0; k < sizeof(Bounds) / sizeof(Bounds[0]); k++) {
+    for (int i = 0; i < 10000; i++) {
+      inBounds = inBounds && rng_below(&rng, Bounds[k]) < Bounds[k];
+    }
+  }
+  check(inBounds, "rng_below stays below its bound");
+  check(rng_below(&rng, 0) == 0, "rng_below(0) is 0");
+
+  // fairness: with a bound of 3 * 2^30, rng_next() % bound would give the
+  // first 2^30 results twice as often as the rest
+  const uint32_t bound = 3u << 30;
+  long low = 0;
+  const long draws = 300000;
+  for (long i = 0; i < draws; i++) {
+    low += rng_below(&rng, bound) < (1u << 30);
+  }
+  check(low > draws * 0.32 && low < draws * 0.347, "rng_below is fair");
+
+  // save and restore, mid-sequence
+  char saved[rng_SavedBytes];
+  rng_seed(&a, 12345, 3);
+  for (int i = 0; i < 17; i++) {
+    rng_next(&a);
+  }
+  rng_save(&a, saved);
+  check(strlen(saved) == rng_SavedBytes - 1, "a saved state fills its buffer");
+  check(rng_restore(&b, saved), "restore a saved state");
+  same = true;
+  for (int i = 0; i < 1000; i++) {
+    same = same && rng_next(&a) == rng_next(&b);
+  }
+  check(same, "a restored generator carries on as the saved one");
+
+  // what is not a saved state
+  b = a;
+  check(!rng_restore(&b, ""), "reject an empty state");
+  check(!rng_restore(&b, "853c49e6748fea9b-da3e39cb94b95bdb"), "reject a missing colon");
+  check(!rng_restore(&b, "853c49e6748fea9b:da3e39cb94b95bdx"), "reject a non-hex digit");
+  check(!rng_restore(&b, "853c49e6748fea9b:da3e39cb94b95bda"), "reject an even increment");
+  check(!rng_restore(&b, "853c49e6748fea9b:da3e39cb94b95bdb0"), "reject a long state");
+  check(b.state == a.state && b.inc == a.inc, "a rejected state leaves the generator alone");
+
+  if (failures == 0) {
+    printf("all rng tests passed\n");
+  }
+  return failures == 0 ? 0 : 1;
+}
+#endif // UNIT_TEST
@@ -0,0 +1,74 @@
+/*
+ * rng - small, fast random number generators with independent streams
+ *
+ * Each rng_t is a PCG32 generator (O'Neill, "PCG: A Family of Simple
+ * Fast Space-Efficient Statistically Good Algorithms for Random Number
+ * Generation", 2014): 64 bits of state advanced by a multiply and an add,
+ * and 32 bits out through a xorshift and a data-dependent rotation.
+ * Besides its seed, a generator is given a stream number, which picks
+ * the increment added at each step; generators seeded alike but on
+ * different streams give unrelated sequences.  A game can thus keep one
+ * generator for each thing it does at random, so that (for instance)
+ * where players appear never changes where the gold was put.
+ *
+ * A generator is a plain struct, with no hidden or global state, so it
+ * may be embedded in whatever uses it and copied freely; two generators
+ * never share anything, so threads may each use their own.  Its state
+ * can be saved as text and restored, to carry on exactly where it was.
+ *
+ *   rng_t rng;
+ *   rng_seed(&rng, seed, 0);
+ *   int pile = rng_below(&rng, numPiles);   // 0 .. numPiles-1, uniformly
+ *
+ * Nuggets: Bash Boys
+ */
+
+#ifndef __RNG_H
+#define __RNG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**************** constants ****************/
+#define rng_SavedBytes 34       // room for a generator saved by rng_save, with its null
+
+/**************** global types ****************/
+/* A generator; its fields are private to the module */
+typedef struct rng {
+  uint64_t state;               // advanced at each draw
+  uint64_t inc;                 // odd; picks the stream
+} rng_t;
+
+/**************** functions ****************/
+
+/**************** rng_seed ****************/
+/* Start rng on the given stream, from seed.  The same seed and stream
+ * always give the same sequence.
+ */
+void rng_seed(rng_t *rng, uint64_t seed, uint64_t stream);
+
+/**************** rng_next ****************/
+/* Return the next 32 random bits from rng. */
+uint32_t rng_next(rng_t *rng);
+
+/**************** rng_below ****************/
+/* Return a random number from 0 to bound-1, each equally likely (unlike
+ * rng_next() % bound, which favours the low numbers when bound does not
+ * divide 2^32); 0 if bound is 0.
+ */
+uint32_t rng_below(rng_t *rng, uint32_t bound);
+
+/**************** rng_save ****************/
+/* Write rng's state into buf (rng_SavedBytes of room) as text, as in
+ * "853c49e6748fea9b:da3e39cb94b95bdb", for rng_restore.
+ */
+void rng_save(const rng_t *rng, char *buf);
+
+/**************** rng_restore ****************/
+/* Set rng to the state saved in buf by rng_save, so it goes on to draw
+ * just what the saved generator would have.
+ * We return false, leaving rng alone, if buf is not a saved state.
+ */
+bool rng_restore(rng_t *rng, const char *buf);
+
+#endif // __RNG_H
@@ -6,6 +6,11 @@
  *
  * see set.h for more information.
  *
+ * The pairs live in one array, in the order they were inserted, which
+ * doubles as the set grows; a lookup or a walk over the set streams
+ * through it.  Each node caches its key's hash, which is compared before
+ * the key itself.
+ *
  * William Dinauer, Dartmouth CS50 Winter 2021
  */
 
@@ -15,79 +20,92 @@
 #include "string.h"
 #include "set.h"
 #include "memory.h"
+#include "jhash.h"
+
+/**************** local constants ****************/
+static const int MinNodes = 8;      // room in a new set's array
 
 /**************** local types ****************/
 typedef struct setnode {
+    uint64_t hash;      // hash of the key, compared before the key itself
     char *key;          // stores a unique string key
     void *item;         // the item to be stored
-    struct setnode *next;   // the next node in the list
 } setnode_t;
 
 /**************** global types ****************/
 typedef struct set {
-    struct setnode *head;   // the front of the linked list
+    setnode_t *nodes;   // array of 'capacity' nodes, the first 'size' in use
+    int size;           // number of pairs in the set
+    int capacity;       // number of nodes allocated
 } set_t;
 
 /**************** local functions ****************/
 /* not visible outside this file */
-static setnode_t *setnode_new(const char *key, void *item);
+static int findNode(set_t *set, const char *key, uint64_t hash);
 
 /**************** set_new() ****************/
 /* see set.h for description */
 set_t *set_new(void) {
-    set_t *set = count_malloc(sizeof(set_t));
+    set_t *set = count_mallocTag(sizeof(set_t), mem_CONTAINERS);
     if (set == NULL) {
-        // error allocating memory
+        // error allocating memory for the set
+        return NULL;
+    }
+    set->size = 0;
+    set->capacity = MinNodes;
+    set->nodes = count_mallocTag(MinNodes * sizeof(setnode_t), mem_CONTAINERS);
+    if (set->nodes == NULL) {
+        // error allocating memory for the array
+        count_free(set);
         return NULL;
-    } else {
-        set->head = NULL;
-        return set;
     }
+    return set;
 }
 
 /**************** set_insert() ****************/
 /* see set.h for description */
 bool set_insert(set_t *set, const char *key, void *item) {
-    if (set != NULL && key != NULL && item != NULL) {
-       if (set->head == NULL) {
-           // empty set; create a new node as the head     
-           setnode_t *new = setnode_new(key, item);
-           if (new != NULL) {
-               set->head = new;
-               return true;
-           }
-       } else {
-           // traverse through the entire set
-           for (setnode_t *node = set->head; node != NULL; node = node->next) {
-               if (strcmp(node->key, key) == 0) {
-                   // return false if the key is already in the set; no duplicates
-                   return false;
-               }
-               if (node->next == NULL){ // reached the end of the list without a match
-                   // insert a setnode at the head of the list
-                   setnode_t *new = setnode_new(key, item);
-                   if (new != NULL) {
-                       new->next = set->head;
-                       set->head = new;
-                       return true;
-                   }
-               }
-           }
-       }
+    if (set == NULL || key == NULL || item == NULL) {
+        return false;
+    }
+    uint64_t hash = StringHash(key, 0);
+    if (findNode(set, key, hash) >= 0) {
+        // return false if the key is already in the set; no duplicates
+        return false;
     }
-    return false;
+    if (set->size == set->capacity) {
+        // the array is full; move the nodes to one twice the size
+        setnode_t *nodes = count_mallocTag(2 * set->capacity * sizeof(setnode_t), mem_CONTAINERS);
+        if (nodes == NULL) {
+            return false;
+        }
+        memcpy(nodes, set->nodes, set->size * sizeof(setnode_t));
+        count_free(set->nodes);
+        set->nodes = nodes;
+        set->capacity *= 2;
+    }
+
+    // copy the key to allow caller to free their key
+    setnode_t *node = &set->nodes[set->size];
+    node->key = count_mallocTag(strlen(key) + 1, mem_CONTAINERS);
+    if (node->key == NULL) {
+        return false;
+    }
+    strcpy(node->key, key);
+    node->hash = hash;
+    node->item = item;
+    set->size++;
+    return true;
 }
 
 /**************** set_find() ****************/
 /* see set.h for description */
 void *set_find(set_t *set, const char *key) {
     if (set != NULL && key != NULL) {
-        // traverse through the linked list
-        for (setnode_t *node = set->head; node != NULL; node = node->next) {
-            if (strcmp(node->key, key) == 0) {
-                // found a match; return the item
-                return node->item;
-            }
+        int x = findNode(set, key, StringHash(key, 0));
+        if (x >= 0) {
+            // found a match; return the item
+            return set->nodes[x].item;
         }
     }
     return NULL;
@@ -100,14 +118,12 @@ void set_print(set_t *set, FILE *fp,
     if (fp != NULL) {
         if (set != NULL) {
             fputc('{', fp);
-            // traverse through the linked list
-            for (setnode_t *node = set->head; node != NULL; node = node->next) {
-                if (itemprint != NULL) {
-                    // print each item
-                    (*itemprint)(fp, node->key, node->item);
-                    if (node->next != NULL){ // separate by commas
-                        fputc(',', fp);
+            if (itemprint != NULL) {
+                for (int x = 0; x < set->size; x++) {
+                    if (x > 0) {
+                        fputc(',', fp);     // separate by commas
                     }
+                    (*itemprint)(fp, set->nodes[x].key, set->nodes[x].item);
                 }
             }
             fputc('}', fp);
@@ -123,49 +139,58 @@ void set_iterate(set_t *set, void *arg,
                  void (*itemfunc)(void *arg, const char *key, void *item)) {
     if (set != NULL && itemfunc != NULL) {
         // call itemfunc for every node in the set
-        for (setnode_t *node = set->head; node != NULL; node = node->next) {
-            (*itemfunc)(arg, node->key, node->item);
+        for (int x = 0; x < set->size; x++) {
+            (*itemfunc)(arg, set->nodes[x].key, set->nodes[x].item);
         }
     }
 }
 
+/**************** set_cursor() ****************/
+/* see set.h for description */
+set_cursor_t set_cursor(set_t *set) {
+    set_cursor_t cursor = { 0 };
+    return cursor;
+}
+
+/**************** set_next() ****************/
+/* see set.h for description */
+bool set_next(set_t *set, set_cursor_t *cursor, const char **key, void **item) {
+    if (set == NULL || cursor == NULL || cursor->next >= set->size) {
+        return false;
+    }
+    setnode_t *node = &set->nodes[cursor->next++];
+    if (key != NULL) {
+        *key = node->key;
+    }
+    if (item != NULL) {
+        *item = node->item;
+    }
+    return true;
+}
+
 /**************** set_delete() ****************/
 /* see set.h for description */
 void set_delete(set_t *set, void (*itemdelete)(void *item)) {
     if (set != NULL) {
-        for (setnode_t *node = set->head; node != NULL; ) {
+        for (int x = 0; x < set->size; x++) {
             if (itemdelete != NULL) {
                 // caller handles deleting the item in the node
-                (*itemdelete)(node->item);
+                (*itemdelete)(set->nodes[x].item);
             }
-            setnode_t *next = node->next;// store the next node
-            count_free(node->key);       // free the key   
-            count_free(node);            // free the current node
-            node = next;                 // set the current node to the stored next node
+            count_free(set->nodes[x].key);   // free the key
         }
-        count_free(set);    // free the set
+        count_free(set->nodes);     // free the array
+        count_free(set);            // free the set
     }
 }
 
-/**************** setnode_new() ****************/
-/* creates a new setnode for insertion into the set */
-static setnode_t *setnode_new(const char *key, void *item) {
-    setnode_t *node = count_malloc(sizeof(setnode_t));
-    if (node == NULL){
-        // error allocating memory for the setnode
-        return NULL;
-    } else {
-        // allocate memory for the key
-        node->key = count_malloc(strlen(key)+1);
-        if (node->key == NULL){
-            // error allocating memory; free the node
-            count_free(node);
-            return NULL;
-        } else {
-            strcpy(node->key, key); // copy the key to allow caller to free their key
-            node->item = item;      // store the item
-            node->next = NULL;
-            return node;
+/**************** findNode() ****************/
+/* returns the index of the node holding key, or -1 if it is absent */
+static int findNode(set_t *set, const char *key, uint64_t hash) {
+    for (int x = 0; x < set->size; x++) {
+        if (set->nodes[x].hash == hash && strcmp(set->nodes[x].key, key) == 0) {
+            return x;
         }
     }
+    return -1;
 }
@@ -20,6 +20,11 @@
 /**************** global types ****************/
 typedef struct set set_t;  // opaque to users of the module
 
+/* a place in a walk over a set; see set_next */
+typedef struct set_cursor {
+    int next;       // private to the module
+} set_cursor_t;
+
 /**************** functions ****************/
 
 /**************** set_new ****************/
@@ -103,6 +108,28 @@ void set_print(set_t *set, FILE *fp,
 void set_iterate(set_t *set, void *arg,
                  void (*itemfunc)(void *arg, const char *key, void *item) );
 
+/**************** set_cursor / set_next ****************/
+/* Walk over the set one item at a time, under the caller's control.
+ *
+ * set_cursor returns a cursor at the start of the set.  Each call to
+ * set_next moves the cursor to the next (key, item) pair and stores it in
+ * *key and *item (either may be NULL, if not wanted), returning false
+ * once every pair has been seen.  The caller may stop at any point; a
+ * cursor holds no resources.  Typical use:
+ *
+ *     const char *key;
+ *     void *item;
+ *     for (set_cursor_t c = set_cursor(set); set_next(set, &c, &key, &item); ) {
+ *         ...
+ *     }
+ *
+ * Notes:
+ *   items are visited in the order they were inserted.
+ *   the set must not gain items while a cursor is in use.
+ */
+set_cursor_t set_cursor(set_t *set);
+bool set_next(set_t *set, set_cursor_t *cursor, const char **key, void **item);
+
 /**************** set_delete ****************/
 /* Delete set, calling a delete function on each item.
  *
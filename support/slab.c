@@ -0,0 +1,136 @@
+/*
+ * slab.c - pools of fixed-size objects
+ *
+ * see slab.h for description
+ *
+ * Each chunk starts with a header linking it to the slab's previous
+ * chunk, followed by room for perChunk objects.  A freed object holds the
+ * link to the next free object in its own first bytes, so objects are at
+ * least the size of a pointer.
+ *
+ * Nuggets: Bash Boys
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include "slab.h"
+#include "memory.h"
+
+/**************** local types ****************/
+typedef struct chunk {
+  struct chunk *prev;           // the chunk allocated before this one
+  max_align_t align;            // objects start here, aligned for any type
+} chunk_t;
+
+typedef struct freeobj {
+  struct freeobj *next;         // the next object on the free list
+} freeobj_t;
+
+/**************** global types ****************/
+typedef struct slab {
+  size_t objectBytes;           // size of each object, rounded up
+  int perChunk;                 // objects per chunk
+  chunk_t *chunks;              // the newest chunk; NULL if none yet
+  char *bump;                   // next never-used object in that chunk
+  char *end;                    // end of that chunk
+  freeobj_t *free;              // objects freed, for reuse
+  int live;                     // objects allocated and not freed
+  memtag_t tag;                 // what its memory is counted as
+} slab_t;
+
+/**************** slab_new ****************/
+/* see slab.h for description */
+slab_t *
+slab_new(const size_t objectBytes, const int perChunk, memtag_t tag)
+{
+  if (objectBytes < 1 || perChunk < 1) {
+    return NULL;
+  }
+  slab_t *slab = count_mallocTag(sizeof(slab_t), tag);
+  if (slab == NULL) {
+    return NULL;
+  }
+
+  // round the size up to hold a free-list link, and to keep alignment
+  size_t bytes = objectBytes < sizeof(freeobj_t) ? sizeof(freeobj_t) : objectBytes;
+  size_t align = _Alignof(max_align_t);
+  slab->objectBytes = (bytes + align - 1) / align * align;
+  slab->perChunk = perChunk;
+  slab->chunks = NULL;
+  slab->bump = slab->end = NULL;
+  slab->free = NULL;
+  slab->live = 0;
+  slab->tag = tag;
+  return slab;
+}
+
+/**************** slab_alloc ****************/
+/* see slab.h for description */
+void *
+slab_alloc(slab_t *slab)
+{
+  if (slab == NULL) {
+    return NULL;
+  }
+
+  void *object;
+  if (slab->free != NULL) {
+    // reuse the most recently freed object
+    object = slab->free;
+    slab->free = slab->free->next;
+  } else {
+    if (slab->bump == slab->end) {
+      // the chunk is used up; start another
+      size_t bytes = offsetof(chunk_t, align) + slab->objectBytes * slab->perChunk;
+      chunk_t *chunk = count_mallocTag(bytes, slab->tag);
+      if (chunk == NULL) {
+        return NULL;
+      }
+      chunk->prev = slab->chunks;
+      slab->chunks = chunk;
+      slab->bump = (char *) &chunk->align;
+      slab->end = (char *) chunk + bytes;
+    }
+    object = slab->bump;
+    slab->bump += slab->objectBytes;
+  }
+  slab->live++;
+  return object;
+}
+
+/**************** slab_free ****************/
+/* see slab.h for description */
+void
+slab_free(slab_t *slab, void *object)
+{
+  if (slab != NULL && object != NULL) {
+    freeobj_t *freed = object;
+    freed->next = slab->free;
+    slab->free = freed;
+    slab->live--;
+  }
+}
+
+/**************** slab_live ****************/
+/* see slab.h for description */
+int
+slab_live(slab_t *slab)
+{
+  return slab == NULL ? 0 : slab->live;
+}
+
+/**************** slab_delete ****************/
+/* see slab.h for description */
+void
+slab_delete(slab_t *slab)
+{
+  if (slab != NULL) {
+    for (chunk_t *chunk = slab->chunks; chunk != NULL; ) {
+      chunk_t *prev = chunk->prev;
+      count_free(chunk);
+      chunk = prev;
+    }
+    count_free(slab);
+  }
+}
@@ -0,0 +1,69 @@
+/*
+ * slab - pools of fixed-size objects
+ *
+ * A slab hands out objects of one size, carved from chunks that each hold
+ * many of them.  Allocation pops a recycled object from the slab's free
+ * list or, failing that, bumps a pointer through the current chunk; a
+ * freed object goes onto the free list.  Objects of one kind thus sit
+ * together in memory, and deleting the slab releases all of them at once,
+ * with no need to free each.
+ *
+ * Give each kind of object its own slab, created with slab_new (or
+ * slab_newOf, which takes the type); the server keeps one per kind for
+ * the lifetime of a game.  Chunks come from count_malloc, so memory.h's
+ * accounting sees them, and slab_live reports objects not yet freed.
+ *
+ * Nuggets: Bash Boys
+ */
+
+#ifndef __SLAB_H
+#define __SLAB_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "memory.h"
+
+/**************** global types ****************/
+typedef struct slab slab_t;  // opaque to users of the module
+
+/**************** functions ****************/
+
+/**************** slab_new ****************/
+/* Create an empty slab of objects of objectBytes bytes each, allocated
+ * perChunk at a time; its memory is counted under tag (see memory.h).
+ *
+ * We return:
+ *   pointer to a new slab; NULL if error (or if either argument is < 1).
+ * Caller is responsible for:
+ *   later calling slab_delete.
+ */
+slab_t *slab_new(const size_t objectBytes, const int perChunk, memtag_t tag);
+#define slab_newOf(type, perChunk, tag) slab_new(sizeof(type), (perChunk), (tag))
+
+/**************** slab_alloc ****************/
+/* Return a new object from the slab, suitably aligned for any type; its
+ * contents are undefined.
+ * We return NULL if slab is NULL or we are out of memory.
+ */
+void *slab_alloc(slab_t *slab);
+
+/**************** slab_free ****************/
+/* Return an object, got from slab_alloc on the same slab, for reuse.
+ * We ignore a NULL slab or object.
+ */
+void slab_free(slab_t *slab, void *object);
+
+/**************** slab_live ****************/
+/* Return the number of objects allocated from the slab and not freed;
+ * 0 if slab is NULL.
+ */
+int slab_live(slab_t *slab);
+
+/**************** slab_delete ****************/
+/* Delete the slab, releasing every object allocated from it, freed or not.
+ * Pointers to those objects are invalid after this call.
+ * We ignore a NULL slab.
+ */
+void slab_delete(slab_t *slab);
+
+#endif // __SLAB_H
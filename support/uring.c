@@ -0,0 +1,735 @@
+/*
+ * uring - an io_uring-based network backend for the message module
+ *
+ * See uring.h for the interface.  We talk to the kernel directly through
+ * the io_uring_setup/io_uring_enter/io_uring_register system calls, so
+ * there is no dependency on liburing.
+ *
+ * Requires Linux 6.0 or later (multishot recvmsg, provided-buffer rings,
+ * extended getevents arguments); uring_init fails cleanly otherwise.
+ *
+ * Nuggets: Bash Boys
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include "uring.h"
+#include "log.h"
+#include "memory.h"
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#endif
+
+#if defined(__linux__) && defined(IORING_RECV_MULTISHOT) && defined(IORING_FEAT_EXT_ARG)
+
+/**************** file-local constants ****************/
+static const unsigned RingEntries = 256;  // submission queue size
+static const unsigned NumBuffers = 16;    // provided buffers; power of 2
+static const int BufferGroup = 0;         // provided-buffer group id
+
+// user_data tags; send requests carry a pointer to their record instead
+static const uint64_t TagRecv = 1;
+static const uint64_t TagPoll = 2;
+static const uint64_t TagProbe = 3;
+
+/**************** file-local types ****************/
+/* A queued send: the kernel reads msghdr, iovec, address and data
+ * after we return from uring_send, so all of it lives here until the
+ * completion arrives.
+ */
+typedef struct sendrec {
+  struct msghdr msg;
+  struct iovec iov;
+  addr_t to;
+  char data[];
+} sendrec_t;
+
+/**************** file-local global variables ****************/
+/* Like ourSocket in message.c, the ring is a module-wide singleton. */
+static struct {
+  int fd;                       // ring file descriptor; -1 if not in use
+  int sock;                     // socket we receive on
+
+  // submission queue
+  void *sqPtr;  size_t sqSize;
+  unsigned *sqHead, *sqTail, *sqMask, *sqArray, *sqFlags;
+  struct io_uring_sqe *sqes;  size_t sqesSize;
+  unsigned sqEntries;
+  unsigned localTail;           // our copy of the tail, ahead of *sqTail
+  unsigned toSubmit;            // entries not yet passed to io_uring_enter
+
+  // completion queue
+  void *cqPtr;  size_t cqSize;
+  unsigned *cqHead, *cqTail, *cqMask;
+  struct io_uring_cqe *cqes;
+
+  // provided-buffer ring
+  struct io_uring_buf_ring *br;  size_t brSize;
+  char *bufs;  size_t bufSize;
+
+  struct msghdr recvHdr;        // template for the multishot recvmsg
+  bool recvArmed;
+  bool pollArmed;
+  int sendsInFlight;
+  bool sendRefused;             // uring_send refused for lack of room
+} ring = { .fd = -1 };
+
+/**************** file-local functions ****************/
+static int sys_setup(unsigned entries, struct io_uring_params *p);
+static int sys_enter(unsigned toSubmit, unsigned minComplete, unsigned flags,
+                     void *arg, size_t argsz);
+static int sys_register(unsigned opcode, void *arg, unsigned nargs);
+static bool mapRings(struct io_uring_params *p);
+static void unmapRings(void);
+static struct io_uring_sqe *getSqe(void);
+static bool armRecv(void);
+static bool armPoll(void);
+static bool probeRecv(void);
+static void provideBuffer(int bid);
+static int submit(unsigned minComplete, const float timeout);
+static bool reapOne(uring_event_t *ev);
+
+/**************** raw system calls ****************/
+static int
+sys_setup(unsigned entries, struct io_uring_params *p)
+{
+  return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+sys_enter(unsigned toSubmit, unsigned minComplete, unsigned flags,
+          void *arg, size_t argsz)
+{
+  return (int) syscall(__NR_io_uring_enter, ring.fd, toSubmit, minComplete,
+                       flags, arg, argsz);
+}
+
+static int
+sys_register(unsigned opcode, void *arg, unsigned nargs)
+{
+  return (int) syscall(__NR_io_uring_register, ring.fd, opcode, arg, nargs);
+}
+
+/**************** uring_init ****************/
+/* see uring.h for description */
+bool
+uring_init(int sock, int maxBytes, FILE *logFP)
+{
+  log_init(logFP);
+
+  if (ring.fd >= 0) {
+    log_v("uring_init: called again, when already initialized");
+    return false;
+  }
+
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  int fd = sys_setup(RingEntries, &p);
+  if (fd < 0) {
+    log_e("uring_init: io_uring_setup");
+    return false;
+  }
+  ring.fd = fd;
+  ring.sock = sock;
+
+  if (!(p.features & IORING_FEAT_EXT_ARG)) {
+    log_v("uring_init: kernel lacks IORING_FEAT_EXT_ARG");
+    uring_done();
+    return false;
+  }
+  if (!mapRings(&p)) {
+    log_e("uring_init: mapping rings");
+    uring_done();
+    return false;
+  }
+
+  // the kernel writes recvmsg_out + sender address + payload into each
+  // buffer; leave room for the null we add after the payload
+  ring.recvHdr.msg_namelen = sizeof(struct sockaddr_in);
+  ring.recvHdr.msg_controllen = 0;
+  ring.bufSize = sizeof(struct io_uring_recvmsg_out)
+    + sizeof(struct sockaddr_in) + maxBytes + 1;
+
+  // the buffer ring itself must be page-aligned; mmap guarantees that
+  ring.brSize = NumBuffers * sizeof(struct io_uring_buf);
+  ring.br = mmap(NULL, ring.brSize, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  ring.bufs = count_mallocTag(NumBuffers * ring.bufSize, mem_NET);
+  if (ring.br == MAP_FAILED || ring.bufs == NULL) {
+    log_v("uring_init: out of memory for buffers");
+    if (ring.br == MAP_FAILED) {
+      ring.br = NULL;
+    }
+    uring_done();
+    return false;
+  }
+
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (uint64_t)(uintptr_t) ring.br;
+  reg.ring_entries = NumBuffers;
+  reg.bgid = BufferGroup;
+  if (sys_register(IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+    log_e("uring_init: registering provided-buffer ring");
+    uring_done();
+    return false;
+  }
+  ring.br->tail = 0;
+  for (int bid = 0; bid < NumBuffers; bid++) {
+    provideBuffer(bid);
+  }
+
+  // arm the receive; kernels without multishot recvmsg reject it at once
+  if (!armRecv() || !probeRecv()) {
+    log_e("uring_init: multishot recvmsg unsupported");
+    uring_done();
+    return false;
+  }
+
+  log_v("uring_init: io_uring backend ready");
+  return true;
+}
+
+/**************** mapRings ****************/
+/* mmap the submission queue, completion queue and SQE array.
+ */
+static bool
+mapRings(struct io_uring_params *p)
+{
+  ring.sqSize = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+  ring.cqSize = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+  bool single = p->features & IORING_FEAT_SINGLE_MMAP;
+  if (single) {
+    if (ring.cqSize > ring.sqSize) {
+      ring.sqSize = ring.cqSize;
+    }
+    ring.cqSize = ring.sqSize;
+  }
+
+  ring.sqPtr = mmap(NULL, ring.sqSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+  if (ring.sqPtr == MAP_FAILED) {
+    ring.sqPtr = NULL;
+    return false;
+  }
+  if (single) {
+    ring.cqPtr = ring.sqPtr;
+  } else {
+    ring.cqPtr = mmap(NULL, ring.cqSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+    if (ring.cqPtr == MAP_FAILED) {
+      ring.cqPtr = NULL;
+      return false;
+    }
+  }
+  ring.sqesSize = p->sq_entries * sizeof(struct io_uring_sqe);
+  ring.sqes = mmap(NULL, ring.sqesSize, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+  if (ring.sqes == MAP_FAILED) {
+    ring.sqes = NULL;
+    return false;
+  }
+
+  char *sq = ring.sqPtr;
+  ring.sqHead = (unsigned *)(sq + p->sq_off.head);
+  ring.sqTail = (unsigned *)(sq + p->sq_off.tail);
+  ring.sqMask = (unsigned *)(sq + p->sq_off.ring_mask);
+  ring.sqFlags = (unsigned *)(sq + p->sq_off.flags);
+  ring.sqArray = (unsigned *)(sq + p->sq_off.array);
+  ring.sqEntries = p->sq_entries;
+  ring.localTail = *ring.sqTail;
+
+  char *cq = ring.cqPtr;
+  ring.cqHead = (unsigned *)(cq + p->cq_off.head);
+  ring.cqTail = (unsigned *)(cq + p->cq_off.tail);
+  ring.cqMask = (unsigned *)(cq + p->cq_off.ring_mask);
+  ring.cqes = (struct io_uring_cqe *)(cq + p->cq_off.cqes);
+  return true;
+}
+
+/**************** unmapRings ****************/
+static void
+unmapRings(void)
+{
+  if (ring.sqes != NULL) {
+    munmap(ring.sqes, ring.sqesSize);
+  }
+  if (ring.cqPtr != NULL && ring.cqPtr != ring.sqPtr) {
+    munmap(ring.cqPtr, ring.cqSize);
+  }
+  if (ring.sqPtr != NULL) {
+    munmap(ring.sqPtr, ring.sqSize);
+  }
+  ring.sqes = NULL;
+  ring.cqPtr = NULL;
+  ring.sqPtr = NULL;
+}
+
+/**************** getSqe ****************/
+/* Return the next free submission entry, zeroed; if the queue is full,
+ * submit what we have first.  Returns NULL if the queue stays full.
+ */
+static struct io_uring_sqe *
+getSqe(void)
+{
+  unsigned head = __atomic_load_n(ring.sqHead, __ATOMIC_ACQUIRE);
+  if (ring.localTail - head >= ring.sqEntries) {
+    submit(0, 0);
+    head = __atomic_load_n(ring.sqHead, __ATOMIC_ACQUIRE);
+    if (ring.localTail - head >= ring.sqEntries) {
+      return NULL;
+    }
+  }
+  unsigned idx = ring.localTail & *ring.sqMask;
+  struct io_uring_sqe *sqe = &ring.sqes[idx];
+  memset(sqe, 0, sizeof(*sqe));
+  ring.sqArray[idx] = idx;
+  ring.localTail++;
+  ring.toSubmit++;
+  return sqe;
+}
+
+/**************** armRecv ****************/
+/* Queue the multishot recvmsg; it stays live until it runs out of buffers.
+ */
+static bool
+armRecv(void)
+{
+  struct io_uring_sqe *sqe = getSqe();
+  if (sqe == NULL) {
+    return false;
+  }
+  sqe->opcode = IORING_OP_RECVMSG;
+  sqe->fd = ring.sock;
+  sqe->addr = (uint64_t)(uintptr_t) &ring.recvHdr;
+  sqe->len = 1;
+  sqe->msg_flags = MSG_TRUNC;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = BufferGroup;
+  sqe->user_data = TagRecv;
+  ring.recvArmed = true;
+  return true;
+}
+
+/**************** probeRecv ****************/
+/* Submit the armed receive with a no-op behind it, and wait for the
+ * no-op.  Entries are started in order, so by the time the no-op has
+ * completed, a kernel that rejects multishot recvmsg has posted that
+ * error.  Completions are looked at but left for reapOne.
+ * Returns false, with errno set, if the receive was rejected or the
+ * no-op never completed.
+ */
+static bool
+probeRecv(void)
+{
+  struct io_uring_sqe *sqe = getSqe();
+  if (sqe == NULL) {
+    errno = EBUSY;
+    return false;
+  }
+  sqe->opcode = IORING_OP_NOP;
+  sqe->user_data = TagProbe;
+  if (submit(1, 1.0) < 0) {
+    return false;
+  }
+
+  bool probed = false;
+  unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+  for (unsigned head = *ring.cqHead; head != tail; head++) {
+    struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cqMask];
+    if (cqe->user_data == TagRecv && cqe->res < 0) {
+      errno = -cqe->res;
+      return false;
+    }
+    if (cqe->user_data == TagProbe) {
+      probed = true;
+    }
+  }
+  if (!probed) {
+    errno = ETIME;
+  }
+  return probed;
+}
+
+/**************** armPoll ****************/
+/* Queue a one-shot poll for input on stdin.
+ */
+static bool
+armPoll(void)
+{
+  struct io_uring_sqe *sqe = getSqe();
+  if (sqe == NULL) {
+    return false;
+  }
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = 0;
+  sqe->poll32_events = POLLIN;
+  sqe->user_data = TagPoll;
+  ring.pollArmed = true;
+  return true;
+}
+
+/**************** provideBuffer ****************/
+/* Hand buffer 'bid' (back) to the kernel.
+ */
+static void
+provideBuffer(int bid)
+{
+  unsigned short tail = ring.br->tail;
+  struct io_uring_buf *buf = &ring.br->bufs[tail & (NumBuffers - 1)];
+  buf->addr = (uint64_t)(uintptr_t)(ring.bufs + bid * ring.bufSize);
+  buf->len = ring.bufSize - 1;    // keep a byte for the terminating null
+  buf->bid = bid;
+  __atomic_store_n(&ring.br->tail, (unsigned short)(tail + 1),
+                   __ATOMIC_RELEASE);
+}
+
+/**************** submit ****************/
+/* Publish queued entries and enter the kernel, optionally waiting for
+ * 'minComplete' completions or until 'timeout' seconds pass.
+ * Returns the io_uring_enter result; errno is set on failure, and is
+ * ETIME if the timeout passed first.
+ */
+static int
+submit(unsigned minComplete, const float timeout)
+{
+  __atomic_store_n(ring.sqTail, ring.localTail, __ATOMIC_RELEASE);
+
+  unsigned flags = 0;
+  bool overflow = __atomic_load_n(ring.sqFlags, __ATOMIC_ACQUIRE)
+    & IORING_SQ_CQ_OVERFLOW;
+  if (minComplete > 0 || overflow) {
+    flags |= IORING_ENTER_GETEVENTS;
+  }
+  if (ring.toSubmit == 0 && flags == 0) {
+    return 0;
+  }
+
+  struct __kernel_timespec ts;
+  struct io_uring_getevents_arg arg;
+  memset(&arg, 0, sizeof(arg));
+  void *argp = NULL;
+  size_t argsz = 0;
+  if (minComplete > 0 && timeout > 0.0) {
+    ts.tv_sec = (long long) timeout;
+    ts.tv_nsec = (long long)((timeout - (long long) timeout) * 1e9);
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = (uint64_t)(uintptr_t) &ts;
+    argp = &arg;
+    argsz = sizeof(arg);
+    flags |= IORING_ENTER_EXT_ARG;
+  }
+
+  int ret = sys_enter(ring.toSubmit, minComplete, flags, argp, argsz);
+  if (ret >= 0) {
+    ring.toSubmit -= (ret < ring.toSubmit) ? ret : ring.toSubmit;
+  } else if (errno == ETIME) {
+    // timed out waiting; the submission itself went through
+    ring.toSubmit = 0;
+  }
+  return ret;
+}
+
+/**************** uring_send ****************/
+/* see uring.h for description */
+bool
+uring_send(const addr_t to, const char *buf, const size_t len)
+{
+  if (ring.fd < 0) {
+    errno = EBADF;
+    return false;
+  }
+  if (ring.sendsInFlight >= uring_MaxSendsInFlight) {
+    ring.sendRefused = true;
+    errno = EAGAIN;
+    return false;
+  }
+  sendrec_t *rec = count_mallocTag(sizeof(sendrec_t) + len, mem_NET);
+  if (rec == NULL) {
+    errno = ENOMEM;
+    return false;
+  }
+  struct io_uring_sqe *sqe = getSqe();
+  if (sqe == NULL) {
+    // the queue is full of sends; one completing makes room, as above
+    count_free(rec);
+    if (ring.sendsInFlight > 0) {
+      ring.sendRefused = true;
+      errno = EAGAIN;
+    } else {
+      errno = EBUSY;
+    }
+    return false;
+  }
+
+  memcpy(rec->data, buf, len);
+  rec->to = to;
+  rec->iov.iov_base = rec->data;
+  rec->iov.iov_len = len;
+  memset(&rec->msg, 0, sizeof(rec->msg));
+  rec->msg.msg_name = &rec->to;
+  rec->msg.msg_namelen = sizeof(rec->to);
+  rec->msg.msg_iov = &rec->iov;
+  rec->msg.msg_iovlen = 1;
+
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = ring.sock;
+  sqe->addr = (uint64_t)(uintptr_t) &rec->msg;
+  sqe->len = 1;
+  sqe->user_data = (uint64_t)(uintptr_t) rec;
+  ring.sendsInFlight++;
+  return true;
+}
+
+/**************** uring_flush ****************/
+/* see uring.h for description */
+void
+uring_flush(void)
+{
+  if (ring.fd >= 0 && ring.toSubmit > 0 && submit(0, 0) < 0) {
+    log_e("uring_flush: io_uring_enter");
+  }
+}
+
+/**************** reapOne ****************/
+/* Consume one completion, if any.  Internal completions (sends, receive
+ * errors and re-arms) are handled here; returns true only when 'ev' has
+ * been filled with an event for the caller.  Sets ev->type to
+ * uring_TIMEOUT when the completion queue is empty.
+ */
+static bool
+reapOne(uring_event_t *ev)
+{
+  ev->type = uring_TIMEOUT;
+  unsigned head = *ring.cqHead;
+  if (head == __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE)) {
+    return false;
+  }
+  struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cqMask];
+  uint64_t tag = cqe->user_data;
+  int res = cqe->res;
+  unsigned flags = cqe->flags;
+  __atomic_store_n(ring.cqHead, head + 1, __ATOMIC_RELEASE);
+
+  if (tag == TagProbe) {
+    return false;               // uring_init has seen it already
+  }
+
+  if (tag == TagPoll) {
+    ring.pollArmed = false;
+    if (res < 0) {
+      errno = -res;
+      log_e("uring: polling stdin");
+      return false;
+    }
+    ev->type = uring_INPUT;
+    return true;
+  }
+
+  if (tag == TagRecv) {
+    if (!(flags & IORING_CQE_F_MORE)) {
+      ring.recvArmed = false;   // multishot ended; re-armed by uring_next
+    }
+    if (res < 0) {
+      if (res != -ENOBUFS) {
+        errno = -res;
+        log_e("uring: receiving from socket");
+      }
+      return false;
+    }
+    if (!(flags & IORING_CQE_F_BUFFER)) {
+      return false;
+    }
+    int bid = flags >> IORING_CQE_BUFFER_SHIFT;
+    char *buf = ring.bufs + bid * ring.bufSize;
+    struct io_uring_recvmsg_out *out = (struct io_uring_recvmsg_out *) buf;
+    char *name = buf + sizeof(*out);
+    char *payload = name + ring.recvHdr.msg_namelen
+      + ring.recvHdr.msg_controllen;
+    size_t room = buf + res - payload;
+    if (out->flags & MSG_TRUNC || out->payloadlen > room) {
+      log_d("uring: dropped truncated datagram of %d bytes",
+            (int) out->payloadlen);
+      provideBuffer(bid);
+      return false;
+    }
+    memset(&ev->from, 0, sizeof(ev->from));
+    if (out->namelen >= sizeof(struct sockaddr_in)) {
+      memcpy(&ev->from, name, sizeof(struct sockaddr_in));
+    }
+    payload[out->payloadlen] = '\0';
+    ev->type = uring_MESSAGE;
+    ev->data = payload;
+    ev->len = out->payloadlen;
+    ev->bid = bid;
+    return true;
+  }
+
+  // anything else is a send completing
+  sendrec_t *rec = (sendrec_t *)(uintptr_t) tag;
+  if (res < 0) {
+    errno = -res;
+    log_e("message_send: error sending to datagram socket");
+  }
+  count_free(rec);
+  ring.sendsInFlight--;
+  if (ring.sendRefused) {
+    // there is room again for the sender that was turned away
+    ring.sendRefused = false;
+    ev->type = uring_SENT;
+    return true;
+  }
+  return false;
+}
+
+/**************** uring_next ****************/
+/* see uring.h for description */
+uring_evtype_t
+uring_next(uring_event_t *ev, const bool wantInput, const float timeout)
+{
+  if (ring.fd < 0) {
+    return ev->type = uring_ERROR;
+  }
+
+  // the timeout runs from here, however many internal completions
+  // (sends, re-arms) wake us before it passes
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += (time_t) timeout;
+  deadline.tv_nsec += (long)((timeout - (long) timeout) * 1e9);
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+
+  bool timedOut = false;
+  while (true) {
+    // drain whatever has already completed
+    while (*ring.cqHead != __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE)) {
+      if (reapOne(ev)) {
+        return ev->type;
+      }
+    }
+    if (timedOut) {
+      return ev->type = uring_TIMEOUT;
+    }
+
+    if (!ring.recvArmed && !armRecv()) {
+      log_v("uring_next: cannot re-arm receive");
+      return ev->type = uring_ERROR;
+    }
+    if (wantInput && !ring.pollArmed && !armPoll()) {
+      log_v("uring_next: cannot arm stdin poll");
+      return ev->type = uring_ERROR;
+    }
+
+    float remaining = 0;
+    if (timeout > 0) {
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      remaining = (deadline.tv_sec - now.tv_sec)
+        + (deadline.tv_nsec - now.tv_nsec) / 1e9;
+      if (remaining <= 0) {
+        uring_flush();          // the sends still go out
+        return ev->type = uring_TIMEOUT;
+      }
+    }
+
+    // one system call submits every queued send and waits for events
+    if (submit(1, remaining) < 0) {
+      if (errno == ETIME) {
+        timedOut = true;
+      } else if (errno == EINTR) {
+        return ev->type = uring_INTR;
+      } else {
+        log_e("uring_next: io_uring_enter");
+        return ev->type = uring_ERROR;
+      }
+    }
+  }
+}
+
+/**************** uring_release ****************/
+/* see uring.h for description */
+void
+uring_release(uring_event_t *ev)
+{
+  if (ring.fd >= 0 && ev != NULL && ev->type == uring_MESSAGE) {
+    provideBuffer(ev->bid);
+    ev->data = NULL;
+  }
+}
+
+/**************** uring_done ****************/
+/* see uring.h for description */
+void
+uring_done(void)
+{
+  if (ring.fd < 0) {
+    return;
+  }
+
+  // give queued sends a moment to leave; anything left is abandoned
+  if (ring.sqPtr != NULL && ring.cqPtr != NULL) {
+    uring_event_t ev;
+    for (int tries = 0; ring.sendsInFlight > 0 && tries < 10; tries++) {
+      if (submit(1, 0.01) < 0 && errno != ETIME) {
+        break;
+      }
+      while (*ring.cqHead != __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE)) {
+        if (reapOne(&ev) && ev.type == uring_MESSAGE) {
+          provideBuffer(ev.bid);
+        }
+      }
+    }
+  }
+
+  close(ring.fd);   // the kernel cancels the multishot receive and poll
+  unmapRings();
+  if (ring.br != NULL) {
+    munmap(ring.br, ring.brSize);
+  }
+  count_free(ring.bufs);
+  // send records still in flight were owned by the kernel; they leak
+  // only in the pathological case that sends never completed
+  memset(&ring, 0, sizeof(ring));
+  ring.fd = -1;
+}
+
+#else // no io_uring support at compile time
+
+bool uring_init(int sock, int maxBytes, FILE *logFP)
+{
+  log_init(logFP);
+  log_v("uring_init: built without io_uring support");
+  return false;
+}
+bool uring_send(const addr_t to, const char *buf, const size_t len)
+{
+  errno = ENOSYS;
+  return false;
+}
+void uring_flush(void) { }
+uring_evtype_t uring_next(uring_event_t *ev, const bool wantInput,
+                          const float timeout)
+{
+  return ev->type = uring_ERROR;
+}
+void uring_release(uring_event_t *ev) { }
+void uring_done(void) { }
+
+#endif
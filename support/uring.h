@@ -0,0 +1,106 @@
+/*
+ * uring - an io_uring-based network backend for the message module
+ *
+ * This module is used only by message.c; module users select it with
+ * message_setBackend(message_URING) before calling message_init().
+ *
+ * Datagrams are received with a single multishot recvmsg request that
+ * draws its buffers from a provided-buffer ring, so the kernel delivers
+ * a stream of completions without a system call per packet.  Sends are
+ * queued as sendmsg requests and submitted in a batch when the message
+ * loop next waits for input (or when the submission queue fills).
+ *
+ * uring_init() returns false if the running kernel lacks any of the
+ * features we need; the message module then falls back to select().
+ *
+ * Nuggets: Bash Boys
+ */
+
+#ifndef __URING_H
+#define __URING_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "message.h"
+
+/**************** constants ****************/
+// Sends submitted but not yet completed; beyond this, uring_send refuses
+// and the message module holds datagrams in its own send queues.
+static const int uring_MaxSendsInFlight = 128;
+
+/**************** global types ****************/
+typedef enum {
+  uring_TIMEOUT,      // the timeout passed without any event
+  uring_INPUT,        // stdin has input ready
+  uring_MESSAGE,      // a datagram arrived; see from/data/len
+  uring_SENT,         // a send completed after uring_send refused one
+  uring_INTR,         // the wait was interrupted by a signal
+  uring_ERROR,        // fatal error; the ring is no longer usable
+} uring_evtype_t;
+
+typedef struct uring_event {
+  uring_evtype_t type;
+  addr_t from;        // sender of the datagram (uring_MESSAGE only)
+  char *data;         // null-terminated payload (uring_MESSAGE only)
+  int len;            // payload length, excluding the null
+  int bid;            // provided-buffer id; see uring_release
+} uring_event_t;
+
+/**************** functions ****************/
+
+/**************** uring_init ****************/
+/* Set up a ring serving the given (bound) datagram socket.
+ * Caller provides:
+ *   the socket, the maximum datagram payload, and a log file (may be NULL).
+ * We return:
+ *   true if the ring is ready and the multishot receive is armed;
+ *   false if io_uring or a required feature is unavailable; nothing
+ *   is left allocated in that case.
+ */
+bool uring_init(int sock, int maxBytes, FILE *logFP);
+
+/**************** uring_send ****************/
+/* Queue a datagram of 'len' bytes for 'to'; the bytes are copied.
+ * The request is submitted at the next uring_flush or uring_next.
+ * We return false, with errno set, if the request could not be queued.
+ * If that is only because earlier sends have not completed (there are
+ * uring_MaxSendsInFlight of them, or the submission queue is full),
+ * errno is EAGAIN and uring_next reports uring_SENT once one completes.
+ * A send that fails in the kernel is logged when its completion arrives,
+ * with errno set from the completion's result.
+ */
+bool uring_send(const addr_t to, const char *buf, const size_t len);
+
+/**************** uring_flush ****************/
+/* Submit every queued request to the kernel in one system call.
+ */
+void uring_flush(void);
+
+/**************** uring_next ****************/
+/* Submit queued requests and wait for the next event.
+ * Caller provides:
+ *   an event to fill in,
+ *   whether stdin should be watched,
+ *   a timeout in seconds (ignored if <= 0), counted from the call;
+ *   completions handled internally do not restart it.
+ * We return:
+ *   the event type, also stored in ev->type.
+ * Caller is responsible for:
+ *   calling uring_release on every uring_MESSAGE event, once the
+ *   payload is no longer needed.
+ */
+uring_evtype_t uring_next(uring_event_t *ev, const bool wantInput,
+                          const float timeout);
+
+/**************** uring_release ****************/
+/* Return the buffer behind a uring_MESSAGE event to the kernel.
+ */
+void uring_release(uring_event_t *ev);
+
+/**************** uring_done ****************/
+/* Submit outstanding sends, wait briefly for them, and tear down the ring.
+ */
+void uring_done(void);
+
+#endif // __URING_H
@@ -0,0 +1,712 @@
+/*
+ * wire - codec for the compact binary Nuggets protocol
+ *
+ * See wire.h for the frame layout and interface.
+ *
+ * Compile with -DUNIT_TEST for a standalone unit test; see below.
+ *
+ * Nuggets: Bash Boys
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "wire.h"
+
+/**************** file-local constants ****************/
+static const int OverlayCode = 7;       // cell code meaning "see overlay"
+static const char CodeChars[] = " .-|+#*";  // characters for codes 0-6
+enum { OpLiteral, OpRun, OpAbove, OpBack };  // ZDISPLAY token ops
+static const size_t MinMatch = 3;       // shortest run or copy worth a token
+#define ZHashBits 10                    // size of the back-reference table
+
+/**************** file-local types ****************/
+/* Where the ZDISPLAY encoder writes: bytes past cap are counted, not stored */
+typedef struct sink {
+  unsigned char *buf;
+  size_t cap;
+  size_t pos;
+} sink_t;
+
+/**************** file-local functions ****************/
+static int cellCode(const char c);
+static void putHeader(unsigned char *buf, wire_type_t type, size_t payload);
+static size_t varintBytes(unsigned long v);
+static size_t encodeInts(unsigned char *buf, size_t cap, wire_type_t type,
+                         const unsigned long *vals, int nvals);
+static void sinkVarint(sink_t *out, unsigned long v);
+static void sinkBytes(sink_t *out, const char *bytes, size_t n);
+static void flushLiterals(sink_t *out, const char *start, const char *end);
+static size_t matchLength(const char *a, const char *b, const char *end);
+static bool unpackZ(const wire_msg_t *msg, char *out, size_t n);
+
+/**************** cellCode ****************/
+/* Return the 3-bit code for a grid character. */
+static int
+cellCode(const char c)
+{
+  // one more than each code, so that every other character maps to 0
+  static const unsigned char CodePlusOne[256] = {
+    [' '] = 1, ['.'] = 2, ['-'] = 3, ['|'] = 4, ['+'] = 5, ['#'] = 6, ['*'] = 7,
+  };
+  int code = CodePlusOne[(unsigned char) c];
+  return code == 0 ? OverlayCode : code - 1;
+}
+
+/**************** putHeader ****************/
+static void
+putHeader(unsigned char *buf, wire_type_t type, size_t payload)
+{
+  buf[0] = 0;
+  buf[1] = 'B';
+  buf[2] = wire_Version;
+  buf[3] = type;
+  buf[4] = payload >> 24;
+  buf[5] = payload >> 16;
+  buf[6] = payload >> 8;
+  buf[7] = payload;
+}
+
+/**************** wire_putVarint ****************/
+/* see wire.h for description */
+size_t
+wire_putVarint(unsigned char *buf, unsigned long v)
+{
+  size_t n = 0;
+  while (v >= 0x80) {
+    buf[n++] = (v & 0x7f) | 0x80;
+    v >>= 7;
+  }
+  buf[n++] = v;
+  return n;
+}
+
+/**************** wire_getVarint ****************/
+/* see wire.h for description */
+size_t
+wire_getVarint(const unsigned char *buf, size_t len, unsigned long *v)
+{
+  unsigned long result = 0;
+  for (size_t n = 0; n < len && n < 10; n++) {
+    result |= (unsigned long)(buf[n] & 0x7f) << (7 * n);
+    if ((buf[n] & 0x80) == 0) {
+      *v = result;
+      return n + 1;
+    }
+  }
+  return 0;
+}
+
+/**************** varintBytes ****************/
+/* Return the number of bytes wire_putVarint would write for v. */
+static size_t
+varintBytes(unsigned long v)
+{
+  size_t n = 1;
+  while (v >= 0x80) {
+    v >>= 7;
+    n++;
+  }
+  return n;
+}
+
+/**************** encodeInts ****************/
+/* Encode a frame whose payload is just a list of varints. */
+static size_t
+encodeInts(unsigned char *buf, size_t cap, wire_type_t type,
+           const unsigned long *vals, int nvals)
+{
+  size_t payload = 0;
+  for (int i = 0; i < nvals; i++) {
+    payload += varintBytes(vals[i]);
+  }
+  size_t need = wire_HeaderBytes + payload;
+  if (buf != NULL && need <= cap) {
+    putHeader(buf, type, payload);
+    unsigned char *p = buf + wire_HeaderBytes;
+    for (int i = 0; i < nvals; i++) {
+      p += wire_putVarint(p, vals[i]);
+    }
+  }
+  return need;
+}
+
+/**************** wire_encodeOk ****************/
+/* see wire.h for description */
+size_t
+wire_encodeOk(unsigned char *buf, size_t cap, char letter)
+{
+  size_t need = wire_HeaderBytes + 1;
+  if (buf != NULL && need <= cap) {
+    putHeader(buf, wire_OK, 1);
+    buf[wire_HeaderBytes] = letter;
+  }
+  return need;
+}
+
+/**************** wire_encodeGrid ****************/
+/* see wire.h for description */
+size_t
+wire_encodeGrid(unsigned char *buf, size_t cap, int nrows, int ncols)
+{
+  unsigned long vals[2] = { nrows, ncols };
+  return encodeInts(buf, cap, wire_GRID, vals, 2);
+}
+
+/**************** wire_encodeView ****************/
+/* see wire.h for description */
+size_t
+wire_encodeView(unsigned char *buf, size_t cap, int nrows, int ncols)
+{
+  unsigned long vals[2] = { nrows, ncols };
+  return encodeInts(buf, cap, wire_VIEW, vals, 2);
+}
+
+/**************** wire_encodeGold ****************/
+/* see wire.h for description */
+size_t
+wire_encodeGold(unsigned char *buf, size_t cap, int n, int p, int r)
+{
+  unsigned long vals[3] = { n, p, r };
+  return encodeInts(buf, cap, wire_GOLD, vals, 3);
+}
+
+/**************** wire_encodeQuit ****************/
+/* see wire.h for description */
+size_t
+wire_encodeQuit(unsigned char *buf, size_t cap, const char *explanation)
+{
+  size_t len = strlen(explanation);
+  size_t need = wire_HeaderBytes + len;
+  if (buf != NULL && need <= cap) {
+    putHeader(buf, wire_QUIT, len);
+    memcpy(buf + wire_HeaderBytes, explanation, len);
+  }
+  return need;
+}
+
+/**************** wire_encodeDisplay ****************/
+/* see wire.h for description */
+size_t
+wire_encodeDisplay(unsigned char *buf, size_t cap, const char *grid,
+                   int nrows, int ncols)
+{
+  size_t ncells = (size_t) nrows * ncols;
+  size_t packed = (3 * ncells + 7) / 8;
+
+  // first pass: size the overlay
+  size_t noverlay = 0;
+  size_t overlayBytes = 0;
+  size_t last = 0;
+  for (int row = 0; row < nrows; row++) {
+    const char *line = grid + (size_t) row * (ncols + 1);
+    for (int col = 0; col < ncols; col++) {
+      if (cellCode(line[col]) == OverlayCode) {
+        size_t i = (size_t) row * ncols + col;
+        overlayBytes += varintBytes(i - last) + 1;
+        last = i;
+        noverlay++;
+      }
+    }
+  }
+
+  size_t payload = varintBytes(nrows) + varintBytes(ncols) + packed
+    + varintBytes(noverlay) + overlayBytes;
+  size_t need = wire_HeaderBytes + payload;
+  if (buf == NULL || need > cap) {
+    return need;
+  }
+
+  // second pass: pack the cells, 3 bits each, most significant first
+  putHeader(buf, wire_DISPLAY, payload);
+  unsigned char *p = buf + wire_HeaderBytes;
+  p += wire_putVarint(p, nrows);
+  p += wire_putVarint(p, ncols);
+  unsigned long acc = 0;    // bits not yet written
+  int nbits = 0;            // number of bits in acc
+  for (int row = 0; row < nrows; row++) {
+    const char *line = grid + (size_t) row * (ncols + 1);
+    for (int col = 0; col < ncols; col++) {
+      acc = (acc << 3) | cellCode(line[col]);
+      nbits += 3;
+      if (nbits >= 8) {
+        nbits -= 8;
+        *p++ = acc >> nbits;
+      }
+    }
+  }
+  if (nbits > 0) {
+    *p++ = acc << (8 - nbits);
+  }
+
+  // then the overlay
+  p += wire_putVarint(p, noverlay);
+  last = 0;
+  for (int row = 0; row < nrows; row++) {
+    const char *line = grid + (size_t) row * (ncols + 1);
+    for (int col = 0; col < ncols; col++) {
+      if (cellCode(line[col]) == OverlayCode) {
+        size_t i = (size_t) row * ncols + col;
+        p += wire_putVarint(p, i - last);
+        *p++ = line[col];
+        last = i;
+      }
+    }
+  }
+  return need;
+}
+
+/**************** wire_zDisplayBound ****************/
+/* see wire.h for description */
+size_t
+wire_zDisplayBound(int nrows, int ncols)
+{
+  // at worst every byte is a literal; each literal token is followed by a
+  // match of at least MinMatch bytes, which never costs more than it covers
+  size_t n = (size_t) nrows * (ncols + 1);
+  return wire_HeaderBytes + 20 + n + n / MinMatch + 10;
+}
+
+/**************** sinkVarint / sinkBytes ****************/
+static void
+sinkVarint(sink_t *out, unsigned long v)
+{
+  unsigned char tmp[10];
+  sinkBytes(out, (char *) tmp, wire_putVarint(tmp, v));
+}
+
+static void
+sinkBytes(sink_t *out, const char *bytes, size_t n)
+{
+  if (out->buf != NULL && out->pos + n <= out->cap) {
+    memcpy(out->buf + out->pos, bytes, n);
+  }
+  out->pos += n;
+}
+
+/**************** flushLiterals ****************/
+/* Emit the bytes from start up to end, if any, as one literal token. */
+static void
+flushLiterals(sink_t *out, const char *start, const char *end)
+{
+  if (end > start) {
+    sinkVarint(out, (unsigned long)(end - start) << 2 | OpLiteral);
+    sinkBytes(out, start, end - start);
+  }
+}
+
+/**************** matchLength ****************/
+/* Return how many bytes from a match those from b, stopping at end. */
+static size_t
+matchLength(const char *a, const char *b, const char *end)
+{
+  const char *start = b;
+  while (b < end && *a == *b) {
+    a++;
+    b++;
+  }
+  return b - start;
+}
+
+/**************** wire_encodeZDisplay ****************/
+/* see wire.h for description
+ * A greedy single pass: at each byte we measure a run, a copy from the
+ * row above, and a copy from the last place the next four bytes were
+ * seen, and take whichever saves the most.
+ */
+size_t
+wire_encodeZDisplay(unsigned char *buf, size_t cap, const char *grid,
+                    int nrows, int ncols)
+{
+  sink_t out = { buf, cap, wire_HeaderBytes };
+  sinkVarint(&out, nrows);
+  sinkVarint(&out, ncols);
+
+  const size_t stride = ncols + 1;
+  const char *end = grid + (size_t) nrows * stride;
+  const char *lit = grid;       // first byte not yet emitted
+  int last[1 << ZHashBits];     // offset where each 4-byte hash was seen
+  memset(last, -1, sizeof(last));
+
+  for (const char *p = grid; p < end; ) {
+    size_t run = matchLength(p, p + 1, end) + 1;
+    size_t above = p - grid >= stride ? matchLength(p - stride, p, end) : 0;
+    size_t back = 0, dist = 0;
+    if (end - p >= 4) {
+      unsigned long h = ((unsigned char) p[0] | (unsigned char) p[1] << 8
+                         | (unsigned char) p[2] << 16
+                         | (unsigned long)(unsigned char) p[3] << 24);
+      h = (h * 2654435761UL) >> (32 - ZHashBits) & ((1 << ZHashBits) - 1);
+      if (last[h] >= 0) {
+        dist = (p - grid) - last[h];
+        back = matchLength(grid + last[h], p, end);
+      }
+      last[h] = p - grid;
+    }
+
+    // weigh each by bytes saved against a literal
+    long saveRun = (long) run - 1 - (long) varintBytes(run << 2);
+    long saveAbove = (long) above - (long) varintBytes(above << 2);
+    long saveBack = (long) back - (long) varintBytes(back << 2)
+      - (long) varintBytes(dist);
+    if (run >= MinMatch && saveRun >= saveAbove && saveRun >= saveBack
+        && saveRun > 0) {
+      flushLiterals(&out, lit, p);
+      sinkVarint(&out, (unsigned long) run << 2 | OpRun);
+      sinkBytes(&out, p, 1);
+      p += run;
+      lit = p;
+    } else if (above >= MinMatch && saveAbove >= saveBack && saveAbove > 0) {
+      flushLiterals(&out, lit, p);
+      sinkVarint(&out, (unsigned long) above << 2 | OpAbove);
+      p += above;
+      lit = p;
+    } else if (back >= MinMatch && saveBack > 0) {
+      flushLiterals(&out, lit, p);
+      sinkVarint(&out, (unsigned long) back << 2 | OpBack);
+      sinkVarint(&out, dist);
+      p += back;
+      lit = p;
+    } else {
+      p++;
+    }
+  }
+  flushLiterals(&out, lit, end);
+
+  if (buf != NULL && out.pos <= cap) {
+    putHeader(buf, wire_ZDISPLAY, out.pos - wire_HeaderBytes);
+  }
+  return out.pos;
+}
+
+/**************** wire_isFrame ****************/
+/* see wire.h for description */
+bool
+wire_isFrame(const char *message)
+{
+  return message != NULL && message[0] == '\0' && message[1] == 'B';
+}
+
+/**************** wire_frameBytes ****************/
+/* see wire.h for description */
+size_t
+wire_frameBytes(const unsigned char *buf)
+{
+  return wire_HeaderBytes + ((size_t) buf[4] << 24 | (size_t) buf[5] << 16
+                             | (size_t) buf[6] << 8 | buf[7]);
+}
+
+/**************** wire_decode ****************/
+/* see wire.h for description */
+bool
+wire_decode(const unsigned char *buf, size_t len, wire_msg_t *msg)
+{
+  if (buf == NULL || msg == NULL || len < wire_HeaderBytes
+      || buf[0] != 0 || buf[1] != 'B' || buf[2] != wire_Version
+      || wire_frameBytes(buf) > len) {
+    return false;
+  }
+  memset(msg, 0, sizeof(*msg));
+  msg->type = buf[3];
+  const unsigned char *p = buf + wire_HeaderBytes;
+  size_t left = wire_frameBytes(buf) - wire_HeaderBytes;
+
+  unsigned long v[3];
+  int want = 0;
+  switch (msg->type) {
+  case wire_OK:
+    if (left != 1) {
+      return false;
+    }
+    msg->letter = p[0];
+    return true;
+  case wire_QUIT:
+    msg->text = (const char *) p;
+    msg->textLen = left;
+    return true;
+  case wire_GRID:
+  case wire_VIEW:
+  case wire_DISPLAY:
+  case wire_ZDISPLAY:
+    want = 2;
+    break;
+  case wire_GOLD:
+    want = 3;
+    break;
+  default:
+    return false;
+  }
+
+  for (int i = 0; i < want; i++) {
+    size_t n = wire_getVarint(p, left, &v[i]);
+    if (n == 0) {
+      return false;
+    }
+    p += n;
+    left -= n;
+  }
+  if (msg->type == wire_GOLD) {
+    msg->n = v[0];
+    msg->p = v[1];
+    msg->r = v[2];
+    return left == 0;
+  }
+  msg->nrows = v[0];
+  msg->ncols = v[1];
+  if (msg->type == wire_DISPLAY || msg->type == wire_ZDISPLAY) {
+    msg->cells = p;
+    msg->cellsLen = left;
+    return true;
+  }
+  return left == 0;
+}
+
+/**************** wire_decodeDisplay ****************/
+/* see wire.h for description */
+bool
+wire_decodeDisplay(const wire_msg_t *msg, char *out, size_t cap)
+{
+  if (msg == NULL || out == NULL || msg->nrows < 0 || msg->ncols < 0
+      || cap < (size_t) msg->nrows * (msg->ncols + 1) + 1) {
+    return false;
+  }
+  if (msg->type == wire_ZDISPLAY) {
+    return unpackZ(msg, out, (size_t) msg->nrows * (msg->ncols + 1));
+  }
+  if (msg->type != wire_DISPLAY) {
+    return false;
+  }
+  int nrows = msg->nrows;
+  int ncols = msg->ncols;
+  size_t ncells = (size_t) nrows * ncols;
+  size_t packed = (3 * ncells + 7) / 8;
+  if (msg->cellsLen < packed) {
+    return false;
+  }
+
+  // unpack the cells, leaving overlay cells to be filled below
+  const unsigned char *p = msg->cells;
+  unsigned long acc = 0;
+  int nbits = 0;
+  char *o = out;
+  for (int row = 0; row < nrows; row++) {
+    for (int col = 0; col < ncols; col++) {
+      if (nbits < 3) {
+        acc = (acc << 8) | *p++;
+        nbits += 8;
+      }
+      nbits -= 3;
+      int code = (acc >> nbits) & 7;
+      *o++ = code == OverlayCode ? '?' : CodeChars[code];
+    }
+    *o++ = '\n';
+  }
+  *o = '\0';
+
+  // apply the overlay
+  p = msg->cells + packed;
+  size_t left = msg->cellsLen - packed;
+  unsigned long noverlay, gap;
+  size_t n = wire_getVarint(p, left, &noverlay);
+  if (n == 0) {
+    return false;
+  }
+  p += n;
+  left -= n;
+  size_t i = 0;
+  for (unsigned long k = 0; k < noverlay; k++) {
+    if ((n = wire_getVarint(p, left, &gap)) == 0 || left < n + 1) {
+      return false;
+    }
+    i += gap;
+    if (i >= ncells) {
+      return false;
+    }
+    out[(i / ncols) * (ncols + 1) + i % ncols] = p[n];
+    p += n + 1;
+    left -= n + 1;
+  }
+  return left == 0;
+}
+
+/**************** unpackZ ****************/
+/* Expand the tokens of a ZDISPLAY into the n bytes of its text grid,
+ * plus a null, checking that every token stays within bounds.
+ */
+static bool
+unpackZ(const wire_msg_t *msg, char *out, size_t n)
+{
+  const unsigned char *p = msg->cells;
+  const unsigned char *end = p + msg->cellsLen;
+  const size_t stride = msg->ncols + 1;
+  size_t o = 0;         // bytes of out filled so far
+
+  while (p < end) {
+    unsigned long token, count, dist;
+    size_t k = wire_getVarint(p, end - p, &token);
+    if (k == 0) {
+      return false;
+    }
+    p += k;
+    count = token >> 2;
+    if (count > n - o) {
+      return false;
+    }
+    switch (token & 3) {
+    case OpLiteral:
+      if (count > end - p) {
+        return false;
+      }
+      memcpy(out + o, p, count);
+      p += count;
+      break;
+    case OpRun:
+      if (p == end) {
+        return false;
+      }
+      memset(out + o, *p++, count);
+      break;
+    case OpAbove:
+    case OpBack:
+      dist = stride;
+      if ((token & 3) == OpBack) {
+        if ((k = wire_getVarint(p, end - p, &dist)) == 0) {
+          return false;
+        }
+        p += k;
+      }
+      if (dist == 0 || dist > o) {
+        return false;
+      }
+      // byte by byte, since the source may overlap what we are writing
+      for (unsigned long i = 0; i < count; i++) {
+        out[o + i] = out[o + i - dist];
+      }
+      break;
+    }
+    o += count;
+  }
+  out[o] = '\0';
+  return o == n;
+}
+
+/* ****************************************************************** */
+/* ************************* UNIT_TEST ****************************** */
+/*
+ * Round-trip every frame type through the encoder and decoder, including
+ * a DISPLAY of the map file named on the command line (with a player and
+ * some gold dropped onto it).  Prints one line per check; exits non-zero
+ * if any check fails.
+ *
+ *   ./wiretest ../maps/main.txt
+ */
+
+#ifdef UNIT_TEST
+#include "file.h"
+
+static int failures = 0;
+
+static void
+check(const bool ok, const char *what)
+{
+  printf("%s: %s\n", ok ? "pass" : "FAIL", what);
+  if (!ok) {
+    failures++;
+  }
+}
+
+int
+main(const int argc, char *argv[])
+{
+  unsigned char buf[256];
+  wire_msg_t msg;
+
+  // varints at the edges of each byte length
+  unsigned long vals[] = { 0, 1, 127, 128, 16383, 16384, 4294967295UL };
+  bool ok = true;
+  for (int i = 0; i < sizeof(vals) / sizeof(vals[0]); i++) {
+    unsigned long v;
+    size_t n = wire_putVarint(buf, vals[i]);
+    ok = ok && n == varintBytes(vals[i])
+      && wire_getVarint(buf, n, &v) == n && v == vals[i]
+      && wire_getVarint(buf, n - 1, &v) == 0;
+  }
+  check(ok, "varint round trip");
+
+  size_t n = wire_encodeOk(buf, sizeof(buf), 'C');
+  check(wire_decode(buf, n, &msg) && msg.type == wire_OK && msg.letter == 'C',
+        "OK");
+  n = wire_encodeGrid(buf, sizeof(buf), 21, 79);
+  check(wire_decode(buf, n, &msg) && msg.type == wire_GRID
+        && msg.nrows == 21 && msg.ncols == 79, "GRID");
+  n = wire_encodeView(buf, sizeof(buf), 24, 80);
+  check(wire_decode(buf, n, &msg) && msg.type == wire_VIEW
+        && msg.nrows == 24 && msg.ncols == 80, "VIEW");
+  n = wire_encodeGold(buf, sizeof(buf), 5, 200, 45);
+  check(n == wire_HeaderBytes + 4 && wire_decode(buf, n, &msg)
+        && msg.type == wire_GOLD && msg.n == 5 && msg.p == 200 && msg.r == 45,
+        "GOLD");
+  n = wire_encodeQuit(buf, sizeof(buf), "GAME OVER");
+  check(wire_decode(buf, n, &msg) && msg.type == wire_QUIT
+        && msg.textLen == 9 && strncmp(msg.text, "GAME OVER", 9) == 0, "QUIT");
+  check(wire_encodeGold(buf, 3, 1, 2, 3) == wire_HeaderBytes + 3
+        && buf[3] == wire_QUIT, "encoder writes nothing when out of room");
+  check(!wire_decode(buf, n - 1, &msg), "truncated frame rejected");
+
+  if (argc > 1) {
+    FILE *fp = fopen(argv[1], "r");
+    char *text = fp == NULL ? NULL : freadfilep(fp);
+    if (fp != NULL) {
+      fclose(fp);
+    }
+    check(text != NULL, "read map");
+    int nrows = 0;
+    int ncols = text == NULL ? 0 : strcspn(text, "\n");
+    for (char *c = text; c != NULL && *c != '\0'; c++) {
+      nrows += *c == '\n';
+    }
+    if (text != NULL && strlen(text) != (size_t) nrows * (ncols + 1)) {
+      printf("skip: %s is not rectangular\n", argv[1]);
+    } else if (text != NULL) {
+      // drop a player, the viewer, and a gold pile onto the first room
+      char *dot = strchr(text, '.');
+      dot[0] = 'A';
+      dot[1] = '@';
+      if ((dot = strchr(dot, '.')) != NULL) {
+        *dot = '*';
+      }
+
+      size_t need = wire_encodeDisplay(NULL, 0, text, nrows, ncols);
+      unsigned char *frame = malloc(need);
+      char *back = malloc(strlen(text) + 1);
+      check(wire_encodeDisplay(frame, need, text, nrows, ncols) == need
+            && wire_decode(frame, need, &msg) && msg.type == wire_DISPLAY
+            && wire_decodeDisplay(&msg, back, strlen(text) + 1)
+            && strcmp(back, text) == 0, "DISPLAY round trip");
+      printf("DISPLAY %dx%d: %d bytes as text, %d bytes as a frame\n",
+             nrows, ncols, (int) strlen(text) + 8, (int) need);
+      free(frame);
+
+      size_t bound = wire_zDisplayBound(nrows, ncols);
+      frame = malloc(bound);
+      need = wire_encodeZDisplay(frame, bound, text, nrows, ncols);
+      memset(back, 0, strlen(text) + 1);
+      check(need <= bound && wire_decode(frame, need, &msg)
+            && msg.type == wire_ZDISPLAY
+            && wire_decodeDisplay(&msg, back, strlen(text) + 1)
+            && strcmp(back, text) == 0, "ZDISPLAY round trip");
+      check(!wire_decode(frame, need - 1, &msg)
+            && wire_encodeZDisplay(NULL, 0, text, nrows, ncols) == need,
+            "ZDISPLAY sizing");
+      printf("ZDISPLAY: %d bytes\n", (int) need);
+      free(frame);
+      free(back);
+    }
+    free(text);
+  }
+
+  return failures == 0 ? 0 : 1;
+}
+
+#endif // UNIT_TEST
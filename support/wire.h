@@ -0,0 +1,147 @@
+/*
+ * wire - codec for the compact binary Nuggets protocol
+ *
+ * A client that joins with "PLAY/BIN name" or "SPECTATE/BIN" receives
+ * every server message as a binary frame instead of text.  The codec is
+ * shared by the server, which encodes frames, and by clients, which
+ * decode them; the text protocol remains the default.
+ *
+ * Every frame starts with a fixed 8-byte header:
+ *   byte  0     0x00 - no text message starts with a null
+ *   byte  1     'B'
+ *   byte  2     protocol version (wire_Version)
+ *   byte  3     frame type (wire_type_t)
+ *   bytes 4-7   payload length, big-endian
+ * followed by the payload.  Integers in payloads are unsigned LEB128
+ * varints (7 bits per byte, low bits first).  Payloads by type:
+ *   OK       the player's letter (1 byte)
+ *   GRID     nrows, ncols
+ *   VIEW     nrows, ncols of the window each DISPLAY will show
+ *   GOLD     n, p, r
+ *   QUIT     the explanation text, not null-terminated
+ *   DISPLAY  nrows, ncols; nrows*ncols cells packed at 3 bits each,
+ *            row-major, most significant bit first; then the number of
+ *            overlay cells and, for each, the gap in cells since the
+ *            previous overlay cell (or the start) and its character.
+ *   ZDISPLAY nrows, ncols; then the text grid (each row followed by a
+ *            newline, as in a text DISPLAY) compressed as a series of
+ *            tokens; see below.
+ * DISPLAY cells use these codes:
+ *   0 ' '   1 '.'   2 '-'   3 '|'   4 '+'   5 '#'   6 '*'   7 overlay
+ * where an overlay cell (a player letter, '@', or anything else) takes its
+ * character from the overlay list.
+ *
+ * A ZDISPLAY token is a varint (count << 2 | op), where op is
+ *   0 literal  the next count bytes are copied to the output
+ *   1 run      the next byte is repeated count times
+ *   2 above    copy count bytes from one row (ncols+1 bytes) back
+ *   3 back     a varint distance follows; copy count bytes from that far
+ *              back in the output (the copy may overlap itself)
+ * so walls, corridors and unexplored space, which repeat along a row and
+ * from one row to the next, cost a byte or two per stretch.  A client
+ * asks for ZDISPLAY with "PLAY/Z name" (which implies /BIN).
+ *
+ * Nuggets: Bash Boys
+ */
+
+#ifndef __WIRE_H
+#define __WIRE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**************** constants ****************/
+static const int wire_Version = 1;
+#define wire_HeaderBytes 8
+
+/**************** global types ****************/
+typedef enum {
+  wire_OK = 1,
+  wire_GRID,
+  wire_GOLD,
+  wire_DISPLAY,
+  wire_QUIT,
+  wire_ZDISPLAY,
+  wire_VIEW,
+} wire_type_t;
+
+/* A decoded frame; see wire_decode.  Pointers refer into the frame. */
+typedef struct wire_msg {
+  wire_type_t type;
+  char letter;                  // OK
+  int nrows, ncols;             // GRID, VIEW, DISPLAY, ZDISPLAY
+  int n, p, r;                  // GOLD
+  const char *text;             // QUIT explanation (not null-terminated)
+  size_t textLen;
+  const unsigned char *cells;   // DISPLAY: packed cells, then the overlay;
+                                // ZDISPLAY: the tokens
+  size_t cellsLen;
+} wire_msg_t;
+
+/**************** functions ****************/
+
+/**************** wire_putVarint / wire_getVarint ****************/
+/* wire_putVarint writes v at buf (which must have 10 bytes of room) and
+ * returns the number of bytes written.
+ * wire_getVarint reads a varint from the len bytes at buf into *v and
+ * returns the number of bytes read, or 0 if the varint is malformed or
+ * runs past len.
+ */
+size_t wire_putVarint(unsigned char *buf, unsigned long v);
+size_t wire_getVarint(const unsigned char *buf, size_t len, unsigned long *v);
+
+/**************** wire_encode* ****************/
+/* Encode one frame into buf, which has room for cap bytes.
+ * Like snprintf, each returns the number of bytes the frame needs and
+ * writes nothing unless that many fit; thus encode(NULL, 0, ...) sizes
+ * a buffer.
+ * wire_encodeDisplay takes the grid as the text protocol would send it
+ * (after "DISPLAY\n"): nrows rows of ncols characters, each row followed
+ * by a newline.
+ */
+size_t wire_encodeOk(unsigned char *buf, size_t cap, char letter);
+size_t wire_encodeGrid(unsigned char *buf, size_t cap, int nrows, int ncols);
+size_t wire_encodeView(unsigned char *buf, size_t cap, int nrows, int ncols);
+size_t wire_encodeGold(unsigned char *buf, size_t cap, int n, int p, int r);
+size_t wire_encodeQuit(unsigned char *buf, size_t cap, const char *explanation);
+size_t wire_encodeDisplay(unsigned char *buf, size_t cap, const char *grid,
+                          int nrows, int ncols);
+
+/**************** wire_encodeZDisplay ****************/
+/* Encode the grid, as for wire_encodeDisplay, as a compressed ZDISPLAY.
+ * Compression costs a pass over the grid, so unlike the other encoders
+ * this one writes as it goes: if the return value exceeds cap, the frame
+ * did not fit and buf holds a partial frame.  A buffer of
+ * wire_zDisplayBound(nrows, ncols) bytes always suffices.
+ */
+size_t wire_encodeZDisplay(unsigned char *buf, size_t cap, const char *grid,
+                           int nrows, int ncols);
+size_t wire_zDisplayBound(int nrows, int ncols);
+
+/**************** wire_isFrame ****************/
+/* Return true if the message, as delivered by message_loop, is a binary
+ * frame rather than a text message.
+ */
+bool wire_isFrame(const char *message);
+
+/**************** wire_frameBytes ****************/
+/* Return the total length (header and payload) of the frame at buf.
+ */
+size_t wire_frameBytes(const unsigned char *buf);
+
+/**************** wire_decode ****************/
+/* Decode the frame of len bytes at buf into msg.
+ * We return false if the frame is malformed or of an unknown version.
+ */
+bool wire_decode(const unsigned char *buf, size_t len, wire_msg_t *msg);
+
+/**************** wire_decodeDisplay ****************/
+/* Rebuild the text grid of a decoded DISPLAY or ZDISPLAY frame into out, with a
+ * newline after each row and a terminating null; out must hold
+ * nrows*(ncols+1)+1 characters.  We return false if the frame's cells
+ * are malformed or cap is too small.
+ */
+bool wire_decodeDisplay(const wire_msg_t *msg, char *out, size_t cap);
+
+#endif // __WIRE_H
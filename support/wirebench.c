@@ -0,0 +1,195 @@
+/*
+ * wirebench.c - measure the DISPLAY encodings of the wire module
+ *
+ * For each map file named on the command line we build the grid a
+ * spectator would see (the whole map, with a few players dropped into
+ * it) and encode it repeatedly as a binary DISPLAY and as a compressed
+ * ZDISPLAY.  We report the size of each against the text DISPLAY, and the
+ * CPU time per frame spent encoding, so the bytes saved can be weighed
+ * against the cost.  Maps whose rows differ in length are padded with
+ * spaces, as the server's grid would be.
+ *
+ * usage: ./wirebench map.txt...
+ *   typically given every map in ../maps and ../maps/contrib
+ *
+ * Nuggets: Bash Boys
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "file.h"
+#include "wire.h"
+
+/**************** file-local constants ****************/
+static const double MinSeconds = 0.05;  // time each encoder at least this long
+
+/**************** file-local functions ****************/
+static char *loadGrid(const char *fname, int *nrows, int *ncols);
+static double timeEncoder(bool compress, unsigned char *frame, size_t cap,
+                          const char *grid, int nrows, int ncols);
+static double cpuNow(void);
+
+/**************** main ****************/
+int
+main(const int argc, char *argv[])
+{
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s map.txt...\n", argv[0]);
+    return 1;
+  }
+
+  printf("%-36s %7s %7s %6s %7s %6s %9s %9s\n", "map", "size", "text",
+         "bin", "bin us", "z", "z us", "z saved");
+  size_t totalText = 0, totalBin = 0, totalZ = 0;
+  double totalBinUs = 0, totalZUs = 0;
+  int nmaps = 0;
+  for (int i = 1; i < argc; i++) {
+    int nrows, ncols;
+    char *grid = loadGrid(argv[i], &nrows, &ncols);
+    if (grid == NULL) {
+      fprintf(stderr, "%s: cannot read map\n", argv[i]);
+      continue;
+    }
+
+    size_t text = strlen("DISPLAY\n") + strlen(grid);
+    size_t cap = wire_zDisplayBound(nrows, ncols);
+    unsigned char *frame = malloc(cap);
+    char *back = malloc(strlen(grid) + 1);
+    size_t bin = wire_encodeDisplay(NULL, 0, grid, nrows, ncols);
+    size_t z = wire_encodeZDisplay(frame, cap, grid, nrows, ncols);
+
+    // make sure what we time decodes to what we started with
+    wire_msg_t msg;
+    if (!wire_decode(frame, z, &msg)
+        || !wire_decodeDisplay(&msg, back, strlen(grid) + 1)
+        || strcmp(back, grid) != 0) {
+      fprintf(stderr, "%s: ZDISPLAY does not round-trip\n", argv[i]);
+      return 2;
+    }
+
+    double binUs = timeEncoder(false, frame, cap, grid, nrows, ncols);
+    double zUs = timeEncoder(true, frame, cap, grid, nrows, ncols);
+    const char *name = strrchr(argv[i], '/') ? strrchr(argv[i], '/') + 1 : argv[i];
+    char size[16];
+    snprintf(size, sizeof(size), "%dx%d", nrows, ncols);
+    printf("%-36.36s %7s %7d %6d %7.2f %6d %9.2f %8.1f%%\n", name, size,
+           (int) text, (int) bin, binUs, (int) z, zUs,
+           100.0 * ((double) text - z) / text);
+
+    totalText += text;
+    totalBin += bin;
+    totalZ += z;
+    totalBinUs += binUs;
+    totalZUs += zUs;
+    nmaps++;
+    free(frame);
+    free(back);
+    free(grid);
+  }
+
+  if (nmaps > 0) {
+    printf("%-36s %7s %7d %6d %7.2f %6d %9.2f %8.1f%%\n", "total (us: mean)",
+           "", (int) totalText, (int) totalBin, totalBinUs / nmaps,
+           (int) totalZ, totalZUs / nmaps,
+           100.0 * ((double) totalText - totalZ) / totalText);
+  }
+  return 0;
+}
+
+/**************** loadGrid ****************/
+/* Read a map into a rectangular text grid, each row followed by a
+ * newline, with a player in each of the first few rooms' dots.
+ * Returns NULL if the file cannot be read or is empty.
+ */
+static char *
+loadGrid(const char *fname, int *nrows, int *ncols)
+{
+  FILE *fp = fopen(fname, "r");
+  if (fp == NULL) {
+    return NULL;
+  }
+  char *text = freadfilep(fp);
+  fclose(fp);
+  if (text == NULL) {
+    return NULL;
+  }
+
+  // measure the widest row
+  *nrows = 0;
+  *ncols = 0;
+  for (char *line = text; *line != '\0'; ) {
+    int len = strcspn(line, "\n");
+    *ncols = len > *ncols ? len : *ncols;
+    (*nrows)++;
+    line += len + (line[len] == '\n');
+  }
+  if (*nrows == 0) {
+    free(text);
+    return NULL;
+  }
+
+  // copy rows, padding short ones
+  char *grid = malloc((size_t) *nrows * (*ncols + 1) + 1);
+  char *g = grid;
+  for (char *line = text; *line != '\0'; ) {
+    int len = strcspn(line, "\n");
+    memcpy(g, line, len);
+    memset(g + len, ' ', *ncols - len);
+    g += *ncols;
+    *g++ = '\n';
+    line += len + (line[len] == '\n');
+  }
+  *g = '\0';
+  free(text);
+
+  // drop in a handful of players, spread through the map
+  int ndots = 0;
+  for (g = grid; *g != '\0'; g++) {
+    ndots += *g == '.';
+  }
+  int dot = 0;
+  char letter = 'A';
+  for (g = grid; *g != '\0' && letter <= 'E'; g++) {
+    if (*g == '.' && dot++ == (letter - 'A' + 1) * ndots / 6) {
+      *g = letter++;
+    }
+  }
+  return grid;
+}
+
+/**************** timeEncoder ****************/
+/* Return the CPU microseconds per frame for one of the DISPLAY encoders.
+ */
+static double
+timeEncoder(bool compress, unsigned char *frame, size_t cap,
+            const char *grid, int nrows, int ncols)
+{
+  long frames = 0;
+  double start = cpuNow();
+  double elapsed;
+  do {
+    for (int i = 0; i < 100; i++) {
+      if (compress) {
+        wire_encodeZDisplay(frame, cap, grid, nrows, ncols);
+      } else {
+        wire_encodeDisplay(frame, cap, grid, nrows, ncols);
+      }
+    }
+    frames += 100;
+    elapsed = cpuNow() - start;
+  } while (elapsed < MinSeconds);
+  return elapsed * 1e6 / frames;
+}
+
+/**************** cpuNow ****************/
+static double
+cpuNow(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}